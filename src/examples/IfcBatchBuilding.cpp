@@ -0,0 +1,191 @@
+﻿/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+// Generates a synthetic building of a configurable size twice: once by means of the
+// generated constructors and IfcFile::addEntity() and once by means of the
+// IfcEntityBatch, and reports the time spent in both cases.
+
+#include <ctime>
+#include <string>
+#include <iostream>
+
+#include <boost/lexical_cast.hpp>
+
+#include "../ifcparse/IfcHierarchyHelper.h"
+#include "../ifcparse/IfcEntityBatch.h"
+
+#if USE_VLD
+#include <vld.h>
+#endif
+
+typedef IfcParse::IfcGlobalId guid;
+boost::none_t const null = boost::none;
+
+// The parts of the model shared by all walls
+struct Context {
+	IfcSchema::IfcOwnerHistory* owner_history;
+	IfcSchema::IfcRepresentationContext* context;
+	IfcSchema::IfcProfileDef* profile;
+	IfcSchema::IfcDirection* direction;
+	std::vector<IfcSchema::IfcBuildingStorey*> storeys;
+};
+
+void setup(IfcHierarchyHelper& file, int num_storeys, Context& ctx) {
+	IfcSchema::IfcBuilding* building = file.addBuilding();
+	ctx.owner_history = file.getSingle<IfcSchema::IfcOwnerHistory>();
+	ctx.context = file.getRepresentationContext("Model");
+	ctx.profile = new IfcSchema::IfcRectangleProfileDef(IfcSchema::IfcProfileTypeEnum::IfcProfileType_AREA, null, file.addPlacement2d(), 5000., 200.);
+	file.addEntity(ctx.profile);
+	ctx.direction = file.addTriplet<IfcSchema::IfcDirection>(0., 0., 1.);
+	for (int i = 0; i < num_storeys; ++i) {
+		ctx.storeys.push_back(file.addBuildingStorey(building));
+	}
+}
+
+void generate_using_constructors(IfcHierarchyHelper& file, const Context& ctx, int num_walls) {
+	for (std::vector<IfcSchema::IfcBuildingStorey*>::const_iterator it = ctx.storeys.begin(); it != ctx.storeys.end(); ++it) {
+		IfcSchema::IfcProduct::list::ptr walls(new IfcSchema::IfcProduct::list);
+		for (int i = 0; i < num_walls; ++i) {
+			std::vector<double> coords(3, 0.);
+			coords[0] = (i % 100) * 6000.;
+			coords[1] = (i / 100) * 6000.;
+			IfcSchema::IfcCartesianPoint* point = new IfcSchema::IfcCartesianPoint(coords);
+			IfcSchema::IfcAxis2Placement3D* axis = new IfcSchema::IfcAxis2Placement3D(point, 0, 0);
+			IfcSchema::IfcLocalPlacement* placement = new IfcSchema::IfcLocalPlacement((*it)->ObjectPlacement(), axis);
+			IfcSchema::IfcCartesianPoint* solid_origin = new IfcSchema::IfcCartesianPoint(std::vector<double>(3, 0.));
+			IfcSchema::IfcAxis2Placement3D* solid_axis = new IfcSchema::IfcAxis2Placement3D(solid_origin, 0, 0);
+			IfcSchema::IfcExtrudedAreaSolid* solid = new IfcSchema::IfcExtrudedAreaSolid(ctx.profile, solid_axis, ctx.direction, 3000.);
+			IfcSchema::IfcRepresentationItem::list::ptr items(new IfcSchema::IfcRepresentationItem::list);
+			items->push(solid);
+			IfcSchema::IfcShapeRepresentation* rep = new IfcSchema::IfcShapeRepresentation(ctx.context, std::string("Body"), std::string("SweptSolid"), items);
+			IfcSchema::IfcRepresentation::list::ptr reps(new IfcSchema::IfcRepresentation::list);
+			reps->push(rep);
+			IfcSchema::IfcProductDefinitionShape* shape = new IfcSchema::IfcProductDefinitionShape(null, null, reps);
+			IfcSchema::IfcWallStandardCase* wall = new IfcSchema::IfcWallStandardCase(guid(), ctx.owner_history,
+				std::string("Wall"), null, null, placement, shape, null
+#ifdef USE_IFC4
+				, IfcSchema::IfcWallTypeEnum::IfcWallType_STANDARD
+#endif
+			);
+			file.addEntity(wall);
+			walls->push(wall);
+		}
+		file.addEntity(new IfcSchema::IfcRelContainedInSpatialStructure(guid(), ctx.owner_history, null, null, walls, *it));
+	}
+}
+
+void generate_using_batch(IfcHierarchyHelper& file, const Context& ctx, int num_walls) {
+	IfcParse::IfcEntityBatch batch(file);
+	for (std::vector<IfcSchema::IfcBuildingStorey*>::const_iterator it = ctx.storeys.begin(); it != ctx.storeys.end(); ++it) {
+		IfcEntityList::ptr walls(new IfcEntityList);
+		for (int i = 0; i < num_walls; ++i) {
+			std::vector<double> coords(3, 0.);
+			coords[0] = (i % 100) * 6000.;
+			coords[1] = (i / 100) * 6000.;
+			IfcSchema::IfcCartesianPoint* point = batch.create<IfcSchema::IfcCartesianPoint>();
+			batch.move(point, 0, coords);
+
+			IfcSchema::IfcAxis2Placement3D* axis = batch.create<IfcSchema::IfcAxis2Placement3D>();
+			batch.set(axis, 0, point);
+
+			IfcSchema::IfcLocalPlacement* placement = batch.create<IfcSchema::IfcLocalPlacement>();
+			batch.set(placement, 0, (*it)->ObjectPlacement());
+			batch.set(placement, 1, axis);
+
+			std::vector<double> origin(3, 0.);
+			IfcSchema::IfcCartesianPoint* solid_origin = batch.create<IfcSchema::IfcCartesianPoint>();
+			batch.move(solid_origin, 0, origin);
+			IfcSchema::IfcAxis2Placement3D* solid_axis = batch.create<IfcSchema::IfcAxis2Placement3D>();
+			batch.set(solid_axis, 0, solid_origin);
+
+			IfcSchema::IfcExtrudedAreaSolid* solid = batch.create<IfcSchema::IfcExtrudedAreaSolid>();
+			batch.set(solid, 0, ctx.profile);
+			batch.set(solid, 1, solid_axis);
+			batch.set(solid, 2, ctx.direction);
+			batch.set(solid, 3, 3000.);
+
+			IfcEntityList::ptr items(new IfcEntityList);
+			items->push(solid);
+			IfcSchema::IfcShapeRepresentation* rep = batch.create<IfcSchema::IfcShapeRepresentation>();
+			batch.set(rep, 0, ctx.context);
+			batch.set(rep, 1, std::string("Body"));
+			batch.set(rep, 2, std::string("SweptSolid"));
+			batch.move(rep, 3, items);
+
+			IfcEntityList::ptr reps(new IfcEntityList);
+			reps->push(rep);
+			IfcSchema::IfcProductDefinitionShape* shape = batch.create<IfcSchema::IfcProductDefinitionShape>();
+			batch.move(shape, 2, reps);
+
+			std::string global_id = guid();
+			IfcSchema::IfcWallStandardCase* wall = batch.create<IfcSchema::IfcWallStandardCase>();
+			batch.move(wall, 0, global_id);
+			batch.set(wall, 1, ctx.owner_history);
+			batch.set(wall, 2, std::string("Wall"));
+			batch.set(wall, 5, placement);
+			batch.set(wall, 6, shape);
+#ifdef USE_IFC4
+			batch.set(wall, 8, IfcWrite::IfcWriteArgument::EnumerationReference(IfcSchema::IfcWallTypeEnum::IfcWallType_STANDARD,
+				IfcSchema::IfcWallTypeEnum::ToString(IfcSchema::IfcWallTypeEnum::IfcWallType_STANDARD)));
+#endif
+			walls->push(wall);
+		}
+		std::string global_id = guid();
+		IfcSchema::IfcRelContainedInSpatialStructure* rel = batch.create<IfcSchema::IfcRelContainedInSpatialStructure>();
+		batch.move(rel, 0, global_id);
+		batch.set(rel, 1, ctx.owner_history);
+		batch.move(rel, 4, walls);
+		batch.set(rel, 5, *it);
+	}
+	batch.commit();
+}
+
+int main(int argc, char** argv) {
+	if (argc > 3) {
+		std::cout << "usage: IfcBatchBuilding [<num_storeys> [<num_walls_per_storey>]]" << std::endl;
+		return 1;
+	}
+
+	const int num_storeys = argc > 1 ? boost::lexical_cast<int>(argv[1]) : 10;
+	const int num_walls = argc > 2 ? boost::lexical_cast<int>(argv[2]) : 10000;
+
+	for (int pass = 0; pass < 2; ++pass) {
+		IfcHierarchyHelper file;
+		Context ctx;
+		setup(file, num_storeys, ctx);
+
+		const size_t num_instances_before = std::distance(file.begin(), file.end());
+		const std::clock_t start = std::clock();
+
+		if (pass == 0) {
+			generate_using_constructors(file, ctx, num_walls);
+		} else {
+			generate_using_batch(file, ctx, num_walls);
+		}
+
+		const double seconds = (std::clock() - start) / (double) CLOCKS_PER_SEC;
+		const size_t num_instances = std::distance(file.begin(), file.end()) - num_instances_before;
+
+		std::cout << (pass == 0 ? "Constructors + addEntity(): " : "IfcEntityBatch:             ")
+			<< num_instances << " instances in " << seconds << "s ("
+			<< (seconds > 0. ? (num_instances / seconds) : 0.) << " instances/s)" << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,138 @@
+﻿/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+// Generates a model of faceted breps in memory and reports the time spent to
+// determine the shape type of its brep, shell, face, bound and loop instances,
+// once by means of the dispatch table of the kernel and once by means of the
+// chains of is() calls the register macros expanded into before.
+
+#include <ctime>
+#include <string>
+#include <iostream>
+
+#include <boost/lexical_cast.hpp>
+
+#include "../ifcparse/IfcFile.h"
+#include "../ifcgeom/IfcGeom.h"
+
+#if USE_VLD
+#include <vld.h>
+#endif
+
+using namespace IfcSchema;
+
+// The former implementation of Kernel::shape_type()
+IfcGeom::ShapeType shape_type_by_is(const IfcUtil::IfcBaseClass* l) {
+#include "../ifcgeom/IfcRegisterUndef.h"
+#define SHAPES(T) if ( l->is(T::Class()) ) return IfcGeom::ST_SHAPELIST;
+#define SHAPE(T) if ( l->is(T::Class()) ) return IfcGeom::ST_SHAPE;
+#define WIRE(T) if ( l->is(T::Class()) ) return IfcGeom::ST_WIRE;
+#define FACE(T) if ( l->is(T::Class()) ) return IfcGeom::ST_FACE;
+#define CURVE(T) if ( l->is(T::Class()) ) return IfcGeom::ST_CURVE;
+#include "../ifcgeom/IfcRegisterDef.h"
+#include "../ifcgeom/IfcRegister.h"
+#include "../ifcgeom/IfcRegisterUndef.h"
+	return IfcGeom::ST_OTHER;
+}
+
+// Adds a unit cube at the given offset, returns the instances that are dispatched on conversion
+void add_cube(IfcParse::IfcFile& file, double x, std::vector<IfcUtil::IfcBaseClass*>& items) {
+	static const int faces[6][4] = {{0,3,2,1}, {4,5,6,7}, {0,1,5,4}, {1,2,6,5}, {2,3,7,6}, {3,0,4,7}};
+	IfcCartesianPoint* points[8];
+	for (int i = 0; i < 8; ++i) {
+		std::vector<double> coords(3);
+		coords[0] = x + ((i == 1 || i == 2 || i == 5 || i == 6) ? 1. : 0.);
+		coords[1] = (i % 4) >= 2 ? 1. : 0.;
+		coords[2] = i >= 4 ? 1. : 0.;
+		points[i] = new IfcCartesianPoint(coords);
+		file.addEntity(points[i]);
+	}
+	IfcFace::list::ptr cube_faces(new IfcFace::list);
+	for (int i = 0; i < 6; ++i) {
+		IfcCartesianPoint::list::ptr polygon(new IfcCartesianPoint::list);
+		for (int j = 0; j < 4; ++j) {
+			polygon->push(points[faces[i][j]]);
+		}
+		IfcPolyLoop* loop = new IfcPolyLoop(polygon);
+		IfcFaceBound::list::ptr bounds(new IfcFaceBound::list);
+		IfcFaceOuterBound* bound = new IfcFaceOuterBound(loop, true);
+		bounds->push(bound);
+		IfcFace* face = new IfcFace(bounds);
+		file.addEntity(loop);
+		file.addEntity(bound);
+		file.addEntity(face);
+		cube_faces->push(face);
+		items.push_back(face);
+		items.push_back(bound);
+		items.push_back(loop);
+	}
+	IfcClosedShell* shell = new IfcClosedShell(cube_faces);
+	IfcFacetedBrep* brep = new IfcFacetedBrep(shell);
+	file.addEntity(shell);
+	file.addEntity(brep);
+	items.push_back(shell);
+	items.push_back(brep);
+}
+
+int main(int argc, char** argv) {
+	if (argc > 3) {
+		std::cout << "usage: IfcDispatchBenchmark [<num_breps> [<num_repetitions>]]" << std::endl;
+		return 1;
+	}
+
+	const int num_breps = argc > 1 ? boost::lexical_cast<int>(argv[1]) : 20000;
+	const int num_repetitions = argc > 2 ? boost::lexical_cast<int>(argv[2]) : 20;
+
+	IfcParse::IfcFile file;
+	std::vector<IfcUtil::IfcBaseClass*> items;
+	for (int i = 0; i < num_breps; ++i) {
+		add_cube(file, i * 2., items);
+	}
+
+	IfcGeom::Kernel kernel;
+	size_t checksum[2] = {0, 0};
+	size_t mismatches = 0;
+
+	for (int pass = 0; pass < 2; ++pass) {
+		const std::clock_t start = std::clock();
+
+		for (int i = 0; i < num_repetitions; ++i) {
+			for (std::vector<IfcUtil::IfcBaseClass*>::const_iterator it = items.begin(); it != items.end(); ++it) {
+				checksum[pass] += pass == 0 ? shape_type_by_is(*it) : kernel.shape_type(*it);
+			}
+		}
+
+		const double seconds = (std::clock() - start) / (double) CLOCKS_PER_SEC;
+		const size_t num_lookups = items.size() * num_repetitions;
+
+		std::cout << (pass == 0 ? "is() chains:    " : "Dispatch table: ")
+			<< num_lookups << " lookups in " << seconds << "s ("
+			<< (seconds > 0. ? (num_lookups / seconds) : 0.) << " lookups/s)" << std::endl;
+	}
+
+	for (std::vector<IfcUtil::IfcBaseClass*>::const_iterator it = items.begin(); it != items.end(); ++it) {
+		if (shape_type_by_is(*it) != kernel.shape_type(*it)) {
+			++mismatches;
+		}
+	}
+
+	std::cout << mismatches << " instances with a different shape type" << std::endl;
+
+	return mismatches == 0 && checksum[0] == checksum[1] ? 0 : 1;
+}
@@ -0,0 +1,439 @@
+﻿/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+// Converts the elements of a file and reports the wall time and the peak
+// memory use of the process. The options select how intermediate results are
+// cached. An unbounded cache purged every 64 elements approximates the former
+// policy of the iterator, which purged its cache every 64 representations.
+// The area, volume and bounds of the mesh of every element can be written to
+// a file, so that the output of two runs with different settings can be compared.
+// Optionally the triangulation of every element is timed separately. Models
+// with a single element with many openings can be generated to time the
+// subtraction of openings.
+
+#include <map>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "../ifcparse/IfcFile.h"
+#include "../ifcparse/IfcHierarchyHelper.h"
+#include "../ifcgeom/IfcGeomIterator.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <sys/resource.h>
+#endif
+
+#if USE_VLD
+#include <vld.h>
+#endif
+
+typedef IfcParse::IfcGlobalId guid;
+boost::none_t const null = boost::none;
+
+// Returns the peak resident set size of the process in MiB
+double peak_memory() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0.;
+	}
+	return counters.PeakWorkingSetSize / 1048576.;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1048576.;
+#else
+	return usage.ru_maxrss / 1024.;
+#endif
+#endif
+}
+
+// Writes the surface area, the enclosed volume and the bounds of the mesh of an element
+void write_digest(std::ostream& os, const std::string& id, const IfcGeom::Representation::Triangulation<double>& triangulation) {
+	const std::vector<double>& verts = triangulation.verts();
+	const std::vector<int>& faces = triangulation.faces();
+
+	double bounds[6];
+	std::fill(bounds, bounds + 3, +std::numeric_limits<double>::infinity());
+	std::fill(bounds + 3, bounds + 6, -std::numeric_limits<double>::infinity());
+	for (size_t i = 0; i + 2 < verts.size(); i += 3) {
+		for (size_t j = 0; j < 3; ++j) {
+			bounds[j] = (std::min)(bounds[j], verts[i + j]);
+			bounds[j + 3] = (std::max)(bounds[j + 3], verts[i + j]);
+		}
+	}
+
+	double area = 0., volume = 0.;
+	for (size_t i = 0; i + 2 < faces.size(); i += 3) {
+		const gp_XYZ a(verts[3 * faces[i + 0]], verts[3 * faces[i + 0] + 1], verts[3 * faces[i + 0] + 2]);
+		const gp_XYZ b(verts[3 * faces[i + 1]], verts[3 * faces[i + 1] + 1], verts[3 * faces[i + 1] + 2]);
+		const gp_XYZ c(verts[3 * faces[i + 2]], verts[3 * faces[i + 2] + 1], verts[3 * faces[i + 2] + 2]);
+		area += (b - a).Crossed(c - a).Modulus() / 2.;
+		volume += a.Dot(b.Crossed(c)) / 6.;
+	}
+
+	os << id << " " << area << " " << volume;
+	for (int i = 0; i < 6; ++i) {
+		os << " " << (faces.empty() ? 0. : bounds[i]);
+	}
+	os << "\n";
+}
+
+typedef std::map< std::string, std::vector<double> > digest_t;
+
+bool read_digest(const std::string& filename, digest_t& digest) {
+	std::ifstream is(filename.c_str());
+	std::string id;
+	while (is >> id) {
+		std::vector<double>& values = digest[id];
+		values.resize(8);
+		for (int i = 0; i < 8; ++i) {
+			is >> values[i];
+		}
+	}
+	return is.eof();
+}
+
+// Reports the largest differences between the elements in two digests. Areas
+// and volumes are compared relative to the first digest, bounds relative to
+// the size of the element.
+int compare_digests(const std::string& filename1, const std::string& filename2) {
+	digest_t digest1, digest2;
+	if (!read_digest(filename1, digest1) || !read_digest(filename2, digest2)) {
+		std::cout << "Unable to read digests" << std::endl;
+		return 1;
+	}
+
+	const double tolerance = 1.e-3;
+	const char* const names[3] = {"area", "volume", "bounds"};
+	double max_difference[3] = {0., 0., 0.};
+	std::string max_difference_id[3];
+	size_t num_compared = 0, num_missing = 0, num_different = 0;
+
+	for (digest_t::const_iterator it = digest1.begin(); it != digest1.end(); ++it) {
+		digest_t::const_iterator jt = digest2.find(it->first);
+		if (jt == digest2.end()) {
+			++num_missing;
+			continue;
+		}
+		++num_compared;
+		const std::vector<double>& a = it->second;
+		const std::vector<double>& b = jt->second;
+
+		double size = 0.;
+		for (int i = 0; i < 3; ++i) {
+			size = (std::max)(size, a[i + 5] - a[i + 2]);
+		}
+
+		double difference[3];
+		difference[0] = std::fabs(a[0] - b[0]) / (std::max)(std::fabs(a[0]), 1.e-9);
+		difference[1] = std::fabs(a[1] - b[1]) / (std::max)(std::fabs(a[1]), 1.e-9);
+		difference[2] = 0.;
+		for (int i = 2; i < 8; ++i) {
+			difference[2] = (std::max)(difference[2], std::fabs(a[i] - b[i]) / (std::max)(size, 1.e-9));
+		}
+
+		bool different = false;
+		for (int i = 0; i < 3; ++i) {
+			if (difference[i] > max_difference[i]) {
+				max_difference[i] = difference[i];
+				max_difference_id[i] = it->first;
+			}
+			different = different || difference[i] > tolerance;
+		}
+		if (different) {
+			++num_different;
+		}
+	}
+	num_missing += digest2.size() - num_compared;
+
+	std::cout << num_compared << " elements compared, " << num_missing << " not in both digests, "
+		<< num_different << " differ by more than " << tolerance << std::endl;
+	for (int i = 0; i < 3; ++i) {
+		std::cout << "Largest relative difference in " << names[i] << ": " << max_difference[i];
+		if (!max_difference_id[i].empty()) {
+			std::cout << " (" << max_difference_id[i] << ")";
+		}
+		std::cout << std::endl;
+	}
+
+	return 0;
+}
+
+struct triangulation_time {
+	std::string id;
+	// Including the meshing of the shapes respectively with the shapes meshed already
+	double seconds, seconds_meshed;
+	bool operator<(const triangulation_time& other) const { return seconds < other.seconds; }
+};
+
+double seconds_since(const boost::posix_time::ptime& start) {
+	return (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1.e6;
+}
+
+// Triangulates the shapes of the element twice, as a shape that is meshed
+// already is not meshed again, and returns the time spent
+triangulation_time time_triangulation(const IfcGeom::BRepElement<double>& element, std::ostream* digest) {
+	triangulation_time t;
+	t.id = element.unique_id();
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+	{
+		IfcGeom::Representation::Triangulation<double> triangulation(element.geometry());
+		t.seconds = seconds_since(start);
+		if (digest) {
+			write_digest(*digest, t.id, triangulation);
+		}
+	}
+	start = boost::posix_time::microsec_clock::universal_time();
+	{
+		IfcGeom::Representation::Triangulation<double> triangulation(element.geometry());
+		t.seconds_meshed = seconds_since(start);
+	}
+	return t;
+}
+
+void report_triangulation_times(std::vector<triangulation_time>& times) {
+	if (times.empty()) {
+		return;
+	}
+	double total = 0., total_meshed = 0.;
+	for (std::vector<triangulation_time>::const_iterator it = times.begin(); it != times.end(); ++it) {
+		total += it->seconds;
+		total_meshed += it->seconds_meshed;
+	}
+	std::sort(times.begin(), times.end());
+	std::cout << "Triangulation: " << total << "s in total, " << total_meshed << "s with the shapes meshed already" << std::endl
+		<< "Per element: mean " << total / times.size() * 1.e3 << "ms, median " << times[times.size() / 2].seconds * 1.e3
+		<< "ms, 99th percentile " << times[times.size() * 99 / 100].seconds * 1.e3 << "ms" << std::endl
+		<< "Slowest elements:" << std::endl;
+	for (size_t i = 0; i < 10 && i < times.size(); ++i) {
+		const triangulation_time& t = times[times.size() - i - 1];
+		std::cout << "  " << t.id << " " << t.seconds * 1.e3 << "ms, " << t.seconds_meshed * 1.e3 << "ms meshed" << std::endl;
+	}
+}
+
+void add_opening(IfcHierarchyHelper& file, IfcSchema::IfcElement* element, double x, double z, double w, double d, double h) {
+	IfcSchema::IfcOpeningElement* opening = new IfcSchema::IfcOpeningElement(guid(), file.getSingle<IfcSchema::IfcOwnerHistory>(),
+		null, null, null, file.addLocalPlacement(element->ObjectPlacement(), x, 0, z), file.addBox(w, d, h), null
+#ifdef USE_IFC4
+		, IfcSchema::IfcOpeningElementTypeEnum::IfcOpeningElementType_OPENING
+#endif
+	);
+	file.addEntity(opening);
+	file.addEntity(new IfcSchema::IfcRelVoidsElement(guid(), file.getSingle<IfcSchema::IfcOwnerHistory>(), null, null, element, opening));
+}
+
+// Writes a model with a single element with the amount of openings specified. A
+// perforated wall has a single body with ten rows of openings. A curtain wall has
+// a body of one panel per four openings, so that every opening cuts one item only.
+int generate(const std::string& kind, int num_openings, const std::string& filename) {
+	const bool curtain_wall = kind == "curtain-wall";
+	if (!curtain_wall && kind != "perforated") {
+		std::cout << "Unknown kind of model: " << kind << std::endl;
+		return 1;
+	}
+
+	IfcHierarchyHelper file;
+	file.header().file_name().name(filename);
+
+	IfcSchema::IfcElement* element;
+	if (curtain_wall) {
+		element = new IfcSchema::IfcCurtainWall(guid(), 0, std::string("Curtain wall"), null, null, 0, 0, null
+#ifdef USE_IFC4
+			, IfcSchema::IfcCurtainWallTypeEnum::IfcCurtainWallType_NOTDEFINED
+#endif
+		);
+	} else {
+		element = new IfcSchema::IfcWall(guid(), 0, std::string("Perforated wall"), null, null, 0, 0, null
+#ifdef USE_IFC4
+			, IfcSchema::IfcWallTypeEnum::IfcWallType_NOTDEFINED
+#endif
+		);
+	}
+	file.addBuildingProduct(element);
+	element->setOwnerHistory(file.getSingle<IfcSchema::IfcOwnerHistory>());
+	element->setObjectPlacement(file.addLocalPlacement(file.getSingle<IfcSchema::IfcBuildingStorey>()->ObjectPlacement()));
+
+	if (curtain_wall) {
+		// Panels of 1000 x 3000 with a gap of 20, with two rows of two openings of 300 x 300
+		const int num_panels = (num_openings + 3) / 4;
+		IfcSchema::IfcShapeRepresentation* body = file.addEmptyRepresentation();
+		for (int i = 0; i < num_panels; ++i) {
+			file.addBox(body, 1000., 50., 3000., 0, file.addPlacement3d(i * 1020. + 500., 0., 0.));
+		}
+		IfcSchema::IfcRepresentation::list::ptr representations(new IfcSchema::IfcRepresentation::list);
+		representations->push(body);
+		IfcSchema::IfcProductDefinitionShape* shape = new IfcSchema::IfcProductDefinitionShape(null, null, representations);
+		file.addEntity(shape);
+		element->setRepresentation(shape);
+		for (int i = 0; i < num_openings; ++i) {
+			add_opening(file, element, (i / 4) * 1020. + ((i % 2) ? 750. : 250.), (i % 4) < 2 ? 700. : 2000., 300., 200., 300.);
+		}
+	} else {
+		// Openings of 200 x 200 at a distance of 400 in a wall of 200 thick
+		const int num_rows = (std::min)(num_openings, 10);
+		const int num_columns = (num_openings + num_rows - 1) / num_rows;
+		const double length = num_columns * 400. + 200.;
+		element->setRepresentation(file.addBox(length, 200., num_rows * 400. + 200., 0, file.addPlacement3d(length / 2., 0., 0.)));
+		for (int i = 0; i < num_openings; ++i) {
+			add_opening(file, element, (i / num_rows) * 400. + 300., (i % num_rows) * 400. + 200., 200., 400., 200.);
+		}
+	}
+
+	std::ofstream os(filename.c_str());
+	os << file;
+	return os.good() ? 0 : 1;
+}
+
+void usage() {
+	std::cout << "usage: IfcGeomBenchmark [options] <filename.ifc>" << std::endl
+		<< "  --threads <n>          number of threads used to create geometry, 1 by default" << std::endl
+		<< "  --cache-budget <MiB>   cache budget, 0 disables caching, -1 for an unbounded cache" << std::endl
+		<< "  --purge-interval <n>   purges the cache every n elements, requires a single thread" << std::endl
+		<< "  --no-passthrough       triangulates all items by means of shapes, see NO_MESH_PASSTHROUGH" << std::endl
+		<< "  --digest <file>        writes the area, volume and bounds of every element to file" << std::endl
+		<< "  --triangulation-times  triangulates the elements separately from their conversion and" << std::endl
+		<< "                         reports the time spent per element" << std::endl
+		<< "  --boolean-threads <n>  number of threads used to subtract the openings of an element" << std::endl
+		<< "  --parallel-booleans    enables the parallel mode of Open Cascade boolean operations" << std::endl
+		<< "  --boolean-fuzziness <d> fuzzy value of boolean operations" << std::endl
+		<< "usage: IfcGeomBenchmark --compare <digest1> <digest2>" << std::endl
+		<< "usage: IfcGeomBenchmark --generate <perforated|curtain-wall> <num_openings> <filename.ifc>" << std::endl;
+}
+
+int main(int argc, char** argv) {
+	IfcGeom::IteratorSettings settings;
+	settings.set(IfcGeom::IteratorSettings::USE_WORLD_COORDS, true);
+	int purge_interval = 0;
+	bool triangulation_times = false;
+	std::string filename, digest_filename;
+
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		if (arg == "--threads" && has_value) {
+			settings.set_num_threads(boost::lexical_cast<int>(argv[++i]));
+		} else if (arg == "--cache-budget" && has_value) {
+			const int budget = boost::lexical_cast<int>(argv[++i]);
+			if (budget < 0) {
+				settings.set_cache_policy(IfcGeom::IteratorSettings::CACHE_UNBOUNDED);
+			} else if (budget == 0) {
+				settings.set_cache_policy(IfcGeom::IteratorSettings::CACHE_OFF);
+			} else {
+				settings.set_cache_policy(IfcGeom::IteratorSettings::CACHE_BOUNDED);
+				settings.set_cache_budget(static_cast<std::size_t>(budget) * 1024 * 1024);
+			}
+		} else if (arg == "--purge-interval" && has_value) {
+			purge_interval = boost::lexical_cast<int>(argv[++i]);
+		} else if (arg == "--no-passthrough") {
+			settings.set(IfcGeom::IteratorSettings::NO_MESH_PASSTHROUGH, true);
+		} else if (arg == "--triangulation-times") {
+			triangulation_times = true;
+			settings.set(IfcGeom::IteratorSettings::DISABLE_TRIANGULATION, true);
+		} else if (arg == "--boolean-threads" && has_value) {
+			settings.set_boolean_threads(boost::lexical_cast<int>(argv[++i]));
+		} else if (arg == "--parallel-booleans") {
+			settings.set(IfcGeom::IteratorSettings::PARALLEL_BOOLEANS, true);
+		} else if (arg == "--boolean-fuzziness" && has_value) {
+			settings.set_boolean_fuzziness(boost::lexical_cast<double>(argv[++i]));
+		} else if (arg == "--digest" && has_value) {
+			digest_filename = argv[++i];
+		} else if (arg == "--compare" && argc == 4 && i == 1) {
+			return compare_digests(argv[2], argv[3]);
+		} else if (arg == "--generate" && argc == 5 && i == 1) {
+			return generate(argv[2], boost::lexical_cast<int>(argv[3]), argv[4]);
+		} else if (filename.empty() && arg.substr(0, 2) != "--") {
+			filename = arg;
+		} else {
+			usage();
+			return 1;
+		}
+	}
+
+	if (filename.empty() || (purge_interval > 0 && settings.num_threads() > 1)) {
+		usage();
+		return 1;
+	}
+
+	Logger::SetOutput(0, &std::cerr);
+
+	IfcParse::IfcFile file;
+	if (!file.Init(filename)) {
+		std::cout << "Unable to parse .ifc file" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Peak memory after parsing: " << peak_memory() << " MiB" << std::endl;
+
+	std::ofstream digest;
+	if (!digest_filename.empty()) {
+		digest.open(digest_filename.c_str());
+		digest.precision(12);
+	}
+
+	const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+	IfcGeom::Iterator<double> iterator(settings, &file);
+	size_t num_elements = 0;
+	std::vector<triangulation_time> times;
+
+	if (iterator.initialize()) {
+		do {
+			++num_elements;
+			if (triangulation_times) {
+				times.push_back(time_triangulation(*iterator.get_native(), digest.is_open() ? &digest : 0));
+			} else if (digest.is_open()) {
+				const IfcGeom::TriangulationElement<double>* element = static_cast<IfcGeom::TriangulationElement<double>*>(iterator.get());
+				write_digest(digest, element->unique_id(), element->geometry());
+			}
+			if (purge_interval > 0 && num_elements % purge_interval == 0) {
+				iterator.shared_cache()->purge();
+			}
+		} while (iterator.next());
+	}
+
+	const double seconds = seconds_since(start);
+
+	std::cout << num_elements << " elements in " << seconds << "s ("
+		<< (seconds > 0. ? (num_elements / seconds) : 0.) << " elements/s)" << std::endl;
+	std::cout << "Peak memory: " << peak_memory() << " MiB" << std::endl;
+	if (iterator.shared_cache()) {
+		std::cout << "Cache memory in use: " << iterator.shared_cache()->memory_used() / 1048576. << " MiB" << std::endl;
+	}
+	report_triangulation_times(times);
+
+	return 0;
+}
@@ -0,0 +1,111 @@
+﻿/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+// Looks up the relationships the geometry kernel needs for every product in a
+// file, once by means of the inverse attributes and once by means of a
+// RelationshipIndex, and reports the time spent in both cases.
+
+#include <ctime>
+#include <string>
+#include <iostream>
+
+#include <boost/shared_ptr.hpp>
+
+#include "../ifcparse/IfcFile.h"
+#include "../ifcgeom/IfcGeom.h"
+#include "../ifcgeom/IfcGeomRelationships.h"
+
+#if USE_VLD
+#include <vld.h>
+#endif
+
+using namespace IfcSchema;
+
+// Performs the lookups Kernel::convert() and the iterator do for a product and
+// returns the number of related instances found
+size_t lookup(IfcGeom::Kernel& kernel, IfcProduct* product) {
+	const boost::shared_ptr<const IfcGeom::RelationshipIndex>& index = kernel.get_relationship_index();
+	size_t n = kernel.find_openings(product)->size();
+	n += kernel.get_material_associations(product)->size();
+	n += kernel.decomposing_entity(product) ? 1 : 0;
+	if (!product->hasRepresentation()) {
+		return n;
+	}
+	IfcRepresentation::list::ptr representations = product->Representation()->Representations();
+	for (IfcRepresentation::list::it it = representations->begin(); it != representations->end(); ++it) {
+		n += kernel.representation_mapped_to(*it) ? 1 : 0;
+		n += kernel.products_represented_by(*it)->size();
+		IfcRepresentationItem::list::ptr items = (*it)->Items();
+		for (IfcRepresentationItem::list::it jt = items->begin(); jt != items->end(); ++jt) {
+			n += (index ? index->styled_items(*jt) : (*jt)->StyledByItem())->size();
+		}
+	}
+	return n;
+}
+
+int main(int argc, char** argv) {
+	if (argc != 2) {
+		std::cout << "usage: IfcRelationshipBenchmark <filename.ifc>" << std::endl;
+		return 1;
+	}
+
+	Logger::SetOutput(0, &std::cerr);
+
+	IfcParse::IfcFile file;
+	if (!file.Init(argv[1])) {
+		std::cout << "Unable to parse .ifc file" << std::endl;
+		return 1;
+	}
+
+	// Attributes are parsed on first access, load them up front so that neither case pays for it
+	for (IfcParse::IfcFile::entity_by_id_t::const_iterator it = file.begin(); it != file.end(); ++it) {
+		if (it->second->entity->getArgumentCount()) {
+			it->second->entity->getArgument(0);
+		}
+	}
+
+	IfcProduct::list::ptr products = file.entitiesByType<IfcProduct>();
+	IfcGeom::Kernel kernel;
+	size_t num_related[2] = {0, 0};
+
+	for (int pass = 0; pass < 2; ++pass) {
+		std::clock_t start = std::clock();
+
+		if (pass == 1) {
+			boost::shared_ptr<IfcGeom::RelationshipIndex> index(new IfcGeom::RelationshipIndex);
+			index->build(kernel, &file);
+			kernel.set_relationship_index(index);
+
+			const double seconds = (std::clock() - start) / (double) CLOCKS_PER_SEC;
+			std::cout << "Building the index:  " << seconds << "s" << std::endl;
+			start = std::clock();
+		}
+
+		for (IfcProduct::list::it it = products->begin(); it != products->end(); ++it) {
+			num_related[pass] += lookup(kernel, *it);
+		}
+
+		const double seconds = (std::clock() - start) / (double) CLOCKS_PER_SEC;
+		std::cout << (pass == 0 ? "Inverse attributes:  " : "RelationshipIndex:   ")
+			<< products->size() << " products, " << num_related[pass] << " related instances in "
+			<< seconds << "s" << std::endl;
+	}
+
+	return num_related[0] == num_related[1] ? 0 : 1;
+}
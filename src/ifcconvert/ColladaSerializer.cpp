@@ -415,7 +415,7 @@ void ColladaSerializer::ColladaExporter::write(const IfcGeom::TriangulationEleme
 		mesh.faces(), mesh.edges(), mesh.material_ids(), mesh.materials(), material_references, mesh.uvs());
 
 	if (serializer->settings().get(SerializerSettings::USE_ELEMENT_HIERARCHY)) {
-		deferred.parents() = o->parents();
+		deferred.parents_ = o->parents_pointer();
 	}
 
 	deferreds.push_back(deferred);
@@ -477,7 +477,8 @@ void ColladaSerializer::ColladaExporter::endDocument() {
 
 		if (use_hierarchy)
 		{
-			size_t parentsNumber = it->parents_.size();
+			const std::vector<const IfcGeom::Element<real_t>*>& parents = it->parents();
+			size_t parentsNumber = parents.size();
 			bool finished = false;
 
 			// If we have no parent in the stack and the object has no parent, nothing to do : skip the loop
@@ -488,17 +489,17 @@ void ColladaSerializer::ColladaExporter::endDocument() {
 				// If we need to add a parent
 				if (serializer->parentStackId.size() <= parentsNumber)
 				{
-					if (serializer->parentStackId.empty()) { scene.addParent(*(it->parents_.at(0))); }
+					if (serializer->parentStackId.empty()) { scene.addParent(*(parents.at(0))); }
 					else
 					{
 						size_t diff = parentsNumber - serializer->parentStackId.size();
 
 						// If we have the wrong parent in the list
-						if (serializer->parentStackId.top() != it->parents_.at(parentsNumber - diff - 1)->id()) {
+						if (serializer->parentStackId.top() != parents.at(parentsNumber - diff - 1)->id()) {
 							scene.closeParent();
 						} else {
 							// So far we have the right parents, we just need to add the missing ones
-							for (size_t i = parentsNumber - diff; i < parentsNumber; i++) { scene.addParent(*(it->parents_.at(i))); }
+							for (size_t i = parentsNumber - diff; i < parentsNumber; i++) { scene.addParent(*(parents.at(i))); }
 
 							// if diff == 0, we can leave the loop. In fact we have the right number of parents, and the last one is ok
 							if (diff == 0) { finished = true; }
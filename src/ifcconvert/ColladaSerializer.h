@@ -140,19 +140,21 @@ private:
 		class DeferredObject {
 		
 			friend bool operator < (const DeferredObject& def_obj1, const DeferredObject& def_obj2) {
-				size_t size = (def_obj1.parents_.size() < def_obj2.parents_.size() ? def_obj1.parents_.size() : def_obj2.parents_.size());
+				const std::vector<const IfcGeom::Element<real_t>*>& parents1 = def_obj1.parents();
+				const std::vector<const IfcGeom::Element<real_t>*>& parents2 = def_obj2.parents();
+				size_t size = (parents1.size() < parents2.size() ? parents1.size() : parents2.size());
 				size_t cpt = 0;
 
 				// Skip the shared parents
-				while (cpt < size && *(def_obj1.parents_.at(cpt)) == *(def_obj2.parents_.at(cpt))) {
+				while (cpt < size && *(parents1.at(cpt)) == *(parents2.at(cpt))) {
 					cpt++;
 				}
 
 				// If a parent list container the other one
 				if (cpt >= size) {
-					return def_obj1.parents_.size() < def_obj2.parents_.size();
+					return parents1.size() < parents2.size();
 				} else {
-					return *(def_obj1.parents_.at(cpt)) < *(def_obj2.parents_.at(cpt));
+					return *(parents1.at(cpt)) < *(parents2.at(cpt));
 				}
 			}
 
@@ -167,7 +169,8 @@ private:
 			std::vector<IfcGeom::Material> materials;
 			std::vector<std::string> material_references;
             std::vector<real_t> uvs;
-			std::vector<const IfcGeom::Element<real_t>*> parents_;
+			// Shared with the element and the other objects with the same parent
+			boost::shared_ptr<const std::vector<const IfcGeom::Element<real_t>*> > parents_;
 
 			DeferredObject(const std::string& unique_id, const std::string& representation_id, const std::string& type, const IfcGeom::Transformation<real_t>& transformation,
 				const std::vector<real_t>& vertices, const std::vector<real_t>& normals, const std::vector<int>& faces,
@@ -187,8 +190,10 @@ private:
 				, uvs(uvs)
 			{}
 
-			std::vector<const IfcGeom::Element<real_t>*>& parents() { return parents_; }
-			const std::vector<const IfcGeom::Element<real_t>*>& parents() const { return parents_; }
+			const std::vector<const IfcGeom::Element<real_t>*>& parents() const {
+				static const std::vector<const IfcGeom::Element<real_t>*> no_parents;
+				return parents_ ? *parents_ : no_parents;
+			}
 		};
 		COLLADABU::NativeString filename;
 		COLLADASW::StreamWriter stream;
@@ -42,8 +42,11 @@
 #include <boost/program_options.hpp>
 #include <boost/make_shared.hpp>
 
+#include <algorithm>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
+#include <limits>
 #include <set>
 #include <time.h>
 
@@ -74,6 +77,7 @@ void print_usage(bool suggest_help = true)
         << "  .igs   IGES           Initial Graphics Exchange Specification\n"
         << "  .xml   XML            Property definitions and decomposition tree\n"
         << "  .svg   SVG            Scalable Vector Graphics (2D floor plan)\n"
+        << "  .csv   CSV            Bounding boxes of the elements, without booleans or meshing\n"
         << "\n"
         << "If no output filename given, <input>." + DEFAULT_EXTENSION + " will be used as the output file.\n";
     if (suggest_help) {
@@ -152,6 +156,7 @@ void parse_filter(geom_filter &, const std::vector<std::string>&);
 std::vector<IfcGeom::filter_t> setup_filters(const std::vector<geom_filter>&, const std::string&);
 
 bool init_input_file(const std::string& filename, IfcParse::IfcFile& ifc_file, bool no_progress, bool mmap);
+bool write_element_bounds(const std::string& filename, const std::vector<IfcGeom::ElementBounds>& bounds, double unit_magnitude);
 
 int main(int argc, char** argv)
 {
@@ -177,6 +182,15 @@ int main(int argc, char** argv)
 		
 
     double deflection_tolerance;
+    std::vector<double> lod_deflection_tolerances;
+    int num_threads;
+    int mesher_threads;
+    int boolean_threads;
+    double boolean_fuzziness;
+    double element_time_budget;
+    int cache_budget;
+    std::string disk_cache_directory;
+    int disk_cache_size;
     inclusion_filter include_filter;
     inclusion_traverse_filter include_traverse_filter;
     exclusion_filter exclude_filter;
@@ -250,12 +264,51 @@ int main(int argc, char** argv)
         ("exclude+", po::value<exclusion_traverse_filter>(&exclude_traverse_filter)->multitoken(),
             "Same as --exclude but applies filtering also to the decomposition and/or containment "
             "of the filtered entity. See --include+ for more details.")
+        ("no-mesh-passthrough",
+            "Converts tessellated face sets, faceted breps and polygonal extrusions to "
+            "shapes that are triangulated by Open Cascade, rather than copying or "
+            "generating their triangles directly. Slower, mostly useful for comparison.")
         ("no-normals",
             "Disables computation of normals. Saves time and file size and is useful "
             "in instances where you're going to recompute normals for the exported "
             "model in other modelling application in any case.")
         ("deflection-tolerance", po::value<double>(&deflection_tolerance)->default_value(1e-3),
             "Sets the deflection tolerance of the mesher, 1e-3 by default if not specified.")
+        ("lod-deflection-tolerances", po::value< std::vector<double> >(&lod_deflection_tolerances)->multitoken(),
+            "Deflection tolerances of additional levels of detail, for example '0.01 0.1'. "
+            "Every element is meshed once for every tolerance from the same geometry. "
+            "The levels of detail are written as separate groups, or separate files "
+            "using --lod-files. Applicable for OBJ output.")
+        ("threads", po::value<int>(&num_threads)->default_value(1),
+            "Number of threads used to create geometry, 1 by default. Elements are "
+            "written in the same order regardless of the number of threads.")
+        ("mesher-threads", po::value<int>(&mesher_threads)->default_value(1),
+            "Number of threads used to triangulate the items of a single element, 1 by "
+            "default. Speeds up elements with many items, such as curtain walls. The "
+            "triangulation is the same regardless of the number of threads.")
+        ("boolean-threads", po::value<int>(&boolean_threads)->default_value(1),
+            "Number of threads used to subtract openings from the shapes of a single "
+            "element, 1 by default. Speeds up elements with many items and openings.")
+        ("parallel-booleans",
+            "Enables the parallel mode of Open Cascade boolean operations.")
+        ("boolean-fuzziness", po::value<double>(&boolean_fuzziness)->default_value(-1.),
+            "Sets the initial fuzzy value of boolean operations, which is increased "
+            "when an operation fails. By default the precision of the file is used.")
+        ("element-time-budget", po::value<double>(&element_time_budget)->default_value(0.),
+            "Time in seconds in which an element is to be converted. Elements exceeding "
+            "it are converted without openings, then without sewing shells and finally "
+            "as a bounding box. Unlimited by default.")
+        ("cache-budget", po::value<int>(&cache_budget)->default_value(256),
+            "Memory budget in MiB for caching intermediate geometry, such as placements "
+            "and profiles, 256 by default. Use 0 to disable caching and -1 for an "
+            "unbounded cache.")
+        ("disk-cache", po::value<std::string>(&disk_cache_directory),
+            "Directory in which converted geometry is stored, so that subsequent "
+            "conversions of the same or modified models can reuse geometry of elements "
+            "that did not change. The directory can be shared by concurrent processes.")
+        ("disk-cache-size", po::value<int>(&disk_cache_size)->default_value(1024),
+            "Size limit in MiB of the --disk-cache directory, 1024 by default. Least "
+            "recently used geometry is removed when exceeded.")
         ("generate-uvs",
             "Generates UVs (texture coordinates) by using simple box projection. Requires normals. "
             "Not guaranteed to work properly if used with --weld-vertices.")
@@ -316,7 +369,11 @@ int main(int argc, char** argv)
             "Sets the precision to be used to format floating-point values, 15 by default. "
             "Use a negative value to use the system's default precision (should be 6 typically). "
             "Applicable for OBJ and DAE output. For DAE output, value >= 15 means that up to 16 decimals are used, "
-            " and any other value means that 6 or 7 decimals are used.");
+            " and any other value means that 6 or 7 decimals are used.")
+        ("lod-files",
+            "Writes the levels of detail of --lod-deflection-tolerances to separate files, "
+            "for example output.lod1.obj, rather than as groups in the output file. "
+            "Applicable for OBJ output.");
 
     po::options_description cmdline_options;
 	cmdline_options.add(generic_options).add(fileio_options).add(geom_options).add(serializer_options);
@@ -361,6 +418,7 @@ int main(int argc, char** argv)
 	const bool merge_boolean_operands = vmap.count("merge-boolean-operands") != 0;
 #endif
 	const bool disable_opening_subtractions = vmap.count("disable-opening-subtractions") != 0;
+	const bool parallel_booleans = vmap.count("parallel-booleans") != 0;
 	const bool include_plan = vmap.count("plan") != 0;
 	const bool include_model = vmap.count("model") != 0 || (!include_plan);
 	const bool enable_layerset_slicing = vmap.count("enable-layerset-slicing") != 0;
@@ -370,11 +428,13 @@ int main(int argc, char** argv)
 	const bool use_element_types = vmap.count("use-element-types") != 0;
 	const bool use_element_hierarchy = vmap.count("use-element-hierarchy") != 0;
 	const bool no_normals = vmap.count("no-normals") != 0;
+	const bool no_mesh_passthrough = vmap.count("no-mesh-passthrough") != 0;
 	const bool center_model = vmap.count("center-model") != 0;
 	const bool model_offset = vmap.count("model-offset") != 0;
 	const bool site_local_placement = vmap.count("site-local-placement") != 0;
 	const bool building_local_placement = vmap.count("building-local-placement") != 0;
 	const bool generate_uvs = vmap.count("generate-uvs") != 0;
+	const bool lod_files = vmap.count("lod-files") != 0;
 
 	if (!quiet || vmap.count("version")) {
 		print_version();
@@ -544,10 +604,12 @@ int main(int argc, char** argv)
 	settings.set(IfcGeom::IteratorSettings::FASTER_BOOLEANS,              merge_boolean_operands);
 #endif
 	settings.set(IfcGeom::IteratorSettings::DISABLE_OPENING_SUBTRACTIONS, disable_opening_subtractions);
+	settings.set(IfcGeom::IteratorSettings::PARALLEL_BOOLEANS, parallel_booleans);
 	settings.set(IfcGeom::IteratorSettings::INCLUDE_CURVES,               include_plan);
 	settings.set(IfcGeom::IteratorSettings::EXCLUDE_SOLIDS_AND_SURFACES,  !include_model);
 	settings.set(IfcGeom::IteratorSettings::APPLY_LAYERSETS,              enable_layerset_slicing);
     settings.set(IfcGeom::IteratorSettings::NO_NORMALS, no_normals);
+	settings.set(IfcGeom::IteratorSettings::NO_MESH_PASSTHROUGH, no_mesh_passthrough);
     settings.set(IfcGeom::IteratorSettings::GENERATE_UVS, generate_uvs);
 	settings.set(IfcGeom::IteratorSettings::SEARCH_FLOOR, use_element_hierarchy);
 	settings.set(IfcGeom::IteratorSettings::SITE_LOCAL_PLACEMENT, site_local_placement);
@@ -560,9 +622,56 @@ int main(int argc, char** argv)
 	settings.set(SerializerSettings::USE_ELEMENT_TYPES, use_element_types);
 	settings.set(SerializerSettings::USE_ELEMENT_HIERARCHY, use_element_hierarchy);
     settings.set_deflection_tolerance(deflection_tolerance);
+    settings.set_lod_deflection_tolerances(lod_deflection_tolerances);
+    settings.set_num_threads(num_threads);
+    settings.set_mesher_threads(mesher_threads);
+    settings.set_boolean_threads(boolean_threads);
+    settings.set_boolean_fuzziness(boolean_fuzziness);
+    settings.set_element_time_budget(element_time_budget);
+    if (cache_budget < 0) {
+        settings.set_cache_policy(IfcGeom::IteratorSettings::CACHE_UNBOUNDED);
+    } else if (cache_budget == 0) {
+        settings.set_cache_policy(IfcGeom::IteratorSettings::CACHE_OFF);
+    } else {
+        settings.set_cache_policy(IfcGeom::IteratorSettings::CACHE_BOUNDED);
+        settings.set_cache_budget(static_cast<std::size_t>(cache_budget) * 1024 * 1024);
+    }
+    settings.set_disk_cache_directory(disk_cache_directory);
+    settings.set_disk_cache_size(static_cast<boost::uint64_t>(disk_cache_size < 0 ? 0 : disk_cache_size) * 1024 * 1024);
     settings.precision = precision;
 
+	if (output_extension == ".csv") {
+		int exit_code = EXIT_FAILURE;
+		time_t start, end;
+		time(&start);
+		if (init_input_file(input_filename, ifc_file, no_progress || quiet, mmap)) {
+			IfcGeom::Iterator<real_t> bounds_iterator(settings, &ifc_file, filter_funcs);
+			std::vector<IfcGeom::ElementBounds> bounds;
+			if (!quiet) Logger::Status("Computing bounds...");
+			if (!bounds_iterator.compute_element_bounds(bounds)) {
+				Logger::Error("No geometrical entities found");
+			} else if (write_element_bounds(output_temp_filename, bounds, convert_back_units ? bounds_iterator.getUnitMagnitude() : 1.)) {
+				time(&end);
+				if (!quiet) Logger::Status("Done! Computed the bounds of " + boost::lexical_cast<std::string>(bounds.size()) +
+					" elements in " + format_duration(start, end));
+				if (rename_file(output_temp_filename, output_filename)) {
+					exit_code = EXIT_SUCCESS;
+				} else {
+					Logger::Error("Unable to write output file '" + output_filename + "', see '" +
+						output_temp_filename + "' for the result.");
+				}
+			} else {
+				Logger::Error("Unable to write output file '" + output_filename + "'");
+			}
+		}
+		write_log(!quiet);
+		return exit_code;
+	}
+
 	boost::shared_ptr<GeometrySerializer> serializer; /**< @todo use std::unique_ptr when possible */
+	// Serializers for the levels of detail after the first when using --lod-files
+	std::vector< boost::shared_ptr<GeometrySerializer> > lod_serializers;
+	std::vector<std::string> lod_filenames;
 	if (output_extension == ".obj") {
         // Do not use temp file for MTL as it's such a small file.
         const std::string mtl_filename = change_extension(output_filename, "mtl");
@@ -571,6 +680,14 @@ int main(int argc, char** argv)
 			settings.set(IfcGeom::IteratorSettings::USE_WORLD_COORDS, true);
 		}
 		serializer = boost::make_shared<WaveFrontOBJSerializer>(output_temp_filename, mtl_filename, settings);
+		if (lod_files) {
+			for (size_t i = 1; i <= lod_deflection_tolerances.size(); ++i) {
+				const std::string lod = "lod" + boost::lexical_cast<std::string>(i);
+				lod_filenames.push_back(change_extension(output_filename, lod + ".obj"));
+				lod_serializers.push_back(boost::make_shared<WaveFrontOBJSerializer>(lod_filenames.back() + TEMP_FILE_EXTENSION,
+					change_extension(output_filename, lod + ".mtl"), settings));
+			}
+		}
 #ifdef WITH_OPENCOLLADA
 	} else if (output_extension == ".dae") {
 		serializer = boost::make_shared<ColladaSerializer>(output_temp_filename, settings);
@@ -621,11 +738,22 @@ int main(int argc, char** argv)
         settings.set(IfcGeom::IteratorSettings::DISABLE_TRIANGULATION, true);
 	}
 
+	if (lod_files && output_extension != ".obj") {
+		Logger::Notice("Separate files for levels of detail are only written for WaveFront OBJ output");
+	}
+
 	if (!serializer->ready()) {
         std::remove(output_temp_filename.c_str()); /**< @todo Windows Unicode support */
 		write_log(!quiet);
 		return EXIT_FAILURE;
 	}
+	for (size_t i = 0; i < lod_serializers.size(); ++i) {
+		if (!lod_serializers[i]->ready()) {
+			Logger::Error("Unable to write output file '" + lod_filenames[i] + "'");
+			write_log(!quiet);
+			return EXIT_FAILURE;
+		}
+	}
 
 	time_t start,end;
 	time(&start);
@@ -655,6 +783,9 @@ int main(int argc, char** argv)
 	}
 
 	serializer->writeHeader();
+	for (size_t i = 0; i < lod_serializers.size(); ++i) {
+		lod_serializers[i]->writeHeader();
+	}
 
 	int old_progress = quiet ? 0 : -1;
 
@@ -683,6 +814,10 @@ int main(int argc, char** argv)
             }
         }
 
+        for (size_t i = 0; i < lod_serializers.size(); ++i) {
+            std::copy(offset, offset + 3, lod_serializers[i]->settings().offset);
+        }
+
         std::stringstream msg;
         msg << "Using model offset (" << offset[0] << "," << offset[1] << "," << offset[2] << ")";
         Logger::Notice(msg.str());
@@ -707,7 +842,18 @@ int main(int argc, char** argv)
 	do {
         IfcGeom::Element<real_t> *geom_object = context_iterator.get();
 
-		if (is_tesselated)
+		if (is_tesselated && !lod_serializers.empty())
+		{
+			// Every serializer receives a single level of detail
+			const IfcGeom::TriangulationElement<real_t>* triangulation_object = static_cast<const IfcGeom::TriangulationElement<real_t>*>(geom_object);
+			const IfcGeom::TriangulationElement<real_t> lod0(*triangulation_object, triangulation_object->geometry_pointer());
+			serializer->write(&lod0);
+			for (size_t i = 0; i < lod_serializers.size(); ++i) {
+				const IfcGeom::TriangulationElement<real_t> lod(*triangulation_object, triangulation_object->lod_pointers()[i]);
+				lod_serializers[i]->write(&lod);
+			}
+		}
+		else if (is_tesselated)
 		{
 			serializer->write(static_cast<const IfcGeom::TriangulationElement<real_t>*>(geom_object));
 		}
@@ -735,6 +881,24 @@ int main(int argc, char** argv)
         }
     } while (++num_created, context_iterator.next());
 
+	if (verbose && context_iterator.shared_cache()) {
+		const std::vector<IfcGeom::SharedCacheStatistics> stats = context_iterator.shared_cache()->statistics();
+		for (std::vector<IfcGeom::SharedCacheStatistics>::const_iterator it = stats.begin(); it != stats.end(); ++it) {
+			if (it->hits + it->misses) {
+				std::stringstream msg;
+				msg << "Cache " << it->name << ": " << it->hits << " hits, " << it->misses << " misses, " << it->size << " entries";
+				Logger::Notice(msg.str());
+			}
+		}
+	}
+
+	if (verbose && context_iterator.disk_cache()) {
+		std::stringstream msg;
+		msg << "Disk cache: " << context_iterator.disk_cache()->hits() << " hits, " << context_iterator.disk_cache()->misses() << " misses, "
+			<< context_iterator.disk_cache()->writes() << " written";
+		Logger::Notice(msg.str());
+	}
+
 	if (!no_progress && quiet) {
 		for (; old_progress < 100; ++old_progress) {
 			std::cout << ".";
@@ -749,6 +913,25 @@ int main(int argc, char** argv)
 			" objects)                                ");
 	}
 
+	if (!quiet && context_iterator.shared_cache()) {
+		const IfcGeom::SharedCacheStatistics dedup = context_iterator.shared_cache()->deduplication_statistics();
+		if (dedup.hits) {
+			std::stringstream msg;
+			msg << "Reused the geometry of " << dedup.hits << " of " << (dedup.hits + dedup.misses)
+				<< " representation items (" << std::fixed << std::setprecision(1) << (100. * dedup.hits / (dedup.hits + dedup.misses))
+				<< "%), saving an estimated " << context_iterator.shared_cache()->deduplication_seconds_saved() << " seconds";
+			Logger::Status(msg.str());
+		}
+		const IfcGeom::SharedCacheStatistics subtractions = context_iterator.shared_cache()->subtraction_statistics();
+		if (subtractions.hits) {
+			std::stringstream msg;
+			msg << "Reused the opening subtractions of " << subtractions.hits << " of " << (subtractions.hits + subtractions.misses)
+				<< " products (" << std::fixed << std::setprecision(1) << (100. * subtractions.hits / (subtractions.hits + subtractions.misses))
+				<< "%), saving an estimated " << context_iterator.shared_cache()->subtraction_seconds_saved() << " seconds";
+			Logger::Status(msg.str());
+		}
+	}
+
     serializer->finalize();
     // Make sure the dtor is explicitly run here (e.g. output files are closed before renaming them).
     serializer.reset();
@@ -760,6 +943,15 @@ int main(int argc, char** argv)
         Logger::Error("Unable to write output file '" + output_filename + "', see '" +
             output_temp_filename + "' for the conversion result.");
     }
+    for (size_t i = 0; i < lod_serializers.size(); ++i) {
+        lod_serializers[i]->finalize();
+        lod_serializers[i].reset();
+        if (!rename_file(lod_filenames[i] + TEMP_FILE_EXTENSION, lod_filenames[i])) {
+            Logger::Error("Unable to write output file '" + lod_filenames[i] + "', see '" +
+                lod_filenames[i] + TEMP_FILE_EXTENSION + "' for the conversion result.");
+            successful = false;
+        }
+    }
 
 	write_log(!quiet);
 
@@ -772,6 +964,36 @@ int main(int argc, char** argv)
     return successful ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
+/// Writes a line per element with its id, GlobalId and type, the axis-aligned
+/// box in world coordinates, the box in the coordinate system of the element
+/// and the 3x4 matrix of its placement in row-major order, which together form
+/// the oriented box.
+bool write_element_bounds(const std::string& filename, const std::vector<IfcGeom::ElementBounds>& bounds, double unit_magnitude)
+{
+    /// @todo Windows Unicode support
+    std::ofstream file(filename.c_str());
+    if (!file.good()) {
+        return false;
+    }
+    file << std::setprecision(std::numeric_limits<double>::digits10 + 1);
+    file << "id,guid,type,world_min_x,world_min_y,world_min_z,world_max_x,world_max_y,world_max_z,"
+        "min_x,min_y,min_z,max_x,max_y,max_z,m11,m12,m13,m14,m21,m22,m23,m24,m31,m32,m33,m34\n";
+    for (std::vector<IfcGeom::ElementBounds>::const_iterator it = bounds.begin(); it != bounds.end(); ++it) {
+        const gp_XYZ* points[] = { &it->world_min, &it->world_max, &it->min, &it->max };
+        file << it->id << "," << it->guid << "," << it->type;
+        for (int i = 0; i < 4; ++i) {
+            file << "," << points[i]->X() / unit_magnitude << "," << points[i]->Y() / unit_magnitude << "," << points[i]->Z() / unit_magnitude;
+        }
+        for (int i = 1; i < 4; ++i) {
+            for (int j = 1; j < 5; ++j) {
+                file << "," << (j == 4 ? it->placement.Value(i, j) / unit_magnitude : it->placement.Value(i, j));
+            }
+        }
+        file << "\n";
+    }
+    return file.good();
+}
+
 std::string format_duration(time_t start, time_t end)
 {
     int seconds = (int)difftime(end, start);
@@ -73,10 +73,17 @@ void WaveFrontOBJSerializer::writeMaterial(const IfcGeom::Material& style)
 
 void WaveFrontOBJSerializer::write(const IfcGeom::TriangulationElement<real_t>* o)
 {
-    obj_stream << "g " << object_id(o) << "\n";
-	obj_stream << "s 1" << "\n";
+	// Levels of detail after the first are written as separate groups
+	writeMesh(object_id(o), o->geometry());
+	for (size_t i = 1; i < o->num_lods(); ++i) {
+		writeMesh(object_id(o) + "-lod" + boost::lexical_cast<std::string>(i), o->lod(i));
+	}
+}
 
-    const IfcGeom::Representation::Triangulation<real_t>& mesh = o->geometry();
+void WaveFrontOBJSerializer::writeMesh(const std::string& name, const IfcGeom::Representation::Triangulation<real_t>& mesh)
+{
+    obj_stream << "g " << name << "\n";
+	obj_stream << "s 1" << "\n";
 
 	const int vcount = (int)mesh.verts().size() / 3;
     for ( std::vector<real_t>::const_iterator it = mesh.verts().begin(); it != mesh.verts().end(); ) {
@@ -34,6 +34,7 @@ private:
 	std::ofstream mtl_stream;
 	unsigned int vcount_total;
 	std::set<std::string> materials;
+	void writeMesh(const std::string& name, const IfcGeom::Representation::Triangulation<real_t>& mesh);
 public:
 	WaveFrontOBJSerializer(const std::string& obj_filename, const std::string& mtl_filename, const SerializerSettings& settings)
 		: GeometrySerializer(settings)
@@ -45,6 +45,7 @@ inline static bool ALMOST_THE_SAME(const T& a, const T& b, double tolerance=ALMO
 #include <TColgp_SequenceOfPnt.hxx>
 #include <TopTools_ListOfShape.hxx>
 #include <BOPAlgo_Operation.hxx>
+#include <Bnd_Box.hxx>
 
 #include "../ifcparse/IfcParse.h"
 #include "../ifcparse/IfcBaseClass.h"
@@ -53,8 +54,15 @@ inline static bool ALMOST_THE_SAME(const T& a, const T& b, double tolerance=ALMO
 #include "../ifcgeom/IfcGeomRepresentation.h" 
 #include "../ifcgeom/IfcRepresentationShapeItem.h"
 #include "../ifcgeom/IfcGeomShapeType.h"
+#include "../ifcgeom/IfcGeomSharedCache.h"
+#include "../ifcgeom/IfcGeomPlacements.h"
+#include "../ifcgeom/IfcGeomRelationships.h"
+#include "../ifcgeom/IfcGeomStyles.h"
 #include "ifc_geom_api.h"
 
+#include <boost/shared_ptr.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
 // Define this in case you want to conserve memory usage at all cost. This has been
 // benchmarked extensively: https://github.com/IfcOpenShell/IfcOpenShell/pull/47
 // #define NO_CACHE
@@ -66,9 +74,12 @@ inline static bool ALMOST_THE_SAME(const T& a, const T& b, double tolerance=ALMO
 
 #else
 
-#define IN_CACHE(T,E,t,e) std::map<int,t>::const_iterator it = cache.T.find(E->entity->id());\
-if ( it != cache.T.end() ) { e = it->second; return true; }
-#define CACHE(T,E,e) cache.T[E->entity->id()] = e;
+// When the kernel has a shared cache, it is used instead of the kernel's own cache
+#define IN_CACHE(T,E,t,e) IfcGeom::SharedCacheEntry<t> shared_cache_entry(shared_cache ? &shared_cache->T : 0, E->entity->id(), *this);\
+if ( shared_cache_entry.find(e) ) { return true; }\
+std::map<int,t>::const_iterator it = cache.T.find(E->entity->id());\
+if ( !shared_cache && it != cache.T.end() ) { e = it->second; return true; }
+#define CACHE(T,E,e) if ( shared_cache ) { shared_cache_entry.set(e); } else { cache.T[E->entity->id()] = e; }
 
 #endif
 
@@ -108,15 +119,57 @@ private:
 	double ifc_planeangle_unit;
 	double modelling_precision;
 	double dimensionality;
+	double boolean_fuzziness;
+
+	// Number of threads used to subtract openings from the shapes of a product,
+	// and whether boolean operations use the parallel mode of Open Cascade
+	int boolean_threads;
+	bool parallel_booleans;
+
+	// Whether tessellated items are converted to meshes rather than shapes,
+	// and whether such meshes may approximate curved geometry
+	bool mesh_passthrough;
+	bool approximate_mesh_passthrough;
+
+	// End of the time budget, not a date time if there is none
+	boost::posix_time::ptime deadline;
 
 #ifndef NO_CACHE
 	Cache cache;
+	boost::shared_ptr<SharedCache> shared_cache;
 #endif
 
+	// Absolute placements resolved in advance, shared amongst copies of the kernel
+	boost::shared_ptr<const PlacementTable> placement_table;
+
+	// Relationships gathered in advance, shared amongst copies of the kernel
+	boost::shared_ptr<const RelationshipIndex> relationship_index;
+
+	// Styles of representation items resolved in advance, shared amongst copies of the kernel
+	boost::shared_ptr<const StyleTable> style_table;
+
 	std::map<int, SurfaceStyle> style_cache;
 
+	// Content hashes of the instances in the file, and the style definitions by
+	// their content hash, used to resolve styles of shapes read from a DiskCache
+	IfcParse::ContentHash content_hash;
+	std::map<IfcParse::ContentHash::value_type, IfcUtil::IfcBaseClass*> style_definitions;
+	IfcParse::IfcFile* style_definitions_file;
+
+	// Traversals of individual items and representations. They are reused, so
+	// that their visited bitmap, sized by the file, is allocated only once
+	// rather than for every item.
+	IfcParse::Traversal item_traversal;
+	IfcParse::Traversal styled_item_traversal;
+
 	const SurfaceStyle* internalize_surface_style(const std::pair<IfcSchema::IfcSurfaceStyle*, IfcSchema::IfcSurfaceStyleShading*>& shading_style);
 
+	// The fuzzy value with which boolean operations start
+	double initial_boolean_fuzziness() const { return boolean_fuzziness > 0. ? boolean_fuzziness : modelling_precision; }
+
+	// The products that refer to the representation by means of an IfcProductRepresentation
+	IfcSchema::IfcProduct::list::ptr products_of_representation_(const IfcSchema::IfcRepresentation*);
+
 	 // For stopping PlacementRelTo recursion in convert(const IfcSchema::IfcObjectPlacement* l, gp_Trsf& trsf)
 	IfcSchema::Type::Enum placement_rel_to;
 
@@ -130,10 +183,21 @@ public:
 		, ifc_planeangle_unit(-1.0)
 		, modelling_precision(0.00001)
 		, dimensionality(1.)
+		, boolean_fuzziness(-1.)
+		, boolean_threads(1)
+		, parallel_booleans(false)
+		, mesh_passthrough(false)
+		, approximate_mesh_passthrough(true)
+		, style_definitions_file(0)
 		, placement_rel_to(IfcSchema::Type::UNDEFINED)
-	{}
+	{
+		styled_item_traversal.skip(IfcSchema::Type::IfcCartesianPoint).skip(IfcSchema::Type::IfcDirection);
+	}
 
-	Kernel(const Kernel& other) {
+	Kernel(const Kernel& other)
+		: style_definitions_file(0)
+	{
+		styled_item_traversal.skip(IfcSchema::Type::IfcCartesianPoint).skip(IfcSchema::Type::IfcDirection);
 		*this = other;
 	}
 
@@ -147,6 +211,19 @@ public:
 		setValue(GV_PRECISION,                other.getValue(GV_PRECISION));
 		setValue(GV_DIMENSIONALITY,           other.getValue(GV_DIMENSIONALITY));
 		setValue(GV_DEFLECTION_TOLERANCE,     other.getValue(GV_DEFLECTION_TOLERANCE));
+		setValue(GV_BOOLEAN_FUZZINESS,        other.getValue(GV_BOOLEAN_FUZZINESS));
+		boolean_threads = other.boolean_threads;
+		parallel_booleans = other.parallel_booleans;
+		placement_rel_to = other.placement_rel_to;
+		mesh_passthrough = other.mesh_passthrough;
+		approximate_mesh_passthrough = other.approximate_mesh_passthrough;
+#ifndef NO_CACHE
+		// Entries are keyed by the kernel settings, so copies can share the cache
+		shared_cache = other.shared_cache;
+#endif
+		placement_table = other.placement_table;
+		relationship_index = other.relationship_index;
+		style_table = other.style_table;
 		return *this;
 	}
 
@@ -181,13 +258,21 @@ public:
 		// Default: 0.00001 (obtained from IfcGeometricRepresentationContext if available)
 		GV_PRECISION,
 		// Whether to process shapes of type Face or higher (1) Wire or lower (-1) or all (0)
-		GV_DIMENSIONALITY
+		GV_DIMENSIONALITY,
+		// The initial fuzzy value of boolean operations, which is increased when an
+		// operation fails
+		// Default: -1.0 (= not set, use GV_PRECISION)
+		GV_BOOLEAN_FUZZINESS
 	};
 
 	bool convert_wire_to_face(const TopoDS_Wire& wire, TopoDS_Face& face);
 	bool convert_curve_to_wire(const Handle(Geom_Curve)& curve, TopoDS_Wire& wire);
 	bool convert_shapes(const IfcUtil::IfcBaseClass* L, IfcRepresentationShapeItems& result);
 	IfcGeom::ShapeType shape_type(const IfcUtil::IfcBaseClass* L);
+	/// Calls the conversion function registered for T, used to populate the
+	/// dispatch table of convert_shape() and related functions
+	template <typename T, typename R>
+	bool convert_as(const IfcUtil::IfcBaseClass* L, R& r) { return convert(static_cast<const T*>(L), r); }
 	bool convert_shape(const IfcUtil::IfcBaseClass* L, TopoDS_Shape& result);
 	bool flatten_shape_list(const IfcGeom::IfcRepresentationShapeItems& shapes, TopoDS_Shape& result, bool fuse);
 	bool convert_wire(const IfcUtil::IfcBaseClass* L, TopoDS_Wire& result);
@@ -269,22 +354,80 @@ public:
 	std::pair<std::string, double> initializeUnits(IfcSchema::IfcUnitAssignment*);
 
     static IfcSchema::IfcObjectDefinition* get_decomposing_entity(IfcSchema::IfcProduct*);
+	/// Equivalent of get_decomposing_entity() that uses the relationship index if set
+	IfcSchema::IfcObjectDefinition* decomposing_entity(IfcSchema::IfcProduct*);
 
     static std::map<std::string, IfcSchema::IfcPresentationLayerAssignment*> get_layers(IfcSchema::IfcProduct* prod);
 
+	/// Records how the shapes for a product are derived from its representation,
+	/// so that an element can be recreated from shapes read from a cache
+	enum ShapeDerivation {
+		DERIVED_LAYERSET = 1,
+		DERIVED_MATERIAL_STYLE = 1 << 1,
+		DERIVED_OPENINGS = 1 << 2,
+		DERIVED_WORLD_COORDS = 1 << 3,
+		DERIVED_UNSEWN = 1 << 4,
+		DERIVED_BOUNDING_BOX = 1 << 5,
+		DERIVED_NO_OPENINGS = 1 << 6
+	};
+
+	/// Converts the representation and applies the layer sets, materials, openings
+	/// and placement of the product as configured in the settings
+	bool convert_shapes_for_product(const IteratorSettings&, IfcSchema::IfcRepresentation*, IfcSchema::IfcProduct*,
+		IfcRepresentationShapeItems& shapes, int& derivation);
+
+	/// Creates a box around the items of the representation in place of its
+	/// shapes, for products of which the conversion exceeds the time budget.
+	/// See bounding_box(), items that are not bounded analytically are bounded
+	/// by their points rather than converted.
+	bool convert_bounding_box_for_product(const IteratorSettings&, IfcSchema::IfcRepresentation*, IfcSchema::IfcProduct*,
+		IfcRepresentationShapeItems& shapes, int& derivation);
+
+	/// Transformation of the mapped representation by the mapping origin and
+	/// target of the item
+	bool convert_mapped_item_placement(const IfcSchema::IfcMappedItem*, gp_GTrsf&);
+
+	/// Extends the box by the items of the representation, transformed by the
+	/// placement, without boolean operations or triangulation. Extrusions are
+	/// bounded analytically, faceted geometry by its points, mapped items by
+	/// the transformed bounds of the mapped representation and differences by
+	/// their first operand. Other items are converted to shapes, or if convert
+	/// is false, bounded by the points they reference, disregarding placements
+	/// within the item. Returns false if none of the items could be bounded.
+	bool bounding_box(const IfcSchema::IfcRepresentation*, const gp_GTrsf& placement, Bnd_Box& box, bool convert = true);
+	bool bounding_box(const IfcSchema::IfcRepresentationItem*, const gp_GTrsf& placement, Bnd_Box& box, bool convert = true);
+
+	template <typename P>
+	IfcGeom::BRepElement<P>* create_brep_for_shapes(const IteratorSettings&, IfcSchema::IfcRepresentation*, IfcSchema::IfcProduct*,
+		const IfcRepresentationShapeItems& shapes, int derivation);
+
 	template <typename P>
     IfcGeom::BRepElement<P>* create_brep_for_representation_and_product(
         const IteratorSettings&, IfcSchema::IfcRepresentation*, IfcSchema::IfcProduct*);
 
+	/// Identifies the result of convert_shapes_for_product() by the contents of
+	/// the instances it depends on and the settings, see IfcGeom::DiskCache
+	IfcParse::ContentHash::value_type content_key(const IteratorSettings&, IfcSchema::IfcRepresentation*, IfcSchema::IfcProduct*);
+
+	/// Serializes shapes for a DiskCache. Styles are stored by the content hash of
+	/// their definition. Returns false if the shapes cannot be stored.
+	bool write_shapes(IfcParse::IfcFile* file, const IfcRepresentationShapeItems& shapes, int derivation, std::string& data);
+	bool read_shapes(IfcParse::IfcFile* file, const std::string& data, IfcRepresentationShapeItems& shapes, int& derivation);
+
 	template <typename P>
     IfcGeom::BRepElement<P>* create_brep_for_processed_representation(
         const IteratorSettings&, IfcSchema::IfcRepresentation*, IfcSchema::IfcProduct*, IfcGeom::BRepElement<P>*);
 	
+	IfcSchema::IfcRelAssociatesMaterial::list::ptr get_material_associations(const IfcSchema::IfcProduct*);
 	const IfcSchema::IfcMaterial* get_single_material_association(const IfcSchema::IfcProduct*);
 	IfcSchema::IfcRepresentation* representation_mapped_to(const IfcSchema::IfcRepresentation* representation);
 	IfcSchema::IfcProduct::list::ptr products_represented_by(const IfcSchema::IfcRepresentation*);
 	const SurfaceStyle* get_style(const IfcSchema::IfcRepresentationItem*);
 	const SurfaceStyle* get_style(const IfcSchema::IfcMaterial*);
+	const SurfaceStyle* get_style(const IfcSchema::IfcSurfaceStyle*);
+
+	/// Creates a style from the shading of an IfcSurfaceStyle
+	static SurfaceStyle create_surface_style(const std::pair<IfcSchema::IfcSurfaceStyle*, IfcSchema::IfcSurfaceStyleShading*>&);
 	
 	template <typename T> std::pair<IfcSchema::IfcSurfaceStyle*, T*> _get_surface_style(const IfcSchema::IfcStyledItem* si) {
 #ifdef USE_IFC4
@@ -345,6 +488,100 @@ public:
 	}
 
 	void set_conversion_placement_rel_to(IfcSchema::Type::Enum type);
+	IfcSchema::Type::Enum get_conversion_placement_rel_to() const { return placement_rel_to; }
+
+	/// Returns the placement the placement is relative to, or null if it is not
+	/// relative to another local placement or if the parent places a product of
+	/// the type set by set_conversion_placement_rel_to()
+	IfcSchema::IfcLocalPlacement* placement_parent(IfcSchema::IfcLocalPlacement* placement);
+
+	/// Uses the absolute placements in the table, if it has been built with the
+	/// same placement_rel_to type, instead of resolving placement chains
+	void set_placement_table(const boost::shared_ptr<const PlacementTable>& t) { placement_table = t; }
+	const boost::shared_ptr<const PlacementTable>& get_placement_table() const { return placement_table; }
+
+	/// Uses the relationships in the index instead of inverse attributes to find
+	/// openings, materials, decompositions and the products of representations
+	void set_relationship_index(const boost::shared_ptr<const RelationshipIndex>& i) { relationship_index = i; }
+	const boost::shared_ptr<const RelationshipIndex>& get_relationship_index() const { return relationship_index; }
+
+	/// Reads the styles of representation items from the table rather than
+	/// from the styled items referring to them
+	void set_style_table(const boost::shared_ptr<const StyleTable>& t) { style_table = t; }
+	const boost::shared_ptr<const StyleTable>& get_style_table() const { return style_table; }
+
+	/// Limits the time spent on conversions, starting now, to the amount of
+	/// seconds specified, or removes the limit if not positive. When the time
+	/// is exceeded, boolean operations and sewing are interrupted and further
+	/// items and openings are skipped, so that results are incomplete and are
+	/// to be discarded, see time_budget_exceeded().
+	void set_time_budget(double seconds);
+	bool has_time_budget() const { return !deadline.is_not_a_date_time(); }
+	bool time_budget_exceeded() const;
+
+	/// Number of threads used to subtract openings from the shapes of a product
+	/// by convert_openings_fast()
+	void set_boolean_threads(int n) { boolean_threads = n; }
+	int get_boolean_threads() const { return boolean_threads; }
+	void set_parallel_booleans(bool b) { parallel_booleans = b; }
+	bool get_parallel_booleans() const { return parallel_booleans; }
+
+	/// Converts tessellated items in representations to meshes that are copied
+	/// into a triangulation as is, rather than to shapes that are triangulated
+	/// again. Only to be used if no boundary representation is requested.
+	void set_mesh_passthrough(bool b) { mesh_passthrough = b; }
+	bool get_mesh_passthrough() const { return mesh_passthrough; }
+	/// Whether items with curved geometry, which is discretized by the
+	/// deflection tolerance, are converted to meshes as well. Disabled when
+	/// the shapes are triangulated at other tolerances too, e.g. for levels
+	/// of detail, in which case only items with exact meshes are passed on.
+	void set_approximate_mesh_passthrough(bool b) { approximate_mesh_passthrough = b; }
+	bool get_approximate_mesh_passthrough() const { return approximate_mesh_passthrough; }
+
+#ifdef USE_IFC4
+	/// Reads the points and polygons of a tessellated face set in the units of
+	/// the kernel. Polygons are triangulated unless any cannot be triangulated.
+	bool convert_tessellated(const IfcSchema::IfcTessellatedFaceSet*, TessellatedMesh&);
+#endif
+
+	/// Creates a face for every polygon of the mesh, sewn into a solid if possible
+	bool convert_mesh(const TessellatedMesh&, TopoDS_Shape&, const IfcUtil::IfcBaseClass* item = 0);
+
+	/// Creates a triangulated mesh for the item, if it is of a type that can be
+	/// triangulated directly rather than by means of a shape
+	bool tessellate(const IfcSchema::IfcRepresentationItem*, TessellatedMesh&);
+	/// Extrusions of planar profiles without inner boundaries are triangulated
+	/// directly. Curved profile edges are discretized by the deflection tolerance,
+	/// unless approximate mesh passthrough is disabled.
+	bool tessellate(const IfcSchema::IfcExtrudedAreaSolid*, TessellatedMesh&);
+	/// Faceted breps of which all face bounds are polygons are triangulated
+	/// directly, as they do not need to be sewn if no booleans are applied.
+	bool tessellate(const IfcSchema::IfcFacetedBrep*, TessellatedMesh&);
+
+#ifndef NO_CACHE
+	/// Uses a cache that is shared with other kernels instead of the kernel's own cache
+	void set_shared_cache(const boost::shared_ptr<SharedCache>& c) { shared_cache = c; }
+	const boost::shared_ptr<SharedCache>& get_shared_cache() const { return shared_cache; }
+#endif
+
+	/// Identifies the settings that affect conversion results, used as part of
+	/// the key in a shared cache
+	std::size_t settings_fingerprint() const;
+
+	/// Identifies the shape of a representation item by its definition, so
+	/// that the shape is created once for items that are equal but are not
+	/// instantiated by means of an IfcMappedItem. For extruded and revolved
+	/// area solids, whose conversion applies Position last, the Position is
+	/// excluded and returned as the placement instead. Returns zero for items
+	/// whose shapes are not to be reused.
+	IfcParse::ContentHash::value_type deduplication_key(const IfcUtil::IfcBaseClass*, gp_Trsf& placement);
+
+	/// Identifies the result of subtracting openings from the shapes of a
+	/// representation of a product by the definitions of the representation
+	/// and the openings, and the placements of the openings relative to the
+	/// product, so that the subtraction is performed once for products that
+	/// only differ in their placement. Returns zero if no key can be formed.
+	IfcParse::ContentHash::value_type subtraction_key(const IteratorSettings&, IfcSchema::IfcRepresentation*, const IfcSchema::IfcRelVoidsElement::list::ptr& openings, const gp_Trsf& product_trsf);
 
 #include "IfcRegisterGeomHeader.h"
 
@@ -0,0 +1,285 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+
+#include <cstring>
+#include <vector>
+
+#include <gp_Pnt.hxx>
+#include <gp_Dir.hxx>
+#include <gp_Vec.hxx>
+#include <gp_Trsf.hxx>
+#include <gp_GTrsf.hxx>
+#include <Bnd_Box.hxx>
+#include <BRepBndLib.hxx>
+#include <TopExp_Explorer.hxx>
+#include <Standard_Failure.hxx>
+
+#include "../ifcparse/IfcFile.h"
+
+#include "IfcGeom.h"
+
+namespace {
+	void add_point(Bnd_Box& box, const gp_GTrsf& placement, gp_XYZ p) {
+		placement.Transforms(p);
+		box.Add(gp_Pnt(p));
+	}
+
+	// Adds the corners of b, transformed by the placement, to the box
+	void add_box(Bnd_Box& box, const gp_GTrsf& placement, const Bnd_Box& b) {
+		if (b.IsVoid()) {
+			return;
+		}
+		double xyz[6];
+		b.Get(xyz[0], xyz[1], xyz[2], xyz[3], xyz[4], xyz[5]);
+		for (int i = 0; i < 8; ++i) {
+			add_point(box, placement, gp_XYZ(xyz[(i & 1) ? 3 : 0], xyz[(i & 2) ? 4 : 1], xyz[(i & 4) ? 5 : 2]));
+		}
+	}
+
+	// Bounds of a shape by the geometry of its edges, without triangulation
+	void add_shape(Bnd_Box& box, const gp_GTrsf& placement, const TopoDS_Shape& shape) {
+		Bnd_Box b;
+		TopExp_Explorer exp(shape, TopAbs_EDGE);
+		for (; exp.More(); exp.Next()) {
+			BRepBndLib::Add(exp.Current(), b);
+		}
+		if (b.IsVoid()) {
+			BRepBndLib::Add(shape, b);
+		}
+		// The gap is the tolerance of the edges, which is not part of the bounds
+		b.SetGap(0.);
+		add_box(box, placement, b);
+	}
+
+	// The profile is bounded by its edges and swept along the extrusion
+	// direction, so that the bounds are exact for profiles aligned with the
+	// axes of the position
+	bool extrusion_bounding_box(IfcGeom::Kernel& kernel, const IfcSchema::IfcExtrudedAreaSolid* l, const gp_GTrsf& placement, Bnd_Box& box) {
+		TopoDS_Shape face;
+		if (!kernel.convert_face(l->SweptArea(), face)) {
+			return false;
+		}
+
+		Bnd_Box profile;
+		add_shape(profile, gp_GTrsf(), face);
+		if (profile.IsVoid()) {
+			return false;
+		}
+
+		gp_Trsf position;
+		bool has_position = true;
+#ifdef USE_IFC4
+		has_position = l->hasPosition();
+#endif
+		if (has_position) {
+			kernel.convert(l->Position(), position);
+		}
+
+		gp_Dir dir;
+		kernel.convert(l->ExtrudedDirection(), dir);
+		const gp_XYZ extrusion = dir.XYZ() * l->Depth() * kernel.getValue(IfcGeom::Kernel::GV_LENGTH_UNIT);
+
+		gp_GTrsf swept_placement = placement;
+		swept_placement.Multiply(gp_GTrsf(position));
+
+		double xyz[6];
+		profile.Get(xyz[0], xyz[1], xyz[2], xyz[3], xyz[4], xyz[5]);
+		for (int i = 0; i < 8; ++i) {
+			const gp_XYZ p(xyz[(i & 1) ? 3 : 0], xyz[(i & 2) ? 4 : 1], xyz[(i & 4) ? 5 : 2]);
+			add_point(box, swept_placement, p);
+			add_point(box, swept_placement, p + extrusion);
+		}
+
+		return true;
+	}
+
+	// Bounds of breps and surface models of which all faces are bounded by
+	// poly loops, returns false for any other kind of face bound
+	bool faceted_bounding_box(IfcGeom::Kernel& kernel, IfcParse::Traversal& traversal, const IfcSchema::IfcRepresentationItem* l, const gp_GTrsf& placement, Bnd_Box& box) {
+		IfcSchema::IfcFaceBound::list::ptr bounds = traversal(const_cast<IfcSchema::IfcRepresentationItem*>(l))->as<IfcSchema::IfcFaceBound>();
+		if (bounds->size() == 0) {
+			return false;
+		}
+
+		Bnd_Box b;
+		for (IfcSchema::IfcFaceBound::list::it it = bounds->begin(); it != bounds->end(); ++it) {
+			IfcSchema::IfcLoop* loop = (*it)->Bound();
+			if (!loop->is(IfcSchema::Type::IfcPolyLoop)) {
+				return false;
+			}
+			IfcSchema::IfcCartesianPoint::list::ptr points = loop->as<IfcSchema::IfcPolyLoop>()->Polygon();
+			for (IfcSchema::IfcCartesianPoint::list::it jt = points->begin(); jt != points->end(); ++jt) {
+				gp_Pnt p;
+				kernel.convert(*jt, p);
+				add_point(b, placement, p.XYZ());
+			}
+		}
+
+		box.Add(b);
+		return true;
+	}
+
+	// Bounds of the points referenced by an item, without taking into account
+	// placements within the item, e.g. the Position of a swept solid
+	bool points_bounding_box(IfcGeom::Kernel& kernel, IfcParse::Traversal& traversal, const IfcSchema::IfcRepresentationItem* l, const gp_GTrsf& placement, Bnd_Box& box) {
+		IfcEntityList::ptr instances = traversal(const_cast<IfcSchema::IfcRepresentationItem*>(l));
+		bool bounded = false;
+
+		IfcSchema::IfcCartesianPoint::list::ptr points = instances->as<IfcSchema::IfcCartesianPoint>();
+		for (IfcSchema::IfcCartesianPoint::list::it it = points->begin(); it != points->end(); ++it) {
+			gp_Pnt p;
+			kernel.convert(*it, p);
+			add_point(box, placement, p.XYZ());
+			bounded = true;
+		}
+
+#ifdef USE_IFC4
+		const double unit = kernel.getValue(IfcGeom::Kernel::GV_LENGTH_UNIT);
+		IfcSchema::IfcCartesianPointList3D::list::ptr point_lists = instances->as<IfcSchema::IfcCartesianPointList3D>();
+		for (IfcSchema::IfcCartesianPointList3D::list::it it = point_lists->begin(); it != point_lists->end(); ++it) {
+			const std::vector< std::vector<double> > coordinates = (*it)->CoordList();
+			for (std::vector< std::vector<double> >::const_iterator jt = coordinates.begin(); jt != coordinates.end(); ++jt) {
+				const std::vector<double>& coords = *jt;
+				add_point(box, placement, gp_XYZ(
+					coords.size() < 1 ? 0. : coords[0] * unit,
+					coords.size() < 2 ? 0. : coords[1] * unit,
+					coords.size() < 3 ? 0. : coords[2] * unit));
+				bounded = true;
+			}
+		}
+#endif
+
+		return bounded;
+	}
+
+#ifdef USE_IFC4
+	void tessellated_bounding_box(IfcGeom::Kernel& kernel, const IfcSchema::IfcTessellatedFaceSet* l, const gp_GTrsf& placement, Bnd_Box& box) {
+		const double unit = kernel.getValue(IfcGeom::Kernel::GV_LENGTH_UNIT);
+		const std::vector< std::vector<double> > coordinates = l->Coordinates()->CoordList();
+		for (std::vector< std::vector<double> >::const_iterator it = coordinates.begin(); it != coordinates.end(); ++it) {
+			const std::vector<double>& coords = *it;
+			add_point(box, placement, gp_XYZ(
+				coords.size() < 1 ? 0. : coords[0] * unit,
+				coords.size() < 2 ? 0. : coords[1] * unit,
+				coords.size() < 3 ? 0. : coords[2] * unit));
+		}
+	}
+#endif
+}
+
+bool IfcGeom::Kernel::bounding_box(const IfcSchema::IfcRepresentation* l, const gp_GTrsf& placement, Bnd_Box& box, bool convert) {
+	bool bounded = false;
+	IfcSchema::IfcRepresentationItem::list::ptr items = l->Items();
+	for (IfcSchema::IfcRepresentationItem::list::it it = items->begin(); it != items->end(); ++it) {
+		if (bounding_box(*it, placement, box, convert)) {
+			bounded = true;
+		}
+	}
+	return bounded;
+}
+
+bool IfcGeom::Kernel::bounding_box(const IfcSchema::IfcRepresentationItem* l, const gp_GTrsf& placement, Bnd_Box& box, bool convert) {
+	try {
+		// Tapered extrusions are a subtype in IFC4
+		if (l->type() == IfcSchema::Type::IfcExtrudedAreaSolid) {
+			return extrusion_bounding_box(*this, l->as<IfcSchema::IfcExtrudedAreaSolid>(), placement, box);
+		}
+
+#ifdef USE_IFC4
+		if (l->is(IfcSchema::Type::IfcTessellatedFaceSet)) {
+			tessellated_bounding_box(*this, l->as<IfcSchema::IfcTessellatedFaceSet>(), placement, box);
+			return true;
+		}
+#endif
+
+		if (l->is(IfcSchema::Type::IfcManifoldSolidBrep) ||
+			l->is(IfcSchema::Type::IfcShellBasedSurfaceModel) ||
+			l->is(IfcSchema::Type::IfcFaceBasedSurfaceModel))
+		{
+			if (faceted_bounding_box(*this, item_traversal, l, placement, box)) {
+				return true;
+			}
+		}
+
+		if (l->is(IfcSchema::Type::IfcMappedItem)) {
+			const IfcSchema::IfcMappedItem* mapped_item = l->as<IfcSchema::IfcMappedItem>();
+			gp_GTrsf mapped_placement;
+			if (!convert_mapped_item_placement(mapped_item, mapped_placement)) {
+				return false;
+			}
+			mapped_placement.PreMultiply(placement);
+			return bounding_box(mapped_item->MappingSource()->MappedRepresentation(), mapped_placement, box, convert);
+		}
+
+		if (l->is(IfcSchema::Type::IfcBooleanResult)) {
+			// The result of a difference or intersection is contained in the
+			// first operand, that of a union in both
+			const IfcSchema::IfcBooleanResult* boolean_result = l->as<IfcSchema::IfcBooleanResult>();
+			const bool first = bounding_box(boolean_result->FirstOperand()->as<IfcSchema::IfcRepresentationItem>(), placement, box, convert);
+			if (boolean_result->Operator() == IfcSchema::IfcBooleanOperator::IfcBooleanOperator_UNION) {
+				const bool second = bounding_box(boolean_result->SecondOperand()->as<IfcSchema::IfcRepresentationItem>(), placement, box, convert);
+				return first || second;
+			}
+			return first;
+		}
+
+		if (l->is(IfcSchema::Type::IfcCsgSolid)) {
+			return bounding_box(l->as<IfcSchema::IfcCsgSolid>()->TreeRootExpression()->as<IfcSchema::IfcRepresentationItem>(), placement, box, convert);
+		}
+
+		if (l->is(IfcSchema::Type::IfcBoundingBox)) {
+			const IfcSchema::IfcBoundingBox* bbox = l->as<IfcSchema::IfcBoundingBox>();
+			const double unit = getValue(GV_LENGTH_UNIT);
+			gp_Pnt corner;
+			convert(bbox->Corner(), corner);
+			Bnd_Box b;
+			b.Add(corner);
+			b.Add(corner.Translated(gp_Vec(bbox->XDim() * unit, bbox->YDim() * unit, bbox->ZDim() * unit)));
+			add_box(box, placement, b);
+			return true;
+		}
+
+		if (!convert) {
+			return points_bounding_box(*this, item_traversal, l, placement, box);
+		}
+
+		// Other items are converted, which does not involve boolean operations
+		// for the kinds of items that are commonly used
+		IfcRepresentationShapeItems shapes;
+		if (!convert_shapes(l, shapes)) {
+			return false;
+		}
+		for (IfcRepresentationShapeItems::const_iterator it = shapes.begin(); it != shapes.end(); ++it) {
+			gp_GTrsf shape_placement = it->Placement();
+			shape_placement.PreMultiply(placement);
+			add_shape(box, shape_placement, it->Shape());
+		}
+		return !shapes.empty();
+	} catch (const std::exception& e) {
+		Logger::Error(e);
+	} catch (const Standard_Failure& f) {
+		if (f.GetMessageString() && strlen(f.GetMessageString())) {
+			Logger::Error(f.GetMessageString());
+		} else {
+			Logger::Error("Unknown error computing bounding box");
+		}
+	}
+	return false;
+}
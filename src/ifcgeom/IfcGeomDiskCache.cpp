@@ -0,0 +1,678 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <boost/interprocess/exceptions.hpp>
+
+#include <Standard_Version.hxx>
+#include <BinTools.hxx>
+#include <BRep_Builder.hxx>
+#include <TopoDS_Compound.hxx>
+#include <TopoDS_Iterator.hxx>
+#include <gp_Mat.hxx>
+
+#include "../ifcparse/IfcFile.h"
+
+#include "IfcGeom.h"
+#include "IfcGeomDiskCache.h"
+
+namespace {
+	// Part of every key, to be incremented when the serialization of shapes or
+	// the way conversion results are derived from their inputs changes
+	const char* const DISK_CACHE_FORMAT = "2";
+
+	const char DISK_CACHE_MAGIC[8] = { 'I', 'f', 'c', 'G', 'e', 'o', 'm', '1' };
+	const std::size_t DISK_CACHE_HEADER_SIZE = sizeof(DISK_CACHE_MAGIC) + 3 * 8;
+
+	// Temporary files older than this are left behind by processes that
+	// terminated while writing an entry
+	const std::time_t STALE_TEMPORARY_FILE_AGE = 3600;
+
+	// Integers are stored little endian, doubles by their IEEE 754 representation
+	void write_uint64(std::string& s, boost::uint64_t v) {
+		for (int i = 0; i < 8; ++i) {
+			s.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+		}
+	}
+
+	bool read_uint64(const std::string& s, std::size_t& pos, boost::uint64_t& v) {
+		if (pos + 8 > s.size()) return false;
+		v = 0;
+		for (int i = 0; i < 8; ++i) {
+			v |= static_cast<boost::uint64_t>(static_cast<unsigned char>(s[pos++])) << (8 * i);
+		}
+		return true;
+	}
+
+	void write_double(std::string& s, double d) {
+		boost::uint64_t v;
+		std::memcpy(&v, &d, sizeof(v));
+		write_uint64(s, v);
+	}
+
+	bool read_double(const std::string& s, std::size_t& pos, double& d) {
+		boost::uint64_t v;
+		if (!read_uint64(s, pos, v)) return false;
+		std::memcpy(&d, &v, sizeof(d));
+		return true;
+	}
+
+	void write_int32(std::string& s, int v) {
+		const boost::uint32_t u = static_cast<boost::uint32_t>(v);
+		for (int i = 0; i < 4; ++i) {
+			s.push_back(static_cast<char>((u >> (8 * i)) & 0xff));
+		}
+	}
+
+	bool read_int32(const std::string& s, std::size_t& pos, int& v) {
+		if (pos + 4 > s.size()) return false;
+		boost::uint32_t u = 0;
+		for (int i = 0; i < 4; ++i) {
+			u |= static_cast<boost::uint32_t>(static_cast<unsigned char>(s[pos++])) << (8 * i);
+		}
+		v = static_cast<int>(u);
+		return true;
+	}
+
+	// Reads the number of elements of a sequence, which needs to fit in the
+	// remaining data, so that corrupt entries do not cause huge allocations
+	bool read_count(const std::string& s, std::size_t& pos, std::size_t element_size, std::size_t& n) {
+		boost::uint64_t v;
+		if (!read_uint64(s, pos, v)) return false;
+		if (v > (s.size() - pos) / element_size) return false;
+		n = static_cast<std::size_t>(v);
+		return true;
+	}
+
+	void write_xyzs(std::string& s, const std::vector<gp_XYZ>& xyzs) {
+		write_uint64(s, xyzs.size());
+		for (std::vector<gp_XYZ>::const_iterator it = xyzs.begin(); it != xyzs.end(); ++it) {
+			write_double(s, it->X());
+			write_double(s, it->Y());
+			write_double(s, it->Z());
+		}
+	}
+
+	bool read_xyzs(const std::string& s, std::size_t& pos, std::vector<gp_XYZ>& xyzs) {
+		std::size_t n;
+		if (!read_count(s, pos, 24, n)) return false;
+		xyzs.resize(n);
+		for (std::size_t i = 0; i < n; ++i) {
+			double x, y, z;
+			if (!read_double(s, pos, x) || !read_double(s, pos, y) || !read_double(s, pos, z)) return false;
+			xyzs[i].SetCoord(x, y, z);
+		}
+		return true;
+	}
+
+	void write_ints(std::string& s, const std::vector<int>& ints) {
+		write_uint64(s, ints.size());
+		for (std::vector<int>::const_iterator it = ints.begin(); it != ints.end(); ++it) {
+			write_int32(s, *it);
+		}
+	}
+
+	// Values are required to be in [0, upper)
+	bool read_ints(const std::string& s, std::size_t& pos, int upper, std::vector<int>& ints) {
+		std::size_t n;
+		if (!read_count(s, pos, 4, n)) return false;
+		ints.resize(n);
+		for (std::size_t i = 0; i < n; ++i) {
+			if (!read_int32(s, pos, ints[i]) || ints[i] < 0 || ints[i] >= upper) return false;
+		}
+		return true;
+	}
+
+	void write_mesh(std::string& s, const IfcGeom::TessellatedMesh& mesh) {
+		write_xyzs(s, mesh.points);
+		write_xyzs(s, mesh.normals);
+		write_uint64(s, mesh.faces.size());
+		for (std::vector<IfcGeom::TessellatedMesh::Face>::const_iterator it = mesh.faces.begin(); it != mesh.faces.end(); ++it) {
+			write_uint64(s, it->size());
+			for (IfcGeom::TessellatedMesh::Face::const_iterator jt = it->begin(); jt != it->end(); ++jt) {
+				write_ints(s, *jt);
+			}
+		}
+		write_ints(s, mesh.triangles);
+		write_ints(s, mesh.face_offsets);
+	}
+
+	bool read_mesh(const std::string& s, std::size_t& pos, IfcGeom::TessellatedMesh& mesh) {
+		if (!read_xyzs(s, pos, mesh.points) || !read_xyzs(s, pos, mesh.normals)) return false;
+		if (!mesh.normals.empty() && mesh.normals.size() != mesh.points.size()) return false;
+		const int num_points = static_cast<int>(mesh.points.size());
+		std::size_t num_faces;
+		if (!read_count(s, pos, 8, num_faces)) return false;
+		mesh.faces.resize(num_faces);
+		for (std::size_t i = 0; i < num_faces; ++i) {
+			std::size_t num_loops;
+			if (!read_count(s, pos, 8, num_loops) || num_loops == 0) return false;
+			mesh.faces[i].resize(num_loops);
+			for (std::size_t j = 0; j < num_loops; ++j) {
+				if (!read_ints(s, pos, num_points, mesh.faces[i][j])) return false;
+			}
+		}
+		if (!read_ints(s, pos, num_points, mesh.triangles)) return false;
+		if (!read_ints(s, pos, static_cast<int>(mesh.triangles.size()) + 1, mesh.face_offsets)) return false;
+		return mesh.face_offsets.empty() || mesh.is_triangulated();
+	}
+
+	IfcParse::ContentHash::value_type hash_double(double d) {
+		boost::uint64_t v;
+		std::memcpy(&v, &d, sizeof(v));
+		return v;
+	}
+
+	// Forms in which an item placement is stored
+	enum placement_form { PLACEMENT_IDENTITY, PLACEMENT_TRSF, PLACEMENT_GTRSF };
+
+	// Items are either stored as part of the compound of shapes that follows
+	// the items, or by their mesh, see Kernel::set_mesh_passthrough()
+	enum item_kind { ITEM_SHAPE, ITEM_MESH };
+
+	struct cache_file {
+		boost::filesystem::path path;
+		std::time_t last_used;
+		boost::uint64_t size;
+		bool operator<(const cache_file& other) const { return last_used < other.last_used; }
+	};
+}
+
+IfcGeom::DiskCache::DiskCache(const std::string& directory, boost::uint64_t max_size)
+	: directory_(directory)
+	, max_size_(max_size)
+	, size_(0)
+	, hits_(0)
+	, misses_(0)
+	, writes_(0)
+{
+	boost::system::error_code ec;
+	boost::filesystem::create_directories(directory_, ec);
+	if (ec) {
+		Logger::Error("Failed to create cache directory " + directory + ": " + ec.message());
+	}
+	trim();
+}
+
+boost::filesystem::path IfcGeom::DiskCache::path_(key_type key) const {
+	static const char* const hex = "0123456789abcdef";
+	std::string name(16, '0');
+	for (int i = 15; i >= 0; --i) {
+		name[i] = hex[key & 0xf];
+		key >>= 4;
+	}
+	// Entries are distributed over subdirectories to keep directories small
+	return directory_ / name.substr(0, 2) / (name + ".geom");
+}
+
+bool IfcGeom::DiskCache::read(key_type key, std::string& data) {
+	const boost::filesystem::path p = path_(key);
+	bool valid = false;
+	bool exists = false;
+	{
+		std::ifstream ifs(p.string().c_str(), std::ios::binary);
+		if (ifs) {
+			exists = true;
+			std::string header(DISK_CACHE_HEADER_SIZE, '\0');
+			ifs.read(&header[0], header.size());
+			std::size_t pos = sizeof(DISK_CACHE_MAGIC);
+			boost::uint64_t stored_key, length, checksum;
+			if (ifs &&
+				std::memcmp(header.data(), DISK_CACHE_MAGIC, sizeof(DISK_CACHE_MAGIC)) == 0 &&
+				read_uint64(header, pos, stored_key) &&
+				read_uint64(header, pos, length) &&
+				read_uint64(header, pos, checksum) &&
+				stored_key == key)
+			{
+				data.resize(static_cast<std::size_t>(length));
+				if (length) {
+					ifs.read(&data[0], data.size());
+				}
+				valid = ifs && IfcParse::ContentHash::hash(data) == checksum;
+			}
+		}
+	}
+
+	boost::system::error_code ec;
+	if (valid) {
+		// The modification time is used to determine the least recently used entries
+		boost::filesystem::last_write_time(p, std::time(0), ec);
+	} else if (exists) {
+		Logger::Warning("Removing invalid cache entry " + p.string());
+		boost::filesystem::remove(p, ec);
+	}
+
+	boost::mutex::scoped_lock lock(mutex_);
+	++(valid ? hits_ : misses_);
+	return valid;
+}
+
+void IfcGeom::DiskCache::write(key_type key, const std::string& data) {
+	const boost::filesystem::path p = path_(key);
+	boost::system::error_code ec;
+	boost::filesystem::create_directories(p.parent_path(), ec);
+
+	const boost::filesystem::path temporary = p.parent_path() / boost::filesystem::unique_path("%%%%%%%%%%%%%%%%.tmp", ec);
+	if (ec) {
+		return;
+	}
+
+	std::string header(DISK_CACHE_MAGIC, sizeof(DISK_CACHE_MAGIC));
+	write_uint64(header, key);
+	write_uint64(header, data.size());
+	write_uint64(header, IfcParse::ContentHash::hash(data));
+
+	bool written;
+	{
+		std::ofstream ofs(temporary.string().c_str(), std::ios::binary);
+		ofs.write(header.data(), header.size());
+		ofs.write(data.data(), data.size());
+		ofs.close();
+		written = !ofs.fail();
+	}
+
+	// Renaming replaces an entry for the same key written concurrently
+	// by another process, which has the same contents.
+	if (written) {
+		boost::filesystem::rename(temporary, p, ec);
+	}
+	if (!written || ec) {
+		boost::filesystem::remove(temporary, ec);
+		return;
+	}
+
+	bool exceeded;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		++writes_;
+		size_ += header.size() + data.size();
+		exceeded = size_ > max_size_;
+	}
+
+	if (exceeded) {
+		trim();
+	}
+}
+
+void IfcGeom::DiskCache::trim() {
+	boost::mutex::scoped_try_lock trim_lock(trim_mutex_);
+	if (!trim_lock.owns_lock()) {
+		return;
+	}
+
+	const boost::filesystem::path lock_path = directory_ / "lock";
+	{
+		std::ofstream touch(lock_path.string().c_str(), std::ios::app);
+	}
+
+	boost::uint64_t total = 0;
+
+	try {
+		boost::interprocess::file_lock file_lock(lock_path.string().c_str());
+		if (!file_lock.try_lock()) {
+			return;
+		}
+
+		std::vector<cache_file> files;
+		const std::time_t now = std::time(0);
+
+		boost::system::error_code ec;
+		for (boost::filesystem::recursive_directory_iterator it(directory_, ec), end; !ec && it != end; it.increment(ec)) {
+			if (!boost::filesystem::is_regular_file(it->status())) continue;
+			const boost::filesystem::path& p = it->path();
+			const std::string extension = p.extension().string();
+			if (extension != ".geom" && extension != ".tmp") continue;
+
+			boost::system::error_code file_ec;
+			cache_file f;
+			f.path = p;
+			f.last_used = boost::filesystem::last_write_time(p, file_ec);
+			f.size = boost::filesystem::file_size(p, file_ec);
+			if (file_ec) continue;
+
+			if (extension == ".tmp") {
+				if (now - f.last_used > STALE_TEMPORARY_FILE_AGE) {
+					boost::filesystem::remove(p, file_ec);
+				}
+				continue;
+			}
+
+			files.push_back(f);
+			total += f.size;
+		}
+
+		if (total > max_size_) {
+			// Some headroom is created so that the directory is not scanned on every write
+			const boost::uint64_t target = max_size_ - max_size_ / 8;
+			std::sort(files.begin(), files.end());
+			for (std::vector<cache_file>::const_iterator it = files.begin(); it != files.end() && total > target; ++it) {
+				boost::system::error_code remove_ec;
+				boost::filesystem::remove(it->path, remove_ec);
+				if (!remove_ec) {
+					total -= it->size;
+				}
+			}
+		}
+
+		file_lock.unlock();
+	} catch (const boost::interprocess::interprocess_exception& e) {
+		Logger::Error(e);
+		return;
+	}
+
+	boost::mutex::scoped_lock lock(mutex_);
+	size_ = total;
+}
+
+std::size_t IfcGeom::DiskCache::hits() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return hits_;
+}
+
+std::size_t IfcGeom::DiskCache::misses() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return misses_;
+}
+
+std::size_t IfcGeom::DiskCache::writes() {
+	boost::mutex::scoped_lock lock(mutex_);
+	return writes_;
+}
+
+IfcParse::ContentHash::value_type IfcGeom::Kernel::content_key(const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product) {
+	typedef IfcParse::ContentHash hash;
+
+	if (settings.get(IteratorSettings::APPLY_LAYERSETS) && product->is(IfcSchema::Type::IfcWall)) {
+		// Layers are folded at the connections with other walls, which are not
+		// part of the key
+		IfcSchema::IfcWall* wall = product->as<IfcSchema::IfcWall>();
+		if (wall->ConnectedFrom()->size() || wall->ConnectedTo()->size()) {
+			return 0;
+		}
+	}
+
+	std::stringstream format;
+	format << IFCOPENSHELL_VERSION << "-" << IfcSchema::Identifier << "-" << std::hex << OCC_VERSION_HEX << "-" << DISK_CACHE_FORMAT;
+	hash::value_type key = hash::hash(format.str());
+
+	for (int i = 0; i <= IteratorSettings::NUM_SETTINGS; ++i) {
+		hash::combine(key, settings.get(1 << i) ? 1 : 0);
+	}
+	hash::combine(key, hash_double(settings.deflection_tolerance()));
+
+	const double values[] = {
+		deflection_tolerance, wire_creation_tolerance, point_equality_tolerance, max_faces_to_sew,
+		ifc_length_unit, ifc_planeangle_unit, modelling_precision, dimensionality, boolean_fuzziness
+	};
+	for (std::size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+		hash::combine(key, hash_double(values[i]));
+	}
+	hash::combine(key, static_cast<hash::value_type>(placement_rel_to));
+	hash::combine(key, approximate_mesh_passthrough ? 1 : 0);
+
+	hash::combine(key, content_hash(representation));
+
+	// Styles are assigned to representation items by means of inverse
+	// relationships, which are not part of the content hash
+	IfcEntityList::ptr instances = styled_item_traversal(representation);
+	for (IfcEntityList::it it = instances->begin(); it != instances->end(); ++it) {
+		IfcSchema::IfcRepresentationItem* item = (*it)->as<IfcSchema::IfcRepresentationItem>();
+		if (item) {
+			IfcSchema::IfcStyledItem::list::ptr styled_items = relationship_index ? relationship_index->styled_items(item) : item->StyledByItem();
+			for (IfcSchema::IfcStyledItem::list::it jt = styled_items->begin(); jt != styled_items->end(); ++jt) {
+				hash::combine(key, content_hash(*jt));
+			}
+		}
+	}
+
+	// Materials determine layer sets and the style of items without a style
+	IfcSchema::IfcRelAssociatesMaterial::list::ptr associations = get_material_associations(product);
+	for (IfcSchema::IfcRelAssociatesMaterial::list::it it = associations->begin(); it != associations->end(); ++it) {
+		IfcUtil::IfcBaseClass* relating_material = (*it)->RelatingMaterial();
+		hash::combine(key, content_hash(relating_material));
+		IfcSchema::IfcMaterial::list::ptr materials = IfcParse::traverse(relating_material)->as<IfcSchema::IfcMaterial>();
+		for (IfcSchema::IfcMaterial::list::it jt = materials->begin(); jt != materials->end(); ++jt) {
+			IfcSchema::IfcMaterialDefinitionRepresentation::list::ptr defs = (*jt)->HasRepresentation();
+			for (IfcSchema::IfcMaterialDefinitionRepresentation::list::it kt = defs->begin(); kt != defs->end(); ++kt) {
+				hash::combine(key, content_hash(*kt));
+			}
+		}
+	}
+
+	IfcSchema::IfcRelVoidsElement::list::ptr openings(new IfcSchema::IfcRelVoidsElement::list);
+	if (!settings.get(IteratorSettings::DISABLE_OPENING_SUBTRACTIONS)) {
+		openings = find_openings(product);
+	}
+
+	// The placement of the product is only applied to the shapes in world
+	// coordinates and when relating openings to the product.
+	if ((settings.get(IteratorSettings::USE_WORLD_COORDS) || openings->size()) && product->hasObjectPlacement()) {
+		hash::combine(key, content_hash(product->ObjectPlacement()));
+	}
+
+	for (IfcSchema::IfcRelVoidsElement::list::it it = openings->begin(); it != openings->end(); ++it) {
+		IfcSchema::IfcFeatureElementSubtraction* opening = (*it)->RelatedOpeningElement();
+		if (opening->hasObjectPlacement()) {
+			hash::combine(key, content_hash(opening->ObjectPlacement()));
+		}
+		if (opening->hasRepresentation()) {
+			hash::combine(key, content_hash(opening->Representation()));
+		}
+	}
+
+	// Zero is reserved for results that cannot be cached
+	return key == 0 ? 1 : key;
+}
+
+bool IfcGeom::Kernel::write_shapes(IfcParse::IfcFile* file, const IfcGeom::IfcRepresentationShapeItems& shapes, int derivation, std::string& data) {
+	typedef IfcParse::ContentHash hash;
+
+	data.clear();
+	write_uint64(data, static_cast<boost::uint64_t>(derivation));
+	write_uint64(data, shapes.size());
+
+	BRep_Builder builder;
+	TopoDS_Compound compound;
+	builder.MakeCompound(compound);
+
+	for (IfcRepresentationShapeItems::const_iterator it = shapes.begin(); it != shapes.end(); ++it) {
+		const gp_GTrsf& placement = it->Placement();
+		if (placement.Form() == gp_Identity) {
+			data.push_back(PLACEMENT_IDENTITY);
+		} else {
+			data.push_back(placement.Form() == gp_Other ? PLACEMENT_GTRSF : PLACEMENT_TRSF);
+			for (int i = 1; i < 4; ++i) {
+				for (int j = 1; j < 5; ++j) {
+					write_double(data, placement.Value(i, j));
+				}
+			}
+		}
+
+		hash::value_type style = 0;
+		if (it->hasStyle()) {
+			// Styles are stored by the content of the IfcSurfaceStyle or
+			// IfcMaterial they are created from, default styles are not stored.
+			const boost::optional<int>& id = it->Style().Id();
+			if (!id) {
+				return false;
+			}
+			IfcUtil::IfcBaseClass* definition;
+			try {
+				definition = file->entityById(*id);
+			} catch (const IfcParse::IfcException&) {
+				return false;
+			}
+			style = content_hash(definition);
+		}
+		write_uint64(data, style);
+
+		if (it->hasMesh()) {
+			data.push_back(ITEM_MESH);
+			write_mesh(data, it->Mesh());
+		} else {
+			data.push_back(ITEM_SHAPE);
+			builder.Add(compound, it->Shape());
+		}
+	}
+
+	std::stringstream stream;
+	try {
+		BinTools::Write(compound, stream);
+	} catch (...) {
+		return false;
+	}
+	data += stream.str();
+
+	return true;
+}
+
+bool IfcGeom::Kernel::read_shapes(IfcParse::IfcFile* file, const std::string& data, IfcRepresentationShapeItems& shapes, int& derivation) {
+	typedef IfcParse::ContentHash hash;
+
+	std::size_t pos = 0;
+	boost::uint64_t stored_derivation, count;
+	if (!read_uint64(data, pos, stored_derivation) || !read_uint64(data, pos, count)) {
+		return false;
+	}
+
+	std::vector<gp_GTrsf> placements;
+	std::vector<const SurfaceStyle*> styles;
+	// Null for the items stored as part of the compound
+	std::vector< boost::shared_ptr<const TessellatedMesh> > meshes;
+
+	for (boost::uint64_t i = 0; i < count; ++i) {
+		if (pos >= data.size()) {
+			return false;
+		}
+		const char form = data[pos++];
+		gp_GTrsf placement;
+		if (form != PLACEMENT_IDENTITY) {
+			double v[12];
+			for (int j = 0; j < 12; ++j) {
+				if (!read_double(data, pos, v[j])) {
+					return false;
+				}
+			}
+			if (form == PLACEMENT_TRSF) {
+				gp_Trsf trsf;
+				trsf.SetValues(
+					v[0], v[1], v[2], v[3],
+					v[4], v[5], v[6], v[7],
+					v[8], v[9], v[10], v[11]
+#if OCC_VERSION_HEX < 0x60800
+					, Precision::Angular(), Precision::Confusion()
+#endif
+				);
+				placement = gp_GTrsf(trsf);
+			} else {
+				placement.SetVectorialPart(gp_Mat(v[0], v[1], v[2], v[4], v[5], v[6], v[8], v[9], v[10]));
+				placement.SetTranslationPart(gp_XYZ(v[3], v[7], v[11]));
+			}
+		}
+		placements.push_back(placement);
+
+		hash::value_type style_hash;
+		if (!read_uint64(data, pos, style_hash)) {
+			return false;
+		}
+
+		const SurfaceStyle* style = 0;
+		if (style_hash) {
+			if (style_definitions_file != file) {
+				style_definitions.clear();
+				IfcSchema::IfcSurfaceStyle::list::ptr surface_styles = file->entitiesByType<IfcSchema::IfcSurfaceStyle>();
+				for (IfcSchema::IfcSurfaceStyle::list::it it = surface_styles->begin(); it != surface_styles->end(); ++it) {
+					style_definitions[content_hash(*it)] = *it;
+				}
+				IfcSchema::IfcMaterial::list::ptr materials = file->entitiesByType<IfcSchema::IfcMaterial>();
+				for (IfcSchema::IfcMaterial::list::it it = materials->begin(); it != materials->end(); ++it) {
+					style_definitions[content_hash(*it)] = *it;
+				}
+				style_definitions_file = file;
+			}
+			std::map<hash::value_type, IfcUtil::IfcBaseClass*>::const_iterator it = style_definitions.find(style_hash);
+			if (it == style_definitions.end()) {
+				return false;
+			}
+			if (it->second->is(IfcSchema::Type::IfcMaterial)) {
+				style = get_style(it->second->as<IfcSchema::IfcMaterial>());
+			} else {
+				style = get_style(it->second->as<IfcSchema::IfcSurfaceStyle>());
+			}
+			if (!style) {
+				return false;
+			}
+		}
+		styles.push_back(style);
+
+		if (pos >= data.size()) {
+			return false;
+		}
+		const char kind = data[pos++];
+		if (kind == ITEM_MESH) {
+			boost::shared_ptr<TessellatedMesh> mesh(new TessellatedMesh);
+			if (!read_mesh(data, pos, *mesh)) {
+				return false;
+			}
+			meshes.push_back(mesh);
+		} else if (kind == ITEM_SHAPE) {
+			meshes.push_back(boost::shared_ptr<const TessellatedMesh>());
+		} else {
+			return false;
+		}
+	}
+
+	TopoDS_Shape compound;
+	try {
+		std::stringstream stream(data.substr(pos));
+		BinTools::Read(compound, stream);
+	} catch (...) {
+		return false;
+	}
+
+	IfcRepresentationShapeItems read;
+	TopoDS_Iterator it(compound);
+	for (std::size_t i = 0; i < placements.size(); ++i) {
+		if (meshes[i]) {
+			read.push_back(IfcRepresentationShapeItem(meshes[i], styles[i]));
+			read.back().prepend(placements[i]);
+		} else {
+			if (!it.More()) {
+				return false;
+			}
+			read.push_back(IfcRepresentationShapeItem(placements[i], it.Value(), styles[i]));
+			it.Next();
+		}
+	}
+	if (it.More()) {
+		return false;
+	}
+
+	shapes.swap(read);
+	derivation = static_cast<int>(stored_derivation);
+	return true;
+}
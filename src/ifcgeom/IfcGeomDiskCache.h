@@ -0,0 +1,78 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#ifndef IFCGEOMDISKCACHE_H
+#define IFCGEOMDISKCACHE_H
+
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "ifc_geom_api.h"
+
+namespace IfcGeom {
+
+	/// A directory of serialized conversion results that persists across runs,
+	/// keyed by the content of the instances the results are derived from, see
+	/// Kernel::content_key(). Entries are written to a temporary file that is
+	/// renamed when complete, so that other threads and processes using the
+	/// same directory never read partially written entries. When the size of
+	/// the directory exceeds the limit, the least recently read or written
+	/// entries are removed by a single process at a time.
+	class IFC_GEOM_API DiskCache {
+	public:
+		typedef boost::uint64_t key_type;
+	private:
+		boost::filesystem::path directory_;
+		boost::uint64_t max_size_;
+
+		boost::mutex mutex_;
+		// Size of the directory as of the last scan, plus the entries written since
+		boost::uint64_t size_;
+		std::size_t hits_, misses_, writes_;
+
+		// Serializes trim() amongst the threads of this process, the lock file
+		// does so amongst processes
+		boost::mutex trim_mutex_;
+
+		boost::filesystem::path path_(key_type key) const;
+
+		DiskCache(const DiskCache&); // N/I
+		DiskCache& operator=(const DiskCache&); // N/I
+	public:
+		DiskCache(const std::string& directory, boost::uint64_t max_size);
+
+		/// Returns false if there is no valid entry for the key
+		bool read(key_type key, std::string& data);
+		void write(key_type key, const std::string& data);
+
+		/// Removes the least recently used entries if the directory exceeds the
+		/// size limit. Does nothing if another process is doing so already.
+		void trim();
+
+		std::size_t hits();
+		std::size_t misses();
+		std::size_t writes();
+	};
+
+}
+
+#endif
@@ -21,8 +21,14 @@
 #define IFCGEOMELEMENT_H
 
 #include <string>
+#include <vector>
 #include <algorithm>
 
+#include <boost/shared_ptr.hpp>
+
+#include <gp_XYZ.hxx>
+#include <gp_Trsf.hxx>
+
 #include "../ifcparse/IfcGlobalId.h"
 
 #include "../ifcgeom/IfcGeomRepresentation.h"
@@ -91,7 +97,7 @@ namespace IfcGeom {
 		std::string _unique_id;
 		Transformation<P> _transformation;
         IfcSchema::IfcProduct* product_;
-		std::vector<const IfcGeom::Element<P>*> _parents;
+		boost::shared_ptr<const std::vector<const IfcGeom::Element<P>*> > _parents;
 	public:
 
 		friend bool operator == (const Element<P> & element1, const Element<P> & element2)
@@ -127,8 +133,15 @@ namespace IfcGeom {
 		const std::string& unique_id() const { return _unique_id; }
 		const Transformation<P>& transformation() const { return _transformation; }
         IfcSchema::IfcProduct* product() const { return product_; }
-		const std::vector<const IfcGeom::Element<P>*> parents() const { return _parents; }
-		void SetParents(std::vector<const IfcGeom::Element<P>*> newparents) { _parents = newparents; }
+		/// The ancestors of the element, outermost first, if requested by means of SEARCH_FLOOR
+		const std::vector<const IfcGeom::Element<P>*>& parents() const {
+			static const std::vector<const IfcGeom::Element<P>*> no_parents;
+			return _parents ? *_parents : no_parents;
+		}
+		/// The ancestors are shared amongst the elements with the same parent
+		const boost::shared_ptr<const std::vector<const IfcGeom::Element<P>*> >& parents_pointer() const { return _parents; }
+		void SetParents(std::vector<const IfcGeom::Element<P>*> newparents) { _parents.reset(new std::vector<const IfcGeom::Element<P>*>(newparents)); }
+		void SetParents(const boost::shared_ptr<const std::vector<const IfcGeom::Element<P>*> >& newparents) { _parents = newparents; }
 
 		Element(const ElementSettings& settings, int id, int parent_id, const std::string& name, const std::string& type,
             const std::string& guid, const std::string& context, const gp_Trsf& trsf, IfcSchema::IfcProduct *product)
@@ -180,18 +193,40 @@ namespace IfcGeom {
 
 	template <typename P>
 	class TriangulationElement : public Element<P> {
+	public:
+		typedef std::vector< boost::shared_ptr< Representation::Triangulation<P> > > lod_pointers_t;
 	private:
 		boost::shared_ptr< Representation::Triangulation<P> > _geometry;
+		// Triangulations of the levels of detail after the first
+		lod_pointers_t _lods;
 	public:
 		const Representation::Triangulation<P>& geometry() const { return *_geometry; }
 		const boost::shared_ptr< Representation::Triangulation<P> >& geometry_pointer() const { return _geometry; }
+
+		/// Number of levels of detail, one plus the number of deflection tolerances
+		/// in IteratorSettings::lod_deflection_tolerances()
+		size_t num_lods() const { return _lods.size() + 1; }
+		/// The triangulation of a level of detail, the first being geometry()
+		const Representation::Triangulation<P>& lod(size_t i) const { return i == 0 ? *_geometry : *_lods[i - 1]; }
+		const lod_pointers_t& lod_pointers() const { return _lods; }
+
+		/// The levels of detail are triangulated from the same shapes. Items
+		/// passed through as meshes are copied into every level as is, which
+		/// is why only exact meshes are passed through when there are levels
+		/// of detail, see Kernel::set_approximate_mesh_passthrough().
 		TriangulationElement(const BRepElement<P>& shape_model)
 			: Element<P>(shape_model)
 			, _geometry(boost::shared_ptr<Representation::Triangulation<P> >(new Representation::Triangulation<P>(shape_model.geometry())))
-		{}
-		TriangulationElement(const Element<P>& element, const boost::shared_ptr<Representation::Triangulation<P> >& geometry)
+		{
+			const std::vector<double>& tolerances = shape_model.geometry().settings().lod_deflection_tolerances();
+			for (std::vector<double>::const_iterator it = tolerances.begin(); it != tolerances.end(); ++it) {
+				_lods.push_back(boost::shared_ptr<Representation::Triangulation<P> >(new Representation::Triangulation<P>(shape_model.geometry(), *it)));
+			}
+		}
+		TriangulationElement(const Element<P>& element, const boost::shared_ptr<Representation::Triangulation<P> >& geometry, const lod_pointers_t& lods = lod_pointers_t())
 			: Element<P>(element)
 			, _geometry(geometry)
+			, _lods(lods)
 		{}
 	private:
 		TriangulationElement(const TriangulationElement& other);
@@ -215,6 +250,19 @@ namespace IfcGeom {
 		SerializedElement(const SerializedElement& other);
 		SerializedElement& operator=(const SerializedElement& other);
 	};
+
+	/// Bounds of a product in meters, see Iterator::compute_element_bounds().
+	/// The box from min to max is aligned to the axes of the placement of the
+	/// product, so that together with the placement it is an oriented box. The
+	/// world box is the axis-aligned box around the oriented box.
+	struct ElementBounds {
+		int id;
+		std::string guid;
+		std::string type;
+		gp_Trsf placement;
+		gp_XYZ min, max;
+		gp_XYZ world_min, world_max;
+	};
 }
 
 #endif
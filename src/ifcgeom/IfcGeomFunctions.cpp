@@ -24,9 +24,11 @@
  ********************************************************************************/
 
 #include <set>
+#include <cmath>
 #include <cassert>
 #include <algorithm>
 
+#include <Standard.hxx>
 #include <Standard_Version.hxx>
 
 #include <gp_Pnt.hxx>
@@ -48,6 +50,11 @@
 
 #include <boost/range/irange.hpp>
 #include <boost/range/algorithm_ext/push_back.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <TColgp_Array1OfPnt.hxx>
 #include <TColgp_Array1OfPnt2d.hxx>
@@ -101,6 +108,7 @@
 #include <ShapeFix_Shape.hxx>
 #include <ShapeFix_ShapeTolerance.hxx>
 #include <ShapeFix_Solid.hxx>
+#include <ShapeFix_Face.hxx>
 
 #include <ShapeAnalysis_Curve.hxx>
 #include <ShapeAnalysis_Wire.hxx>
@@ -122,13 +130,9 @@
 
 #include <BRepGProp_Face.hxx>
 
-#include <BRepMesh_IncrementalMesh.hxx>
 #include <BRepTools.hxx>
 #include <BRepTools_WireExplorer.hxx>
 
-#include <Poly_Triangulation.hxx>
-#include <Poly_Array1OfTriangle.hxx>
-
 #include <TopTools_IndexedMapOfShape.hxx>
 #include <TopTools_IndexedDataMapOfShapeListOfShape.hxx>
 #include <TopTools_ListIteratorOfListOfShape.hxx>
@@ -146,9 +150,14 @@
 #include <Extrema_ExtPC.hxx>
 #include <BRepAdaptor_Curve.hxx>
 
+#include <BRepPrimAPI_MakeBox.hxx>
+
+#include <Message_ProgressIndicator.hxx>
+
 #include "../ifcparse/IfcSIPrefix.h"
 #include "../ifcparse/IfcFile.h"
 #include "../ifcgeom/IfcGeom.h"
+#include "../ifcgeom/IfcGeomPolygonTriangulator.h"
 #include "../ifcgeom/IfcGeomTree.h"
 
 #if OCC_VERSION_HEX < 0x60900
@@ -160,6 +169,29 @@
 #endif
 
 namespace {
+	// Interrupts the sewing and boolean algorithms of Open Cascade when the
+	// time budget of the kernel is exceeded
+	class time_budget_indicator : public Message_ProgressIndicator {
+		const IfcGeom::Kernel& kernel_;
+	public:
+		explicit time_budget_indicator(const IfcGeom::Kernel& kernel)
+			: kernel_(kernel)
+		{}
+		virtual Standard_Boolean Show(const Standard_Boolean) {
+			return Standard_True;
+		}
+		virtual Standard_Boolean UserBreak() {
+			return kernel_.time_budget_exceeded();
+		}
+	};
+
+	Handle(Message_ProgressIndicator) create_time_budget_indicator(const IfcGeom::Kernel& kernel) {
+		if (kernel.has_time_budget()) {
+			return new time_budget_indicator(kernel);
+		}
+		return Handle(Message_ProgressIndicator)();
+	}
+
 	void copy_operand(const TopTools_ListOfShape& l, TopTools_ListOfShape& r) {
 #if OCC_VERSION_HEX < 0x70000
 		TopTools_ListIteratorOfListOfShape it(l);
@@ -345,8 +377,12 @@ bool IfcGeom::Kernel::create_solid_from_faces(const TopTools_ListOfShape& face_l
 		builder.Add(face_iterator.Value());
 	}
 
+	if (time_budget_exceeded()) {
+		return false;
+	}
+
 	try {
-		builder.Perform();
+		builder.Perform(create_time_budget_indicator(*this));
 		shape = builder.SewedShape();
 
 		{
@@ -531,6 +567,9 @@ bool IfcGeom::Kernel::convert_openings(const IfcSchema::IfcProduct* entity, cons
 
 		// Iterate over the shapes of the IfcOpeningElements
 		for ( IfcGeom::IfcRepresentationShapeItems::const_iterator it4 = opening_shapes.begin(); it4 != opening_shapes.end(); ++ it4 ) {
+			if (time_budget_exceeded()) {
+				break;
+			}
 			TopoDS_Shape opening_shape_solid;
 			const TopoDS_Shape& opening_shape_unlocated = ensure_fit_for_subtraction(it4->Shape(),opening_shape_solid);
 			const gp_GTrsf& opening_shape_gtrsf = it4->Placement();
@@ -567,7 +606,8 @@ bool IfcGeom::Kernel::convert_openings(const IfcSchema::IfcProduct* entity, cons
 					s1s.Append(exp.Current());
 					TopTools_ListOfShape s2s;
 					s2s.Append(opening_shape);
-					brep_cut.SetFuzzyValue(getValue(GV_PRECISION));
+					brep_cut.SetFuzzyValue(initial_boolean_fuzziness());
+					brep_cut.SetRunParallel(parallel_booleans);
 					brep_cut.SetArguments(s1s);
 					brep_cut.SetTools(s2s);
 					brep_cut.Build();
@@ -605,7 +645,8 @@ bool IfcGeom::Kernel::convert_openings(const IfcSchema::IfcProduct* entity, cons
 				s1s.Append(entity_shape);
 				TopTools_ListOfShape s2s;
 				s2s.Append(opening_shape);
-				brep_cut.SetFuzzyValue(getValue(GV_PRECISION));
+				brep_cut.SetFuzzyValue(initial_boolean_fuzziness());
+				brep_cut.SetRunParallel(parallel_booleans);
 				brep_cut.SetArguments(s1s);
 				brep_cut.SetTools(s2s);
 				brep_cut.Build();
@@ -732,17 +773,160 @@ bool IfcGeom::Kernel::convert_openings_fast(const IfcSchema::IfcProduct* entity,
 #else
 
 namespace {
+	struct opening_shape {
+		double min_edge_length;
+		TopoDS_Shape shape;
+		Bnd_Box box;
+	};
+
 	struct opening_sorter {
-		bool operator()(const std::pair<double, TopoDS_Shape>& a, const std::pair<double, TopoDS_Shape>& b) const {
-			return a.first > b.first;
+		bool operator()(const opening_shape* a, const opening_shape* b) const {
+			return a->min_edge_length > b->min_edge_length;
 		}
 	};
+
+	// A shape of the product with the openings that are near its bounding box
+	struct opening_subtraction {
+		TopoDS_Shape shape;
+		std::vector<const opening_shape*> openings;
+	};
+
+	int find_cluster(std::vector<int>& parents, int i) {
+		while (parents[i] != i) {
+			i = parents[i] = parents[parents[i]];
+		}
+		return i;
+	}
+
+	// Subtracts a batch of openings. If this fails, the batch is split in clusters
+	// of openings with overlapping bounding boxes. Clusters do not interact, so
+	// they are subtracted one by one and a failing cluster does not prevent the
+	// others from being cut.
+	void subtract_opening_batch(IfcGeom::Kernel& kernel, const IfcSchema::IfcProduct* entity, double precision, std::vector<const opening_shape*>::const_iterator first, std::vector<const opening_shape*>::const_iterator last, TopoDS_Shape& result) {
+		TopTools_ListOfShape opening_list;
+		for (std::vector<const opening_shape*>::const_iterator it = first; it != last; ++it) {
+			opening_list.Append((*it)->shape);
+		}
+
+		TopoDS_Shape intermediate_result;
+		if (kernel.boolean_operation(result, opening_list, BOPAlgo_CUT, intermediate_result)) {
+			result = intermediate_result;
+			return;
+		}
+
+		const int n = (int) std::distance(first, last);
+		std::vector<int> parents(n);
+		for (int i = 0; i < n; ++i) {
+			parents[i] = i;
+		}
+
+		// Only openings of which the ranges along the x axis overlap are compared,
+		// rather than all pairs of the openings of e.g. a perforated panel
+		std::vector< std::pair<double, int> > by_xmin(n);
+		std::vector<double> xmax(n);
+		for (int i = 0; i < n; ++i) {
+			double y, z;
+			first[i]->box.Get(by_xmin[i].first, y, z, xmax[i], y, z);
+			by_xmin[i].second = i;
+		}
+		std::sort(by_xmin.begin(), by_xmin.end());
+
+		for (int k = 0; k < n; ++k) {
+			const int i = by_xmin[k].second;
+			for (int l = k + 1; l < n && by_xmin[l].first < xmax[i] + precision; ++l) {
+				const int j = by_xmin[l].second;
+				if (first[i]->box.Distance(first[j]->box) < precision) {
+					// The smallest index of a cluster is its root, regardless of the order of the pairs
+					const int a = find_cluster(parents, i);
+					const int b = find_cluster(parents, j);
+					parents[(std::max)(a, b)] = (std::min)(a, b);
+				}
+			}
+		}
+
+		std::vector< std::vector<int> > clusters;
+		std::vector<int> cluster_indices(n, -1);
+		for (int i = 0; i < n; ++i) {
+			int& cluster = cluster_indices[find_cluster(parents, i)];
+			if (cluster == -1) {
+				cluster = (int) clusters.size();
+				clusters.push_back(std::vector<int>());
+			}
+			clusters[cluster].push_back(i);
+		}
+
+		if (clusters.size() == 1) {
+			Logger::Message(Logger::LOG_ERROR, "Opening subtraction failed for " + boost::lexical_cast<std::string>(n) + " openings", entity->entity);
+			return;
+		}
+
+		for (std::vector< std::vector<int> >::const_iterator it = clusters.begin(); it != clusters.end(); ++it) {
+			TopTools_ListOfShape cluster_list;
+			for (std::vector<int>::const_iterator jt = it->begin(); jt != it->end(); ++jt) {
+				cluster_list.Append(first[*jt]->shape);
+			}
+			if (kernel.boolean_operation(result, cluster_list, BOPAlgo_CUT, intermediate_result)) {
+				result = intermediate_result;
+			} else {
+				Logger::Message(Logger::LOG_ERROR, "Opening subtraction failed for " + boost::lexical_cast<std::string>(it->size()) + " openings", entity->entity);
+			}
+		}
+	}
+
+	// Subtracts the openings in batches of openings of similar size, starting
+	// with the largest, as the fuzziness of an operation is limited by the
+	// shortest edge of its operands.
+	void subtract_openings(IfcGeom::Kernel& kernel, const IfcSchema::IfcProduct* entity, double precision, opening_subtraction& subtraction) {
+		const std::vector<const opening_shape*>& openings = subtraction.openings;
+		std::vector<const opening_shape*>::const_iterator it = openings.begin();
+		std::vector<const opening_shape*>::const_iterator jt = it;
+
+		for (;; ++it) {
+			if (kernel.time_budget_exceeded()) {
+				break;
+			}
+			if (it == openings.end() || (*jt)->min_edge_length / (*it)->min_edge_length > 10.) {
+				if (jt != it) {
+					subtract_opening_batch(kernel, entity, precision, jt, it, subtraction.shape);
+				}
+				jt = it;
+			}
+
+			if (it == openings.end()) {
+				break;
+			}
+		}
+	}
+
+	// Cuts the shapes as long as there are shapes left
+	void subtract_openings_worker(IfcGeom::Kernel& kernel, const IfcSchema::IfcProduct* entity, double precision, std::vector<opening_subtraction>& subtractions, std::size_t& next_subtraction, boost::mutex& mutex) {
+		// The product is tracked per thread, set it so that messages logged by the cuts name the element
+		Logger::SetProduct(const_cast<IfcSchema::IfcProduct*>(entity));
+		for (;;) {
+			std::size_t i;
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				if (next_subtraction == subtractions.size()) {
+					return;
+				}
+				i = next_subtraction++;
+			}
+			// Exceptions cannot be propagated from the thread, the shape is kept as is
+			const TopoDS_Shape shape = subtractions[i].shape;
+			try {
+				subtract_openings(kernel, entity, precision, subtractions[i]);
+			} catch (...) {
+				subtractions[i].shape = shape;
+				Logger::Message(Logger::LOG_ERROR, "Opening subtraction failed for " + boost::lexical_cast<std::string>(subtractions[i].openings.size()) + " openings", entity->entity);
+			}
+		}
+	}
 }
 
 bool IfcGeom::Kernel::convert_openings_fast(const IfcSchema::IfcProduct* entity, const IfcSchema::IfcRelVoidsElement::list::ptr& openings,
 	const IfcGeom::IfcRepresentationShapeItems& entity_shapes, const gp_Trsf& entity_trsf, IfcGeom::IfcRepresentationShapeItems& cut_shapes) {
 
-	std::vector< std::pair<double, TopoDS_Shape> > opening_vector;
+	std::vector<opening_shape> opening_vector;
 
 	for (IfcSchema::IfcRelVoidsElement::list::it it = openings->begin(); it != openings->end(); ++it) {
 		IfcSchema::IfcRelVoidsElement* v = *it;
@@ -780,54 +964,76 @@ bool IfcGeom::Kernel::convert_openings_fast(const IfcSchema::IfcProduct* entity,
 
 				gp_GTrsf gtrsf = opening_shapes[i].Placement();
 				gtrsf.PreMultiply(opening_trsf);
-				TopoDS_Shape opening_shape = apply_transformation(opening_shape_unlocated, gtrsf);
-				opening_vector.push_back(std::make_pair(min_edge_length(opening_shape), opening_shape));
+
+				opening_vector.push_back(opening_shape());
+				opening_shape& opening = opening_vector.back();
+				opening.shape = apply_transformation(opening_shape_unlocated, gtrsf);
+				opening.min_edge_length = min_edge_length(opening.shape);
+				BRepBndLib::Add(opening.shape, opening.box);
 			}
 
 		}
 	}
 
-	std::sort(opening_vector.begin(), opening_vector.end(), opening_sorter());
+	const double precision = getValue(GV_PRECISION);
 
-	// Iterate over the shapes of the IfcProduct
-	for ( IfcGeom::IfcRepresentationShapeItems::const_iterator it3 = entity_shapes.begin(); it3 != entity_shapes.end(); ++ it3 ) {
+	// Only the openings near the bounding box of a shape are subtracted from
+	// it, most openings of a product with multiple shapes only cut one of them
+	std::vector<opening_subtraction> subtractions(entity_shapes.size());
+	for (std::size_t i = 0; i < entity_shapes.size(); ++i) {
+		const IfcGeom::IfcRepresentationShapeItem& item = entity_shapes[i];
 		TopoDS_Shape entity_shape_solid;
-		const TopoDS_Shape& entity_shape_unlocated = ensure_fit_for_subtraction(it3->Shape(),entity_shape_solid);
-		const gp_GTrsf& entity_shape_gtrsf = it3->Placement();
+		const TopoDS_Shape& entity_shape_unlocated = ensure_fit_for_subtraction(item.Shape(), entity_shape_solid);
+		const gp_GTrsf& entity_shape_gtrsf = item.Placement();
 		if (entity_shape_gtrsf.Form() == gp_Other) {
 			Logger::Message(Logger::LOG_WARNING, "Applying non uniform transformation to:", entity->entity);
 		}
-		TopoDS_Shape entity_shape = apply_transformation(entity_shape_unlocated, entity_shape_gtrsf);
-
-		TopoDS_Shape result = entity_shape;
-		
-		auto it = opening_vector.begin();
-		auto jt = it;
-
-		for (;; ++it) {
-			if (it == opening_vector.end() || jt->first / it->first > 10.) {
+		subtractions[i].shape = apply_transformation(entity_shape_unlocated, entity_shape_gtrsf);
 
-				TopTools_ListOfShape opening_list;
-				for (auto kt = jt; kt < it; ++kt) {
-					opening_list.Append(kt->second);
-				}
+		Bnd_Box box;
+		BRepBndLib::Add(subtractions[i].shape, box);
+		if (box.IsVoid()) {
+			continue;
+		}
+		for (std::vector<opening_shape>::const_iterator it = opening_vector.begin(); it != opening_vector.end(); ++it) {
+			if (!it->box.IsVoid() && box.Distance(it->box) < precision) {
+				subtractions[i].openings.push_back(&*it);
+			}
+		}
+		std::stable_sort(subtractions[i].openings.begin(), subtractions[i].openings.end(), opening_sorter());
+	}
 
-				TopoDS_Shape intermediate_result;
-				if (boolean_operation(result, opening_list, BOPAlgo_CUT, intermediate_result)) {
-					result = intermediate_result;
-				} else {
-					Logger::Message(Logger::LOG_ERROR, "Opening subtraction failed for " + boost::lexical_cast<std::string>(std::distance(jt, it)) + " openings", entity->entity);
-				}
+	// Shapes are cut independently, possibly by multiple threads
+	int num_cut = 0;
+	for (std::vector<opening_subtraction>::const_iterator it = subtractions.begin(); it != subtractions.end(); ++it) {
+		if (!it->openings.empty()) {
+			++num_cut;
+		}
+	}
 
-				jt = it;
-			}
+	const int num_threads = (std::min)(boolean_threads, num_cut);
+	if (num_threads <= 1) {
+		for (std::vector<opening_subtraction>::iterator it = subtractions.begin(); it != subtractions.end(); ++it) {
+			subtract_openings(*this, entity, precision, *it);
+		}
+	} else {
+#if OCC_VERSION_HEX < 0x70000
+		// Older versions of Open Cascade only use atomic reference counting
+		// and a thread-safe memory manager when explicitly requested.
+		Standard::SetReentrant(Standard_True);
+#endif
+		std::size_t next_subtraction = 0;
+		boost::mutex mutex;
 
-			if (it == opening_vector.end()) {
-				break;
-			}
+		boost::thread_group threads;
+		for (int i = 0; i < num_threads; ++i) {
+			threads.create_thread(boost::bind(&subtract_openings_worker, boost::ref(*this), entity, precision, boost::ref(subtractions), boost::ref(next_subtraction), boost::ref(mutex)));
 		}
+		threads.join_all();
+	}
 
-		cut_shapes.push_back(IfcGeom::IfcRepresentationShapeItem(result, &it3->Style()));
+	for (std::size_t i = 0; i < entity_shapes.size(); ++i) {
+		cut_shapes.push_back(IfcGeom::IfcRepresentationShapeItem(subtractions[i].shape, &entity_shapes[i].Style()));
 	}
 	return true;
 }
@@ -1082,6 +1288,9 @@ void IfcGeom::Kernel::setValue(GeomValue var, double value) {
 	case GV_DIMENSIONALITY:
 		dimensionality = value;
 		break;
+	case GV_BOOLEAN_FUZZINESS:
+		boolean_fuzziness = value;
+		break;
 	default:
 		assert(!"never reach here");
 	}
@@ -1113,11 +1322,114 @@ double IfcGeom::Kernel::getValue(GeomValue var) const {
 	case GV_DIMENSIONALITY:
 		return dimensionality;
 		break;
+	case GV_BOOLEAN_FUZZINESS:
+		return boolean_fuzziness;
+		break;
 	}
 	assert(!"never reach here");
 	return 0;
 }
 
+void IfcGeom::Kernel::set_time_budget(double seconds) {
+	if (seconds > 0.) {
+		deadline = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::microseconds(static_cast<boost::int64_t>(seconds * 1.e6));
+	} else {
+		deadline = boost::posix_time::ptime();
+	}
+}
+
+bool IfcGeom::Kernel::time_budget_exceeded() const {
+	return has_time_budget() && boost::posix_time::microsec_clock::universal_time() > deadline;
+}
+
+std::size_t IfcGeom::Kernel::settings_fingerprint() const {
+	std::size_t seed = 0;
+	boost::hash_combine(seed, deflection_tolerance);
+	boost::hash_combine(seed, wire_creation_tolerance);
+	boost::hash_combine(seed, point_equality_tolerance);
+	boost::hash_combine(seed, max_faces_to_sew);
+	boost::hash_combine(seed, ifc_length_unit);
+	boost::hash_combine(seed, ifc_planeangle_unit);
+	boost::hash_combine(seed, modelling_precision);
+	boost::hash_combine(seed, dimensionality);
+	boost::hash_combine(seed, boolean_fuzziness);
+	boost::hash_combine(seed, static_cast<int>(placement_rel_to));
+	return seed;
+}
+
+IfcParse::ContentHash::value_type IfcGeom::Kernel::deduplication_key(const IfcUtil::IfcBaseClass* l, gp_Trsf& placement) {
+	// IfcSweptAreaSolid.Position, the second attribute in both schemas
+	static const unsigned int swept_area_solid_position = 1;
+
+	IfcUtil::IfcBaseClass* item = const_cast<IfcUtil::IfcBaseClass*>(l);
+	IfcParse::ContentHash::value_type key;
+	// Only the conversions of extruded and revolved area solids (and their
+	// tapered subtypes, which are dispatched to the same or an equivalent
+	// function) move the shape to Position as the very last step, so that
+	// the same shape can be moved elsewhere. Other swept area solids, e.g.
+	// IfcSurfaceCurveSweptAreaSolid, are only reused when fully equal.
+	if (l->is(IfcSchema::Type::IfcExtrudedAreaSolid) || l->is(IfcSchema::Type::IfcRevolvedAreaSolid)) {
+		const IfcSchema::IfcSweptAreaSolid* solid = l->as<IfcSchema::IfcSweptAreaSolid>();
+		bool has_position = true;
+#ifdef USE_IFC4
+		has_position = solid->hasPosition();
+#endif
+		if (has_position && !convert(solid->Position(), placement)) {
+			return 0;
+		}
+		key = content_hash(item, swept_area_solid_position);
+	} else {
+		key = content_hash(item);
+	}
+	return key ? key : 1;
+}
+
+namespace {
+	IfcParse::ContentHash::value_type quantize(double v, double step) {
+		return static_cast<IfcParse::ContentHash::value_type>(static_cast<boost::int64_t>(std::floor(v / step + 0.5)));
+	}
+}
+
+IfcParse::ContentHash::value_type IfcGeom::Kernel::subtraction_key(const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation, const IfcSchema::IfcRelVoidsElement::list::ptr& openings, const gp_Trsf& product_trsf) {
+	typedef IfcParse::ContentHash hash;
+
+	hash::value_type key = content_hash(representation);
+	hash::combine(key, settings.get(IteratorSettings::FASTER_BOOLEANS) ? 1 : 0);
+
+	const gp_Trsf product_trsf_inverse = product_trsf.Inverted();
+	const double precision = getValue(GV_PRECISION);
+
+	for (IfcSchema::IfcRelVoidsElement::list::it it = openings->begin(); it != openings->end(); ++it) {
+		IfcSchema::IfcFeatureElementSubtraction* opening = (*it)->RelatedOpeningElement();
+		hash::combine(key, static_cast<hash::value_type>(opening->type()));
+		if (!opening->hasRepresentation()) {
+			continue;
+		}
+		hash::combine(key, content_hash(opening->Representation()));
+
+		gp_Trsf opening_trsf;
+		if (opening->hasObjectPlacement()) {
+			try {
+				convert(opening->ObjectPlacement(), opening_trsf);
+			} catch (...) {
+				return 0;
+			}
+		}
+		opening_trsf.PreMultiply(product_trsf_inverse);
+
+		// Products at different locations obtain slightly different relative
+		// placements, which are therefore compared up to the precision
+		for (int i = 1; i <= 3; ++i) {
+			for (int j = 1; j <= 3; ++j) {
+				hash::combine(key, quantize(opening_trsf.Value(i, j), 1.e-9));
+			}
+			hash::combine(key, quantize(opening_trsf.Value(i, 4), precision));
+		}
+	}
+
+	return key ? key : 1;
+}
+
 // Returns the vertex part of an TopoDS_Edge edge that is not TopoDS_Vertex vertex
 TopoDS_Vertex find_other(const TopoDS_Edge& edge, const TopoDS_Vertex& vertex) {
 	TopExp_Explorer exp(edge, TopAbs_VERTEX);
@@ -1385,22 +1697,28 @@ IfcSchema::IfcRelVoidsElement::list::ptr IfcGeom::Kernel::find_openings(IfcSchem
 	IfcSchema::IfcRelVoidsElement::list::ptr openings(new IfcSchema::IfcRelVoidsElement::list);
 	if ( product->is(IfcSchema::Type::IfcElement) && !product->is(IfcSchema::Type::IfcOpeningElement) ) {
 		IfcSchema::IfcElement* element = (IfcSchema::IfcElement*)product;
-		openings = element->HasOpenings();
+		openings = relationship_index ? relationship_index->openings(element) : element->HasOpenings();
 	}
 
 	// Is the IfcElement a decomposition of an IfcElement with any IfcOpeningElements?
 	IfcSchema::IfcObjectDefinition* obdef = product->as<IfcSchema::IfcObjectDefinition>();
 	for (;;) {
+		IfcSchema::IfcObjectDefinition* rel_obdef;
+		if (relationship_index) {
+			rel_obdef = relationship_index->decomposes(obdef);
+			if (!rel_obdef) break;
+		} else {
 #ifdef USE_IFC4
-		IfcSchema::IfcRelAggregates::list::ptr decomposes = obdef->Decomposes();
+			IfcSchema::IfcRelAggregates::list::ptr decomposes = obdef->Decomposes();
 #else
-		IfcSchema::IfcRelDecomposes::list::ptr decomposes = obdef->Decomposes();
+			IfcSchema::IfcRelDecomposes::list::ptr decomposes = obdef->Decomposes();
 #endif
-		if (decomposes->size() != 1) break;
-		IfcSchema::IfcObjectDefinition* rel_obdef = (*decomposes->begin())->RelatingObject();
+			if (decomposes->size() != 1) break;
+			rel_obdef = (*decomposes->begin())->RelatingObject();
+		}
 		if ( rel_obdef->is(IfcSchema::Type::IfcElement) && !rel_obdef->is(IfcSchema::Type::IfcOpeningElement) ) {
 			IfcSchema::IfcElement* element = (IfcSchema::IfcElement*)rel_obdef;
-			openings->push(element->HasOpenings());
+			openings->push(relationship_index ? relationship_index->openings(element) : element->HasOpenings());
 		}
 
 		obdef = rel_obdef;
@@ -1409,9 +1727,16 @@ IfcSchema::IfcRelVoidsElement::list::ptr IfcGeom::Kernel::find_openings(IfcSchem
 	return openings;
 }
 
+IfcSchema::IfcRelAssociatesMaterial::list::ptr IfcGeom::Kernel::get_material_associations(const IfcSchema::IfcProduct* product) {
+	if (relationship_index) {
+		return relationship_index->material_associations(product);
+	}
+	return product->HasAssociations()->as<IfcSchema::IfcRelAssociatesMaterial>();
+}
+
 const IfcSchema::IfcMaterial* IfcGeom::Kernel::get_single_material_association(const IfcSchema::IfcProduct* product) {
 	IfcSchema::IfcMaterial* single_material = 0;
-	IfcSchema::IfcRelAssociatesMaterial::list::ptr associated_materials = product->HasAssociations()->as<IfcSchema::IfcRelAssociatesMaterial>();
+	IfcSchema::IfcRelAssociatesMaterial::list::ptr associated_materials = get_material_associations(product);
 	if (associated_materials->size() == 1) {
 		IfcSchema::IfcMaterialSelect* associated_material = (*associated_materials->begin())->RelatingMaterial();
 		single_material = associated_material->as<IfcSchema::IfcMaterial>();
@@ -1431,19 +1756,145 @@ const IfcSchema::IfcMaterial* IfcGeom::Kernel::get_single_material_association(c
 	return single_material;
 }
 
-template <typename P>
-IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_representation_and_product(
-    const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product)
+bool IfcGeom::Kernel::convert_mesh(const TessellatedMesh& mesh, TopoDS_Shape& shape, const IfcUtil::IfcBaseClass* item) {
+	std::vector<TopoDS_Face> faces;
+	faces.reserve(mesh.faces.size());
+
+	for (std::vector<TessellatedMesh::Face>::const_iterator it = mesh.faces.begin(); it != mesh.faces.end(); ++it) {
+		std::vector<TopoDS_Wire> wires;
+		for (std::vector<TessellatedMesh::Loop>::const_iterator jt = it->begin(); jt != it->end(); ++jt) {
+			BRepBuilderAPI_MakePolygon polygon;
+			for (TessellatedMesh::Loop::const_iterator kt = jt->begin(); kt != jt->end(); ++kt) {
+				polygon.Add(gp_Pnt(mesh.points[*kt]));
+			}
+			polygon.Close();
+			if (polygon.IsDone()) {
+				wires.push_back(polygon.Wire());
+			} else if (jt == it->begin()) {
+				break;
+			}
+		}
+
+		if (wires.empty()) {
+			continue;
+		}
+
+		BRepBuilderAPI_MakeFace builder(wires.front());
+		if (!builder.IsDone()) {
+			continue;
+		}
+		for (std::vector<TopoDS_Wire>::const_iterator jt = wires.begin() + 1; jt != wires.end(); ++jt) {
+			builder.Add(*jt);
+		}
+
+		TopoDS_Face face = builder.Face();
+
+		TopoDS_Iterator face_it(face, false);
+		const TopoDS_Wire& w = TopoDS::Wire(face_it.Value());
+		const bool reversed = w.Orientation() == TopAbs_REVERSED;
+		if (reversed) {
+			face.Reverse();
+		}
+
+		if (wires.size() > 1) {
+			// Orients the inner boundaries opposite to the outer boundary
+			ShapeFix_Face fix(face);
+			fix.FixOrientation();
+			face = fix.Face();
+		}
+
+		if (face_area(face) > getValue(GV_MINIMAL_FACE_AREA)) {
+			faces.push_back(face);
+		}
+	}
+
+	if (faces.empty()) return false;
+	
+	bool valid_shell = false;
+
+	if (faces.size() < getValue(GV_MAX_FACES_TO_SEW)) {
+		BRepOffsetAPI_Sewing builder;
+		builder.SetTolerance(getValue(GV_POINT_EQUALITY_TOLERANCE));
+		builder.SetMaxTolerance(getValue(GV_POINT_EQUALITY_TOLERANCE));
+		builder.SetMinTolerance(getValue(GV_POINT_EQUALITY_TOLERANCE));
+		
+		for (std::vector<TopoDS_Face>::const_iterator it = faces.begin(); it != faces.end(); ++it) {
+			builder.Add(*it);
+		}
+
+		try {
+			builder.Perform(create_time_budget_indicator(*this));
+			shape = builder.SewedShape();
+			valid_shell = BRepCheck_Analyzer(shape).IsValid();
+		} catch(...) {}
+
+		if (valid_shell) {
+			try {
+				ShapeFix_Solid solid;
+				solid.LimitTolerance(getValue(GV_POINT_EQUALITY_TOLERANCE));
+				TopoDS_Solid solid_shape = solid.SolidFromShell(TopoDS::Shell(shape));
+				if (!solid_shape.IsNull()) {
+					try {
+						BRepClass3d_SolidClassifier classifier(solid_shape);
+						shape = solid_shape;
+					} catch (...) {}
+				}
+			} catch(...) {}
+		} else {
+			Logger::Message(Logger::LOG_WARNING, "Failed to sew faceset:", item ? item->entity : 0);
+		}
+	}
+
+	if (!valid_shell) {
+		TopoDS_Compound compound;
+		BRep_Builder builder;
+		builder.MakeCompound(compound);
+		
+		for (std::vector<TopoDS_Face>::const_iterator it = faces.begin(); it != faces.end(); ++it) {
+			builder.Add(compound, *it);
+		}
+
+		shape = compound;
+	}
+
+	return true;
+}
+
+namespace {
+	// Restores the mesh passthrough of a kernel when going out of scope
+	class mesh_passthrough_scope {
+		IfcGeom::Kernel& kernel_;
+		const bool enabled_;
+	public:
+		mesh_passthrough_scope(IfcGeom::Kernel& kernel, bool enabled)
+			: kernel_(kernel)
+			, enabled_(kernel.get_mesh_passthrough())
+		{
+			kernel_.set_mesh_passthrough(enabled_ && enabled);
+		}
+		~mesh_passthrough_scope() {
+			kernel_.set_mesh_passthrough(enabled_);
+		}
+	};
+}
+
+bool IfcGeom::Kernel::convert_shapes_for_product(const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation,
+	IfcSchema::IfcProduct* product, IfcGeom::IfcRepresentationShapeItems& shapes, int& derivation)
 {
-	std::stringstream representation_id_builder;
+	IfcGeom::IfcRepresentationShapeItems shapes2;
+	derivation = 0;
 
-	representation_id_builder << representation->entity->id();
+	// Does the IfcElement have any IfcOpenings?
+	// Note that openings for IfcOpeningElements are not processed
+	IfcSchema::IfcRelVoidsElement::list::ptr openings = find_openings(product);
+	const bool subtract_openings = !settings.get(IfcGeom::IteratorSettings::DISABLE_OPENING_SUBTRACTIONS) && openings && openings->size();
 
-	IfcGeom::Representation::BRep* shape;
-	IfcGeom::IfcRepresentationShapeItems shapes, shapes2;
+	// Layer sets and openings are applied to shapes, so tessellated items of
+	// such products, and of their openings, are not converted to meshes
+	mesh_passthrough_scope passthrough(*this, !subtract_openings && !settings.get(IteratorSettings::APPLY_LAYERSETS));
 
 	if ( !convert_shapes(representation, shapes) ) {
-		return 0;
+		return false;
 	}
 
 	if (settings.get(IteratorSettings::APPLY_LAYERSETS)) {
@@ -1456,14 +1907,8 @@ IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_representation_and_pro
 				std::vector<const SurfaceStyle*> styles;
 				if (convert_layerset(product, layers, styles, thickness)) {
 
-					IfcSchema::IfcRelAssociates::list::ptr associations = product->HasAssociations();
-					for (IfcSchema::IfcRelAssociates::list::it it = associations->begin(); it != associations->end(); ++it) {
-						IfcSchema::IfcRelAssociatesMaterial* associates_material = (**it).as<IfcSchema::IfcRelAssociatesMaterial>();
-						if (associates_material) {
-							unsigned layerset_id = associates_material->RelatingMaterial()->entity->id();
-							representation_id_builder << "-layerset-" << layerset_id;
-							break;
-						}
+					if (get_material_associations(product)->size()) {
+						derivation |= DERIVED_LAYERSET;
 					}
 					
 					if (styles.size() > 1) {
@@ -1490,15 +1935,13 @@ IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_representation_and_pro
 		}
 	}
 
-	bool material_style_applied = false;
-
 	const IfcSchema::IfcMaterial* single_material = get_single_material_association(product);
 	if (single_material) {
 		const IfcGeom::SurfaceStyle* s = get_style(single_material);
 		for (IfcGeom::IfcRepresentationShapeItems::iterator it = shapes.begin(); it != shapes.end(); ++it) {
 			if (!it->hasStyle() && s) {
 				it->setStyle(s);
-				material_style_applied = true;
+				derivation |= DERIVED_MATERIAL_STYLE;
 			}
 		}
 	} else {
@@ -1514,23 +1957,6 @@ IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_representation_and_pro
 		}
     }
 
-	if (material_style_applied) {
-		representation_id_builder << "-material-" << single_material->entity->id();
-	}
-
-	int parent_id = -1;
-	try {
-		IfcSchema::IfcObjectDefinition* parent_object = get_decomposing_entity(product);
-		if (parent_object) {
-			parent_id = parent_object->entity->id();
-		}
-	} catch (const std::exception& e) {
-		Logger::Error(e);
-	}
-		
-	const std::string name = product->hasName() ? product->Name() : "";
-	const std::string guid = product->GlobalId();
-		
 	gp_Trsf trsf;
 	try {
 		convert(product->ObjectPlacement(),trsf);
@@ -1540,71 +1966,218 @@ IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_representation_and_pro
 		Logger::Error("Failed to construct placement");
 	}
 
-	// Does the IfcElement have any IfcOpenings?
-	// Note that openings for IfcOpeningElements are not processed
-	IfcSchema::IfcRelVoidsElement::list::ptr openings = find_openings(product);
+    if (subtract_openings) {
+		derivation |= DERIVED_OPENINGS;
 
-	const std::string product_type = IfcSchema::Type::ToString(product->type());
-	ElementSettings element_settings(settings, getValue(GV_LENGTH_UNIT), product_type);
+		IfcGeom::IfcRepresentationShapeItems opened_shapes;
 
-    if (!settings.get(IfcGeom::IteratorSettings::DISABLE_OPENING_SUBTRACTIONS) && openings && openings->size()) {
-		representation_id_builder << "-openings";
-		for (IfcSchema::IfcRelVoidsElement::list::it it = openings->begin(); it != openings->end(); ++it) {
-			representation_id_builder << "-" << (*it)->entity->id();
+#ifndef NO_CACHE
+		// Products with equal representations and openings at equal relative
+		// placements, such as the walls of repetitive storeys, reuse the result
+		// of the subtraction. Folded layer sets depend on the connected walls.
+		const IfcParse::ContentHash::value_type subtraction_key = (shared_cache && !(derivation & DERIVED_LAYERSET))
+			? this->subtraction_key(settings, representation, openings, trsf)
+			: 0;
+		IfcGeom::SharedCacheEntry<IfcGeom::SubtractedShapes, boost::uint64_t> subtraction_entry(
+			subtraction_key ? &shared_cache->Subtraction : 0, subtraction_key, *this);
+		IfcGeom::SubtractedShapes subtracted_shapes;
+		if (subtraction_entry.find(subtracted_shapes) && subtracted_shapes.shapes.size() == shapes.size()) {
+			for (std::size_t i = 0; i < shapes.size(); ++i) {
+				const TopoDS_Shape& s = subtracted_shapes.shapes[i];
+				opened_shapes.push_back(IfcGeom::IfcRepresentationShapeItem(
+					shared_cache->concurrent() ? BRepBuilderAPI_Copy(s).Shape() : s,
+					shapes[i].hasStyle() ? &shapes[i].Style() : 0));
+			}
+			shared_cache->subtraction_reused(subtracted_shapes.seconds);
 		}
+		const boost::posix_time::ptime subtraction_start = boost::posix_time::microsec_clock::universal_time();
+#endif
 
-		IfcGeom::IfcRepresentationShapeItems opened_shapes;
 		bool caught_error = false;
-		try {
+		// Unless the result of an equal product is reused
+		if (opened_shapes.empty()) {
+			try {
 #if OCC_VERSION_HEX < 0x60900
-            const bool faster_booleans = settings.get(IteratorSettings::FASTER_BOOLEANS);
+	            const bool faster_booleans = settings.get(IteratorSettings::FASTER_BOOLEANS);
 #else
-			const bool faster_booleans = true;
+				const bool faster_booleans = true;
 #endif
-			if (faster_booleans) {
-				bool success = convert_openings_fast(product,openings,shapes,trsf,opened_shapes);
+				if (faster_booleans) {
+					bool success = convert_openings_fast(product,openings,shapes,trsf,opened_shapes);
 #if OCC_VERSION_HEX < 0x60900
-				if (!success) {
-					opened_shapes.clear();
-					convert_openings(product,openings,shapes,trsf,opened_shapes);
-				}
+					if (!success) {
+						opened_shapes.clear();
+						convert_openings(product,openings,shapes,trsf,opened_shapes);
+					}
 #else
-				(void)success;
+					(void)success;
 #endif
-			} else {
-				convert_openings(product,openings,shapes,trsf,opened_shapes);
+				} else {
+					convert_openings(product,openings,shapes,trsf,opened_shapes);
+				}
+			} catch (const std::exception& e) {
+				Logger::Message(Logger::LOG_ERROR, std::string("Error processing openings for: ") + e.what() + ":", product->entity);
+				caught_error = true;
+			} catch(...) {
+				Logger::Message(Logger::LOG_ERROR,"Error processing openings for:",product->entity); 
+				caught_error = true;
 			}
-		} catch (const std::exception& e) {
-			Logger::Message(Logger::LOG_ERROR, std::string("Error processing openings for: ") + e.what() + ":", product->entity);
-			caught_error = true;
-		} catch(...) {
-			Logger::Message(Logger::LOG_ERROR,"Error processing openings for:",product->entity); 
-			caught_error = true;
 		}
 
 		if (caught_error && opened_shapes.size() < shapes.size()) {
 			opened_shapes = shapes;
 		}
 
-        if (settings.get(IteratorSettings::USE_WORLD_COORDS)) {
-			for ( IfcGeom::IfcRepresentationShapeItems::iterator it = opened_shapes.begin(); it != opened_shapes.end(); ++ it ) {
-				it->prepend(trsf);
+#ifndef NO_CACHE
+		if (subtraction_entry.reserved() && !caught_error && opened_shapes.size() == shapes.size() && !time_budget_exceeded()) {
+			subtracted_shapes.shapes.clear();
+			for (IfcGeom::IfcRepresentationShapeItems::const_iterator it = opened_shapes.begin(); it != opened_shapes.end(); ++it) {
+				// The results of the subtraction have no placement of their own
+				subtracted_shapes.shapes.push_back(shared_cache->concurrent() ? BRepBuilderAPI_Copy(it->Shape()).Shape() : it->Shape());
 			}
-			trsf = gp_Trsf();
-			representation_id_builder << "-world-coords";
+			subtracted_shapes.seconds = (boost::posix_time::microsec_clock::universal_time() - subtraction_start).total_microseconds() / 1.e6;
+			subtraction_entry.set(subtracted_shapes);
 		}
-		shape = new IfcGeom::Representation::BRep(element_settings, representation_id_builder.str(), opened_shapes);
-    } else if (settings.get(IteratorSettings::USE_WORLD_COORDS)) {
+#endif
+
+		std::swap(shapes, opened_shapes);
+	}
+
+	if (settings.get(IteratorSettings::USE_WORLD_COORDS)) {
 		for ( IfcGeom::IfcRepresentationShapeItems::iterator it = shapes.begin(); it != shapes.end(); ++ it ) {
 			it->prepend(trsf);
 		}
+		derivation |= DERIVED_WORLD_COORDS;
+	}
+
+	return true;
+}
+
+bool IfcGeom::Kernel::convert_bounding_box_for_product(const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation,
+	IfcSchema::IfcProduct* product, IfcGeom::IfcRepresentationShapeItems& shapes, int& derivation)
+{
+	// Extrusions, faceted geometry and mapped items are bounded without being
+	// converted. Items are not converted at all, as the conversion of the
+	// product has already exceeded the time budget, other items are bounded
+	// by their points instead.
+	Bnd_Box box;
+	bounding_box(representation, gp_GTrsf(), box, false);
+
+	if (box.IsVoid()) {
+		Logger::Message(Logger::LOG_ERROR, "Failed to create bounding box for:", product->entity);
+		return false;
+	}
+
+	// Flat and linear items would otherwise result in a degenerate box
+	box.Enlarge(getValue(GV_PRECISION));
+
+	double xmin, ymin, zmin, xmax, ymax, zmax;
+	box.Get(xmin, ymin, zmin, xmax, ymax, zmax);
+
+	TopoDS_Shape shape;
+	try {
+		shape = BRepPrimAPI_MakeBox(gp_Pnt(xmin, ymin, zmin), gp_Pnt(xmax, ymax, zmax)).Shape();
+	} catch (...) {
+		Logger::Message(Logger::LOG_ERROR, "Failed to create bounding box for:", product->entity);
+		return false;
+	}
+
+	const IfcSchema::IfcMaterial* single_material = get_single_material_association(product);
+	shapes.push_back(IfcRepresentationShapeItem(shape, single_material ? get_style(single_material) : 0));
+	derivation = DERIVED_BOUNDING_BOX;
+
+	if (settings.get(IteratorSettings::USE_WORLD_COORDS)) {
+		gp_Trsf trsf;
+		try {
+			convert(product->ObjectPlacement(), trsf);
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		} catch (...) {
+			Logger::Error("Failed to construct placement");
+		}
+		shapes.back().prepend(trsf);
+		derivation |= DERIVED_WORLD_COORDS;
+	}
+
+	return true;
+}
+
+template <typename P>
+IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_shapes(const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation,
+	IfcSchema::IfcProduct* product, const IfcGeom::IfcRepresentationShapeItems& shapes, int derivation)
+{
+	std::stringstream representation_id_builder;
+
+	representation_id_builder << representation->entity->id();
+
+	if (derivation & DERIVED_LAYERSET) {
+		IfcSchema::IfcRelAssociatesMaterial::list::ptr associations = get_material_associations(product);
+		if (associations->size()) {
+			unsigned layerset_id = (*associations->begin())->RelatingMaterial()->entity->id();
+			representation_id_builder << "-layerset-" << layerset_id;
+		}
+	}
+
+	if (derivation & DERIVED_MATERIAL_STYLE) {
+		const IfcSchema::IfcMaterial* single_material = get_single_material_association(product);
+		if (single_material) {
+			representation_id_builder << "-material-" << single_material->entity->id();
+		}
+	}
+
+	int parent_id = -1;
+	try {
+		IfcSchema::IfcObjectDefinition* parent_object = decomposing_entity(product);
+		if (parent_object) {
+			parent_id = parent_object->entity->id();
+		}
+	} catch (const std::exception& e) {
+		Logger::Error(e);
+	}
+		
+	const std::string name = product->hasName() ? product->Name() : "";
+	const std::string guid = product->GlobalId();
+		
+	gp_Trsf trsf;
+	try {
+		convert(product->ObjectPlacement(),trsf);
+	} catch (const std::exception& e) {
+		Logger::Error(e);
+	} catch (...) {
+		Logger::Error("Failed to construct placement");
+	}
+
+	if (derivation & DERIVED_OPENINGS) {
+		IfcSchema::IfcRelVoidsElement::list::ptr openings = find_openings(product);
+		representation_id_builder << "-openings";
+		for (IfcSchema::IfcRelVoidsElement::list::it it = openings->begin(); it != openings->end(); ++it) {
+			representation_id_builder << "-" << (*it)->entity->id();
+		}
+	}
+
+	if (derivation & DERIVED_NO_OPENINGS) {
+		representation_id_builder << "-no-openings";
+	}
+
+	if (derivation & DERIVED_UNSEWN) {
+		representation_id_builder << "-unsewn";
+	}
+
+	if (derivation & DERIVED_BOUNDING_BOX) {
+		representation_id_builder << "-bounding-box";
+	}
+
+	if (derivation & DERIVED_WORLD_COORDS) {
+		// The placement is already applied to the shapes
 		trsf = gp_Trsf();
 		representation_id_builder << "-world-coords";
-		shape = new IfcGeom::Representation::BRep(element_settings, representation_id_builder.str(), shapes);
-	} else {
-		shape = new IfcGeom::Representation::BRep(element_settings, representation_id_builder.str(), shapes);
 	}
 
+	const std::string product_type = IfcSchema::Type::ToString(product->type());
+	ElementSettings element_settings(settings, getValue(GV_LENGTH_UNIT), product_type);
+
+	IfcGeom::Representation::BRep* shape = new IfcGeom::Representation::BRep(element_settings, representation_id_builder.str(), shapes);
+
 	std::string context_string = "";
 	if (representation->hasRepresentationIdentifier()) {
 		context_string = representation->RepresentationIdentifier();
@@ -1625,7 +2198,24 @@ IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_representation_and_pro
 	);
 }
 
+template <typename P>
+IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_representation_and_product(
+    const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product)
+{
+	IfcGeom::IfcRepresentationShapeItems shapes;
+	int derivation;
+
+	if (!convert_shapes_for_product(settings, representation, product, shapes, derivation)) {
+		return 0;
+	}
+
+	return create_brep_for_shapes<P>(settings, representation, product, shapes, derivation);
+}
+
 IfcSchema::IfcRepresentation* IfcGeom::Kernel::representation_mapped_to(const IfcSchema::IfcRepresentation* representation) {
+	if (relationship_index) {
+		return relationship_index->mapped_representation(representation);
+	}
 	IfcSchema::IfcRepresentation* representation_mapped_to = 0;
 	IfcSchema::IfcRepresentationItem::list::ptr items = representation->Items();
 	if (items->size() == 1) {
@@ -1645,7 +2235,11 @@ IfcSchema::IfcRepresentation* IfcGeom::Kernel::representation_mapped_to(const If
 	return representation_mapped_to;
 }
 
-IfcSchema::IfcProduct::list::ptr IfcGeom::Kernel::products_represented_by(const IfcSchema::IfcRepresentation* representation) {
+IfcSchema::IfcProduct::list::ptr IfcGeom::Kernel::products_of_representation_(const IfcSchema::IfcRepresentation* representation) {
+	if (relationship_index) {
+		return relationship_index->products(representation);
+	}
+
 	IfcSchema::IfcProduct::list::ptr products(new IfcSchema::IfcProduct::list);
 
 	IfcSchema::IfcProductRepresentation::list::ptr prodreps = representation->OfProductRepresentation();
@@ -1659,6 +2253,12 @@ IfcSchema::IfcProduct::list::ptr IfcGeom::Kernel::products_represented_by(const
 		// Let's find the IfcProducts that reference the IfcProductRepresentation anyway
 		products->push((*it)->entity->getInverse(IfcSchema::Type::IfcProduct, -1)->as<IfcSchema::IfcProduct>());
 	}
+
+	return products;
+}
+
+IfcSchema::IfcProduct::list::ptr IfcGeom::Kernel::products_represented_by(const IfcSchema::IfcRepresentation* representation) {
+	IfcSchema::IfcProduct::list::ptr products = products_of_representation_(representation);
 	
 	IfcSchema::IfcRepresentationMap::list::ptr maps = representation->RepresentationMap();
 	if (maps->size() == 1) {
@@ -1667,7 +2267,7 @@ IfcSchema::IfcProduct::list::ptr IfcGeom::Kernel::products_represented_by(const
 			IfcSchema::IfcMappedItem::list::ptr items = map->MapUsage();
 			for (IfcSchema::IfcMappedItem::list::it it = items->begin(); it != items->end(); ++it) {
 				IfcSchema::IfcMappedItem* item = *it;
-				if (item->StyledByItem()->size() != 0) continue;
+				if (relationship_index ? relationship_index->is_styled(item) : item->StyledByItem()->size() != 0) continue;
 
 				if (!is_identity_transform(item->MappingTarget())) {
 					continue;
@@ -1677,11 +2277,7 @@ IfcSchema::IfcProduct::list::ptr IfcGeom::Kernel::products_represented_by(const
 				for (IfcSchema::IfcRepresentation::list::it jt = reps->begin(); jt != reps->end(); ++jt) {
 					IfcSchema::IfcRepresentation* rep = *jt;
 					if (rep->Items()->size() != 1) continue;
-					IfcSchema::IfcProductRepresentation::list::ptr prodreps_mapped = rep->OfProductRepresentation();
-					for (IfcSchema::IfcProductRepresentation::list::it kt = prodreps_mapped->begin(); kt != prodreps_mapped->end(); ++kt) {
-						IfcSchema::IfcProduct::list::ptr ps = (*kt)->entity->getInverse(IfcSchema::Type::IfcProduct, -1)->as<IfcSchema::IfcProduct>();
-						products->push(ps);
-					}
+					products->push(products_of_representation_(rep));
 				}
 			}
 		}
@@ -1697,7 +2293,7 @@ IfcGeom::BRepElement<P>* IfcGeom::Kernel::create_brep_for_processed_representati
 {
 	int parent_id = -1;
 	try {
-		IfcSchema::IfcObjectDefinition* parent_object = get_decomposing_entity(product);
+		IfcSchema::IfcObjectDefinition* parent_object = decomposing_entity(product);
 		if (parent_object) {
 			parent_id = parent_object->entity->id();
 		}
@@ -1794,6 +2390,13 @@ IfcSchema::IfcObjectDefinition* IfcGeom::Kernel::get_decomposing_entity(IfcSchem
 	return parent;
 }
 
+IfcSchema::IfcObjectDefinition* IfcGeom::Kernel::decomposing_entity(IfcSchema::IfcProduct* product) {
+	if (relationship_index) {
+		return relationship_index->decomposing_entity(product);
+	}
+	return get_decomposing_entity(product);
+}
+
 std::map<std::string, IfcSchema::IfcPresentationLayerAssignment*> IfcGeom::Kernel::get_layers(IfcSchema::IfcProduct* prod)
 {
     using namespace IfcSchema;
@@ -1816,6 +2419,11 @@ template IFC_GEOM_API IfcGeom::BRepElement<float>* IfcGeom::Kernel::create_brep_
 template IFC_GEOM_API IfcGeom::BRepElement<double>* IfcGeom::Kernel::create_brep_for_representation_and_product<double>(
     const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product);
 
+template IFC_GEOM_API IfcGeom::BRepElement<float>* IfcGeom::Kernel::create_brep_for_shapes<float>(
+	const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product, const IfcGeom::IfcRepresentationShapeItems& shapes, int derivation);
+template IFC_GEOM_API IfcGeom::BRepElement<double>* IfcGeom::Kernel::create_brep_for_shapes<double>(
+	const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product, const IfcGeom::IfcRepresentationShapeItems& shapes, int derivation);
+
 template IFC_GEOM_API IfcGeom::BRepElement<float>* IfcGeom::Kernel::create_brep_for_processed_representation<float>(
     const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product, IfcGeom::BRepElement<float>* brep);
 template IFC_GEOM_API IfcGeom::BRepElement<double>* IfcGeom::Kernel::create_brep_for_processed_representation<double>(
@@ -1891,13 +2499,9 @@ bool IfcGeom::Kernel::convert_layerset(const IfcSchema::IfcProduct* product, std
 	IfcSchema::IfcMaterialLayerSetUsage* usage = 0;
 	Handle_Geom_Surface reference_surface;
 
-	IfcSchema::IfcRelAssociates::list::ptr associations = product->HasAssociations();
-	for (IfcSchema::IfcRelAssociates::list::it it = associations->begin(); it != associations->end(); ++it) {
-		IfcSchema::IfcRelAssociatesMaterial* associates_material = (**it).as<IfcSchema::IfcRelAssociatesMaterial>();
-		if (associates_material) {
-			usage = associates_material->RelatingMaterial()->as<IfcSchema::IfcMaterialLayerSetUsage>();
-			break;
-		}
+	IfcSchema::IfcRelAssociatesMaterial::list::ptr associations = get_material_associations(product);
+	if (associations->size()) {
+		usage = (*associations->begin())->RelatingMaterial()->as<IfcSchema::IfcMaterialLayerSetUsage>();
 	}
 
 	if (!usage) {
@@ -3090,87 +3694,44 @@ bool IfcGeom::Kernel::flatten_wire(TopoDS_Wire& wire) {
 }
 
 bool IfcGeom::Kernel::triangulate_wire(const TopoDS_Wire& wire, TopTools_ListOfShape& faces) {
-	// This is a bit of a precarious approach, but seems to work for the 
-	// versions of OCCT tested for. OCCT has a Delaunay triangulation function 
-	// BRepMesh_Delaun, but it is notoriously hard to interpret the results 
-	// (due to the Bowyer-Watson super triangle perhaps?). Therefore 
-	// alternatively we use the regular OCCT incremental mesher on a new face 
-	// created from the UV coordinates of the original wire. Pray to our gods 
-	// that the vertex coordinates are unaffected by the meshing algorithm and 
-	// map them back to 3d coordinates when iterating over the mesh triangles. 
-
-	typedef std::pair<double, double> uv_node;
+	// The wire vertices are triangulated as a polygon, projected onto the
+	// coordinate plane most perpendicular to the wire, so that no face needs
+	// to be constructed for a wire that is not planar in the first place.
 
-	gp_Pln pln;
-	if (!approximate_plane_through_wire(wire, pln)) {
-		return false;
+	std::vector<gp_XYZ> points;
+	for (BRepTools_WireExplorer exp(wire); exp.More(); exp.Next()) {
+		points.push_back(BRep_Tool::Pnt(exp.CurrentVertex()).XYZ());
 	}
 
-	const gp_XYZ& udir = pln.Position().XDirection().XYZ();
-	const gp_XYZ& vdir = pln.Position().YDirection().XYZ();
-	const gp_XYZ& pnt = pln.Position().Location().XYZ();
-	
-	BRepTools_WireExplorer exp(wire);
-	BRepBuilderAPI_MakePolygon mp;
-	std::map<uv_node, gp_Pnt> mapping;
-
-	// Add UV coordinates to a newly created polygon
-	for (; exp.More(); exp.Next()) {
-		gp_Pnt p = BRep_Tool::Pnt(exp.CurrentVertex());
-		double u = (p.XYZ() - pnt).Dot(udir);
-		double v = (p.XYZ() - pnt).Dot(vdir);
-		mp.Add(gp_Pnt(u, v, 0));
-		mapping.insert(std::make_pair(std::make_pair(u, v), p));
+	PolygonTriangulator::Loop loop(points.size());
+	for (std::size_t i = 0; i < points.size(); ++i) {
+		loop[i] = (int) i;
 	}
 
-	// Not closed by default
-	mp.Close();
-
-	// Create a new face from the {u,v,0} wire and mesh the face
-	TopoDS_Face face = BRepBuilderAPI_MakeFace(mp.Wire());
-	BRepMesh_IncrementalMesh(face, Precision::Confusion());
-
-	int n123[3]; 
-	TopLoc_Location loc;
-	Handle_Poly_Triangulation tri = BRep_Tool::Triangulation(face, loc);
-	
-	if (!tri.IsNull()) {
-		const TColgp_Array1OfPnt& nodes = tri->Nodes();
-
-		const Poly_Array1OfTriangle& triangles = tri->Triangles();
-		for (int i = 1; i <= triangles.Length(); ++i) {			
-			if (face.Orientation() == TopAbs_REVERSED)
-				triangles(i).Get(n123[2], n123[1], n123[0]);
-			else triangles(i).Get(n123[0], n123[1], n123[2]);
-			
-			// Create polygons from the mesh vertices
-			BRepBuilderAPI_MakePolygon mp2;
-			for (int j = 0; j < 3; ++j) {
-				const gp_Pnt& uv = nodes.Value(n123[j]);
-				uv_node key = std::make_pair(uv.X(), uv.Y());
-
-				if (mapping.find(key) == mapping.end()) {
-					Logger::Error("Internal error: unable to unproject uv-mesh");
-					return false;
-				}
+	std::vector<int> triangles;
+	if (!PolygonTriangulator().triangulate(points, loop, triangles)) {
+		return false;
+	}
 
-				const gp_Pnt& p = mapping.find(key)->second;
-				mp2.Add(p);
-			}
-			mp2.Close();
+	for (std::size_t i = 0; i < triangles.size(); i += 3) {
+		// Create polygons from the triangle vertices
+		BRepBuilderAPI_MakePolygon mp;
+		for (std::size_t j = 0; j < 3; ++j) {
+			mp.Add(gp_Pnt(points[triangles[i + j]]));
+		}
+		mp.Close();
 
-			BRepBuilderAPI_MakeFace mf(mp2.Wire());
-			if (mf.IsDone()) {
-				TopoDS_Face triangle_face = mf.Face();
-				TopoDS_Iterator jt(triangle_face, false);
-				for (; jt.More(); jt.Next()) {
-					const TopoDS_Wire& w = TopoDS::Wire(jt.Value());
-					if (w.Orientation() != wire.Orientation()) {
-						triangle_face.Reverse();
-					}
+		BRepBuilderAPI_MakeFace mf(mp.Wire());
+		if (mf.IsDone()) {
+			TopoDS_Face triangle_face = mf.Face();
+			TopoDS_Iterator jt(triangle_face, false);
+			for (; jt.More(); jt.Next()) {
+				const TopoDS_Wire& w = TopoDS::Wire(jt.Value());
+				if (w.Orientation() != wire.Orientation()) {
+					triangle_face.Reverse();
 				}
-				faces.Append(triangle_face);
 			}
+			faces.Append(triangle_face);
 		}
 	}
 
@@ -3634,8 +4195,13 @@ bool IfcGeom::Kernel::boolean_operation(const TopoDS_Shape& a, const TopTools_Li
 		return true;
 	}
 
+	if (time_budget_exceeded()) {
+		delete builder;
+		return false;
+	}
+
 	if (fuzziness < 0.) {
-		fuzziness = getValue(GV_PRECISION);
+		fuzziness = initial_boolean_fuzziness();
 	}
 
 	// Find a sensible value for the fuzziness, based on precision
@@ -3662,6 +4228,10 @@ bool IfcGeom::Kernel::boolean_operation(const TopoDS_Shape& a, const TopTools_Li
 	builder->SetNonDestructive(true);
 #endif
 	builder->SetFuzzyValue(fuzz);
+	builder->SetRunParallel(parallel_booleans);
+#if OCC_VERSION_HEX >= 0x70200
+	builder->SetProgressIndicator(create_time_budget_indicator(*this));
+#endif
 	builder->SetArguments(s1s);
 	copy_operand(b, B);
 	builder->SetTools(B);
@@ -3716,7 +4286,7 @@ bool IfcGeom::Kernel::boolean_operation(const TopoDS_Shape& a, const TopTools_Li
 	Logger::Notice(str.str());
 	}
 	delete builder;
-	if (!success) {
+	if (!success && !time_budget_exceeded()) {
         const double new_fuzziness = fuzziness * 10.;
         if (new_fuzziness + 1e-15 <= getValue(GV_PRECISION) * 1000. && new_fuzziness < min_length_orig) {
             return boolean_operation(a, b, op, result, new_fuzziness);
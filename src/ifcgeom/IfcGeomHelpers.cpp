@@ -384,34 +384,36 @@ void IfcGeom::Kernel::set_conversion_placement_rel_to(IfcSchema::Type::Enum type
 	placement_rel_to = type;
 }
 
+IfcSchema::IfcLocalPlacement* IfcGeom::Kernel::placement_parent(IfcSchema::IfcLocalPlacement* placement) {
+	if ( ! placement->hasPlacementRelTo() ) return 0;
+	IfcSchema::IfcObjectPlacement* parent = placement->PlacementRelTo();
+	IfcSchema::IfcProduct::list::ptr parentPlaces = parent->PlacesObject();
+	for ( IfcSchema::IfcProduct::list::it iter = parentPlaces->begin();
+		  iter != parentPlaces->end(); ++iter) {
+		if ( (*iter)->is(placement_rel_to) ) return 0;
+	}
+	if ( ! parent->is(IfcSchema::Type::IfcLocalPlacement) ) return 0;
+	return (IfcSchema::IfcLocalPlacement*)parent;
+}
+
 bool IfcGeom::Kernel::convert(const IfcSchema::IfcObjectPlacement* l, gp_Trsf& trsf) {
+	if ( placement_table && placement_table->placement_rel_to() == placement_rel_to && placement_table->find(l, trsf) ) {
+		return true;
+	}
 	IN_CACHE(IfcObjectPlacement,l,gp_Trsf,trsf)
 	if ( ! l->is(IfcSchema::Type::IfcLocalPlacement) ) {
 		Logger::Message(Logger::LOG_ERROR, "Unsupported IfcObjectPlacement:", l->entity);
 		return false; 		
 	}
 	IfcSchema::IfcLocalPlacement* current = (IfcSchema::IfcLocalPlacement*)l;
-	for (;;) {
+	while ( current ) {
 		gp_Trsf trsf2;
 		IfcSchema::IfcAxis2Placement* relplacement = current->RelativePlacement();
 		if ( relplacement->is(IfcSchema::Type::IfcAxis2Placement3D) ) {
 			IfcGeom::Kernel::convert((IfcSchema::IfcAxis2Placement3D*)relplacement,trsf2);
 			trsf.PreMultiply(trsf2);
 		}
-		if ( current->hasPlacementRelTo() ) {
-			IfcSchema::IfcObjectPlacement* parent = current->PlacementRelTo();
-			IfcSchema::IfcProduct::list::ptr parentPlaces = parent->PlacesObject();
-			bool parentPlacesType = false;
-			for ( IfcSchema::IfcProduct::list::it iter = parentPlaces->begin();
-				  iter != parentPlaces->end(); ++iter) {
-				if ( (*iter)->is(placement_rel_to) ) parentPlacesType = true;
-			}
-
-			if ( parentPlacesType ) break;
-			else if ( parent->is(IfcSchema::Type::IfcLocalPlacement) )
-				current = (IfcSchema::IfcLocalPlacement*)current->PlacementRelTo();
-			else break;
-		} else break;
+		current = placement_parent(current);
 	}
 	CACHE(IfcObjectPlacement,l,trsf)
 	return true;
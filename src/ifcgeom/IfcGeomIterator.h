@@ -63,8 +63,16 @@
 #include <vector>
 #include <limits>
 #include <algorithm>
+#include <deque>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <Standard.hxx>
+#include <Standard_Version.hxx>
 
 #include <gp_Mat.hxx>
 #include <gp_Mat2d.hxx>
@@ -81,6 +89,7 @@
 #include "../ifcgeom/IfcGeomIteratorSettings.h"
 #include "../ifcgeom/IfcRepresentationShapeItem.h"
 #include "../ifcgeom/IfcGeomFilter.h"
+#include "../ifcgeom/IfcGeomDiskCache.h"
 
 // The infamous min & max Win32 #defines can leak here from OCE depending on the build configuration
 #ifdef min
@@ -162,6 +171,159 @@ namespace IfcGeom {
         }
 
 		bool initialize() {
+			if (!select_representations_()) {
+				return false;
+			}
+
+			representation_iterator = representations->begin();
+			ifcproducts.reset();
+
+			if (settings.num_threads() > 1) {
+				start_workers_();
+			}
+
+			if (!create()) {
+				return false;
+			}
+
+			done = 0;
+			total = representations->size();
+
+			return true;
+		}
+
+		/// Computes the bounds of the products that would be iterated over, see
+		/// Kernel::bounding_box(), without boolean operations or triangulation. The
+		/// products of mapped representations are bounded individually. Used instead
+		/// of initialize() and with the number of threads in the settings.
+		bool compute_element_bounds(std::vector<ElementBounds>& bounds) {
+			if (!select_representations_()) {
+				return false;
+			}
+
+			// The representations of every product, in file order
+			std::vector<bounds_task> tasks;
+			std::map<IfcSchema::IfcProduct*, size_t> task_index;
+
+			for (IfcSchema::IfcRepresentation::list::it it = representations->begin(); it != representations->end(); ++it) {
+				IfcSchema::IfcRepresentation* representation = *it;
+				IfcSchema::IfcProduct::list::ptr products = relationship_index_->products(representation);
+				for (IfcSchema::IfcProduct::list::it jt = products->begin(); jt != products->end(); ++jt) {
+					IfcSchema::IfcProduct* product = *jt;
+					if (!boost::all(filters_, filter_match(product))) {
+						continue;
+					}
+					std::map<IfcSchema::IfcProduct*, size_t>::const_iterator kt = task_index.find(product);
+					if (kt == task_index.end()) {
+						kt = task_index.insert(std::make_pair(product, tasks.size())).first;
+						tasks.push_back(bounds_task());
+						tasks.back().product = product;
+					}
+					tasks[kt->second].representations.push_back(representation);
+				}
+			}
+
+			std::vector<ElementBounds> results(tasks.size());
+			std::vector<char> bounded(tasks.size(), 0);
+			size_t next_task = 0;
+			boost::mutex mutex;
+
+			if (settings.num_threads() > 1) {
+#if OCC_VERSION_HEX < 0x70000
+				Standard::SetReentrant(Standard_True);
+#endif
+				std::vector<Kernel*> kernels;
+				boost::thread_group threads;
+				for (int i = 0; i < settings.num_threads(); ++i) {
+					kernels.push_back(new Kernel(kernel));
+					threads.create_thread(boost::bind(&Iterator::bounds_worker_, this, kernels.back(),
+						boost::cref(tasks), boost::ref(results), boost::ref(bounded), boost::ref(next_task), boost::ref(mutex)));
+				}
+				threads.join_all();
+				for (std::vector<Kernel*>::const_iterator it = kernels.begin(); it != kernels.end(); ++it) {
+					delete *it;
+				}
+			} else {
+				bounds_worker_(&kernel, tasks, results, bounded, next_task, mutex);
+			}
+
+			for (size_t i = 0; i < results.size(); ++i) {
+				if (bounded[i]) {
+					bounds.push_back(results[i]);
+				}
+			}
+
+			return true;
+		}
+
+	private:
+		struct bounds_task {
+			IfcSchema::IfcProduct* product;
+			std::vector<IfcSchema::IfcRepresentation*> representations;
+		};
+
+		void bounds_worker_(Kernel* k, const std::vector<bounds_task>& tasks, std::vector<ElementBounds>& results,
+			std::vector<char>& bounded, size_t& next_task, boost::mutex& mutex)
+		{
+			for (;;) {
+				size_t i;
+				{
+					boost::mutex::scoped_lock lock(mutex);
+					if (next_task == tasks.size()) {
+						return;
+					}
+					i = next_task++;
+				}
+
+				IfcSchema::IfcProduct* product = tasks[i].product;
+				Logger::SetProduct(product);
+
+				Bnd_Box box;
+				for (std::vector<IfcSchema::IfcRepresentation*>::const_iterator it = tasks[i].representations.begin(); it != tasks[i].representations.end(); ++it) {
+					k->bounding_box(*it, gp_GTrsf(), box);
+				}
+
+				gp_Trsf trsf;
+				try {
+					k->convert(product->ObjectPlacement(), trsf);
+				} catch (const std::exception& e) {
+					Logger::Error(e);
+				} catch (...) {
+					Logger::Error("Failed to construct placement");
+				}
+
+				Logger::SetProduct(boost::none);
+
+				if (box.IsVoid()) {
+					continue;
+				}
+
+				ElementBounds& result = results[i];
+				result.id = product->entity->id();
+				result.guid = product->GlobalId();
+				result.type = IfcSchema::Type::ToString(product->type());
+				result.placement = trsf;
+				box.Get(result.min.ChangeCoord(1), result.min.ChangeCoord(2), result.min.ChangeCoord(3),
+					result.max.ChangeCoord(1), result.max.ChangeCoord(2), result.max.ChangeCoord(3));
+
+				Bnd_Box world_box;
+				for (int j = 0; j < 8; ++j) {
+					gp_XYZ p((j & 1) ? result.max.X() : result.min.X(), (j & 2) ? result.max.Y() : result.min.Y(), (j & 4) ? result.max.Z() : result.min.Z());
+					trsf.Transforms(p);
+					world_box.Add(gp_Pnt(p));
+				}
+				world_box.SetGap(0.);
+				world_box.Get(result.world_min.ChangeCoord(1), result.world_min.ChangeCoord(2), result.world_min.ChangeCoord(3),
+					result.world_max.ChangeCoord(1), result.world_max.ChangeCoord(2), result.world_max.ChangeCoord(3));
+
+				// Written by a single thread, read after all threads are joined
+				bounded[i] = true;
+			}
+		}
+
+		// Selects the representations in the contexts of interest, with units and
+		// precision initialized accordingly
+		bool select_representations_() {
 			try {
 				initUnits();
 			} catch (const std::exception& e) {
@@ -282,21 +444,33 @@ namespace IfcGeom {
 				return false;
 			}
 
-			representation_iterator = representations->begin();
-			ifcproducts.reset();
+			// Resolved after the units are known and before the kernel is copied
+			// for worker threads, so that all kernels use the same table
+			if (!placement_table_) {
+				placement_table_.reset(new PlacementTable);
+				placement_table_->build(kernel, ifc_file, settings.num_threads());
+				kernel.set_placement_table(placement_table_);
+			}
 
-			if (!create()) {
-				return false;
+			if (!relationship_index_) {
+				relationship_index_.reset(new RelationshipIndex);
+				relationship_index_->build(kernel, ifc_file);
+				kernel.set_relationship_index(relationship_index_);
 			}
 
-			done = 0;
-			total = representations->size();
+			if (!style_table_) {
+				style_table_.reset(new StyleTable);
+				style_table_->build(kernel, ifc_file);
+				kernel.set_style_table(style_table_);
+			}
 
 			return true;
 		}
 
-        /// Computes model's bounding box (bounds_min and bounds_max).
-        /// @note Can take several minutes for large files.
+	public:
+
+        /// Computes model's bounding box (bounds_min and bounds_max). Placements are
+        /// read from the placement table if the iterator has been initialized.
         void compute_bounds()
         {
             for (int i = 1; i < 4; ++i) {
@@ -349,19 +523,24 @@ namespace IfcGeom {
         const std::vector<IfcGeom::filter_t>& filters() const { return filters_; }
         std::vector<IfcGeom::filter_t>& filters() { return filters_; }
 
+        /// Returns the cache used by the kernels of the iterator
+        const boost::shared_ptr<SharedCache>& shared_cache() const { return shared_cache_; }
+
+        /// Returns the absolute placements of the file, which are null until initialized
+        const boost::shared_ptr<PlacementTable>& placement_table() const { return placement_table_; }
+
+        /// Returns the relationships of the file, which are null until initialized
+        const boost::shared_ptr<RelationshipIndex>& relationship_index() const { return relationship_index_; }
+
+        /// Returns the disk cache, which is null unless a directory is set in the settings
+        const boost::shared_ptr<DiskCache>& disk_cache() const { return disk_cache_; }
+
         const gp_XYZ& bounds_min() const { return bounds_min_; }
         const gp_XYZ& bounds_max() const { return bounds_max_; }
 
 	private:
 		// Move to the next IfcRepresentation
 		void _nextShape() {
-			// In order to conserve memory and reduce cache insertion times, the cache is
-			// cleared after an arbitrary number of processed representations. This has been
-			// benchmarked extensively: https://github.com/IfcOpenShell/IfcOpenShell/pull/47
-			static const int clear_interval = 64;
-			if (done % clear_interval == clear_interval - 1) {
-				kernel.purge_cache();
-			}
 			ifcproducts.reset();
 			++ representation_iterator;
 			++ done;
@@ -386,14 +565,11 @@ namespace IfcGeom {
 				}
 
 				if (settings.get(IteratorSettings::APPLY_LAYERSETS)) {
-					IfcSchema::IfcRelAssociates::list::ptr associations = product->HasAssociations();
-					for (IfcSchema::IfcRelAssociates::list::it jt = associations->begin(); jt != associations->end(); ++jt) {
-						IfcSchema::IfcRelAssociatesMaterial* assoc = (*jt)->as<IfcSchema::IfcRelAssociatesMaterial>();
-						if (assoc) {
-							if (assoc->RelatingMaterial()->is(IfcSchema::Type::IfcMaterialLayerSetUsage)) {
-								// TODO: Check whether single layer? 
-								return false;
-							}
+					IfcSchema::IfcRelAssociatesMaterial::list::ptr associations = kernel.get_material_associations(product);
+					for (IfcSchema::IfcRelAssociatesMaterial::list::it jt = associations->begin(); jt != associations->end(); ++jt) {
+						if ((*jt)->RelatingMaterial()->is(IfcSchema::Type::IfcMaterialLayerSetUsage)) {
+							// TODO: Check whether single layer? 
+							return false;
 						}
 					}
 				}
@@ -406,6 +582,58 @@ namespace IfcGeom {
 			return associated_single_materials.size() == 1;
 		}
 
+		// Initializes the list of filtered products to be processed for the representation
+		// and determines whether geometry can be reused amongst them. Returns false when
+		// the representation is to be skipped, e.g. because it is processed as part of
+		// the representation it is mapped to.
+		bool products_for_representation_(IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct::list::ptr& products, bool& reuse_ok) {
+			products = IfcSchema::IfcProduct::list::ptr(new IfcSchema::IfcProduct::list);
+			IfcSchema::IfcProduct::list::ptr unfiltered_products = kernel.products_represented_by(representation);
+            // Include only the desired products for processing.
+            for (IfcSchema::IfcProduct::list::it jt = unfiltered_products->begin(); jt != unfiltered_products->end(); ++jt) {
+                IfcSchema::IfcProduct* prod = *jt;
+                if (boost::all(filters_, filter_match(prod))) {
+                    products->push(prod);
+                }
+            }
+
+            if (products->size() == 0) {
+                return false;
+            }
+
+            reuse_ok = reuse_ok_(products);
+
+			IfcSchema::IfcRepresentationMap::list::ptr maps = representation->RepresentationMap();
+
+			if (!reuse_ok && maps->size() == 1) {
+				// unfiltered_products contains products represented by this representation by means of mapped items.
+				// For example because of openings applied to products, reuse might not be acceptable and then the
+				// products will be processed by means of their immediate representation and not the mapped representation.
+
+				// IfcRepresentationMaps are also used for IfcTypeProducts, so an additional check is performed whether the map
+				// is indeed used by IfcMappedItems.
+				IfcSchema::IfcRepresentationMap* map = *maps->begin();
+				if (map->MapUsage()->size() > 0) {
+					return false;
+				}
+			}
+
+			// Check if this represenation has (or will be) processed as part its mapped representation
+			bool representation_processed_as_mapped_item = false;
+            IfcSchema::IfcRepresentation* representation_mapped_to = kernel.representation_mapped_to(representation);
+			if (representation_mapped_to) {
+                representation_processed_as_mapped_item = reuse_ok ||
+                    ok_mapped_representations->contains(representation_mapped_to);
+			}
+
+			if (representation_processed_as_mapped_item) {
+                ok_mapped_representations->push(representation_mapped_to);
+				return false;
+			}
+
+			return true;
+		}
+
 		BRepElement<P>* create_shape_model_for_next_entity() {
 			for (;;) {
 				IfcSchema::IfcRepresentation* representation;
@@ -417,54 +645,10 @@ namespace IfcGeom {
 				representation = *representation_iterator;
 
 				if (!ifcproducts) {
-					// Init. the list of filtered IfcProducts for this representation
-					ifcproducts = IfcSchema::IfcProduct::list::ptr(new IfcSchema::IfcProduct::list);
-					IfcSchema::IfcProduct::list::ptr unfiltered_products = kernel.products_represented_by(representation);
-                    // Include only the desired products for processing.
-                    for (IfcSchema::IfcProduct::list::it jt = unfiltered_products->begin(); jt != unfiltered_products->end(); ++jt) {
-                        IfcSchema::IfcProduct* prod = *jt;
-                        if (boost::all(filters_, filter_match(prod))) {
-                            ifcproducts->push(prod);
-                        }
-                    }
-
-                    if (ifcproducts->size() == 0) {
-                        _nextShape();
-                        continue;
-                    }
-
-                    geometry_reuse_ok_for_current_representation_ = reuse_ok_(ifcproducts);
-
-					IfcSchema::IfcRepresentationMap::list::ptr maps = representation->RepresentationMap();
-
-					if (!geometry_reuse_ok_for_current_representation_ && maps->size() == 1) {
-						// unfiltered_products contains products represented by this representation by means of mapped items.
-						// For example because of openings applied to products, reuse might not be acceptable and then the
-						// products will be processed by means of their immediate representation and not the mapped representation.
-
-						// IfcRepresentationMaps are also used for IfcTypeProducts, so an additional check is performed whether the map
-						// is indeed used by IfcMappedItems.
-						IfcSchema::IfcRepresentationMap* map = *maps->begin();
-						if (map->MapUsage()->size() > 0) {
-							_nextShape();
-							continue;
-						}
-					}
-
-					// Check if this represenation has (or will be) processed as part its mapped representation
-					bool representation_processed_as_mapped_item = false;
-                    IfcSchema::IfcRepresentation* representation_mapped_to = kernel.representation_mapped_to(representation);
-					if (representation_mapped_to) {
-                        representation_processed_as_mapped_item = geometry_reuse_ok_for_current_representation_ ||
-                            ok_mapped_representations->contains(representation_mapped_to);
-					}
-
-					if (representation_processed_as_mapped_item) {
-                        ok_mapped_representations->push(representation_mapped_to);
+					if (!products_for_representation_(representation, ifcproducts, geometry_reuse_ok_for_current_representation_)) {
 						_nextShape();
 						continue;
 					}
-
 					ifcproduct_iterator = ifcproducts->begin();
 				}
 
@@ -479,7 +663,7 @@ namespace IfcGeom {
 
 				BRepElement<P>* element;
 				if (ifcproduct_iterator == ifcproducts->begin() || !geometry_reuse_ok_for_current_representation_) {
-					element = kernel.create_brep_for_representation_and_product<P>(settings, representation, product);
+					element = create_brep_within_budget_(kernel, representation, product);
 				} else {
 					element = kernel.create_brep_for_processed_representation(settings, representation, product, current_shape_model);
 				}
@@ -495,6 +679,428 @@ namespace IfcGeom {
 			}
 		}
 
+		// Shapes read from and written to the disk cache, if enabled in the settings
+		boost::shared_ptr<DiskCache> disk_cache_;
+
+		// Equivalent of Kernel::create_brep_for_representation_and_product(), which
+		// uses the disk cache if enabled. The degradation is added to the derivation
+		// of the shapes.
+		BRepElement<P>* create_brep_(Kernel& k, const IteratorSettings& settings, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product, int degradation = 0) {
+			const DiskCache::key_type key = disk_cache_ ? k.content_key(settings, representation, product) : 0;
+
+			IfcRepresentationShapeItems shapes;
+			int derivation;
+			std::string data;
+
+			if (key && disk_cache_->read(key, data) && k.read_shapes(ifc_file, data, shapes, derivation)) {
+				return k.create_brep_for_shapes<P>(settings, representation, product, shapes, derivation);
+			}
+
+			if (!k.convert_shapes_for_product(settings, representation, product, shapes, derivation)) {
+				return 0;
+			}
+			derivation |= degradation;
+
+			// Shapes converted beyond the time budget are incomplete
+			if (key && !k.time_budget_exceeded()) {
+				if (!settings.get(IteratorSettings::USE_BREP_DATA) && !settings.get(IteratorSettings::DISABLE_TRIANGULATION)) {
+					// Shapes are triangulated before they are stored, so that the
+					// triangulation is stored as well. Triangulation does not
+					// recompute it, as the deflection is the same.
+					for (IfcRepresentationShapeItems::const_iterator it = shapes.begin(); it != shapes.end(); ++it) {
+						if (it->hasMesh()) {
+							continue;
+						}
+						try {
+							BRepMesh_IncrementalMesh(it->Shape(), settings.deflection_tolerance());
+						} catch (...) {}
+					}
+				}
+				if (k.write_shapes(ifc_file, shapes, derivation, data)) {
+					disk_cache_->write(key, data);
+				}
+			}
+
+			return k.create_brep_for_shapes<P>(settings, representation, product, shapes, derivation);
+		}
+
+		// Removes the time budget of a kernel when going out of scope and restores
+		// the sewing of shells, which is disabled when the budget is exceeded
+		class time_budget_scope {
+			Kernel& kernel_;
+			const double max_faces_to_sew_;
+		public:
+			explicit time_budget_scope(Kernel& k)
+				: kernel_(k)
+				, max_faces_to_sew_(k.getValue(Kernel::GV_MAX_FACES_TO_SEW))
+			{}
+			~time_budget_scope() {
+				kernel_.set_time_budget(0.);
+				kernel_.setValue(Kernel::GV_MAX_FACES_TO_SEW, max_faces_to_sew_);
+			}
+		};
+
+		// Converts the product within the time budget in the settings, if any. When
+		// the budget is exceeded the conversion is repeated in steps of decreasing
+		// fidelity, each within the budget: without opening subtractions, then
+		// without sewing shells, and finally as a bounding box. Every step taken is
+		// recorded in the derivation and hence in the id of the representation.
+		BRepElement<P>* create_brep_within_budget_(Kernel& k, IfcSchema::IfcRepresentation* representation, IfcSchema::IfcProduct* product) {
+			const double budget = settings.element_time_budget();
+			if (budget <= 0.) {
+				return create_brep_(k, settings, representation, product);
+			}
+
+			time_budget_scope scope(k);
+			IteratorSettings degraded_settings = settings;
+			int degradation = 0;
+
+			k.set_time_budget(budget);
+			BRepElement<P>* element = create_brep_(k, degraded_settings, representation, product);
+
+			if (k.time_budget_exceeded() && !degraded_settings.get(IteratorSettings::DISABLE_OPENING_SUBTRACTIONS) && k.find_openings(product)->size()) {
+				delete element;
+				Logger::Message(Logger::LOG_WARNING, "Time budget exceeded, skipping opening subtractions for:", product->entity);
+				degraded_settings.set(IteratorSettings::DISABLE_OPENING_SUBTRACTIONS, true);
+				degradation |= Kernel::DERIVED_NO_OPENINGS;
+				k.set_time_budget(budget);
+				element = create_brep_(k, degraded_settings, representation, product, degradation);
+			}
+
+			if (k.time_budget_exceeded() && k.getValue(Kernel::GV_MAX_FACES_TO_SEW) > -1) {
+				delete element;
+				Logger::Message(Logger::LOG_WARNING, "Time budget exceeded, skipping sewing for:", product->entity);
+				degraded_settings.set(IteratorSettings::SEW_SHELLS, false);
+				degradation |= Kernel::DERIVED_UNSEWN;
+				k.setValue(Kernel::GV_MAX_FACES_TO_SEW, -1);
+				k.set_time_budget(budget);
+				element = create_brep_(k, degraded_settings, representation, product, degradation);
+			}
+
+			if (k.time_budget_exceeded()) {
+				delete element;
+				element = 0;
+				Logger::Message(Logger::LOG_WARNING, "Time budget exceeded, creating bounding box for:", product->entity);
+				k.set_time_budget(0.);
+				IfcRepresentationShapeItems shapes;
+				int derivation;
+				if (k.convert_bounding_box_for_product(settings, representation, product, shapes, derivation)) {
+					element = k.create_brep_for_shapes<P>(settings, representation, product, shapes, derivation);
+				}
+			}
+
+			return element;
+		}
+
+		// State for processing representations using multiple threads. Representations
+		// are assigned their products on the calling thread, in file order, so that the
+		// same decisions regarding mapped representations and geometry reuse are made as
+		// when processing sequentially. Every task is then processed by one of a pool of
+		// threads, each with its own kernel, as the kernel caches are not thread-safe.
+		struct task_result {
+			BRepElement<P>* shape_model;
+			SerializedElement<P>* serialization;
+			TriangulationElement<P>* triangulation;
+		};
+
+		struct task {
+			IfcSchema::IfcRepresentation* representation;
+			IfcSchema::IfcProduct::list::ptr products;
+			bool reuse_ok;
+			// Index of the representation, used for reporting progress
+			int index;
+			bool finished;
+			std::vector<task_result> results;
+		};
+
+		boost::thread_group workers_;
+		std::vector<Kernel*> worker_kernels_;
+		boost::mutex tasks_mutex_;
+		boost::condition_variable task_available_;
+		boost::condition_variable task_finished_;
+		// Tasks not yet picked up by a worker
+		std::deque<task*> pending_tasks_;
+		// All planned tasks that are not yet delivered, in file order
+		std::deque<task*> tasks_;
+		bool stop_workers_;
+		// Task of which the results are currently being returned by next()
+		task* delivering_task_;
+		size_t delivering_index_;
+		// Number of representations for which tasks have been planned or skipped
+		int planned_;
+
+		// Conversion results cached according to the cache policy in the settings
+		boost::shared_ptr<SharedCache> shared_cache_;
+
+		// Absolute placements of the file, built once by select_representations_()
+		boost::shared_ptr<PlacementTable> placement_table_;
+
+		// Relationships of the file, built once by select_representations_()
+		boost::shared_ptr<RelationshipIndex> relationship_index_;
+
+		// The ancestors of elements for SEARCH_FLOOR by the instance name of their
+		// parent, outermost first. Every ancestor is created once and the vectors
+		// are shared by the elements with the same parent.
+		std::map<int, boost::shared_ptr<const std::vector<const Element<P>*> > > ancestors_;
+		// Owns the elements in ancestors_
+		std::vector<const Element<P>*> ancestor_elements_;
+
+		boost::shared_ptr<const std::vector<const Element<P>*> > ancestors_of_(int parent_id) {
+			typename std::map<int, boost::shared_ptr<const std::vector<const Element<P>*> > >::const_iterator it = ancestors_.find(parent_id);
+			if (it != ancestors_.end()) {
+				return it->second;
+			}
+
+			// Inserted before the ancestors of the parent are looked up, so that
+			// cyclic decompositions terminate
+			boost::shared_ptr<const std::vector<const Element<P>*> >& ancestors = ancestors_[parent_id];
+			ancestors.reset(new std::vector<const Element<P>*>);
+
+			const Element<P>* parent = 0;
+			try {
+				parent = getObject(parent_id);
+			} catch (const std::exception& e) {
+				Logger::Error(e);
+			}
+
+			std::vector<const Element<P>*>* chain = new std::vector<const Element<P>*>;
+			if (parent) {
+				ancestor_elements_.push_back(parent);
+				if (parent->parent_id() != -1) {
+					const boost::shared_ptr<const std::vector<const Element<P>*> > outer = ancestors_of_(parent->parent_id());
+					chain->assign(outer->begin(), outer->end());
+				}
+				chain->push_back(parent);
+			}
+
+			ancestors.reset(chain);
+			return ancestors;
+		}
+
+		// Styles of the representation items of the file, built once by select_representations_()
+		boost::shared_ptr<StyleTable> style_table_;
+
+		bool parallel_() const { return !worker_kernels_.empty(); }
+
+		void start_workers_() {
+#if OCC_VERSION_HEX < 0x70000
+			// Older versions of Open Cascade only use atomic reference counting
+			// and a thread-safe memory manager when explicitly requested.
+			Standard::SetReentrant(Standard_True);
+#endif
+			stop_workers_ = false;
+			for (int i = 0; i < settings.num_threads(); ++i) {
+				// The kernel is copied after units and precision are initialized. The
+				// copies share the cache, so that placements, profiles and other
+				// conversion results are not recomputed by every thread.
+				Kernel* k = new Kernel(kernel);
+				worker_kernels_.push_back(k);
+				workers_.create_thread(boost::bind(&Iterator::worker_, this, k));
+			}
+		}
+
+		void stop_workers_and_free_tasks_() {
+			{
+				boost::mutex::scoped_lock lock(tasks_mutex_);
+				stop_workers_ = true;
+			}
+			task_available_.notify_all();
+			workers_.join_all();
+
+			for (std::vector<Kernel*>::const_iterator it = worker_kernels_.begin(); it != worker_kernels_.end(); ++it) {
+				delete *it;
+			}
+			worker_kernels_.clear();
+
+			for (typename std::deque<task*>::const_iterator it = tasks_.begin(); it != tasks_.end(); ++it) {
+				free_task_(*it, 0);
+			}
+			tasks_.clear();
+			pending_tasks_.clear();
+
+			if (delivering_task_) {
+				free_task_(delivering_task_, delivering_index_);
+				delivering_task_ = 0;
+			}
+		}
+
+		// Deletes the task and the results that have not been handed out by next()
+		static void free_task_(task* t, size_t first_undelivered) {
+			for (size_t i = first_undelivered; i < t->results.size(); ++i) {
+				delete t->results[i].triangulation;
+				delete t->results[i].serialization;
+				delete t->results[i].shape_model;
+			}
+			delete t;
+		}
+
+		void worker_(Kernel* k) {
+			for (;;) {
+				task* t;
+				{
+					boost::mutex::scoped_lock lock(tasks_mutex_);
+					while (!stop_workers_ && pending_tasks_.empty()) {
+						task_available_.wait(lock);
+					}
+					if (stop_workers_) {
+						return;
+					}
+					t = pending_tasks_.front();
+					pending_tasks_.pop_front();
+				}
+
+				process_task_(*k, *t);
+
+				{
+					boost::mutex::scoped_lock lock(tasks_mutex_);
+					t->finished = true;
+				}
+				task_finished_.notify_all();
+			}
+		}
+
+		// Equivalent of create_shape_model_for_next_entity() and create() for all
+		// products of a single representation.
+		void process_task_(Kernel& k, task& t) {
+			for (IfcSchema::IfcProduct::list::it it = t.products->begin(); it != t.products->end(); ++it) {
+				IfcSchema::IfcProduct* product = *it;
+				const bool first = it == t.products->begin();
+				const task_result* previous = first ? 0 : &t.results.back();
+
+				task_result result = { 0, 0, 0 };
+
+				Logger::SetProduct(product);
+
+				try {
+					if (first || !t.reuse_ok) {
+						result.shape_model = create_brep_within_budget_(k, t.representation, product);
+					} else {
+						result.shape_model = k.create_brep_for_processed_representation(settings, t.representation, product, previous->shape_model);
+					}
+				} catch (const std::exception& e) {
+					Logger::Error(e);
+				} catch (const Standard_Failure& e) {
+					if (e.GetMessageString() && strlen(e.GetMessageString())) {
+						Logger::Error(e.GetMessageString());
+					} else {
+						Logger::Error("Unknown error creating geometry");
+					}
+				} catch (...) {
+					Logger::Error("Unknown error creating geometry");
+				}
+
+				Logger::SetProduct(boost::none);
+
+				if (!result.shape_model) {
+					// Like in the sequential case, the remaining products are skipped
+					break;
+				}
+
+				if (settings.get(IteratorSettings::USE_BREP_DATA)) {
+					try {
+						result.serialization = new SerializedElement<P>(*result.shape_model);
+					} catch (...) {
+						Logger::Message(Logger::LOG_ERROR, "Getting a serialized element from model failed.");
+					}
+				} else if (!settings.get(IteratorSettings::DISABLE_TRIANGULATION)) {
+					try {
+						if (first || !t.reuse_ok || !previous->triangulation) {
+							result.triangulation = new TriangulationElement<P>(*result.shape_model);
+						} else {
+							result.triangulation = new TriangulationElement<P>(*result.shape_model, previous->triangulation->geometry_pointer(), previous->triangulation->lod_pointers());
+						}
+					} catch (...) {
+						Logger::Message(Logger::LOG_ERROR, "Getting a triangulation element from model failed.");
+					}
+				}
+
+				t.results.push_back(result);
+			}
+		}
+
+		// Assigns products to representations until the number of tasks in flight
+		// reaches a limit, which bounds the memory used for results not yet returned.
+		void plan_tasks_() {
+			const size_t max_tasks_in_flight = 4 * worker_kernels_.size();
+			while (representations && representation_iterator != representations->end() && tasks_.size() < max_tasks_in_flight) {
+				IfcSchema::IfcRepresentation* representation = *representation_iterator;
+				IfcSchema::IfcProduct::list::ptr products;
+				bool reuse_ok = false;
+				bool process = false;
+
+				try {
+					process = products_for_representation_(representation, products, reuse_ok);
+				} catch (const std::exception& e) {
+					Logger::Error(e);
+				}
+
+				if (process) {
+					task* t = new task;
+					t->representation = representation;
+					t->products = products;
+					t->reuse_ok = reuse_ok;
+					t->index = planned_;
+					t->finished = false;
+					tasks_.push_back(t);
+					{
+						boost::mutex::scoped_lock lock(tasks_mutex_);
+						pending_tasks_.push_back(t);
+					}
+					task_available_.notify_one();
+				}
+
+				++representation_iterator;
+				++planned_;
+			}
+		}
+
+		IfcSchema::IfcProduct* create_parallel_() {
+			free_shapes();
+
+			for (;;) {
+				if (delivering_task_) {
+					if (delivering_index_ < delivering_task_->results.size()) {
+						const task_result& result = delivering_task_->results[delivering_index_++];
+						current_shape_model = result.shape_model;
+						current_serialization = result.serialization;
+						current_triangulation = result.triangulation;
+						return current_shape_model->product();
+					}
+					free_task_(delivering_task_, delivering_index_);
+					delivering_task_ = 0;
+				}
+
+				plan_tasks_();
+
+				if (tasks_.empty()) {
+					done = planned_;
+					return 0;
+				}
+
+				typename std::deque<task*>::iterator it = tasks_.end();
+				{
+					boost::mutex::scoped_lock lock(tasks_mutex_);
+					for (;;) {
+						if (settings.get(IteratorSettings::UNORDERED_RESULTS)) {
+							for (it = tasks_.begin(); it != tasks_.end(); ++it) {
+								if ((*it)->finished) break;
+							}
+						} else {
+							it = tasks_.begin();
+							if (!(*it)->finished) it = tasks_.end();
+						}
+						if (it != tasks_.end()) break;
+						task_finished_.wait(lock);
+					}
+				}
+
+				delivering_task_ = *it;
+				delivering_index_ = 0;
+				tasks_.erase(it);
+				done = delivering_task_->index;
+			}
+		}
+
 		void free_shapes() {
 			// Free all possible representations of the current geometrical entity
 			delete current_triangulation;
@@ -542,49 +1148,9 @@ namespace IfcGeom {
             else if (current_shape_model) { ret = current_shape_model; }
 
 			// If we want to organize the element considering their hierarchy
-			if (settings.get(IteratorSettings::SEARCH_FLOOR))
+			if (ret && settings.get(IteratorSettings::SEARCH_FLOOR) && ret->parent_id() != -1)
 			{
-				// We are going to build a vector with the element parents.
-				// First, create the parent vector
-				std::vector<const IfcGeom::Element<P>*> parents;
-				
-				// if the element has a parent
-				if (ret->parent_id() != -1)
-				{
-					const IfcGeom::Element<P>* parent_object = NULL;
-					bool hasParent = true;
-
-					// get the parent 
-					try {
-						parent_object = getObject(ret->parent_id());
-					} catch (const std::exception& e) {
-						Logger::Error(e);
-						hasParent = false;
-					}
-
-					// Add the previously found parent to the vector
-					if (hasParent) parents.insert(parents.begin(), parent_object);
-					
-					// We need to find all the parents
-					while (parent_object != NULL && hasParent && parent_object->parent_id() != -1)
-					{
-						// Find the next parent
-						try {
-							parent_object = getObject(parent_object->parent_id());
-						} catch (const std::exception& e) {
-							Logger::Error(e);
-							hasParent = false;
-						}
-
-						// Add the previously found parent to the vector
-						if (hasParent) parents.insert(parents.begin(), parent_object);
-
-						hasParent = hasParent && parent_object->parent_id() != -1;
-					}
-
-					// when done push the parent list in the Element object
-					ret->SetParents(parents);
-				}
+				ret->SetParents(ancestors_of_(ret->parent_id()));
 			}
 
             return ret;
@@ -617,7 +1183,7 @@ namespace IfcGeom {
 					ifc_product = ifc_entity->as<IfcSchema::IfcProduct>();
 					parent_id = -1;
 					try {
-						IfcSchema::IfcObjectDefinition* parent_object = kernel.get_decomposing_entity(ifc_product);
+						IfcSchema::IfcObjectDefinition* parent_object = kernel.decomposing_entity(ifc_product);
 						if (parent_object) {
 							parent_id = parent_object->entity->id();
 						}
@@ -654,6 +1220,10 @@ namespace IfcGeom {
 		}
 
 		IfcSchema::IfcProduct* create() {
+			if (parallel_()) {
+				return create_parallel_();
+			}
+
 			IfcGeom::BRepElement<P>* next_shape_model = 0;
 			IfcGeom::SerializedElement<P>* next_serialization = 0;
 			IfcGeom::TriangulationElement<P>* next_triangulation = 0;
@@ -684,7 +1254,7 @@ namespace IfcGeom {
 						if (ifcproduct_iterator == ifcproducts->begin() || !geometry_reuse_ok_for_current_representation_) {
 							next_triangulation = new TriangulationElement<P>(*next_shape_model);
 						} else {
-							next_triangulation = new TriangulationElement<P>(*next_shape_model, current_triangulation->geometry_pointer());
+							next_triangulation = new TriangulationElement<P>(*next_shape_model, current_triangulation->geometry_pointer(), current_triangulation->lod_pointers());
 						}
 					} catch (...) {
                         Logger::Message(Logger::LOG_ERROR, "Getting a triangulation element from model failed.");
@@ -692,6 +1262,13 @@ namespace IfcGeom {
 				}
 			}
 
+#ifndef NO_CACHE
+			// Meshing adds triangulations to the shapes shared with the cache
+			if (shared_cache_ && !shared_cache_->concurrent()) {
+				shared_cache_->remeasure();
+			}
+#endif
+
 			free_shapes();
 
 			current_shape_model = next_shape_model;
@@ -706,6 +1283,11 @@ namespace IfcGeom {
 			current_shape_model = 0;
 			current_serialization = 0;
 
+			delivering_task_ = 0;
+			delivering_index_ = 0;
+			stop_workers_ = false;
+			planned_ = 0;
+
 			unit_name = "METER";
 			unit_magnitude = 1.f;
 
@@ -720,6 +1302,39 @@ namespace IfcGeom {
 			} else if (settings.get(IteratorSettings::SITE_LOCAL_PLACEMENT)) {
 				kernel.set_conversion_placement_rel_to(IfcSchema::Type::IfcSite);
 			}
+
+			// Tessellated items and extrusions are triangulated directly when no
+			// shapes are returned, curves in profiles by the deflection tolerance
+			kernel.setValue(IfcGeom::Kernel::GV_DEFLECTION_TOLERANCE, settings.deflection_tolerance());
+			kernel.setValue(IfcGeom::Kernel::GV_BOOLEAN_FUZZINESS, settings.boolean_fuzziness());
+			kernel.set_boolean_threads(settings.boolean_threads());
+			kernel.set_parallel_booleans(settings.get(IteratorSettings::PARALLEL_BOOLEANS));
+			kernel.set_mesh_passthrough(
+				!settings.get(IteratorSettings::USE_BREP_DATA) &&
+				!settings.get(IteratorSettings::DISABLE_TRIANGULATION) &&
+				!settings.get(IteratorSettings::NO_MESH_PASSTHROUGH));
+			// Levels of detail are triangulated from the same items at other
+			// tolerances, which meshes of curved geometry would not follow
+			kernel.set_approximate_mesh_passthrough(settings.lod_deflection_tolerances().empty());
+
+#ifndef NO_CACHE
+			// Replaces the kernel's own cache, which is never evicted from
+			shared_cache_.reset(new SharedCache(settings.num_threads() > 1));
+			if (settings.cache_policy() == IteratorSettings::CACHE_OFF) {
+				shared_cache_->set_budget(0);
+			} else if (settings.cache_policy() == IteratorSettings::CACHE_BOUNDED) {
+				shared_cache_->set_budget(settings.cache_budget());
+			}
+			kernel.set_shared_cache(shared_cache_);
+#endif
+
+			if (!settings.disk_cache_directory().empty()) {
+				try {
+					disk_cache_.reset(new DiskCache(settings.disk_cache_directory(), settings.disk_cache_size()));
+				} catch (const std::exception& e) {
+					Logger::Error(e);
+				}
+			}
 		}
 
 		bool owns_ifc_file;
@@ -757,11 +1372,18 @@ namespace IfcGeom {
 		}
 
 		~Iterator() {
+			// Workers read from the file, so they are stopped before it is deleted
+			stop_workers_and_free_tasks_();
+
 			if (owns_ifc_file) {
 				delete ifc_file;
 			}
 
 			free_shapes();
+
+			for (typename std::vector<const Element<P>*>::const_iterator it = ancestor_elements_.begin(); it != ancestor_elements_.end(); ++it) {
+				delete *it;
+			}
 		}
 	};
 }
@@ -20,6 +20,11 @@
 #ifndef IFCGEOMITERATORSETTINGS_H
 #define IFCGEOMITERATORSETTINGS_H
 
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
 #include "ifc_geom_api.h"
 #include "../ifcparse/IfcException.h"
 #include "../ifcparse/IfcBaseClass.h"
@@ -84,15 +89,48 @@ namespace IfcGeom
 			SITE_LOCAL_PLACEMENT = 1 << 15,
 			///
 			BUILDING_LOCAL_PLACEMENT = 1 << 16,
+			/// When multiple threads are used, returns elements as soon as they are
+			/// processed rather than in the order of the representations in the file.
+			UNORDERED_RESULTS = 1 << 17,
+			/// Converts IfcTessellatedFaceSets, faceted breps and extrusions of polygonal
+			/// profiles to shapes even if only triangulated output is requested, rather
+			/// than copying the triangles as specified in the file or triangulating the
+			/// items directly. Useful if the shapes of the elements are used as well,
+			/// e.g. for quantities.
+			NO_MESH_PASSTHROUGH = 1 << 18,
+			/// Enables the parallel mode of Open Cascade boolean operations, in which
+			/// the intersections of the operands are computed by multiple threads.
+			PARALLEL_BOOLEANS = 1 << 19,
 			/// Number of different setting flags.
-			NUM_SETTINGS = 16
+			NUM_SETTINGS = 19
         };
         /// Used to store logical OR combination of setting flags.
         typedef unsigned SettingField;
 
+        /// Policy for caching intermediate conversion results, such as placements
+        /// and shapes, which are often shared by multiple representations.
+        enum CachePolicy
+        {
+            /// Nothing is cached
+            CACHE_OFF,
+            /// Least recently used entries are evicted when the estimated memory
+            /// used exceeds the cache budget
+            CACHE_BOUNDED,
+            /// Nothing is evicted from the cache
+            CACHE_UNBOUNDED
+        };
+
         IteratorSettings()
             : settings_(WELD_VERTICES) // OR options that default to true here
             , deflection_tolerance_(1.e-3)
+            , num_threads_(1)
+            , mesher_threads_(1)
+            , boolean_threads_(1)
+            , boolean_fuzziness_(-1.)
+            , element_time_budget_(0.)
+            , cache_policy_(CACHE_BOUNDED)
+            , cache_budget_(256 * 1024 * 1024)
+            , disk_cache_size_(1024ULL * 1024 * 1024)
         {
         }
 
@@ -110,6 +148,71 @@ namespace IfcGeom
             }
         }
 
+        /// Deflection tolerances of additional levels of detail, typically larger
+        /// than deflection_tolerance(). For every tolerance, a triangulation of the
+        /// same shapes is created, see TriangulationElement::lod(). Empty by default.
+        const std::vector<double>& lod_deflection_tolerances() const { return lod_deflection_tolerances_; }
+        void set_lod_deflection_tolerances(const std::vector<double>& value) { lod_deflection_tolerances_ = value; }
+
+        /// Number of threads used by the iterator to create geometry. By default,
+        /// all geometry is created on the thread that calls Iterator::next().
+        int num_threads() const { return num_threads_; }
+
+        void set_num_threads(int value)
+        {
+            num_threads_ = value < 1 ? 1 : value;
+        }
+
+        /// Number of threads used to triangulate the shapes of a single element,
+        /// which speeds up elements with many items, such as curtain walls and
+        /// steel assemblies. The triangulation is the same regardless of the
+        /// number of threads. By default, shapes are triangulated one by one.
+        int mesher_threads() const { return mesher_threads_; }
+
+        void set_mesher_threads(int value)
+        {
+            mesher_threads_ = value < 1 ? 1 : value;
+        }
+
+        /// Number of threads used to subtract openings from the shapes of a single
+        /// element, for example the panels of a curtain wall. By default, shapes
+        /// are cut one by one.
+        int boolean_threads() const { return boolean_threads_; }
+
+        void set_boolean_threads(int value)
+        {
+            boolean_threads_ = value < 1 ? 1 : value;
+        }
+
+        /// Fuzzy value of boolean operations, which is increased when an operation
+        /// fails. Negative by default, in which case the precision of the
+        /// representation context is used.
+        double boolean_fuzziness() const { return boolean_fuzziness_; }
+        void set_boolean_fuzziness(double value) { boolean_fuzziness_ = value; }
+
+        /// Time in seconds in which an element is to be converted. When exceeded,
+        /// the element is converted again without opening subtractions, then
+        /// without sewing shells and finally as a bounding box. Zero, i.e.
+        /// unlimited, by default.
+        double element_time_budget() const { return element_time_budget_; }
+        void set_element_time_budget(double value) { element_time_budget_ = value; }
+
+        CachePolicy cache_policy() const { return cache_policy_; }
+        void set_cache_policy(CachePolicy value) { cache_policy_ = value; }
+
+        /// Budget in bytes for the CACHE_BOUNDED policy, 256 MiB by default.
+        std::size_t cache_budget() const { return cache_budget_; }
+        void set_cache_budget(std::size_t value) { cache_budget_ = value; }
+
+        /// Directory in which converted shapes are stored to be reused by subsequent
+        /// runs, see IfcGeom::DiskCache. Empty, i.e. disabled, by default.
+        const std::string& disk_cache_directory() const { return disk_cache_directory_; }
+        void set_disk_cache_directory(const std::string& value) { disk_cache_directory_ = value; }
+
+        /// Size limit in bytes of the disk cache directory, 1 GiB by default.
+        boost::uint64_t disk_cache_size() const { return disk_cache_size_; }
+        void set_disk_cache_size(boost::uint64_t value) { disk_cache_size_ = value; }
+
         /// Get boolean value for a single settings or for a combination of settings.
         bool get(SettingField setting) const
         {
@@ -131,6 +234,16 @@ namespace IfcGeom
     protected:
         SettingField settings_;
         double deflection_tolerance_;
+        std::vector<double> lod_deflection_tolerances_;
+        int num_threads_;
+        int mesher_threads_;
+        int boolean_threads_;
+        double boolean_fuzziness_;
+        double element_time_budget_;
+        CachePolicy cache_policy_;
+        std::size_t cache_budget_;
+        std::string disk_cache_directory_;
+        boost::uint64_t disk_cache_size_;
     };
 
     class IFC_GEOM_API ElementSettings : public IteratorSettings
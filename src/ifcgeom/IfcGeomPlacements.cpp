@@ -0,0 +1,219 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+
+#include <cstring>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <Standard.hxx>
+#include <Standard_Version.hxx>
+#include <Standard_Failure.hxx>
+
+#include "../ifcparse/IfcFile.h"
+#include "../ifcparse/IfcLogger.h"
+
+#include "IfcGeom.h"
+#include "IfcGeomPlacements.h"
+
+namespace {
+	// Levels with fewer placements are resolved by a single thread
+	const size_t min_placements_per_thread = 256;
+}
+
+void IfcGeom::PlacementTable::build(Kernel& kernel, IfcParse::IfcFile* file, int num_threads) {
+	placement_rel_to_ = kernel.get_conversion_placement_rel_to();
+
+	IfcSchema::IfcLocalPlacement::list::ptr list = file->entitiesByType<IfcSchema::IfcLocalPlacement>();
+	std::vector<IfcSchema::IfcLocalPlacement*> placements;
+	placements.reserve(list->size());
+
+	// Temporarily indexes the placements in file order
+	slots_.assign(file->getMaxId() + 1, -1);
+	for (IfcSchema::IfcLocalPlacement::list::it it = list->begin(); it != list->end(); ++it) {
+		const unsigned int id = (*it)->entity->id();
+		if (id >= slots_.size()) {
+			slots_.resize(id + 1, -1);
+		}
+		slots_[id] = (int) placements.size();
+		placements.push_back(*it);
+	}
+
+	const size_t n = placements.size();
+
+	std::vector<int> parent(n, -1);
+	for (size_t i = 0; i < n; ++i) {
+		try {
+			IfcSchema::IfcLocalPlacement* p = kernel.placement_parent(placements[i]);
+			if (p) {
+				parent[i] = slots_[p->entity->id()];
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		}
+	}
+
+	// The depth of every placement, determined by walking up the chain of
+	// parents until a placement of which the depth is known or a root
+	std::vector<int> depth(n, -1);
+	std::vector<size_t> chain;
+	int max_depth = -1;
+	for (size_t i = 0; i < n; ++i) {
+		int d = -1;
+		size_t j = i;
+		for (;;) {
+			if (depth[j] >= 0) {
+				d = depth[j];
+				break;
+			}
+			if (depth[j] == -2) {
+				Logger::Message(Logger::LOG_ERROR, "Cyclic placement:", placements[j]->entity);
+				parent[chain.back()] = -1;
+				break;
+			}
+			// Marks the placement as being on the current chain
+			depth[j] = -2;
+			chain.push_back(j);
+			if (parent[j] == -1) {
+				break;
+			}
+			j = parent[j];
+		}
+		while (!chain.empty()) {
+			depth[chain.back()] = ++d;
+			chain.pop_back();
+		}
+		max_depth = std::max(max_depth, depth[i]);
+	}
+
+	// Orders the placements by depth
+	levels_.assign(max_depth + 2, 0);
+	for (size_t i = 0; i < n; ++i) {
+		++levels_[depth[i] + 1];
+	}
+	for (size_t d = 1; d < levels_.size(); ++d) {
+		levels_[d] += levels_[d - 1];
+	}
+
+	std::vector<size_t> next(levels_.begin(), levels_.end() - 1);
+	std::vector<size_t> position(n);
+	for (size_t i = 0; i < n; ++i) {
+		position[i] = next[depth[i]]++;
+	}
+
+	std::vector<IfcSchema::IfcLocalPlacement*> ordered(n);
+	parents_.assign(n, -1);
+	for (size_t i = 0; i < n; ++i) {
+		ordered[position[i]] = placements[i];
+		slots_[placements[i]->entity->id()] = (int) position[i];
+		if (parent[i] != -1) {
+			parents_[position[i]] = (int) position[parent[i]];
+		}
+	}
+
+	transforms_.assign(n, gp_Trsf());
+	resolved_.assign(n, 0);
+
+	std::vector<Kernel*> kernels;
+	if (num_threads > 1) {
+#if OCC_VERSION_HEX < 0x70000
+		Standard::SetReentrant(Standard_True);
+#endif
+		for (int i = 1; i < num_threads; ++i) {
+			kernels.push_back(new Kernel(kernel));
+		}
+	}
+
+	// The placements of a level only depend on the placements of the levels
+	// before it, so that every level is divided amongst the threads
+	for (size_t d = 0; d + 1 < levels_.size(); ++d) {
+		const size_t begin = levels_[d];
+		const size_t end = levels_[d + 1];
+		const size_t num_chunks = std::min(kernels.size() + 1, (end - begin) / min_placements_per_thread);
+		if (num_chunks < 2) {
+			resolve_(&kernel, ordered, begin, end);
+			continue;
+		}
+		boost::thread_group threads;
+		for (size_t t = 1; t < num_chunks; ++t) {
+			threads.create_thread(boost::bind(&PlacementTable::resolve_, this, kernels[t - 1], boost::cref(ordered),
+				begin + (end - begin) * t / num_chunks, begin + (end - begin) * (t + 1) / num_chunks));
+		}
+		resolve_(&kernel, ordered, begin, begin + (end - begin) / num_chunks);
+		threads.join_all();
+	}
+
+	for (std::vector<Kernel*>::const_iterator it = kernels.begin(); it != kernels.end(); ++it) {
+		delete *it;
+	}
+}
+
+void IfcGeom::PlacementTable::resolve_(Kernel* kernel, const std::vector<IfcSchema::IfcLocalPlacement*>& placements, size_t begin, size_t end) {
+	for (size_t i = begin; i < end; ++i) {
+		const int parent = parents_[i];
+		if (parent != -1 && !resolved_[parent]) {
+			// Left to the kernel, which reports the error
+			continue;
+		}
+
+		gp_Trsf local;
+		try {
+			IfcSchema::IfcAxis2Placement* relplacement = placements[i]->RelativePlacement();
+			if (relplacement->is(IfcSchema::Type::IfcAxis2Placement3D)) {
+				kernel->convert((IfcSchema::IfcAxis2Placement3D*) relplacement, local);
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+			continue;
+		} catch (const Standard_Failure& e) {
+			if (e.GetMessageString() && strlen(e.GetMessageString())) {
+				Logger::Error(e.GetMessageString());
+			} else {
+				Logger::Error("Failed to construct placement");
+			}
+			continue;
+		} catch (...) {
+			Logger::Error("Failed to construct placement");
+			continue;
+		}
+
+		if (parent == -1) {
+			transforms_[i] = local;
+		} else {
+			transforms_[i] = transforms_[parent];
+			transforms_[i].Multiply(local);
+		}
+		resolved_[i] = 1;
+	}
+}
+
+bool IfcGeom::PlacementTable::find(const IfcSchema::IfcObjectPlacement* placement, gp_Trsf& trsf) const {
+	const unsigned int id = placement->entity->id();
+	if (id >= slots_.size()) {
+		return false;
+	}
+	const int slot = slots_[id];
+	if (slot == -1 || !resolved_[slot]) {
+		return false;
+	}
+	trsf = transforms_[slot];
+	return true;
+}
@@ -0,0 +1,85 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+
+#ifndef IFCGEOMPLACEMENTS_H
+#define IFCGEOMPLACEMENTS_H
+
+#include <vector>
+
+#include <gp_Trsf.hxx>
+
+#include "../ifcparse/IfcParse.h"
+#include "../ifcparse/IfcBaseClass.h"
+
+#include "ifc_geom_api.h"
+
+namespace IfcGeom {
+
+	class Kernel;
+
+	/// The absolute transformations of all IfcLocalPlacements in a file, resolved
+	/// once so that the placement chains of products, which typically share the
+	/// placements of storeys, buildings and sites, are not traversed for every
+	/// product. Placements are stored in topological order, parents before their
+	/// children, and are resolved one depth level at a time, every level in
+	/// parallel. The table is read-only after build() and can be shared by the
+	/// kernels of multiple threads.
+	class IFC_GEOM_API PlacementTable {
+	private:
+		// Absolute transformations, in order of depth
+		std::vector<gp_Trsf> transforms_;
+		// Index of the parent transformation, -1 for placements that are not
+		// relative to another placement
+		std::vector<int> parents_;
+		// Whether the transformation could be resolved
+		std::vector<char> resolved_;
+		// Index of the transformation by instance name, -1 for other instances
+		std::vector<int> slots_;
+		// Index in transforms_ of the first placement of every depth level
+		std::vector<size_t> levels_;
+		IfcSchema::Type::Enum placement_rel_to_;
+
+		void resolve_(Kernel* kernel, const std::vector<IfcSchema::IfcLocalPlacement*>& placements, size_t begin, size_t end);
+
+		PlacementTable(const PlacementTable&); // N/I
+		PlacementTable& operator=(const PlacementTable&); // N/I
+	public:
+		PlacementTable() : placement_rel_to_(IfcSchema::Type::UNDEFINED) {}
+
+		/// Resolves the placements in the file using the settings of the kernel.
+		/// Copies of the kernel are used for the other threads.
+		void build(Kernel& kernel, IfcParse::IfcFile* file, int num_threads);
+
+		/// Returns false if the placement is not in the table or could not be
+		/// resolved, in which case the kernel converts it on its own.
+		bool find(const IfcSchema::IfcObjectPlacement* placement, gp_Trsf& trsf) const;
+
+		/// The product type at which placement chains are cut off, see
+		/// Kernel::set_conversion_placement_rel_to()
+		IfcSchema::Type::Enum placement_rel_to() const { return placement_rel_to_; }
+
+		size_t size() const { return transforms_.size(); }
+		/// The number of depth levels, a level being resolved after its parent level
+		size_t levels() const { return levels_.empty() ? 0 : levels_.size() - 1; }
+	};
+
+}
+
+#endif
@@ -0,0 +1,450 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+
+/********************************************************************************
+ *                                                                              *
+ * Triangulation of planar polygons by ear clipping, after the algorithm of     *
+ * the earcut library by Mapbox (ISC license). The polygon is projected onto    *
+ * the coordinate plane that is most perpendicular to its normal, in which the  *
+ * outer boundary is counter-clockwise and the inner boundaries are clockwise.  *
+ *                                                                              *
+ ********************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "IfcGeom.h"
+#include "IfcGeomPolygonTriangulator.h"
+
+namespace {
+	bool point_in_triangle(double ax, double ay, double bx, double by, double cx, double cy, double px, double py) {
+		const double d1 = (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+		const double d2 = (cx - bx) * (py - by) - (cy - by) * (px - bx);
+		const double d3 = (ax - cx) * (py - cy) - (ay - cy) * (px - cx);
+		return (d1 >= 0. && d2 >= 0. && d3 >= 0.) || (d1 <= 0. && d2 <= 0. && d3 <= 0.);
+	}
+
+	int sign(double d) {
+		return d > 0. ? 1 : (d < 0. ? -1 : 0);
+	}
+
+	bool on_segment(double px, double py, double qx, double qy, double rx, double ry) {
+		return qx <= (std::max)(px, rx) && qx >= (std::min)(px, rx) && qy <= (std::max)(py, ry) && qy >= (std::min)(py, ry);
+	}
+}
+
+int IfcGeom::PolygonTriangulator::insert_(int i, double x, double y, int last) {
+	const int p = (int) index_.size();
+	index_.push_back(i);
+	x_.push_back(x);
+	y_.push_back(y);
+	if (last == -1) {
+		prev_.push_back(p);
+		next_.push_back(p);
+	} else {
+		prev_.push_back(last);
+		next_.push_back(next_[last]);
+		prev_[next_[last]] = p;
+		next_[last] = p;
+	}
+	return p;
+}
+
+void IfcGeom::PolygonTriangulator::remove_(int p) {
+	next_[prev_[p]] = next_[p];
+	prev_[next_[p]] = prev_[p];
+}
+
+double IfcGeom::PolygonTriangulator::orient_(int a, int b, int c) const {
+	return (x_[b] - x_[a]) * (y_[c] - y_[a]) - (y_[b] - y_[a]) * (x_[c] - x_[a]);
+}
+
+bool IfcGeom::PolygonTriangulator::equals_(int a, int b) const {
+	return x_[a] == x_[b] && y_[a] == y_[b];
+}
+
+int IfcGeom::PolygonTriangulator::linked_list_(const std::vector<gp_XYZ>& points, const Loop& loop, int u, int v, double sign, bool counter_clockwise) {
+	const int n = (int) loop.size();
+	double area = 0.;
+	for (int i = 0, j = n - 1; i < n; j = i++) {
+		const gp_XYZ& a = points[loop[j]];
+		const gp_XYZ& b = points[loop[i]];
+		area += a.Coord(u) * sign * b.Coord(v) - b.Coord(u) * sign * a.Coord(v);
+	}
+	int last = -1;
+	if (counter_clockwise == (area > 0.)) {
+		for (int i = 0; i < n; ++i) {
+			const gp_XYZ& p = points[loop[i]];
+			last = insert_(loop[i], p.Coord(u), sign * p.Coord(v), last);
+		}
+	} else {
+		for (int i = n - 1; i >= 0; --i) {
+			const gp_XYZ& p = points[loop[i]];
+			last = insert_(loop[i], p.Coord(u), sign * p.Coord(v), last);
+		}
+	}
+	// A closing point equal to the first one is removed
+	if (last != -1 && equals_(last, next_[last])) {
+		remove_(last);
+		last = next_[last];
+	}
+	return last;
+}
+
+int IfcGeom::PolygonTriangulator::filter_points_(int start, int end) {
+	if (end == -1) {
+		end = start;
+	}
+	int p = start;
+	bool again;
+	do {
+		again = false;
+		if (equals_(p, next_[p]) || orient_(prev_[p], p, next_[p]) == 0.) {
+			remove_(p);
+			p = end = prev_[p];
+			if (p == next_[p]) {
+				break;
+			}
+			again = true;
+		} else {
+			p = next_[p];
+		}
+	} while (again || p != end);
+	return end;
+}
+
+bool IfcGeom::PolygonTriangulator::is_ear_(int ear) const {
+	const int a = prev_[ear], b = ear, c = next_[ear];
+	if (orient_(a, b, c) <= 0.) {
+		// Reflex
+		return false;
+	}
+	const double x0 = (std::min)(x_[a], (std::min)(x_[b], x_[c]));
+	const double y0 = (std::min)(y_[a], (std::min)(y_[b], y_[c]));
+	const double x1 = (std::max)(x_[a], (std::max)(x_[b], x_[c]));
+	const double y1 = (std::max)(y_[a], (std::max)(y_[b], y_[c]));
+	// No reflex vertex other than the ones at the corners may lie in the ear
+	for (int p = next_[c]; p != a; p = next_[p]) {
+		if (x_[p] >= x0 && x_[p] <= x1 && y_[p] >= y0 && y_[p] <= y1 && !equals_(p, a) &&
+			point_in_triangle(x_[a], y_[a], x_[b], y_[b], x_[c], y_[c], x_[p], y_[p]) &&
+			orient_(prev_[p], p, next_[p]) <= 0.)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool IfcGeom::PolygonTriangulator::locally_inside_(int a, int b) const {
+	return orient_(prev_[a], a, next_[a]) > 0.
+		? orient_(a, b, next_[a]) <= 0. && orient_(a, prev_[a], b) <= 0.
+		: orient_(a, b, prev_[a]) > 0. || orient_(a, next_[a], b) > 0.;
+}
+
+bool IfcGeom::PolygonTriangulator::middle_inside_(int a, int b) const {
+	const double px = (x_[a] + x_[b]) / 2.;
+	const double py = (y_[a] + y_[b]) / 2.;
+	bool inside = false;
+	int p = a;
+	do {
+		const int q = next_[p];
+		if ((y_[p] > py) != (y_[q] > py) && y_[q] != y_[p] &&
+			px < (x_[q] - x_[p]) * (py - y_[p]) / (y_[q] - y_[p]) + x_[p])
+		{
+			inside = !inside;
+		}
+		p = q;
+	} while (p != a);
+	return inside;
+}
+
+bool IfcGeom::PolygonTriangulator::intersects_polygon_(int a, int b) const {
+	int p = a;
+	do {
+		const int q = next_[p];
+		if (index_[p] != index_[a] && index_[q] != index_[a] && index_[p] != index_[b] && index_[q] != index_[b]) {
+			const int o1 = sign(orient_(p, q, a));
+			const int o2 = sign(orient_(p, q, b));
+			const int o3 = sign(orient_(a, b, p));
+			const int o4 = sign(orient_(a, b, q));
+			if ((o1 != o2 && o3 != o4) ||
+				(o1 == 0 && on_segment(x_[p], y_[p], x_[a], y_[a], x_[q], y_[q])) ||
+				(o2 == 0 && on_segment(x_[p], y_[p], x_[b], y_[b], x_[q], y_[q])) ||
+				(o3 == 0 && on_segment(x_[a], y_[a], x_[p], y_[p], x_[b], y_[b])) ||
+				(o4 == 0 && on_segment(x_[a], y_[a], x_[q], y_[q], x_[b], y_[b])))
+			{
+				return true;
+			}
+		}
+		p = q;
+	} while (p != a);
+	return false;
+}
+
+bool IfcGeom::PolygonTriangulator::is_valid_diagonal_(int a, int b) const {
+	if (index_[next_[a]] == index_[b] || index_[prev_[a]] == index_[b] || intersects_polygon_(a, b)) {
+		return false;
+	}
+	if (locally_inside_(a, b) && locally_inside_(b, a) && middle_inside_(a, b) &&
+		(orient_(prev_[a], a, prev_[b]) != 0. || orient_(a, prev_[b], b) != 0.))
+	{
+		return true;
+	}
+	// Coincident points of which both are reflex
+	return equals_(a, b) && orient_(prev_[a], a, next_[a]) < 0. && orient_(prev_[b], b, next_[b]) < 0.;
+}
+
+int IfcGeom::PolygonTriangulator::split_polygon_(int a, int b) {
+	// Links a to b and a copy of b to a copy of a, the copy of b is returned
+	const int an = next_[a], bp = prev_[b];
+	const int a2 = insert_(index_[a], x_[a], y_[a], -1);
+	const int b2 = insert_(index_[b], x_[b], y_[b], -1);
+	next_[a] = b; prev_[b] = a;
+	next_[a2] = an; prev_[an] = a2;
+	next_[b2] = a2; prev_[a2] = b2;
+	next_[bp] = b2; prev_[b2] = bp;
+	return b2;
+}
+
+int IfcGeom::PolygonTriangulator::find_hole_bridge_(int hole, int outer) const {
+	const double hx = x_[hole], hy = y_[hole];
+	double qx = -std::numeric_limits<double>::infinity();
+	int m = -1;
+
+	// Finds the segment of the outer boundary left of the hole point that is
+	// intersected by a horizontal ray through it, closest to the hole
+	int p = outer;
+	do {
+		const int q = next_[p];
+		if (hy <= y_[p] && hy >= y_[q] && y_[q] != y_[p]) {
+			const double x = x_[p] + (hy - y_[p]) * (x_[q] - x_[p]) / (y_[q] - y_[p]);
+			if (x <= hx && x > qx) {
+				qx = x;
+				m = x_[p] < x_[q] ? p : q;
+				if (x == hx) {
+					// The hole touches the outer boundary
+					return m;
+				}
+			}
+		}
+		p = q;
+	} while (p != outer);
+
+	if (m == -1) {
+		return -1;
+	}
+
+	// Of the points in the triangle of the hole point, the intersection and the
+	// segment endpoint, the one with the smallest angle to the ray is visible
+	const int stop = m;
+	const double mx = x_[m], my = y_[m];
+	double tan_min = std::numeric_limits<double>::infinity();
+	p = m;
+	do {
+		if (hx >= x_[p] && x_[p] >= mx && hx != x_[p] &&
+			point_in_triangle(hx, hy, qx, hy, mx, my, x_[p], y_[p]))
+		{
+			const double tan = std::fabs(hy - y_[p]) / (hx - x_[p]);
+			if (locally_inside_(p, hole) && (tan < tan_min || (tan == tan_min && (x_[p] > x_[m] ||
+				(x_[p] == x_[m] && orient_(prev_[m], m, prev_[p]) > 0. && orient_(next_[p], m, next_[m]) > 0.)))))
+			{
+				m = p;
+				tan_min = tan;
+			}
+		}
+		p = next_[p];
+	} while (p != stop);
+
+	return m;
+}
+
+namespace {
+	bool compare_leftmost(const std::pair<std::pair<double, double>, int>& a, const std::pair<std::pair<double, double>, int>& b) {
+		return a.first < b.first;
+	}
+}
+
+int IfcGeom::PolygonTriangulator::eliminate_holes_(const std::vector<gp_XYZ>& points, const std::vector<Loop>& loops, int u, int v, double sign, int outer) {
+	std::vector< std::pair<std::pair<double, double>, int> > queue;
+	for (std::vector<Loop>::const_iterator it = loops.begin() + 1; it != loops.end(); ++it) {
+		if (it->size() < 3) {
+			continue;
+		}
+		const int start = linked_list_(points, *it, u, v, sign, false);
+		int leftmost = start, p = start;
+		do {
+			if (x_[p] < x_[leftmost] || (x_[p] == x_[leftmost] && y_[p] < y_[leftmost])) {
+				leftmost = p;
+			}
+			p = next_[p];
+		} while (p != start);
+		queue.push_back(std::make_pair(std::make_pair(x_[leftmost], y_[leftmost]), leftmost));
+	}
+
+	// Holes are bridged from left to right, so that bridges do not cross holes yet to be processed
+	std::sort(queue.begin(), queue.end(), compare_leftmost);
+
+	for (std::vector< std::pair<std::pair<double, double>, int> >::const_iterator it = queue.begin(); it != queue.end(); ++it) {
+		const int hole = it->second;
+		const int bridge = find_hole_bridge_(hole, outer);
+		if (bridge == -1) {
+			failed_ = true;
+			return outer;
+		}
+		const int bridge_reverse = split_polygon_(bridge, hole);
+		filter_points_(bridge_reverse, next_[bridge_reverse]);
+		outer = filter_points_(bridge, next_[bridge]);
+	}
+
+	return outer;
+}
+
+void IfcGeom::PolygonTriangulator::clip_ears_(int ear, int pass, std::vector<int>& triangles) {
+	int stop = ear;
+	while (prev_[ear] != next_[ear]) {
+		const int prev = prev_[ear], next = next_[ear];
+		if (is_ear_(ear)) {
+			triangles.push_back(index_[prev]);
+			triangles.push_back(index_[ear]);
+			triangles.push_back(index_[next]);
+			remove_(ear);
+			ear = stop = next_[next];
+			continue;
+		}
+		ear = next;
+		if (ear == stop) {
+			// No ears left: first remove collinear and duplicate points, then
+			// split the remainder along a diagonal and triangulate the halves
+			if (pass == 0) {
+				clip_ears_(filter_points_(ear), 1, triangles);
+			} else {
+				split_(ear, triangles);
+			}
+			break;
+		}
+	}
+}
+
+void IfcGeom::PolygonTriangulator::split_(int start, std::vector<int>& triangles) {
+	int a = start;
+	do {
+		for (int b = next_[next_[a]]; b != prev_[a]; b = next_[b]) {
+			if (index_[a] != index_[b] && is_valid_diagonal_(a, b)) {
+				int c = split_polygon_(a, b);
+				a = filter_points_(a, next_[a]);
+				c = filter_points_(c, next_[c]);
+				clip_ears_(a, 0, triangles);
+				clip_ears_(c, 0, triangles);
+				return;
+			}
+		}
+		a = next_[a];
+	} while (a != start);
+	failed_ = true;
+}
+
+bool IfcGeom::PolygonTriangulator::triangulate(const std::vector<gp_XYZ>& points, const Loop& loop, std::vector<int>& triangles) {
+	return triangulate(points, std::vector<Loop>(1, loop), triangles);
+}
+
+bool IfcGeom::PolygonTriangulator::triangulate(const std::vector<gp_XYZ>& points, const std::vector<Loop>& loops, std::vector<int>& triangles) {
+	if (loops.empty() || loops.front().size() < 3) {
+		return false;
+	}
+
+	const Loop& outer = loops.front();
+	const int n = (int) outer.size();
+
+	gp_XYZ normal;
+	for (int i = 0; i < n; ++i) {
+		normal += points[outer[i]].Crossed(points[outer[(i + 1) % n]]);
+	}
+
+	bool fan = n == 3 || normal.Modulus() < ALMOST_ZERO;
+
+	int axis = 0;
+	for (int i = 1; i < 3; ++i) {
+		if (std::fabs(normal.Coord(i + 1)) > std::fabs(normal.Coord(axis + 1))) {
+			axis = i;
+		}
+	}
+	const int u = (axis + 1) % 3 + 1;
+	const int v = (axis + 2) % 3 + 1;
+	const double sign = normal.Coord(axis + 1) > 0. ? 1. : -1.;
+
+	bool has_holes = false;
+	for (std::vector<Loop>::const_iterator it = loops.begin() + 1; it != loops.end(); ++it) {
+		if (it->size() >= 3) {
+			has_holes = true;
+		}
+	}
+
+	if (!fan && !has_holes) {
+		// Convex polygons, which are the majority of the faces in building
+		// models, are triangulated as a fan
+		fan = true;
+		for (int i = 0; i < n && fan; ++i) {
+			const gp_XYZ& a = points[outer[i]];
+			const gp_XYZ& b = points[outer[(i + 1) % n]];
+			const gp_XYZ& c = points[outer[(i + 2) % n]];
+			const double ux = b.Coord(u) - a.Coord(u), uy = sign * (b.Coord(v) - a.Coord(v));
+			const double vx = c.Coord(u) - b.Coord(u), vy = sign * (c.Coord(v) - b.Coord(v));
+			fan = ux * vy - uy * vx >= -ALMOST_ZERO * std::sqrt((ux * ux + uy * uy) * (vx * vx + vy * vy));
+		}
+	}
+
+	if (fan) {
+		// Degenerate polygons are triangulated as a fan as well
+		for (int i = 1; i + 1 < n; ++i) {
+			triangles.push_back(outer[0]);
+			triangles.push_back(outer[i]);
+			triangles.push_back(outer[i + 1]);
+		}
+		return true;
+	}
+
+	index_.clear();
+	prev_.clear();
+	next_.clear();
+	x_.clear();
+	y_.clear();
+	failed_ = false;
+
+	const std::size_t size = triangles.size();
+
+	int start = linked_list_(points, outer, u, v, sign, true);
+	if (start != -1 && next_[start] != prev_[start]) {
+		if (has_holes) {
+			start = eliminate_holes_(points, loops, u, v, sign, start);
+		}
+		if (!failed_) {
+			clip_ears_(start, 0, triangles);
+		}
+	}
+
+	if (failed_) {
+		triangles.resize(size);
+		return false;
+	}
+
+	return true;
+}
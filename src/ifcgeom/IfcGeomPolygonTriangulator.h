@@ -0,0 +1,76 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+
+#ifndef IFCGEOMPOLYGONTRIANGULATOR_H
+#define IFCGEOMPOLYGONTRIANGULATOR_H
+
+#include <vector>
+
+#include <gp_XYZ.hxx>
+
+#include "ifc_geom_api.h"
+
+namespace IfcGeom {
+
+	/// Triangulates planar polygons with inner boundaries by ear clipping, without
+	/// constructing faces. Inner boundaries are first joined to the outer boundary
+	/// by bridge edges. The boundaries are kept as linked lists in flat arrays that
+	/// are reused amongst invocations, so that a single instance can triangulate
+	/// the faces of a mesh without allocating for every face.
+	class IFC_GEOM_API PolygonTriangulator {
+	public:
+		typedef std::vector<int> Loop;
+	private:
+		// The nodes of the boundaries: the index of the point, the point projected
+		// onto the plane of the polygon and the adjacent nodes
+		std::vector<int> index_, prev_, next_;
+		std::vector<double> x_, y_;
+		bool failed_;
+
+		int insert_(int i, double x, double y, int last);
+		void remove_(int p);
+		int split_polygon_(int a, int b);
+		int linked_list_(const std::vector<gp_XYZ>& points, const Loop& loop, int u, int v, double sign, bool counter_clockwise);
+		int filter_points_(int start, int end = -1);
+		int eliminate_holes_(const std::vector<gp_XYZ>& points, const std::vector<Loop>& loops, int u, int v, double sign, int outer);
+		int find_hole_bridge_(int hole, int outer) const;
+		void clip_ears_(int ear, int pass, std::vector<int>& triangles);
+		void split_(int start, std::vector<int>& triangles);
+
+		double orient_(int a, int b, int c) const;
+		bool equals_(int a, int b) const;
+		bool is_ear_(int ear) const;
+		bool locally_inside_(int a, int b) const;
+		bool middle_inside_(int a, int b) const;
+		bool intersects_polygon_(int a, int b) const;
+		bool is_valid_diagonal_(int a, int b) const;
+	public:
+		PolygonTriangulator() : failed_(false) {}
+
+		/// Appends the triangles of the polygon as indices into points, oriented
+		/// as the first loop, which is the outer boundary. Returns false if the
+		/// polygon cannot be triangulated, e.g. because its boundaries intersect.
+		bool triangulate(const std::vector<gp_XYZ>& points, const std::vector<Loop>& loops, std::vector<int>& triangles);
+		bool triangulate(const std::vector<gp_XYZ>& points, const Loop& loop, std::vector<int>& triangles);
+	};
+
+}
+
+#endif
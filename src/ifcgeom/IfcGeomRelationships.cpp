@@ -0,0 +1,293 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+
+#include <algorithm>
+
+#include "../ifcparse/IfcFile.h"
+#include "../ifcparse/IfcLogger.h"
+
+#include "IfcGeom.h"
+#include "IfcGeomRelationships.h"
+
+namespace {
+	struct compare_first {
+		template <typename T>
+		bool operator()(const T& a, const T& b) const { return a.first < b.first; }
+	};
+}
+
+const IfcGeom::RelationshipIndex::record* IfcGeom::RelationshipIndex::find_(const IfcUtil::IfcBaseClass* instance) const {
+	const unsigned int id = instance->entity->id();
+	if (id >= slots_.size() || slots_[id] == -1) {
+		return 0;
+	}
+	return &records_[slots_[id]];
+}
+
+int IfcGeom::RelationshipIndex::slot_(const IfcUtil::IfcBaseClass* instance) {
+	const unsigned int id = instance->entity->id();
+	if (id >= slots_.size()) {
+		slots_.resize(id + 1, -1);
+	}
+	if (slots_[id] == -1) {
+		slots_[id] = (int) records_.size();
+		records_.push_back(record());
+	}
+	return slots_[id];
+}
+
+template <typename T>
+void IfcGeom::RelationshipIndex::group_(std::vector< std::pair<int, T*> >& pairs, std::vector<T*>& flat, range record::*r) {
+	// Stable, so that the instances related to a record remain in file order
+	std::stable_sort(pairs.begin(), pairs.end(), compare_first());
+	flat.clear();
+	flat.reserve(pairs.size());
+	for (size_t i = 0; i < pairs.size(); ++i) {
+		range& related = records_[pairs[i].first].*r;
+		if (i == 0 || pairs[i].first != pairs[i - 1].first) {
+			related.begin = (unsigned int) flat.size();
+		}
+		flat.push_back(pairs[i].second);
+		related.end = (unsigned int) flat.size();
+	}
+}
+
+template <typename T>
+typename T::list::ptr IfcGeom::RelationshipIndex::list_(const std::vector<T*>& flat, const range& r) const {
+	typename T::list::ptr related(new typename T::list);
+	for (unsigned int i = r.begin; i < r.end; ++i) {
+		related->push(flat[i]);
+	}
+	return related;
+}
+
+void IfcGeom::RelationshipIndex::build(Kernel& kernel, IfcParse::IfcFile* file) {
+	slots_.assign(file->getMaxId() + 1, -1);
+	records_.clear();
+
+	std::vector< std::pair<int, IfcSchema::IfcRelVoidsElement*> > openings;
+	IfcSchema::IfcRelVoidsElement::list::ptr voids = file->entitiesByType<IfcSchema::IfcRelVoidsElement>();
+	for (IfcSchema::IfcRelVoidsElement::list::it it = voids->begin(); it != voids->end(); ++it) {
+		try {
+			IfcSchema::IfcElement* element = (*it)->RelatingBuildingElement();
+			openings.push_back(std::make_pair(slot_(element), *it));
+			const int opening = slot_((*it)->RelatedOpeningElement());
+			if (!records_[opening].voided_element) {
+				records_[opening].voided_element = element;
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		}
+	}
+	group_(openings, openings_, &record::openings);
+
+	IfcSchema::IfcRelFillsElement::list::ptr fills = file->entitiesByType<IfcSchema::IfcRelFillsElement>();
+	for (IfcSchema::IfcRelFillsElement::list::it it = fills->begin(); it != fills->end(); ++it) {
+		try {
+			IfcSchema::IfcObjectDefinition* opening = (*it)->RelatingOpeningElement();
+			IfcSchema::IfcObjectDefinition* element = (*it)->RelatedBuildingElement();
+			if (opening != element) {
+				records_[slot_(element)].filled_opening = opening;
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		}
+	}
+
+	IfcSchema::IfcRelContainedInSpatialStructure::list::ptr containments = file->entitiesByType<IfcSchema::IfcRelContainedInSpatialStructure>();
+	for (IfcSchema::IfcRelContainedInSpatialStructure::list::it it = containments->begin(); it != containments->end(); ++it) {
+		try {
+			IfcSchema::IfcObjectDefinition* structure = (*it)->RelatingStructure();
+			IfcSchema::IfcProduct::list::ptr elements = (*it)->RelatedElements();
+			for (IfcSchema::IfcProduct::list::it jt = elements->begin(); jt != elements->end(); ++jt) {
+				const int element = slot_(*jt);
+				if (!records_[element].containing_structure) {
+					records_[element].containing_structure = structure;
+				}
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		}
+	}
+
+	// The relationships listed by IfcObjectDefinition::Decomposes(), aggregations
+	// before nestings as in get_decomposing_entity()
+#ifdef USE_IFC4
+	typedef IfcSchema::IfcRelAggregates decomposition_t;
+	decomposition_t::list::ptr decompositions = file->entitiesByType<IfcSchema::IfcRelAggregates>();
+#else
+	typedef IfcSchema::IfcRelDecomposes decomposition_t;
+	decomposition_t::list::ptr decompositions = file->entitiesByType<IfcSchema::IfcRelAggregates>()->as<decomposition_t>();
+	decompositions->push(file->entitiesByType<IfcSchema::IfcRelNests>()->as<decomposition_t>());
+#endif
+	for (decomposition_t::list::it it = decompositions->begin(); it != decompositions->end(); ++it) {
+		try {
+			IfcSchema::IfcObjectDefinition* relating = (*it)->RelatingObject();
+			IfcSchema::IfcObjectDefinition::list::ptr related = (*it)->RelatedObjects();
+			for (IfcSchema::IfcObjectDefinition::list::it jt = related->begin(); jt != related->end(); ++jt) {
+				const int object = slot_(*jt);
+				records_[object].decompositions++;
+				if (*jt != relating) {
+					records_[object].decomposed_object = relating;
+				}
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		}
+	}
+
+	std::vector< std::pair<int, IfcSchema::IfcRelAssociatesMaterial*> > material_associations;
+	IfcSchema::IfcRelAssociatesMaterial::list::ptr associations = file->entitiesByType<IfcSchema::IfcRelAssociatesMaterial>();
+	for (IfcSchema::IfcRelAssociatesMaterial::list::it it = associations->begin(); it != associations->end(); ++it) {
+		try {
+#ifdef USE_IFC4
+			IfcEntityList::ptr related = (*it)->RelatedObjects();
+#else
+			IfcEntityList::ptr related = (*it)->RelatedObjects()->generalize();
+#endif
+			for (IfcEntityList::it jt = related->begin(); jt != related->end(); ++jt) {
+				material_associations.push_back(std::make_pair(slot_(*jt), *it));
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		}
+	}
+	group_(material_associations, material_associations_, &record::material_associations);
+
+	std::vector< std::pair<int, IfcSchema::IfcStyledItem*> > styled_items;
+	IfcSchema::IfcStyledItem::list::ptr styles = file->entitiesByType<IfcSchema::IfcStyledItem>();
+	for (IfcSchema::IfcStyledItem::list::it it = styles->begin(); it != styles->end(); ++it) {
+		try {
+			if ((*it)->hasItem()) {
+				styled_items.push_back(std::make_pair(slot_((*it)->Item()), *it));
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		}
+	}
+	group_(styled_items, styled_items_, &record::styled_items);
+
+	// The products of every product representation, by instance name
+	std::vector< std::pair<unsigned int, IfcSchema::IfcProduct*> > represented;
+	IfcSchema::IfcProduct::list::ptr all_products = file->entitiesByType<IfcSchema::IfcProduct>();
+	for (IfcSchema::IfcProduct::list::it it = all_products->begin(); it != all_products->end(); ++it) {
+		try {
+			if ((*it)->hasRepresentation()) {
+				represented.push_back(std::make_pair((*it)->Representation()->entity->id(), *it));
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		}
+	}
+	std::stable_sort(represented.begin(), represented.end(), compare_first());
+
+	// The products of every representation, in the order of its product
+	// representations as in Kernel::products_represented_by()
+	std::vector< std::pair<int, IfcSchema::IfcProduct*> > products;
+	IfcSchema::IfcProductRepresentation::list::ptr prodreps = file->entitiesByType<IfcSchema::IfcProductRepresentation>();
+	for (IfcSchema::IfcProductRepresentation::list::it it = prodreps->begin(); it != prodreps->end(); ++it) {
+		try {
+			std::pair<unsigned int, IfcSchema::IfcProduct*> key((*it)->entity->id(), 0);
+			std::pair<std::vector< std::pair<unsigned int, IfcSchema::IfcProduct*> >::const_iterator,
+				std::vector< std::pair<unsigned int, IfcSchema::IfcProduct*> >::const_iterator> matches =
+				std::equal_range(represented.begin(), represented.end(), key, compare_first());
+			if (matches.first == matches.second) {
+				continue;
+			}
+			IfcSchema::IfcRepresentation::list::ptr reps = (*it)->Representations();
+			for (IfcSchema::IfcRepresentation::list::it jt = reps->begin(); jt != reps->end(); ++jt) {
+				const int representation = slot_(*jt);
+				for (std::vector< std::pair<unsigned int, IfcSchema::IfcProduct*> >::const_iterator kt = matches.first; kt != matches.second; ++kt) {
+					products.push_back(std::make_pair(representation, kt->second));
+				}
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		}
+	}
+	group_(products, products_, &record::products);
+
+	IfcSchema::IfcRepresentation::list::ptr representations = file->entitiesByType<IfcSchema::IfcRepresentation>();
+	for (IfcSchema::IfcRepresentation::list::it it = representations->begin(); it != representations->end(); ++it) {
+		try {
+			IfcSchema::IfcRepresentation* mapped = kernel.representation_mapped_to(*it);
+			if (mapped) {
+				records_[slot_(*it)].mapped_representation = mapped;
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		}
+	}
+}
+
+IfcSchema::IfcRelVoidsElement::list::ptr IfcGeom::RelationshipIndex::openings(const IfcSchema::IfcProduct* product) const {
+	const record* r = find_(product);
+	return list_(openings_, r ? r->openings : range());
+}
+
+IfcSchema::IfcObjectDefinition* IfcGeom::RelationshipIndex::decomposes(const IfcSchema::IfcObjectDefinition* object) const {
+	const record* r = find_(object);
+	return r && r->decompositions == 1 ? r->decomposed_object : 0;
+}
+
+IfcSchema::IfcObjectDefinition* IfcGeom::RelationshipIndex::decomposing_entity(const IfcSchema::IfcProduct* product) const {
+	const record* r = find_(product);
+	if (!r) {
+		return 0;
+	}
+	IfcSchema::IfcObjectDefinition* parent = 0;
+	if (product->is(IfcSchema::Type::IfcOpeningElement)) {
+		parent = r->voided_element;
+	} else if (product->is(IfcSchema::Type::IfcElement)) {
+		parent = r->filled_opening;
+		if (!parent) {
+			parent = r->containing_structure;
+		}
+	}
+	if (!parent) {
+		parent = r->decomposed_object;
+	}
+	return parent;
+}
+
+IfcSchema::IfcRelAssociatesMaterial::list::ptr IfcGeom::RelationshipIndex::material_associations(const IfcSchema::IfcProduct* product) const {
+	const record* r = find_(product);
+	return list_(material_associations_, r ? r->material_associations : range());
+}
+
+IfcSchema::IfcStyledItem::list::ptr IfcGeom::RelationshipIndex::styled_items(const IfcSchema::IfcRepresentationItem* item) const {
+	const record* r = find_(item);
+	return list_(styled_items_, r ? r->styled_items : range());
+}
+
+bool IfcGeom::RelationshipIndex::is_styled(const IfcSchema::IfcRepresentationItem* item) const {
+	const record* r = find_(item);
+	return r && r->styled_items.end > r->styled_items.begin;
+}
+
+IfcSchema::IfcProduct::list::ptr IfcGeom::RelationshipIndex::products(const IfcSchema::IfcRepresentation* representation) const {
+	const record* r = find_(representation);
+	return list_(products_, r ? r->products : range());
+}
+
+IfcSchema::IfcRepresentation* IfcGeom::RelationshipIndex::mapped_representation(const IfcSchema::IfcRepresentation* representation) const {
+	const record* r = find_(representation);
+	return r ? r->mapped_representation : 0;
+}
@@ -0,0 +1,124 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+
+#ifndef IFCGEOMRELATIONSHIPS_H
+#define IFCGEOMRELATIONSHIPS_H
+
+#include <vector>
+#include <utility>
+
+#include "../ifcparse/IfcParse.h"
+#include "../ifcparse/IfcBaseClass.h"
+
+#include "ifc_geom_api.h"
+
+namespace IfcGeom {
+
+	class Kernel;
+
+	/// The relationships the kernel looks up for every product, representation
+	/// and item, gathered in a single sweep over the relationship instances of
+	/// a file so that inverse attributes need not be evaluated during conversion.
+	/// Instances are mapped to a record by their instance name, lists of related
+	/// instances are stored contiguously in file order, the order in which the
+	/// inverse attributes list them. The index is read-only after build() and
+	/// can be shared by the kernels of multiple threads. Relationships created
+	/// after the index is built are not taken into account.
+	class IFC_GEOM_API RelationshipIndex {
+	private:
+		struct range {
+			unsigned int begin, end;
+			range() : begin(0), end(0) {}
+		};
+
+		struct record {
+			// The relationships get_decomposing_entity() considers, in order of precedence
+			IfcSchema::IfcObjectDefinition* voided_element;
+			IfcSchema::IfcObjectDefinition* filled_opening;
+			IfcSchema::IfcObjectDefinition* containing_structure;
+			IfcSchema::IfcObjectDefinition* decomposed_object;
+			unsigned int decompositions;
+			IfcSchema::IfcRepresentation* mapped_representation;
+			range openings;
+			range material_associations;
+			range styled_items;
+			range products;
+			record()
+				: voided_element(0)
+				, filled_opening(0)
+				, containing_structure(0)
+				, decomposed_object(0)
+				, decompositions(0)
+				, mapped_representation(0)
+			{}
+		};
+
+		// Index of the record by instance name, -1 for instances without relationships
+		std::vector<int> slots_;
+		std::vector<record> records_;
+
+		std::vector<IfcSchema::IfcRelVoidsElement*> openings_;
+		std::vector<IfcSchema::IfcRelAssociatesMaterial*> material_associations_;
+		std::vector<IfcSchema::IfcStyledItem*> styled_items_;
+		std::vector<IfcSchema::IfcProduct*> products_;
+
+		const record* find_(const IfcUtil::IfcBaseClass* instance) const;
+		// Returns the index of the record of the instance, which is created if needed
+		int slot_(const IfcUtil::IfcBaseClass* instance);
+
+		// Stores the instances related to a record contiguously, in the order they are listed
+		template <typename T>
+		void group_(std::vector< std::pair<int, T*> >& pairs, std::vector<T*>& flat, range record::*r);
+
+		template <typename T>
+		typename T::list::ptr list_(const std::vector<T*>& flat, const range& r) const;
+
+		RelationshipIndex(const RelationshipIndex&); // N/I
+		RelationshipIndex& operator=(const RelationshipIndex&); // N/I
+	public:
+		RelationshipIndex() {}
+
+		/// Sweeps over the relationships in the file. The kernel is used to determine
+		/// which representations are mapped to another representation, see
+		/// Kernel::representation_mapped_to().
+		void build(Kernel& kernel, IfcParse::IfcFile* file);
+
+		/// Equivalent of IfcElement::HasOpenings()
+		IfcSchema::IfcRelVoidsElement::list::ptr openings(const IfcSchema::IfcProduct*) const;
+		/// The relating object if the instance is decomposed by exactly one
+		/// relationship, equivalent of IfcObjectDefinition::Decomposes()
+		IfcSchema::IfcObjectDefinition* decomposes(const IfcSchema::IfcObjectDefinition*) const;
+		/// Equivalent of Kernel::get_decomposing_entity()
+		IfcSchema::IfcObjectDefinition* decomposing_entity(const IfcSchema::IfcProduct*) const;
+		/// Equivalent of IfcObjectDefinition::HasAssociations() filtered by IfcRelAssociatesMaterial
+		IfcSchema::IfcRelAssociatesMaterial::list::ptr material_associations(const IfcSchema::IfcProduct*) const;
+		/// Equivalent of IfcRepresentationItem::StyledByItem()
+		IfcSchema::IfcStyledItem::list::ptr styled_items(const IfcSchema::IfcRepresentationItem*) const;
+		bool is_styled(const IfcSchema::IfcRepresentationItem*) const;
+		/// The products that refer to the representation by means of an
+		/// IfcProductRepresentation, not including products with mapped items
+		IfcSchema::IfcProduct::list::ptr products(const IfcSchema::IfcRepresentation*) const;
+		/// Equivalent of Kernel::representation_mapped_to()
+		IfcSchema::IfcRepresentation* mapped_representation(const IfcSchema::IfcRepresentation*) const;
+	};
+
+}
+
+#endif
@@ -20,6 +20,7 @@
 #include <boost/optional/optional.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <map>
 
@@ -61,10 +62,22 @@ const IfcGeom::SurfaceStyle* IfcGeom::Kernel::internalize_surface_style(const st
 		return 0;
 	}
 	int surface_style_id = shading_styles.first->entity->id();
+	if (style_table) {
+		// So that styles of materials and items refer to the same instance
+		const SurfaceStyle* style = style_table->surface_style(surface_style_id);
+		if (style) {
+			return style;
+		}
+	}
 	std::map<int,SurfaceStyle>::const_iterator it = style_cache.find(surface_style_id);
 	if (it != style_cache.end()) {
 		return &(it->second);
 	}
+	return &(style_cache[surface_style_id] = create_surface_style(shading_styles));
+}
+
+IfcGeom::SurfaceStyle IfcGeom::Kernel::create_surface_style(const std::pair<IfcSchema::IfcSurfaceStyle*, IfcSchema::IfcSurfaceStyleShading*>& shading_styles) {
+	int surface_style_id = shading_styles.first->entity->id();
 	SurfaceStyle surface_style;
 	if (shading_styles.first->hasName()) {
 		surface_style = SurfaceStyle(surface_style_id, shading_styles.first->Name());
@@ -109,10 +122,13 @@ const IfcGeom::SurfaceStyle* IfcGeom::Kernel::internalize_surface_style(const st
 			surface_style.Transparency().reset(d);
 		}
 	}
-	return &(style_cache[surface_style_id] = surface_style);
+	return surface_style;
 }
 
 const IfcGeom::SurfaceStyle* IfcGeom::Kernel::get_style(const IfcSchema::IfcRepresentationItem* item) {
+	if (style_table) {
+		return style_table->style(item);
+	}
 	return internalize_surface_style(get_surface_style<IfcSchema::IfcSurfaceStyleShading>(item));	
 }
 
@@ -135,9 +151,21 @@ const IfcGeom::SurfaceStyle* IfcGeom::Kernel::get_style(const IfcSchema::IfcMate
 	return &(style_cache[material->id()] = material_style);
 }
 
+const IfcGeom::SurfaceStyle* IfcGeom::Kernel::get_style(const IfcSchema::IfcSurfaceStyle* surface_style) {
+	IfcEntityList::ptr styles_elements = surface_style->Styles();
+	for (IfcEntityList::it it = styles_elements->begin(); it != styles_elements->end(); ++it) {
+		if ((*it)->is(IfcSchema::IfcSurfaceStyleShading::Class())) {
+			return internalize_surface_style(std::make_pair(const_cast<IfcSchema::IfcSurfaceStyle*>(surface_style), (IfcSchema::IfcSurfaceStyleShading*) *it));
+		}
+	}
+	return 0;
+}
+
 static std::map<std::string, IfcGeom::SurfaceStyle> default_materials;
 static IfcGeom::SurfaceStyle default_material;
 static bool default_materials_initialized = false;
+// Default styles are created on demand, possibly by multiple iterator threads
+static boost::mutex default_materials_mutex;
 
 void InitDefaultMaterials() {
 	default_materials.insert(std::make_pair("IfcSite", IfcGeom::SurfaceStyle("IfcSite")));
@@ -197,6 +225,7 @@ boost::optional<IfcGeom::SurfaceStyle::ColorComponent> read_colour_component(con
 }
 
 void IfcGeom::set_default_style_file(const std::string& json_file) {
+  boost::mutex::scoped_lock lock(default_materials_mutex);
   if (!default_materials_initialized) InitDefaultMaterials();
   default_materials.clear();
 
@@ -235,6 +264,7 @@ void IfcGeom::set_default_style_file(const std::string& json_file) {
 }
 
 const IfcGeom::SurfaceStyle* IfcGeom::get_default_style(const std::string& s) {
+	boost::mutex::scoped_lock lock(default_materials_mutex);
 	if (!default_materials_initialized) InitDefaultMaterials();
 	std::map<std::string, IfcGeom::SurfaceStyle>::const_iterator it = default_materials.find(s);
 	if (it == default_materials.end()) {
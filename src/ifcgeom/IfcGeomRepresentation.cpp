@@ -17,11 +17,19 @@
  *                                                                              *
  ********************************************************************************/
 
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <Standard.hxx>
+#include <Standard_Version.hxx>
+
 #include <BRep_Tool.hxx>
 #include <BRepTools.hxx>
 #include <BRep_Builder.hxx>
 
 #include <TopoDS_Compound.hxx>
+#include <TopTools_DataMapOfShapeInteger.hxx>
 
 #include "../ifcgeom/IfcGeom.h"
 
@@ -72,4 +80,185 @@ TopoDS_Compound IfcGeom::Representation::BRep::as_compound() const {
 		builder.Add(compound, moved_shape);
 	}
 	return compound;
-}
\ No newline at end of file
+}
+namespace {
+	void triangulate_shape(const IfcGeom::IfcRepresentationShapeItem& item, const IfcGeom::ElementSettings& settings, IfcGeom::Representation::ShapeTriangulation& triangulation) {
+		const TopoDS_Shape& s = item.Shape();
+		const gp_GTrsf& trsf = item.Placement();
+
+		// Open Cascade meshes the faces of a shape in parallel as well
+		try {
+			BRepMesh_IncrementalMesh(s, settings.deflection_tolerance(), Standard_False, 0.5, settings.mesher_threads() > 1);
+		} catch(...) {
+			return;
+		}
+		triangulation.meshed = true;
+
+		// Vertex normals are only calculated if vertices are not welded and calculation is not disable explicitly.
+		const bool calculate_normals = !settings.get(IfcGeom::IteratorSettings::WELD_VERTICES) &&
+			!settings.get(IfcGeom::IteratorSettings::NO_NORMALS);
+
+		// A 3x3 matrix to rotate the vertex normals
+		const gp_Mat rotation_matrix = trsf.VectorialPart();
+
+		// Iterates over the faces of the shape
+		TopExp_Explorer exp;
+		for ( exp.Init(s,TopAbs_FACE); exp.More(); exp.Next(), ++triangulation.num_faces ) {
+			TopoDS_Face face = TopoDS::Face(exp.Current());
+			TopLoc_Location loc;
+			Handle_Poly_Triangulation tri = BRep_Tool::Triangulation(face,loc);
+
+			if ( tri.IsNull() ) {
+				continue;
+			}
+
+			const TColgp_Array1OfPnt& nodes = tri->Nodes();
+			const TColgp_Array1OfPnt2d& uvs = tri->UVNodes();
+			BRepGProp_Face prop(face);
+
+			triangulation.node_offsets.push_back((int) triangulation.nodes.size());
+			triangulation.triangle_offsets.push_back((int) triangulation.triangles.size());
+
+			for( int i = 1; i <= nodes.Length(); ++ i ) {
+				gp_XYZ coord = nodes(i).Transformed(loc).XYZ();
+				trsf.Transforms(coord);
+				triangulation.nodes.push_back(coord);
+
+				if ( calculate_normals ) {
+					const gp_Pnt2d& uv = uvs(i);
+					gp_Pnt p;
+					gp_Vec normal_direction;
+					prop.Normal(uv.X(),uv.Y(),p,normal_direction);
+					gp_Vec normal(0., 0., 0.);
+					if (normal_direction.Magnitude() > ALMOST_ZERO) {
+						normal = gp_Dir(normal_direction.XYZ() * rotation_matrix);
+					} else {
+						Handle_Geom_Surface surf = BRep_Tool::Surface(face);
+						// Special case the normal at the poles of a spherical surface
+						if (surf->DynamicType() == STANDARD_TYPE(Geom_SphericalSurface)) {
+							if (ALMOST_THE_SAME(fabs(uv.Y()), M_PI / 2.)) {
+								const bool is_top = uv.Y() > 0;
+								const bool is_forward = face.Orientation() == TopAbs_FORWARD;
+								const double z = (is_top == is_forward) ? 1. : -1.;
+								normal = gp_Dir(gp_XYZ(0, 0, z) * rotation_matrix);
+							}
+						}
+						// TODO: Do the same for conical surfaces, but they are rare in IFC.
+					}
+					triangulation.normals.push_back(normal.XYZ());
+				}
+			}
+
+			const Poly_Array1OfTriangle& triangles = tri->Triangles();
+			for( int i = 1; i <= triangles.Length(); ++ i ) {
+				int n1,n2,n3;
+				if ( face.Orientation() == TopAbs_REVERSED )
+					triangles(i).Get(n3,n2,n1);
+				else triangles(i).Get(n1,n2,n3);
+
+				triangulation.triangles.push_back(n1 - 1);
+				triangulation.triangles.push_back(n2 - 1);
+				triangulation.triangles.push_back(n3 - 1);
+			}
+		}
+
+		if (!triangulation.node_offsets.empty()) {
+			triangulation.node_offsets.push_back((int) triangulation.nodes.size());
+			triangulation.triangle_offsets.push_back((int) triangulation.triangles.size());
+		}
+
+		BRepTools::Clean(s);
+	}
+
+	// Meshes the groups of shapes as long as there are groups left
+	void triangulate_groups(const std::vector< std::vector<int> >& groups, const std::vector<const IfcGeom::IfcRepresentationShapeItem*>& items, const IfcGeom::ElementSettings& settings, std::vector<IfcGeom::Representation::ShapeTriangulation>& triangulations, std::size_t& next_group, boost::mutex& mutex) {
+		for (;;) {
+			std::size_t group;
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				if (next_group == groups.size()) {
+					return;
+				}
+				group = next_group++;
+			}
+			for (std::vector<int>::const_iterator it = groups[group].begin(); it != groups[group].end(); ++it) {
+				try {
+					triangulate_shape(*items[*it], settings, triangulations[*it]);
+				} catch (...) {
+					// Exceptions cannot be propagated from the thread, the shape is reported as not meshed
+					triangulations[*it] = IfcGeom::Representation::ShapeTriangulation();
+				}
+			}
+		}
+	}
+
+	int find_group(std::vector<int>& parents, int i) {
+		while (parents[i] != i) {
+			i = parents[i] = parents[parents[i]];
+		}
+		return i;
+	}
+}
+
+void IfcGeom::Representation::triangulate_shapes(const std::vector<const IfcRepresentationShapeItem*>& items, const ElementSettings& settings, std::vector<ShapeTriangulation>& triangulations) {
+	triangulations.assign(items.size(), ShapeTriangulation());
+
+	// Meshing stores the discretization of edges on the edges, which may be
+	// shared by the shapes of several items, for example equal items or the
+	// adjacent slices of a layer set. Shapes that share edges form a group
+	// that is meshed by a single thread in order of the items.
+	std::vector<int> parents(items.size());
+	for (int i = 0; i < (int) items.size(); ++i) {
+		parents[i] = i;
+	}
+	if (settings.mesher_threads() > 1 && items.size() > 1) {
+		TopTools_DataMapOfShapeInteger edge_items;
+		for (int i = 0; i < (int) items.size(); ++i) {
+			for (TopExp_Explorer exp(items[i]->Shape(), TopAbs_EDGE); exp.More(); exp.Next()) {
+				// Edges are compared regardless of their location and orientation
+				const TopoDS_Shape edge = exp.Current().Located(TopLoc_Location());
+				if (edge_items.IsBound(edge)) {
+					const int a = find_group(parents, edge_items.Find(edge));
+					const int b = find_group(parents, i);
+					parents[(std::max)(a, b)] = (std::min)(a, b);
+				} else {
+					edge_items.Bind(edge, i);
+				}
+			}
+		}
+	}
+
+	std::vector< std::vector<int> > groups;
+	std::vector<int> group_indices(items.size(), -1);
+	for (int i = 0; i < (int) items.size(); ++i) {
+		int& group = group_indices[find_group(parents, i)];
+		if (group == -1) {
+			group = (int) groups.size();
+			groups.push_back(std::vector<int>());
+		}
+		groups[group].push_back(i);
+	}
+
+	const int num_threads = (std::min)(settings.mesher_threads(), (int) groups.size());
+	if (num_threads <= 1) {
+		for (std::size_t i = 0; i < items.size(); ++i) {
+			triangulate_shape(*items[i], settings, triangulations[i]);
+		}
+		return;
+	}
+
+#if OCC_VERSION_HEX < 0x70000
+	// Older versions of Open Cascade only use atomic reference counting
+	// and a thread-safe memory manager when explicitly requested.
+	Standard::SetReentrant(Standard_True);
+#endif
+
+	std::size_t next_group = 0;
+	boost::mutex mutex;
+
+	boost::thread_group threads;
+	for (int i = 0; i < num_threads; ++i) {
+		threads.create_thread(boost::bind(&triangulate_groups, boost::cref(groups), boost::cref(items), boost::cref(settings), boost::ref(triangulations), boost::ref(next_group), boost::ref(mutex)));
+	}
+	threads.join_all();
+}
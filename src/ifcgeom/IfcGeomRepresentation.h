@@ -40,6 +40,8 @@
 
 #include <TopoDS_Compound.hxx>
 
+#include <boost/functional/hash.hpp>
+
 namespace IfcGeom {
 
 	namespace Representation {
@@ -94,16 +96,36 @@ namespace IfcGeom {
 			Serialization& operator=(const Serialization&);
 		};
 
+		/// The triangulated faces of a shape in the coordinates of a representation,
+		/// i.e. with the placement of the shape item applied.
+		struct IFC_GEOM_API ShapeTriangulation {
+			/// Whether the shape has been meshed, false if meshing failed
+			bool meshed;
+			/// Number of faces of the shape, including faces without triangulation
+			int num_faces;
+			/// The nodes of the triangulated faces one after another, and their
+			/// normals if vertex normals are calculated
+			std::vector<gp_XYZ> nodes;
+			std::vector<gp_XYZ> normals;
+			/// Node indices of the triangles relative to the first node of the face
+			std::vector<int> triangles;
+			/// Offsets of the first node and triangle index of every triangulated
+			/// face, followed by the number of nodes and triangle indices
+			std::vector<int> node_offsets;
+			std::vector<int> triangle_offsets;
+
+			ShapeTriangulation() : meshed(false), num_faces(0) {}
+		};
+
+		/// Meshes the shapes of the items with the deflection tolerance in the
+		/// settings, using IteratorSettings::mesher_threads() threads. Shapes that
+		/// share edges are meshed by the same thread in order of the items, so
+		/// that the result is the same as for meshing them one by one.
+		IFC_GEOM_API void triangulate_shapes(const std::vector<const IfcRepresentationShapeItem*>& items, const ElementSettings& settings, std::vector<ShapeTriangulation>& triangulations);
+
 		template <typename P>
 		class Triangulation : public Representation {
 		private:
-			// A nested pair of floats and a material index to be able to store an XYZ coordinate in a map.
-			// TODO: Make this a std::tuple when compilers add support for that.
-			typedef typename std::pair<P, std::pair<P, P> > Coordinate;
-			typedef typename std::pair<int, Coordinate> VertexKey;
-			typedef std::map<VertexKey, int> VertexKeyMap;
-			typedef std::pair<int, int> Edge;
-
 			std::string id_;
 			std::vector<P> _verts;
 			std::vector<int> _faces;
@@ -112,7 +134,24 @@ namespace IfcGeom {
             std::vector<P> uvs_;
 			std::vector<int> _material_ids;
 			std::vector<Material> _materials;
-			VertexKeyMap welds;
+
+			// An open addressing table of the welded vertices. Slots hold the
+			// index of a weld or -1, the keys are stored in order of the welds.
+			std::vector<int> weld_slots_;
+			std::vector<int> weld_materials_;
+			std::vector<P> weld_coords_;
+
+			// Buffers reused amongst the faces of the shapes: the indices of the
+			// triangulation nodes and an open addressing table to count the uses
+			// of the triangle edges. Slots are used by the current face if their
+			// stamp equals the stamp of the face. These and the welding table are
+			// released once the triangulation is constructed.
+			std::vector<int> node_indices_;
+			std::vector<int> edge_keys_;
+			std::vector<int> edge_counts_;
+			std::vector<int> edge_stamps_;
+			std::vector<int> face_edges_;
+			int edge_stamp_;
 
 		public:
 			const std::string& id() const { return id_; }
@@ -124,10 +163,32 @@ namespace IfcGeom {
 			const std::vector<int>& material_ids() const { return _material_ids; }
 			const std::vector<Material>& materials() const { return _materials; }
 
-			Triangulation(const BRep& shape_model)
-					: Representation(shape_model.settings())
+			/// Triangulates the shapes with the deflection tolerance in the settings
+			/// of the shape model, or with the one specified if positive, which is
+			/// used for levels of detail.
+			Triangulation(const BRep& shape_model, double deflection_tolerance = 0.)
+					: Representation(deflection_tolerance > 0.
+						? with_deflection_tolerance(shape_model.settings(), deflection_tolerance)
+						: shape_model.settings())
 					, id_(shape_model.id())
+					, edge_stamp_(0)
 			{
+				// Vertex normals are only calculated if vertices are not welded and calculation is not disable explicitly.
+				const bool calculate_normals = !settings().get(IteratorSettings::WELD_VERTICES) &&
+					!settings().get(IteratorSettings::NO_NORMALS);
+
+				// The shapes are meshed first, possibly in parallel, after which
+				// their faces are added in order of the items.
+				std::vector<const IfcRepresentationShapeItem*> shape_items;
+				for ( IfcGeom::IfcRepresentationShapeItems::const_iterator iit = shape_model.begin(); iit != shape_model.end(); ++ iit ) {
+					if (!iit->hasMesh()) {
+						shape_items.push_back(&*iit);
+					}
+				}
+				std::vector<ShapeTriangulation> shape_triangulations;
+				triangulate_shapes(shape_items, settings(), shape_triangulations);
+				std::vector<ShapeTriangulation>::const_iterator shape_triangulation = shape_triangulations.begin();
+
 				for ( IfcGeom::IfcRepresentationShapeItems::const_iterator iit = shape_model.begin(); iit != shape_model.end(); ++ iit ) {
 
 					int surface_style_id = -1;
@@ -153,117 +214,64 @@ namespace IfcGeom {
 						}
 					}
 
+					if (iit->hasMesh()) {
+						addMesh(iit->Mesh(), iit->Placement(), surface_style_id);
+						if (!_normals.empty() && settings().get(IfcGeom::IteratorSettings::GENERATE_UVS)) {
+							uvs_ = box_project_uvs(_verts, _normals);
+						}
+						continue;
+					}
+
 					const TopoDS_Shape& s = iit->Shape();
 					const gp_GTrsf& trsf = iit->Placement();
 
-					// Triangulate the shape
-					try {
-						BRepMesh_IncrementalMesh(s, settings().deflection_tolerance());
-					} catch(...) {
-
+					const ShapeTriangulation& triangulation = *shape_triangulation++;
+					if (!triangulation.meshed) {
 						// TODO: Catch outside
 						// Logger::Message(Logger::LOG_ERROR,"Failed to triangulate shape:",ifc_file->entityById(_id)->entity);
 						Logger::Message(Logger::LOG_ERROR,"Failed to triangulate shape");
 						continue;
 					}
 
-					// Iterates over the faces of the shape
-					int num_faces = 0;
-					TopExp_Explorer exp;
-					for ( exp.Init(s,TopAbs_FACE); exp.More(); exp.Next(), ++num_faces ) {
-						TopoDS_Face face = TopoDS::Face(exp.Current());
-						TopLoc_Location loc;
-						Handle_Poly_Triangulation tri = BRep_Tool::Triangulation(face,loc);
-
-						if ( ! tri.IsNull() ) {
-
-							// A 3x3 matrix to rotate the vertex normals
-							const gp_Mat rotation_matrix = trsf.VectorialPart();
-			
-							// Keep track of the number of times an edge is used
-							// Manifold edges (i.e. edges used twice) are deemed invisible
-							std::map<std::pair<int,int>,int> edgecount;
-							std::vector<std::pair<int,int> > edges_temp;
-
-							const TColgp_Array1OfPnt& nodes = tri->Nodes();
-							const TColgp_Array1OfPnt2d& uvs = tri->UVNodes();
-							std::vector<gp_XYZ> coords;
-							BRepGProp_Face prop(face);
-							std::map<int,int> dict;
-
-                            // Vertex normals are only calculated if vertices are not welded and calculation is not disable explicitly.
-                            const bool calculate_normals = !settings().get(IteratorSettings::WELD_VERTICES) &&
-                                !settings().get(IteratorSettings::NO_NORMALS);
-
-							for( int i = 1; i <= nodes.Length(); ++ i ) {
-								coords.push_back(nodes(i).Transformed(loc).XYZ());
-								trsf.Transforms(*coords.rbegin());
-								dict[i] = addVertex(surface_style_id, *coords.rbegin());
-					
-								if ( calculate_normals ) {
-									const gp_Pnt2d& uv = uvs(i);
-									gp_Pnt p;
-									gp_Vec normal_direction;
-									prop.Normal(uv.X(),uv.Y(),p,normal_direction);
-									gp_Vec normal(0., 0., 0.);
-									if (normal_direction.Magnitude() > ALMOST_ZERO) {
-										normal = gp_Dir(normal_direction.XYZ() * rotation_matrix);
-									} else {
-										Handle_Geom_Surface surf = BRep_Tool::Surface(face);
-										// Special case the normal at the poles of a spherical surface
-										if (surf->DynamicType() == STANDARD_TYPE(Geom_SphericalSurface)) {
-											if (ALMOST_THE_SAME(fabs(uv.Y()), M_PI / 2.)) {
-												const bool is_top = uv.Y() > 0;
-												const bool is_forward = face.Orientation() == TopAbs_FORWARD;
-												const double z = (is_top == is_forward) ? 1. : -1.;
-												normal = gp_Dir(gp_XYZ(0, 0, z) * rotation_matrix);
-											}
-										}
-										// TODO: Do the same for conical surfaces, but they are rare in IFC.
-									}
-									_normals.push_back(static_cast<P>(normal.X()));
-									_normals.push_back(static_cast<P>(normal.Y()));
-									_normals.push_back(static_cast<P>(normal.Z()));
-								}
+					// Adds the triangulated faces of the shape
+					for (std::size_t f = 0; f + 1 < triangulation.node_offsets.size(); ++f) {
+						const int first_node = triangulation.node_offsets[f];
+						node_indices_.resize(triangulation.node_offsets[f + 1] - first_node);
+
+						for (int i = first_node; i < triangulation.node_offsets[f + 1]; ++i) {
+							node_indices_[i - first_node] = addVertex(surface_style_id, triangulation.nodes[i]);
+							if (calculate_normals) {
+								const gp_XYZ& normal = triangulation.normals[i];
+								_normals.push_back(static_cast<P>(normal.X()));
+								_normals.push_back(static_cast<P>(normal.Y()));
+								_normals.push_back(static_cast<P>(normal.Z()));
 							}
+						}
 
-							const Poly_Array1OfTriangle& triangles = tri->Triangles();			
-							for( int i = 1; i <= triangles.Length(); ++ i ) {
-								int n1,n2,n3;
-								if ( face.Orientation() == TopAbs_REVERSED )
-									triangles(i).Get(n3,n2,n1);
-								else triangles(i).Get(n1,n2,n3);
+						// Keep track of the number of times an edge is used
+						// Manifold edges (i.e. edges used twice) are deemed invisible
+						beginEdges((triangulation.triangle_offsets[f + 1] - triangulation.triangle_offsets[f]) / 3);
 
-								/* An alternative would be to calculate normals based
-									* on the coordinates of the mesh vertices */
-								/*
-								const gp_XYZ pt1 = coords[n1-1];
-								const gp_XYZ pt2 = coords[n2-1];
-								const gp_XYZ pt3 = coords[n3-1];
-								const gp_XYZ v1 = pt2-pt1;
-								const gp_XYZ v2 = pt3-pt2;
-								gp_Dir normal = gp_Dir(v1^v2);
-								_normals.push_back((float)normal.X());
-								_normals.push_back((float)normal.Y());
-								_normals.push_back((float)normal.Z());
-								*/
+						for (int i = triangulation.triangle_offsets[f]; i < triangulation.triangle_offsets[f + 1]; i += 3) {
+							const int v1 = node_indices_[triangulation.triangles[i]];
+							const int v2 = node_indices_[triangulation.triangles[i + 1]];
+							const int v3 = node_indices_[triangulation.triangles[i + 2]];
 
-								_faces.push_back(dict[n1]);
-								_faces.push_back(dict[n2]);
-								_faces.push_back(dict[n3]);
+							_faces.push_back(v1);
+							_faces.push_back(v2);
+							_faces.push_back(v3);
 
-								_material_ids.push_back(surface_style_id);
+							_material_ids.push_back(surface_style_id);
 
-								addEdge(dict[n1], dict[n2], edgecount, edges_temp);
-								addEdge(dict[n2], dict[n3], edgecount, edges_temp);
-								addEdge(dict[n3], dict[n1], edgecount, edges_temp);
-							}
-							for ( std::vector<std::pair<int,int> >::const_iterator jt = edges_temp.begin(); jt != edges_temp.end(); ++jt ) {
-								if (edgecount[*jt] == 1) {
-									// non manifold edge, face boundary
-									_edges.push_back(jt->first);
-									_edges.push_back(jt->second);
-								}
+							addEdge(v1, v2);
+							addEdge(v2, v3);
+							addEdge(v3, v1);
+						}
+						for ( std::vector<int>::const_iterator jt = face_edges_.begin(); jt != face_edges_.end(); ++jt ) {
+							if (edge_counts_[*jt] == 1) {
+								// non manifold edge, face boundary
+								_edges.push_back(edge_keys_[2 * *jt]);
+								_edges.push_back(edge_keys_[2 * *jt + 1]);
 							}
 						}
 					}
@@ -272,7 +280,7 @@ namespace IfcGeom {
                         uvs_ = box_project_uvs(_verts, _normals);
                     }
 
-					if (num_faces == 0) {
+					if (triangulation.num_faces == 0) {
 						// Edges are only emitted if there are no faces. A mixed representation of faces
 						// and loose edges is discouraged by the standard. An alternative would be to use
 						// TopExp_Explorer texp(s, TopAbs_EDGE, TopAbs_FACE) to find edges that do not
@@ -341,8 +349,9 @@ namespace IfcGeom {
 						}
 					}
 
-                    BRepTools::Clean(s);
 				}
+
+				releaseBuffers();
 			}
 			virtual ~Triangulation() {}
 
@@ -377,6 +386,10 @@ namespace IfcGeom {
             }
 
 		private:
+			static ElementSettings with_deflection_tolerance(ElementSettings settings, double deflection_tolerance) {
+				settings.set_deflection_tolerance(deflection_tolerance);
+				return settings;
+			}
 			// Welds vertices that belong to different faces
 			int addVertex(int material_index, const gp_XYZ& p) {
                 const bool convert = settings().get(IteratorSettings::CONVERT_BACK_UNITS);
@@ -385,22 +398,183 @@ namespace IfcGeom {
 				const P Z = static_cast<P>(convert ? (p.Z() / settings().unit_magnitude()) : p.Z());
 				int i = (int) _verts.size() / 3;
 				if (settings().get(IteratorSettings::WELD_VERTICES)) {
-					const VertexKey key = std::make_pair(material_index, std::make_pair(X, std::make_pair(Y, Z)));
-					typename VertexKeyMap::const_iterator it = welds.find(key);
-					if ( it != welds.end() ) return it->second;
-					i = (int) welds.size();
-					welds[key] = i;
+					int& weld = findWeld(material_index, X, Y, Z);
+					if (weld != -1) return weld;
+					i = weld = (int) weld_materials_.size();
+					weld_materials_.push_back(material_index);
+					weld_coords_.push_back(X);
+					weld_coords_.push_back(Y);
+					weld_coords_.push_back(Z);
 				}
 				_verts.push_back(X);
 				_verts.push_back(Y);
 				_verts.push_back(Z);
 				return i;
 			}
-			inline void addEdge(int n1, int n2, std::map<std::pair<int,int>,int>& edgecount, std::vector<std::pair<int,int> >& edges_temp) {
-				const Edge e = Edge( (std::min)(n1,n2),(std::max)(n1,n2) );
-				if ( edgecount.find(e) == edgecount.end() ) edgecount[e] = 1;
-				else edgecount[e] ++;
-				edges_temp.push_back(e);
+			// Copies the triangles of a tessellated item. Points are shared amongst
+			// faces if the normals are specified, otherwise every face has its own
+			// points to which the normal of the face is assigned, as for shapes.
+			void addMesh(const TessellatedMesh& mesh, const gp_GTrsf& trsf, int surface_style_id) {
+				const bool calculate_normals = !settings().get(IteratorSettings::WELD_VERTICES) &&
+					!settings().get(IteratorSettings::NO_NORMALS);
+				const bool shared_normals = calculate_normals && mesh.normals.size() == mesh.points.size();
+				const bool face_normals = calculate_normals && !shared_normals;
+				const gp_Mat rotation_matrix = trsf.VectorialPart();
+
+				std::vector<gp_XYZ> points(mesh.points);
+				for (std::vector<gp_XYZ>::iterator it = points.begin(); it != points.end(); ++it) {
+					trsf.Transforms(*it);
+				}
+
+				std::vector<gp_XYZ> normals;
+				if (shared_normals) {
+					normals.reserve(mesh.normals.size());
+					for (std::vector<gp_XYZ>::const_iterator it = mesh.normals.begin(); it != mesh.normals.end(); ++it) {
+						gp_XYZ normal = *it * rotation_matrix;
+						if (normal.Modulus() > ALMOST_ZERO) {
+							normal.Normalize();
+						}
+						normals.push_back(normal);
+					}
+				}
+
+				// Maps the indices of the mesh to those of the triangulation
+				std::vector<int> dict(points.size(), -1);
+				std::vector<int> face_points;
+
+				for (std::size_t i = 0; i < mesh.faces.size(); ++i) {
+					const TessellatedMesh::Face& face = mesh.faces[i];
+					const TessellatedMesh::Loop& outer = face.front();
+
+					gp_XYZ face_normal;
+					if (face_normals) {
+						for (std::vector<int>::const_iterator it = face_points.begin(); it != face_points.end(); ++it) {
+							dict[*it] = -1;
+						}
+						face_points.clear();
+						for (std::size_t j = 0; j < outer.size(); ++j) {
+							face_normal += points[outer[j]].Crossed(points[outer[(j + 1) % outer.size()]]);
+						}
+						if (face_normal.Modulus() > ALMOST_ZERO) {
+							face_normal.Normalize();
+						}
+					}
+
+					for (int j = mesh.face_offsets[i]; j < mesh.face_offsets[i + 1]; ++j) {
+						const int n = mesh.triangles[j];
+						if (dict[n] == -1) {
+							dict[n] = addVertex(surface_style_id, points[n]);
+							if (calculate_normals) {
+								const gp_XYZ& normal = shared_normals ? normals[n] : face_normal;
+								_normals.push_back(static_cast<P>(normal.X()));
+								_normals.push_back(static_cast<P>(normal.Y()));
+								_normals.push_back(static_cast<P>(normal.Z()));
+							}
+							if (face_normals) {
+								face_points.push_back(n);
+							}
+						}
+						_faces.push_back(dict[n]);
+						if (j % 3 == 2) {
+							_material_ids.push_back(surface_style_id);
+						}
+					}
+
+					// The face boundaries are the edges that are not shared by triangles
+					for (TessellatedMesh::Face::const_iterator it = face.begin(); it != face.end(); ++it) {
+						for (std::size_t j = 0; j < it->size(); ++j) {
+							const int a = dict[(*it)[j]];
+							const int b = dict[(*it)[(j + 1) % it->size()]];
+							if (a != -1 && b != -1) {
+								_edges.push_back(a);
+								_edges.push_back(b);
+							}
+						}
+					}
+				}
+			}
+			static std::size_t hashVertex(int material_index, P x, P y, P z) {
+				// Negative zero equals zero and is hashed as such
+				std::size_t seed = 0;
+				boost::hash_combine(seed, material_index);
+				boost::hash_combine(seed, x == 0 ? P(0) : x);
+				boost::hash_combine(seed, y == 0 ? P(0) : y);
+				boost::hash_combine(seed, z == 0 ? P(0) : z);
+				return seed;
+			}
+			// Returns the slot of the weld equal to the vertex, or the empty slot
+			// to store the vertex in. The table is kept at most half full.
+			int& findWeld(int material_index, P x, P y, P z) {
+				if (2 * (weld_materials_.size() + 1) > weld_slots_.size()) {
+					weld_slots_.assign((std::max)(2 * weld_slots_.size(), (std::size_t) 64), -1);
+					const std::size_t mask = weld_slots_.size() - 1;
+					for (int w = 0; w < (int) weld_materials_.size(); ++w) {
+						std::size_t h = hashVertex(weld_materials_[w], weld_coords_[3 * w], weld_coords_[3 * w + 1], weld_coords_[3 * w + 2]) & mask;
+						while (weld_slots_[h] != -1) {
+							h = (h + 1) & mask;
+						}
+						weld_slots_[h] = w;
+					}
+				}
+				const std::size_t mask = weld_slots_.size() - 1;
+				for (std::size_t h = hashVertex(material_index, x, y, z) & mask;; h = (h + 1) & mask) {
+					const int w = weld_slots_[h];
+					if (w == -1 || (weld_materials_[w] == material_index &&
+						weld_coords_[3 * w] == x && weld_coords_[3 * w + 1] == y && weld_coords_[3 * w + 2] == z))
+					{
+						return weld_slots_[h];
+					}
+				}
+			}
+			// Frees the welding and edge tables, which are only used while the
+			// shapes are added, rather than keeping them for the lifetime of the
+			// triangulation
+			void releaseBuffers() {
+				std::vector<int>().swap(weld_slots_);
+				std::vector<int>().swap(weld_materials_);
+				std::vector<P>().swap(weld_coords_);
+				std::vector<int>().swap(node_indices_);
+				std::vector<int>().swap(edge_keys_);
+				std::vector<int>().swap(edge_counts_);
+				std::vector<int>().swap(edge_stamps_);
+				std::vector<int>().swap(face_edges_);
+				edge_stamp_ = 0;
+			}
+			// Empties the edge table for a face with the given number of triangles
+			void beginEdges(int num_triangles) {
+				std::size_t size = edge_counts_.empty() ? 64 : edge_counts_.size();
+				while (size < 6 * (std::size_t) num_triangles) {
+					size *= 2;
+				}
+				if (size != edge_counts_.size()) {
+					edge_keys_.resize(2 * size);
+					edge_counts_.resize(size);
+					edge_stamps_.assign(size, 0);
+					edge_stamp_ = 0;
+				}
+				++edge_stamp_;
+				face_edges_.clear();
+			}
+			void addEdge(int n1, int n2) {
+				const int a = (std::min)(n1, n2), b = (std::max)(n1, n2);
+				std::size_t seed = 0;
+				boost::hash_combine(seed, a);
+				boost::hash_combine(seed, b);
+				const std::size_t mask = edge_counts_.size() - 1;
+				std::size_t h = seed & mask;
+				for (;; h = (h + 1) & mask) {
+					if (edge_stamps_[h] != edge_stamp_) {
+						edge_stamps_[h] = edge_stamp_;
+						edge_keys_[2 * h] = a;
+						edge_keys_[2 * h + 1] = b;
+						edge_counts_[h] = 1;
+						break;
+					} else if (edge_keys_[2 * h] == a && edge_keys_[2 * h + 1] == b) {
+						++edge_counts_[h];
+						break;
+					}
+				}
+				face_edges_.push_back((int) h);
 			}
 			Triangulation();
 			Triangulation(const Triangulation&);
@@ -23,6 +23,9 @@
  *                                                                              *
  ********************************************************************************/
 
+#include <algorithm>
+#include <map>
+
 #include <gp_Pnt.hxx>
 #include <gp_Vec.hxx>
 #include <gp_Dir.hxx>
@@ -101,7 +104,25 @@
 
 #include <TopTools_ListIteratorOfListOfShape.hxx>
 
+#include <BRepTools.hxx>
+#include <BRepTools_WireExplorer.hxx>
+#include <BRepAdaptor_Curve.hxx>
+#include <GCPnts_QuasiUniformDeflection.hxx>
+#include <Geom_Plane.hxx>
+
 #include "../ifcgeom/IfcGeom.h"
+#include "../ifcgeom/IfcGeomPolygonTriangulator.h"
+
+namespace {
+	gp_XYZ polygon_normal(const std::vector<gp_XYZ>& points, const std::vector<int>& loop) {
+		const std::size_t n = loop.size();
+		gp_XYZ normal;
+		for (std::size_t i = 0; i < n; ++i) {
+			normal += points[loop[i]].Crossed(points[loop[(i + 1) % n]]);
+		}
+		return normal;
+	}
+}
 
 bool IfcGeom::Kernel::convert(const IfcSchema::IfcExtrudedAreaSolid* l, TopoDS_Shape& shape) {
 	const double height = l->Depth() * getValue(GV_LENGTH_UNIT);
@@ -155,13 +176,303 @@ bool IfcGeom::Kernel::convert(const IfcSchema::IfcExtrudedAreaSolid* l, TopoDS_S
 
 	if (has_position && !shape.IsNull()) {
 		// IfcSweptAreaSolid.Position (trsf) is an IfcAxis2Placement3D
-		// and therefore has a unit scale factor
+		// and therefore has a unit scale factor. It needs to be applied
+		// last, see deduplication_key().
 		shape.Move(trsf);
 	}
 
 	return !shape.IsNull();
 }
 
+bool IfcGeom::Kernel::tessellate(const IfcSchema::IfcRepresentationItem* l, TessellatedMesh& mesh) {
+	try {
+#ifdef USE_IFC4
+		if (l->is(IfcSchema::Type::IfcTessellatedFaceSet)) {
+			return convert_tessellated(l->as<IfcSchema::IfcTessellatedFaceSet>(), mesh) && mesh.is_triangulated();
+		}
+#endif
+		// Tapered extrusions are a subtype in IFC4
+		if (l->type() == IfcSchema::Type::IfcExtrudedAreaSolid) {
+			return tessellate(l->as<IfcSchema::IfcExtrudedAreaSolid>(), mesh);
+		}
+		// Faceted breps with voids are subtracted by means of shapes
+		if (l->type() == IfcSchema::Type::IfcFacetedBrep) {
+			return tessellate(l->as<IfcSchema::IfcFacetedBrep>(), mesh);
+		}
+	} catch (const Standard_Failure&) {
+	} catch (const std::exception&) {}
+	return false;
+}
+
+bool IfcGeom::Kernel::tessellate(const IfcSchema::IfcExtrudedAreaSolid* l, TessellatedMesh& mesh) {
+	const double height = l->Depth() * getValue(GV_LENGTH_UNIT);
+	if (height < getValue(GV_PRECISION)) {
+		return false;
+	}
+
+	TopoDS_Shape profile;
+	if (!convert_face(l->SweptArea(), profile) || profile.ShapeType() != TopAbs_FACE || count(profile, TopAbs_WIRE) != 1) {
+		return false;
+	}
+	const TopoDS_Face& face = TopoDS::Face(profile);
+
+	Handle_Geom_Surface surface = BRep_Tool::Surface(face);
+	if (surface.IsNull() || surface->DynamicType() != STANDARD_TYPE(Geom_Plane)) {
+		return false;
+	}
+
+	gp_Trsf trsf;
+	bool has_position = true;
+#ifdef USE_IFC4
+	has_position = l->hasPosition();
+#endif
+	if (has_position) {
+		IfcGeom::Kernel::convert(l->Position(), trsf);
+	}
+
+	gp_Dir dir;
+	convert(l->ExtrudedDirection(), dir);
+	const gp_XYZ extrusion = dir.XYZ() * height;
+
+	// The profile boundary as a polygon. For every edge the index of its first
+	// point is stored, and for curved edges the tangents at the points and at
+	// the end of the edge, to assign smooth normals to the sides.
+	std::vector<gp_XYZ> polygon, tangents, end_tangents;
+	std::vector<int> edge_start;
+	std::vector<bool> edge_curved;
+
+	for (BRepTools_WireExplorer exp(BRepTools::OuterWire(face), face); exp.More(); exp.Next()) {
+		BRepAdaptor_Curve curve(exp.Current());
+		const bool reversed = exp.Current().Orientation() == TopAbs_REVERSED;
+		edge_start.push_back((int) polygon.size());
+		edge_curved.push_back(curve.GetType() != GeomAbs_Line);
+		if (curve.GetType() == GeomAbs_Line) {
+			polygon.push_back(BRep_Tool::Pnt(exp.CurrentVertex()).XYZ());
+			tangents.push_back(gp_XYZ());
+			end_tangents.push_back(gp_XYZ());
+		} else {
+			if (!approximate_mesh_passthrough) {
+				return false;
+			}
+			GCPnts_QuasiUniformDeflection tessellater(curve, getValue(GV_DEFLECTION_TOLERANCE));
+			if (!tessellater.IsDone() || tessellater.NbPoints() < 2) {
+				return false;
+			}
+			const int n = tessellater.NbPoints();
+			gp_Pnt p;
+			gp_Vec d1;
+			for (int i = 1; i <= n; ++i) {
+				curve.D1(tessellater.Parameter(reversed ? n + 1 - i : i), p, d1);
+				if (reversed) {
+					d1.Reverse();
+				}
+				if (i < n) {
+					polygon.push_back(p.XYZ());
+					tangents.push_back(d1.XYZ());
+				} else {
+					end_tangents.push_back(d1.XYZ());
+				}
+			}
+		}
+	}
+
+	const int n = (int) polygon.size();
+	if (n < 3) {
+		return false;
+	}
+
+	std::vector<int> loop(n);
+	for (int i = 0; i < n; ++i) {
+		loop[i] = i;
+	}
+
+	// The orientation of the profile boundary with respect to the extrusion
+	gp_XYZ top_normal = polygon_normal(polygon, loop);
+	const double alignment = top_normal.Dot(extrusion);
+	if (std::fabs(alignment) < ALMOST_ZERO) {
+		return false;
+	}
+	const bool forward = alignment > 0.;
+	top_normal.Normalize();
+	if (!forward) {
+		top_normal.Reverse();
+	}
+
+	std::vector<int> cap;
+	if (!PolygonTriangulator().triangulate(polygon, loop, cap)) {
+		return false;
+	}
+
+	mesh.points.reserve(4 * n + 2 * edge_start.size());
+	mesh.normals.reserve(mesh.points.capacity());
+
+	// The bottom and top faces, oriented opposite to and along the extrusion
+	for (int top = 0; top <= 1; ++top) {
+		const int offset = (int) mesh.points.size();
+		for (int i = 0; i < n; ++i) {
+			mesh.points.push_back(top ? polygon[i] + extrusion : polygon[i]);
+			mesh.normals.push_back(top ? top_normal : top_normal.Reversed());
+		}
+		const bool same_sense = (top == 1) == forward;
+		TessellatedMesh::Loop face_loop(n);
+		for (int i = 0; i < n; ++i) {
+			face_loop[i] = offset + (same_sense ? i : n - 1 - i);
+		}
+		mesh.faces.push_back(TessellatedMesh::Face(1, face_loop));
+		mesh.face_offsets.push_back((int) mesh.triangles.size());
+		for (std::size_t i = 0; i < cap.size(); i += 3) {
+			mesh.triangles.push_back(offset + cap[i + (same_sense ? 0 : 2)]);
+			mesh.triangles.push_back(offset + cap[i + 1]);
+			mesh.triangles.push_back(offset + cap[i + (same_sense ? 2 : 0)]);
+		}
+	}
+
+	// A side face for every profile edge, a strip of quads for curved edges
+	for (std::size_t e = 0; e < edge_start.size(); ++e) {
+		const int first = edge_start[e];
+		const int segments = (e + 1 < edge_start.size() ? edge_start[e + 1] : n) - first;
+		const int offset = (int) mesh.points.size();
+		const gp_XYZ flat_normal = (polygon[(first + 1) % n] - polygon[first]).Crossed(extrusion) * (forward ? 1. : -1.);
+
+		for (int top = 0; top <= 1; ++top) {
+			for (int k = 0; k <= segments; ++k) {
+				const int i = (first + k) % n;
+				gp_XYZ normal = flat_normal;
+				if (edge_curved[e]) {
+					normal = (k < segments ? tangents[i] : end_tangents[e]).Crossed(extrusion) * (forward ? 1. : -1.);
+				}
+				if (normal.Modulus() > ALMOST_ZERO) {
+					normal.Normalize();
+				}
+				mesh.points.push_back(top ? polygon[i] + extrusion : polygon[i]);
+				mesh.normals.push_back(normal);
+			}
+		}
+
+		// Bottom points are at offset + k, top points at offset + segments + 1 + k
+		const int t = offset + segments + 1;
+		TessellatedMesh::Loop face_loop;
+		face_loop.reserve(2 * (segments + 1));
+		for (int k = 0; k <= segments; ++k) {
+			face_loop.push_back(offset + (forward ? k : segments - k));
+		}
+		for (int k = 0; k <= segments; ++k) {
+			face_loop.push_back(t + (forward ? segments - k : k));
+		}
+		mesh.faces.push_back(TessellatedMesh::Face(1, face_loop));
+		mesh.face_offsets.push_back((int) mesh.triangles.size());
+		for (int k = 0; k < segments; ++k) {
+			const int a = offset + k, b = offset + k + 1, c = t + k + 1, d = t + k;
+			if (forward) {
+				const int quad[] = { a, b, c, a, c, d };
+				mesh.triangles.insert(mesh.triangles.end(), quad, quad + 6);
+			} else {
+				const int quad[] = { b, a, d, b, d, c };
+				mesh.triangles.insert(mesh.triangles.end(), quad, quad + 6);
+			}
+		}
+	}
+
+	mesh.face_offsets.push_back((int) mesh.triangles.size());
+
+	if (has_position) {
+		for (std::vector<gp_XYZ>::iterator it = mesh.points.begin(); it != mesh.points.end(); ++it) {
+			trsf.Transforms(*it);
+		}
+		for (std::vector<gp_XYZ>::iterator it = mesh.normals.begin(); it != mesh.normals.end(); ++it) {
+			*it = gp_Vec(*it).Transformed(trsf).XYZ();
+		}
+	}
+
+	return true;
+}
+
+bool IfcGeom::Kernel::tessellate(const IfcSchema::IfcFacetedBrep* l, TessellatedMesh& mesh) {
+	IfcSchema::IfcFace::list::ptr faces = l->Outer()->CfsFaces();
+
+	// Points shared by faces are referenced by index
+	std::map<unsigned int, int> point_indices;
+	PolygonTriangulator triangulator;
+
+	mesh.faces.reserve(faces->size());
+	mesh.face_offsets.reserve(faces->size() + 1);
+
+	for (IfcSchema::IfcFace::list::it it = faces->begin(); it != faces->end(); ++it) {
+		IfcSchema::IfcFaceBound::list::ptr bounds = (*it)->Bounds();
+		TessellatedMesh::Face face;
+		face.reserve(bounds->size());
+		bool has_outer_bound = false;
+
+		for (IfcSchema::IfcFaceBound::list::it jt = bounds->begin(); jt != bounds->end(); ++jt) {
+			IfcSchema::IfcFaceBound* bound = *jt;
+			if (!bound->Bound()->is(IfcSchema::Type::IfcPolyLoop)) {
+				return false;
+			}
+			IfcSchema::IfcCartesianPoint::list::ptr points = bound->Bound()->as<IfcSchema::IfcPolyLoop>()->Polygon();
+			TessellatedMesh::Loop loop;
+			loop.reserve(points->size());
+			for (IfcSchema::IfcCartesianPoint::list::it kt = points->begin(); kt != points->end(); ++kt) {
+				std::map<unsigned int, int>::const_iterator index = point_indices.find((*kt)->entity->id());
+				if (index == point_indices.end()) {
+					gp_Pnt p;
+					convert(*kt, p);
+					index = point_indices.insert(std::make_pair((*kt)->entity->id(), (int) mesh.points.size())).first;
+					mesh.points.push_back(p.XYZ());
+				}
+				loop.push_back(index->second);
+			}
+			if (loop.size() < 3) {
+				return false;
+			}
+			if (!bound->Orientation()) {
+				std::reverse(loop.begin(), loop.end());
+			}
+			// The outer boundary is stored first
+			if (bound->is(IfcSchema::Type::IfcFaceOuterBound)) {
+				// Faces with multiple outer bounds are left to the shape conversion
+				if (has_outer_bound) {
+					return false;
+				}
+				has_outer_bound = true;
+				face.insert(face.begin(), loop);
+			} else {
+				face.push_back(loop);
+			}
+		}
+
+		if (face.empty()) {
+			continue;
+		}
+
+		const std::size_t offset = mesh.triangles.size();
+		if (!triangulator.triangulate(mesh.points, face, mesh.triangles)) {
+			return false;
+		}
+
+		// Faces that are left out when sewing the shell are left out as well
+		double area = 0.;
+		for (std::size_t i = offset; i < mesh.triangles.size(); i += 3) {
+			const gp_XYZ& a = mesh.points[mesh.triangles[i]];
+			area += (mesh.points[mesh.triangles[i + 1]] - a).Crossed(mesh.points[mesh.triangles[i + 2]] - a).Modulus() / 2.;
+		}
+		if (area <= getValue(GV_MINIMAL_FACE_AREA)) {
+			mesh.triangles.resize(offset);
+			continue;
+		}
+
+		mesh.faces.push_back(face);
+		mesh.face_offsets.push_back((int) offset);
+	}
+
+	if (mesh.faces.empty()) {
+		return false;
+	}
+
+	mesh.face_offsets.push_back((int) mesh.triangles.size());
+
+	return true;
+}
+
 #ifdef USE_IFC4
 bool IfcGeom::Kernel::convert(const IfcSchema::IfcExtrudedAreaSolidTapered* l, TopoDS_Shape& shape) {
 	const double height = l->Depth() * getValue(GV_LENGTH_UNIT);
@@ -256,7 +567,8 @@ bool IfcGeom::Kernel::convert(const IfcSchema::IfcExtrudedAreaSolidTapered* l, T
 
 	if (has_position && !shape.IsNull()) {
 		// IfcSweptAreaSolid.Position (trsf) is an IfcAxis2Placement3D
-		// and therefore has a unit scale factor
+		// and therefore has a unit scale factor. It needs to be applied
+		// last, see deduplication_key().
 		shape.Move(trsf);
 	}
 
@@ -355,7 +667,8 @@ bool IfcGeom::Kernel::convert(const IfcSchema::IfcRevolvedAreaSolid* l, TopoDS_S
 
 	if (has_position) {
 		// IfcSweptAreaSolid.Position (trsf) is an IfcAxis2Placement3D
-		// and therefore has a unit scale factor
+		// and therefore has a unit scale factor. It needs to be applied
+		// last, see deduplication_key().
 		shape.Move(trsf);
 	}
 
@@ -657,8 +970,8 @@ bool IfcGeom::Kernel::convert(const IfcSchema::IfcConnectedFaceSet* l, TopoDS_Sh
 	return true;
 }
 
-bool IfcGeom::Kernel::convert(const IfcSchema::IfcMappedItem* l, IfcRepresentationShapeItems& shapes) {
-	gp_GTrsf gtrsf;
+bool IfcGeom::Kernel::convert_mapped_item_placement(const IfcSchema::IfcMappedItem* l, gp_GTrsf& gtrsf) {
+	gtrsf = gp_GTrsf();
 	IfcSchema::IfcCartesianTransformationOperator* transform = l->MappingTarget();
 	if ( transform->is(IfcSchema::Type::IfcCartesianTransformationOperator3DnonUniform) ) {
 		IfcGeom::Kernel::convert((IfcSchema::IfcCartesianTransformationOperator3DnonUniform*)transform,gtrsf);
@@ -685,7 +998,16 @@ bool IfcGeom::Kernel::convert(const IfcSchema::IfcMappedItem* l, IfcRepresentati
 		trsf = trsf_2d;
 	}
 	gtrsf.Multiply(trsf);
+	return true;
+}
 
+bool IfcGeom::Kernel::convert(const IfcSchema::IfcMappedItem* l, IfcRepresentationShapeItems& shapes) {
+	gp_GTrsf gtrsf;
+	if (!convert_mapped_item_placement(l, gtrsf)) {
+		return false;
+	}
+
+	IfcSchema::IfcRepresentationMap* map = l->MappingSource();
 	const IfcGeom::SurfaceStyle* mapped_item_style = get_style(l);
 	
 	const size_t previous_size = shapes.size();
@@ -709,7 +1031,27 @@ bool IfcGeom::Kernel::convert(const IfcSchema::IfcRepresentation* l, IfcRepresen
 	bool part_succes = false;
 	if ( items->size() ) {
 		for ( IfcSchema::IfcRepresentationItem::list::it it = items->begin(); it != items->end(); ++ it ) {
+			if (time_budget_exceeded()) {
+				break;
+			}
 			IfcSchema::IfcRepresentationItem* representation_item = *it;
+			if (mesh_passthrough && getValue(GV_DIMENSIONALITY) != -1.) {
+				boost::shared_ptr<TessellatedMesh> mesh(new TessellatedMesh);
+				if (tessellate(representation_item, *mesh)) {
+					const SurfaceStyle* style = get_style(representation_item);
+					if (representation_item->is(IfcSchema::Type::IfcManifoldSolidBrep)) {
+						// As for the shapes of breps, a style of the shell takes precedence
+						const SurfaceStyle* shell_style = get_style(representation_item->as<IfcSchema::IfcManifoldSolidBrep>()->Outer());
+						if (shell_style) {
+							style = shell_style;
+						}
+					}
+					shapes.push_back(IfcRepresentationShapeItem(boost::shared_ptr<const TessellatedMesh>(mesh), style));
+					part_succes = true;
+					continue;
+				}
+				// Otherwise the item is triangulated by means of a shape
+			}
 			if ( shape_type(representation_item) == ST_SHAPELIST ) {
 				part_succes |= convert_shapes(*it, shapes);
 			} else {
@@ -1124,10 +1466,10 @@ bool IfcGeom::Kernel::convert(const IfcSchema::IfcAdvancedBrep* l, TopoDS_Shape&
 	return convert(l->Outer(), shape);
 }
 
-bool IfcGeom::Kernel::convert(const IfcSchema::IfcTriangulatedFaceSet* l, TopoDS_Shape& shape) {
+bool IfcGeom::Kernel::convert_tessellated(const IfcSchema::IfcTessellatedFaceSet* l, TessellatedMesh& mesh) {
 	IfcSchema::IfcCartesianPointList3D* point_list = l->Coordinates();
 	const std::vector< std::vector<double> > coordinates = point_list->CoordList();
-	std::vector<gp_Pnt> points;
+	std::vector<gp_XYZ> points;
 	points.reserve(coordinates.size());
 	for (std::vector< std::vector<double> >::const_iterator it = coordinates.begin(); it != coordinates.end(); ++it) {
 		const std::vector<double>& coords = *it;
@@ -1135,100 +1477,137 @@ bool IfcGeom::Kernel::convert(const IfcSchema::IfcTriangulatedFaceSet* l, TopoDS
 			Logger::Message(Logger::LOG_ERROR, "Invalid dimensions encountered on Coordinates", l->entity);
 			return false;
 		}
-		points.push_back(gp_Pnt(coords[0] * getValue(GV_LENGTH_UNIT),
+		points.push_back(gp_XYZ(coords[0] * getValue(GV_LENGTH_UNIT),
 		                        coords[1] * getValue(GV_LENGTH_UNIT),
 		                        coords[2] * getValue(GV_LENGTH_UNIT)));
 	}
 
-	std::vector< std::vector<int> > indices = l->CoordIndex();
-	
-	std::vector<TopoDS_Face> faces;
-	faces.reserve(indices.size());
+	const IfcSchema::IfcTriangulatedFaceSet* triangulated = l->as<IfcSchema::IfcTriangulatedFaceSet>();
+	const IfcSchema::IfcPolygonalFaceSet* polygonal = l->as<IfcSchema::IfcPolygonalFaceSet>();
 
-	for(std::vector< std::vector<int> >::const_iterator it = indices.begin(); it != indices.end(); ++ it) {
-		const std::vector<int>& tri = *it;
-		if (tri.size() != 3) {
-			Logger::Message(Logger::LOG_ERROR, "Invalid dimensions encountered on CoordIndex", l->entity);
-			return false;
+	// The points are stored in the order in which they are referenced by the
+	// indices, which is the order of PnIndex if present.
+	std::vector<int> point_index;
+	if (triangulated && triangulated->hasPnIndex()) {
+		point_index = triangulated->PnIndex();
+	} else if (polygonal && polygonal->hasPnIndex()) {
+		point_index = polygonal->PnIndex();
+	}
+	if (point_index.empty()) {
+		mesh.points.swap(points);
+	} else {
+		mesh.points.reserve(point_index.size());
+		for (std::vector<int>::const_iterator it = point_index.begin(); it != point_index.end(); ++it) {
+			if (*it < 1 || *it > (int) points.size()) {
+				Logger::Message(Logger::LOG_ERROR, "Contents of PnIndex out of bounds", l->entity);
+				return false;
+			}
+			mesh.points.push_back(points[*it - 1]);
 		}
+	}
 
-		const int min_index = *std::min_element(tri.begin(), tri.end());
-		const int max_index = *std::max_element(tri.begin(), tri.end());
+	std::vector< std::vector< std::vector<int> > > faces;
 
-		if (min_index < 1 || max_index > (int) points.size()) {
-			Logger::Message(Logger::LOG_ERROR, "Contents of CoordIndex out of bounds", l->entity);
-			return false;
+	if (triangulated) {
+		const std::vector< std::vector<int> > indices = triangulated->CoordIndex();
+		faces.reserve(indices.size());
+		for (std::vector< std::vector<int> >::const_iterator it = indices.begin(); it != indices.end(); ++it) {
+			if (it->size() != 3) {
+				Logger::Message(Logger::LOG_ERROR, "Invalid dimensions encountered on CoordIndex", l->entity);
+				return false;
+			}
+			faces.push_back(std::vector< std::vector<int> >(1, *it));
 		}
 
-		const gp_Pnt& a = points[tri[0] - 1]; // account for zero- vs
-		const gp_Pnt& b = points[tri[1] - 1]; // one-based indices in
-		const gp_Pnt& c = points[tri[2] - 1]; // c++ and express
-
-		TopoDS_Wire wire = BRepBuilderAPI_MakePolygon(a, b, c, true).Wire();
-		TopoDS_Face face = BRepBuilderAPI_MakeFace(wire).Face();
-
-		TopoDS_Iterator face_it(face, false);
-		const TopoDS_Wire& w = TopoDS::Wire(face_it.Value());
-		const bool reversed = w.Orientation() == TopAbs_REVERSED;
-		if (reversed) {
-			face.Reverse();
+		if (triangulated->hasNormals()) {
+			const std::vector< std::vector<double> > normals = triangulated->Normals();
+			if (normals.size() == mesh.points.size()) {
+				mesh.normals.reserve(normals.size());
+				for (std::vector< std::vector<double> >::const_iterator it = normals.begin(); it != normals.end(); ++it) {
+					if (it->size() != 3) {
+						mesh.normals.clear();
+						break;
+					}
+					mesh.normals.push_back(gp_XYZ((*it)[0], (*it)[1], (*it)[2]));
+				}
+			}
+			if (mesh.normals.empty()) {
+				Logger::Message(Logger::LOG_WARNING, "Normals do not correspond to Coordinates and are ignored", l->entity);
+			}
 		}
-
-		if (face_area(face) > getValue(GV_MINIMAL_FACE_AREA)) {
-			faces.push_back(face);
+	} else if (polygonal) {
+		IfcSchema::IfcIndexedPolygonalFace::list::ptr polygonal_faces = polygonal->Faces();
+		faces.reserve(polygonal_faces->size());
+		for (IfcSchema::IfcIndexedPolygonalFace::list::it it = polygonal_faces->begin(); it != polygonal_faces->end(); ++it) {
+			std::vector< std::vector<int> > loops(1, (*it)->CoordIndex());
+			if ((*it)->is(IfcSchema::Type::IfcIndexedPolygonalFaceWithVoids)) {
+				const std::vector< std::vector<int> > inner = (*it)->as<IfcSchema::IfcIndexedPolygonalFaceWithVoids>()->InnerCoordIndices();
+				loops.insert(loops.end(), inner.begin(), inner.end());
+			}
+			faces.push_back(loops);
 		}
+	} else {
+		Logger::Message(Logger::LOG_ERROR, "Unsupported tessellated face set:", l->entity);
+		return false;
 	}
 
-	if (faces.empty()) return false;
-	
-	bool valid_shell = false;
+	if (faces.empty()) {
+		return false;
+	}
 
-	if (faces.size() < getValue(GV_MAX_FACES_TO_SEW)) {
-		BRepOffsetAPI_Sewing builder;
-		builder.SetTolerance(getValue(GV_POINT_EQUALITY_TOLERANCE));
-		builder.SetMaxTolerance(getValue(GV_POINT_EQUALITY_TOLERANCE));
-		builder.SetMinTolerance(getValue(GV_POINT_EQUALITY_TOLERANCE));
-		
-		for (std::vector<TopoDS_Face>::const_iterator it = faces.begin(); it != faces.end(); ++it) {
-			builder.Add(*it);
-		}
+	bool triangulate = true;
+	PolygonTriangulator triangulator;
 
-		try {
-			builder.Perform();
-			shape = builder.SewedShape();
-			valid_shell = BRepCheck_Analyzer(shape).IsValid();
-		} catch(...) {}
-
-		if (valid_shell) {
-			try {
-				ShapeFix_Solid solid;
-				solid.LimitTolerance(getValue(GV_POINT_EQUALITY_TOLERANCE));
-				TopoDS_Solid solid_shape = solid.SolidFromShell(TopoDS::Shell(shape));
-				if (!solid_shape.IsNull()) {
-					try {
-						BRepClass3d_SolidClassifier classifier(solid_shape);
-						shape = solid_shape;
-					} catch (...) {}
+	mesh.faces.reserve(faces.size());
+	mesh.face_offsets.reserve(faces.size() + 1);
+
+	for (std::vector< std::vector< std::vector<int> > >::iterator it = faces.begin(); it != faces.end(); ++it) {
+		for (std::vector< std::vector<int> >::iterator jt = it->begin(); jt != it->end(); ++jt) {
+			if (jt->size() < 3) {
+				Logger::Message(Logger::LOG_ERROR, "Less than three indices in a face boundary", l->entity);
+				return false;
+			}
+			for (std::vector<int>::iterator kt = jt->begin(); kt != jt->end(); ++kt) {
+				if (*kt < 1 || *kt > (int) mesh.points.size()) {
+					Logger::Message(Logger::LOG_ERROR, "Contents of CoordIndex out of bounds", l->entity);
+					return false;
 				}
-			} catch(...) {}
-		} else {
-			Logger::Message(Logger::LOG_WARNING, "Failed to sew faceset:", l->entity);
+				// account for zero- vs one-based indices in c++ and express
+				--(*kt);
+			}
 		}
-	}
 
-	if (!valid_shell) {
-		TopoDS_Compound compound;
-		BRep_Builder builder;
-		builder.MakeCompound(compound);
-		
-		for (std::vector<TopoDS_Face>::const_iterator it = faces.begin(); it != faces.end(); ++it) {
-			builder.Add(compound, *it);
+		mesh.faces.push_back(*it);
+
+		if (!triangulate) {
+			continue;
 		}
 
-		shape = compound;
+		mesh.face_offsets.push_back((int) mesh.triangles.size());
+		if (!triangulator.triangulate(mesh.points, *it, mesh.triangles)) {
+			// Left to the triangulation of the face as a shape
+			triangulate = false;
+		}
+	}
+
+	if (triangulate) {
+		mesh.face_offsets.push_back((int) mesh.triangles.size());
+	} else {
+		mesh.triangles.clear();
+		mesh.face_offsets.clear();
 	}
 
 	return true;
 }
 
+bool IfcGeom::Kernel::convert(const IfcSchema::IfcTriangulatedFaceSet* l, TopoDS_Shape& shape) {
+	TessellatedMesh mesh;
+	return convert_tessellated(l, mesh) && convert_mesh(mesh, shape, l);
+}
+
+bool IfcGeom::Kernel::convert(const IfcSchema::IfcPolygonalFaceSet* l, TopoDS_Shape& shape) {
+	TessellatedMesh mesh;
+	return convert_tessellated(l, mesh) && convert_mesh(mesh, shape, l);
+}
+
 #endif
@@ -0,0 +1,167 @@
+﻿/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+
+#include <algorithm>
+
+#include <BRep_Tool.hxx>
+#include <Poly_Triangulation.hxx>
+#include <TopExp.hxx>
+#include <TopoDS.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
+
+#include "IfcGeomSharedCache.h"
+
+std::size_t IfcGeom::cache_entry_size(const TopoDS_Shape& shape) {
+	// Rough averages of the memory used by topological entities, including
+	// their underlying geometry.
+	TopTools_IndexedMapOfShape faces, edges, vertices;
+	TopExp::MapShapes(shape, TopAbs_FACE, faces);
+	TopExp::MapShapes(shape, TopAbs_EDGE, edges);
+	TopExp::MapShapes(shape, TopAbs_VERTEX, vertices);
+	std::size_t bytes = 256 + faces.Extent() * 512 + edges.Extent() * 320 + vertices.Extent() * 128;
+
+	// Triangulations of the faces, with nodes, uv-coordinates and triangles,
+	// as well as the polygons on the edges estimated at half of that.
+	for (int i = 1; i <= faces.Extent(); ++i) {
+		TopLoc_Location loc;
+		Handle(Poly_Triangulation) tri = BRep_Tool::Triangulation(TopoDS::Face(faces(i)), loc);
+		if (!tri.IsNull()) {
+			const std::size_t nodes = tri->NbNodes() * (sizeof(gp_Pnt) + (tri->HasUVNodes() ? sizeof(gp_Pnt2d) : 0));
+			const std::size_t triangles = tri->NbTriangles() * sizeof(Poly_Triangle);
+			bytes += 64 + (nodes + triangles) * 3 / 2;
+		}
+	}
+
+	return bytes;
+}
+
+void IfcGeom::SharedCacheBudget::allocated(std::size_t bytes) {
+	std::size_t to_free;
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		used_ += bytes;
+		if (!bounded_ || used_ <= budget_) {
+			return;
+		}
+		// Some more than the excess is freed, so that not every insertion
+		// causes entries to be evicted
+		to_free = used_ - budget_ + budget_ / 8;
+	}
+
+	// Only a single thread evicts entries, other threads proceed
+	boost::mutex::scoped_try_lock sweep_lock(sweep_mutex_);
+	if (!sweep_lock.owns_lock() || maps_.empty()) {
+		return;
+	}
+
+	// Within two revolutions of the clock hand all entries that are not
+	// referenced in the meantime are evicted.
+	std::size_t freed = 0;
+	const std::size_t max_steps = 2 * maps_.size() * SharedCacheMapBase::num_shards;
+	for (std::size_t i = 0; i < max_steps && freed < to_free; ++i) {
+		freed += maps_[map_index_]->sweep(shard_index_, to_free - freed);
+		if (++shard_index_ == SharedCacheMapBase::num_shards) {
+			shard_index_ = 0;
+			map_index_ = (map_index_ + 1) % maps_.size();
+		}
+	}
+
+	released(freed);
+}
+
+void IfcGeom::SharedCacheBudget::released(std::size_t bytes) {
+	boost::mutex::scoped_lock lock(mutex_);
+	used_ -= std::min(used_, bytes);
+}
+
+void IfcGeom::SharedCacheBudget::remeasure() {
+	std::size_t grown = 0;
+	for (std::vector<SharedCacheMapBase*>::const_iterator it = maps_.begin(); it != maps_.end(); ++it) {
+		grown += (*it)->remeasure();
+	}
+	if (grown) {
+		allocated(grown);
+	}
+}
+
+IfcGeom::SharedCache::SharedCache(bool concurrent)
+	: concurrent_(concurrent)
+	, deduplication_seconds_saved_(0.)
+	, subtraction_seconds_saved_(0.)
+{
+	// Shapes are only copied upon insertion when the cache is concurrent
+	budget_.set_track_growth(!concurrent);
+#include "IfcRegisterUndef.h"
+#define CLASS(T,V) \
+	T.set_budget(&budget_);
+#include "IfcRegisterDef.h"
+
+#include "IfcRegister.h"
+	Shape.set_budget(&budget_);
+	Geometry.set_budget(&budget_);
+	Subtraction.set_budget(&budget_);
+}
+
+void IfcGeom::SharedCache::purge() {
+#include "IfcRegisterPurgeCache.h"
+	Shape.clear();
+	Geometry.clear();
+	Subtraction.clear();
+}
+
+std::vector<IfcGeom::SharedCacheStatistics> IfcGeom::SharedCache::statistics() {
+	std::vector<SharedCacheStatistics> stats;
+#include "IfcRegisterUndef.h"
+#define CLASS(T,V) \
+	stats.push_back(T.statistics(#T));
+#include "IfcRegisterDef.h"
+
+#include "IfcRegister.h"
+	stats.push_back(Shape.statistics("Shape"));
+	return stats;
+}
+
+void IfcGeom::SharedCache::deduplicated(double seconds) {
+	boost::mutex::scoped_lock lock(deduplication_mutex_);
+	deduplication_seconds_saved_ += seconds;
+}
+
+IfcGeom::SharedCacheStatistics IfcGeom::SharedCache::deduplication_statistics() {
+	return Geometry.statistics("Geometry");
+}
+
+double IfcGeom::SharedCache::deduplication_seconds_saved() {
+	boost::mutex::scoped_lock lock(deduplication_mutex_);
+	return deduplication_seconds_saved_;
+}
+
+void IfcGeom::SharedCache::subtraction_reused(double seconds) {
+	boost::mutex::scoped_lock lock(deduplication_mutex_);
+	subtraction_seconds_saved_ += seconds;
+}
+
+IfcGeom::SharedCacheStatistics IfcGeom::SharedCache::subtraction_statistics() {
+	return Subtraction.statistics("Subtraction");
+}
+
+double IfcGeom::SharedCache::subtraction_seconds_saved() {
+	boost::mutex::scoped_lock lock(deduplication_mutex_);
+	return subtraction_seconds_saved_;
+}
@@ -0,0 +1,496 @@
+﻿/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+
+#ifndef IFCGEOMSHAREDCACHE_H
+#define IFCGEOMSHAREDCACHE_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+
+// Includes of IfcRegister.h, which is expanded inside the SharedCache class definition
+#include <TopoDS_Shape.hxx>
+#include <TopoDS_Wire.hxx>
+#include <TopoDS_Face.hxx>
+#include <gp_Pnt.hxx>
+#include <gp_Vec.hxx>
+#include <gp_Dir.hxx>
+#include <gp_Ax1.hxx>
+#include <gp_Pln.hxx>
+#include <gp_Mat.hxx>
+#include <gp_Mat2d.hxx>
+#include <gp_GTrsf.hxx>
+#include <gp_GTrsf2d.hxx>
+#include <gp_Trsf.hxx>
+#include <gp_Trsf2d.hxx>
+
+#include "../ifcparse/IfcBaseClass.h"
+#include "../ifcparse/IfcParse.h"
+#include "../ifcparse/IfcException.h"
+
+#include "ifc_geom_api.h"
+
+namespace IfcGeom {
+
+	/// Number of lookups of a single cache class in a SharedCache
+	struct SharedCacheStatistics {
+		std::string name;
+		std::size_t hits;
+		std::size_t misses;
+		std::size_t size;
+		std::size_t bytes;
+	};
+
+	/// Estimate of the memory used by a cached value, including bookkeeping
+	template <typename V>
+	std::size_t cache_entry_size(const V&) {
+		return sizeof(V) + 64;
+	}
+
+	/// Estimate of the memory used by a shape, based on its number of sub shapes
+	/// and the size of the triangulations of its faces
+	IFC_GEOM_API std::size_t cache_entry_size(const TopoDS_Shape& shape);
+
+	/// The shape of a representation item that is reused for items with equal
+	/// definitions, see Kernel::deduplication_key(). The placement of the item
+	/// is retained, so that the shape can be moved to the placement of the
+	/// items that reuse it, as well as the time it took to create the shape.
+	struct DeduplicatedShape {
+		TopoDS_Shape shape;
+		gp_Trsf placement;
+		double seconds;
+		DeduplicatedShape() : seconds(0.) {}
+	};
+
+	inline std::size_t cache_entry_size(const DeduplicatedShape& v) {
+		return sizeof(DeduplicatedShape) + cache_entry_size(v.shape);
+	}
+
+	/// The shapes of a representation after the openings of a product have been
+	/// subtracted, in the coordinate system of the product, which are reused by
+	/// products with equal representations and equal openings relative to their
+	/// placement, see Kernel::subtraction_key(). The time it took to subtract the
+	/// openings is retained.
+	struct SubtractedShapes {
+		std::vector<TopoDS_Shape> shapes;
+		double seconds;
+		SubtractedShapes() : seconds(0.) {}
+	};
+
+	inline std::size_t cache_entry_size(const SubtractedShapes& v) {
+		std::size_t bytes = sizeof(SubtractedShapes);
+		for (std::vector<TopoDS_Shape>::const_iterator it = v.shapes.begin(); it != v.shapes.end(); ++it) {
+			bytes += cache_entry_size(*it);
+		}
+		return bytes;
+	}
+
+	class SharedCacheBudget;
+
+	/// Interface of the maps in a SharedCache used by the SharedCacheBudget
+	class IFC_GEOM_API SharedCacheMapBase {
+	public:
+		static const unsigned int num_shards = 16;
+		virtual ~SharedCacheMapBase() {}
+		/// Evicts entries from a shard that have not been used since the previous
+		/// sweep, until the requested amount of bytes is freed. Returns the amount
+		/// of bytes freed.
+		virtual std::size_t sweep(unsigned int shard, std::size_t bytes) = 0;
+		/// Updates the size of the entries inserted since the previous call and
+		/// returns the amount of bytes by which they have grown.
+		virtual std::size_t remeasure() = 0;
+	};
+
+	/// Keeps track of the memory used by the maps in a SharedCache and evicts
+	/// entries when the budget is exceeded. Eviction uses the CLOCK algorithm,
+	/// visiting the shards of all maps in turn, so that no global lock is needed
+	/// on lookups: a lookup only marks the entry as recently used.
+	class IFC_GEOM_API SharedCacheBudget {
+	private:
+		boost::mutex mutex_;
+		boost::mutex sweep_mutex_;
+		std::vector<SharedCacheMapBase*> maps_;
+		std::size_t budget_;
+		std::size_t used_;
+		bool bounded_;
+		bool track_growth_;
+		// Position of the clock hand
+		size_t map_index_;
+		unsigned int shard_index_;
+	public:
+		SharedCacheBudget()
+			: budget_(0)
+			, used_(0)
+			, bounded_(false)
+			, track_growth_(false)
+			, map_index_(0)
+			, shard_index_(0)
+		{}
+
+		void add_map(SharedCacheMapBase* map) { maps_.push_back(map); }
+
+		/// Sets the memory budget in bytes, in which case entries are evicted when it is exceeded
+		void set_budget(std::size_t bytes) {
+			boost::mutex::scoped_lock lock(mutex_);
+			budget_ = bytes;
+			bounded_ = true;
+		}
+
+		/// Whether cached values can grow after insertion, in which case the
+		/// maps keep track of the entries to update upon remeasure()
+		void set_track_growth(bool b) { track_growth_ = b; }
+		bool track_growth() const { return bounded_ && track_growth_; }
+
+		bool bounded() const { return bounded_; }
+		std::size_t budget() const { return budget_; }
+		std::size_t used() {
+			boost::mutex::scoped_lock lock(mutex_);
+			return used_;
+		}
+
+		void allocated(std::size_t bytes);
+		void released(std::size_t bytes);
+		void remeasure();
+	};
+
+	/// A map from entity instance names to conversion results that can be read
+	/// and populated by multiple kernels concurrently. Entries are keyed by the
+	/// instance name, or another identifier I such as a content hash, and a
+	/// fingerprint of the kernel settings and distributed
+	/// over a number of shards, each with their own lock. Every entry is computed
+	/// only once: a thread that looks up an entry that is being computed by
+	/// another thread waits for the result. A thread that looks up an entry
+	/// it is computing itself, which happens for cyclic references in a file,
+	/// gets an exception instead.
+	template <typename V, typename I = unsigned int>
+	class SharedCacheMap : public SharedCacheMapBase {
+	public:
+		typedef std::pair<I, std::size_t> key_type;
+
+	private:
+		SharedCacheMap(const SharedCacheMap&); // N/I
+		SharedCacheMap& operator=(const SharedCacheMap&); // N/I
+
+		struct slot {
+			bool ready;
+			bool referenced;
+			std::size_t bytes;
+			// The thread computing the value, while it is not ready
+			boost::thread::id owner;
+			V value;
+			slot() : ready(false), referenced(false), bytes(0) {}
+		};
+
+		typedef boost::unordered_map<key_type, slot> slots_t;
+
+		struct shard {
+			boost::mutex mutex;
+			boost::condition_variable computed;
+			slots_t slots;
+			// Entries inserted since the previous remeasure()
+			std::vector<key_type> inserted;
+			std::size_t hits;
+			std::size_t misses;
+			std::size_t bytes;
+			shard() : hits(0), misses(0), bytes(0) {}
+		};
+
+		shard shards_[num_shards];
+		SharedCacheBudget* budget_;
+
+		shard& shard_for(const key_type& k) {
+			return shards_[static_cast<std::size_t>(k.first % num_shards)];
+		}
+
+	public:
+		SharedCacheMap() : budget_(0) {}
+
+		void set_budget(SharedCacheBudget* budget) {
+			budget_ = budget;
+			budget_->add_map(this);
+		}
+
+		/// A cache with a budget of zero bytes is disabled altogether
+		bool enabled() const {
+			return !budget_ || !budget_->bounded() || budget_->budget() > 0;
+		}
+
+		/// Assigns the cached value and returns true if present. Otherwise the entry
+		/// is reserved and the caller is to either insert() or abandon() it. Throws
+		/// if the entry is reserved by the calling thread itself.
+		bool find_or_reserve(const key_type& k, V& v) {
+			const boost::thread::id this_thread = boost::this_thread::get_id();
+			shard& s = shard_for(k);
+			boost::mutex::scoped_lock lock(s.mutex);
+			for (;;) {
+				typename slots_t::iterator it = s.slots.find(k);
+				if (it == s.slots.end()) {
+					s.slots[k].owner = this_thread;
+					++s.misses;
+					return false;
+				}
+				if (it->second.ready) {
+					v = it->second.value;
+					it->second.referenced = true;
+					++s.hits;
+					return true;
+				}
+				if (it->second.owner == this_thread) {
+					// Waiting would never end, the value depends on itself
+					throw IfcParse::IfcException("Cyclic reference encountered during conversion");
+				}
+				s.computed.wait(lock);
+			}
+		}
+
+		void insert(const key_type& k, const V& v) {
+			shard& s = shard_for(k);
+			const std::size_t bytes = cache_entry_size(v);
+			{
+				boost::mutex::scoped_lock lock(s.mutex);
+				slot& sl = s.slots[k];
+				sl.value = v;
+				sl.ready = true;
+				sl.bytes = bytes;
+				s.bytes += bytes;
+				if (budget_ && budget_->track_growth()) {
+					s.inserted.push_back(k);
+				}
+			}
+			s.computed.notify_all();
+			if (budget_) {
+				budget_->allocated(bytes);
+			}
+		}
+
+		/// Releases a reserved entry for which no value could be computed, so
+		/// that one of the waiting threads attempts to compute it instead.
+		void abandon(const key_type& k) {
+			shard& s = shard_for(k);
+			{
+				boost::mutex::scoped_lock lock(s.mutex);
+				typename slots_t::iterator it = s.slots.find(k);
+				if (it != s.slots.end() && !it->second.ready) {
+					s.slots.erase(it);
+				}
+			}
+			s.computed.notify_all();
+		}
+
+		std::size_t sweep(unsigned int shard_index, std::size_t bytes) {
+			shard& s = shards_[shard_index];
+			std::size_t freed = 0;
+			{
+				boost::mutex::scoped_lock lock(s.mutex);
+				for (typename slots_t::iterator it = s.slots.begin(); it != s.slots.end() && freed < bytes;) {
+					if (!it->second.ready) {
+						++it;
+					} else if (it->second.referenced) {
+						it->second.referenced = false;
+						++it;
+					} else {
+						freed += it->second.bytes;
+						it = s.slots.erase(it);
+					}
+				}
+				s.bytes -= freed;
+			}
+			return freed;
+		}
+
+		std::size_t remeasure() {
+			std::size_t grown = 0;
+			for (unsigned int i = 0; i < num_shards; ++i) {
+				shard& s = shards_[i];
+				boost::mutex::scoped_lock lock(s.mutex);
+				for (typename std::vector<key_type>::const_iterator it = s.inserted.begin(); it != s.inserted.end(); ++it) {
+					typename slots_t::iterator jt = s.slots.find(*it);
+					if (jt == s.slots.end() || !jt->second.ready) {
+						continue;
+					}
+					const std::size_t bytes = cache_entry_size(jt->second.value);
+					if (bytes > jt->second.bytes) {
+						grown += bytes - jt->second.bytes;
+						s.bytes += bytes - jt->second.bytes;
+						jt->second.bytes = bytes;
+					}
+				}
+				s.inserted.clear();
+			}
+			return grown;
+		}
+
+		/// Removes all computed entries. Entries being computed are retained.
+		void clear() {
+			std::size_t freed = 0;
+			for (unsigned int i = 0; i < num_shards; ++i) {
+				boost::mutex::scoped_lock lock(shards_[i].mutex);
+				slots_t& slots = shards_[i].slots;
+				for (typename slots_t::iterator it = slots.begin(); it != slots.end();) {
+					if (it->second.ready) {
+						freed += it->second.bytes;
+						it = slots.erase(it);
+					} else {
+						++it;
+					}
+				}
+				shards_[i].bytes = 0;
+				shards_[i].inserted.clear();
+			}
+			if (budget_) {
+				budget_->released(freed);
+			}
+		}
+
+		SharedCacheStatistics statistics(const std::string& name) {
+			SharedCacheStatistics stats;
+			stats.name = name;
+			stats.hits = stats.misses = stats.size = stats.bytes = 0;
+			for (unsigned int i = 0; i < num_shards; ++i) {
+				boost::mutex::scoped_lock lock(shards_[i].mutex);
+				stats.hits += shards_[i].hits;
+				stats.misses += shards_[i].misses;
+				stats.size += shards_[i].slots.size();
+				stats.bytes += shards_[i].bytes;
+			}
+			return stats;
+		}
+	};
+
+	/// Reserves an entry in a SharedCacheMap during the conversion of an entity
+	/// instance, releasing it when the conversion fails before a value is set.
+	template <typename V, typename I = unsigned int>
+	class SharedCacheEntry {
+	private:
+		SharedCacheEntry(const SharedCacheEntry&); // N/I
+		SharedCacheEntry& operator=(const SharedCacheEntry&); // N/I
+
+		SharedCacheMap<V, I>* map_;
+		typename SharedCacheMap<V, I>::key_type key_;
+		bool reserved_;
+
+	public:
+		/// A null map results in a no-op, which is used when the kernel has no shared cache
+		template <typename K>
+		SharedCacheEntry(SharedCacheMap<V, I>* map, I id, const K& kernel)
+			: map_(map && map->enabled() ? map : 0)
+			, key_(id, map_ ? kernel.settings_fingerprint() : 0)
+			, reserved_(false)
+		{}
+
+		/// Whether the value is to be computed and set by the caller
+		bool reserved() const { return reserved_; }
+
+		bool find(V& v) {
+			if (!map_) {
+				return false;
+			}
+			if (map_->find_or_reserve(key_, v)) {
+				return true;
+			}
+			reserved_ = true;
+			return false;
+		}
+
+		void set(const V& v) {
+			if (reserved_) {
+				map_->insert(key_, v);
+				reserved_ = false;
+			}
+		}
+
+		~SharedCacheEntry() {
+			if (reserved_) {
+				map_->abandon(key_);
+			}
+		}
+	};
+
+	/// Conversion results that can be shared by multiple Kernel instances, for
+	/// example the kernels of the threads of an Iterator. When the cache is used
+	/// concurrently, shapes are copied upon insertion and retrieval, as Open
+	/// Cascade modifies shapes when they are meshed.
+	class IFC_GEOM_API SharedCache {
+	private:
+		SharedCache(const SharedCache&); // N/I
+		SharedCache& operator=(const SharedCache&); // N/I
+
+		SharedCacheBudget budget_;
+		bool concurrent_;
+
+		boost::mutex deduplication_mutex_;
+		double deduplication_seconds_saved_;
+		double subtraction_seconds_saved_;
+
+	public:
+#include "IfcRegisterCreateSharedCache.h"
+		SharedCacheMap<TopoDS_Shape> Shape;
+		/// Shapes of representation items keyed by content hash
+		SharedCacheMap<DeduplicatedShape, boost::uint64_t> Geometry;
+		/// Shapes of products with their openings subtracted keyed by content hash
+		SharedCacheMap<SubtractedShapes, boost::uint64_t> Subtraction;
+
+		explicit SharedCache(bool concurrent = true);
+
+		/// Whether the cache is used by multiple threads
+		bool concurrent() const { return concurrent_; }
+
+		/// Limits the estimated memory used by the cache to the amount of bytes
+		/// specified. By default the cache is unbounded.
+		void set_budget(std::size_t bytes) { budget_.set_budget(bytes); }
+		/// When the cache is not concurrent, shapes are not copied and the
+		/// triangulations added by meshing end up in the cached shapes. This
+		/// accounts for the triangulations added to the shapes inserted since
+		/// the previous call, evicting entries when the budget is exceeded.
+		void remeasure() { budget_.remeasure(); }
+		/// Returns the estimated memory used by the cache in bytes
+		std::size_t memory_used() { return budget_.used(); }
+
+		/// Removes all computed entries
+		void purge();
+		/// Returns the number of hits and misses for every cache class
+		std::vector<SharedCacheStatistics> statistics();
+
+		/// Records the reuse of a shape that took the amount of seconds to create
+		void deduplicated(double seconds);
+		/// Returns the number of representation items that reused the shape of
+		/// an equal item (hits) and the number of shapes created (misses)
+		SharedCacheStatistics deduplication_statistics();
+		/// Returns the sum of the conversion times of the reused shapes
+		double deduplication_seconds_saved();
+
+		/// Records the reuse of a subtraction of openings that took the amount of seconds
+		void subtraction_reused(double seconds);
+		/// Returns the number of products that reused the result of the subtraction of
+		/// openings of an equal product (hits) and the number of subtractions (misses)
+		SharedCacheStatistics subtraction_statistics();
+		/// Returns the sum of the times of the reused subtractions
+		double subtraction_seconds_saved();
+	};
+
+}
+
+#endif
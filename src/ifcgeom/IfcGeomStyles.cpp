@@ -0,0 +1,114 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+
+#include "../ifcparse/IfcFile.h"
+#include "../ifcparse/IfcLogger.h"
+
+#include "IfcGeom.h"
+#include "IfcGeomStyles.h"
+
+int IfcGeom::StyleTable::slot_(const IfcUtil::IfcBaseClass* item) const {
+	const unsigned int id = item->entity->id();
+	return id < slots_.size() ? slots_[id] : -1;
+}
+
+bool IfcGeom::StyleTable::assign_(const IfcUtil::IfcBaseClass* item, const SurfaceStyle* style) {
+	const unsigned int id = item->entity->id();
+	if (id >= slots_.size()) {
+		slots_.resize(id + 1, -1);
+	}
+	if (slots_[id] != -1) {
+		return false;
+	}
+	slots_[id] = (int) item_styles_.size();
+	item_styles_.push_back(style);
+	return true;
+}
+
+void IfcGeom::StyleTable::build(Kernel& kernel, IfcParse::IfcFile* file) {
+	slots_.assign(file->getMaxId() + 1, -1);
+	item_styles_.clear();
+	surface_styles_.clear();
+
+	// StyledByItem is a SET [0:1], but of multiple styled items, the first is
+	// used as in Kernel::get_surface_style()
+	IfcSchema::IfcStyledItem::list::ptr styled_items = file->entitiesByType<IfcSchema::IfcStyledItem>();
+	for (IfcSchema::IfcStyledItem::list::it it = styled_items->begin(); it != styled_items->end(); ++it) {
+		IfcSchema::IfcStyledItem* styled_item = *it;
+		const SurfaceStyle* style = 0;
+		try {
+			const std::pair<IfcSchema::IfcSurfaceStyle*, IfcSchema::IfcSurfaceStyleShading*> ss =
+				kernel._get_surface_style<IfcSchema::IfcSurfaceStyleShading>(styled_item);
+			if (ss.second) {
+				const int surface_style_id = ss.first->entity->id();
+				std::map<int, SurfaceStyle>::const_iterator jt = surface_styles_.find(surface_style_id);
+				if (jt == surface_styles_.end()) {
+					jt = surface_styles_.insert(std::make_pair(surface_style_id, Kernel::create_surface_style(ss))).first;
+				}
+				style = &jt->second;
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		}
+
+		// Styled items are representation items themselves and carry their own style
+		assign_(styled_item, style);
+		try {
+			if (styled_item->hasItem()) {
+				assign_(styled_item->Item(), style);
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		}
+	}
+
+	// Boolean clipping results without a style of their own are assigned the
+	// style of the first styled first operand
+	IfcSchema::IfcBooleanClippingResult::list::ptr results = file->entitiesByType<IfcSchema::IfcBooleanClippingResult>();
+	for (IfcSchema::IfcBooleanClippingResult::list::it it = results->begin(); it != results->end(); ++it) {
+		if (slot_(*it) != -1) {
+			continue;
+		}
+		try {
+			const IfcSchema::IfcRepresentationItem* item = *it;
+			while (item->is(IfcSchema::Type::IfcBooleanClippingResult)) {
+				// All instantiations of IfcBooleanOperand are subtypes of IfcGeometricRepresentationItem
+				item = (IfcSchema::IfcGeometricRepresentationItem*) ((IfcSchema::IfcBooleanClippingResult*) item)->FirstOperand();
+				const int slot = slot_(item);
+				if (slot != -1) {
+					assign_(*it, item_styles_[slot]);
+					break;
+				}
+			}
+		} catch (const std::exception& e) {
+			Logger::Error(e);
+		}
+	}
+}
+
+const IfcGeom::SurfaceStyle* IfcGeom::StyleTable::style(const IfcSchema::IfcRepresentationItem* item) const {
+	const int slot = slot_(item);
+	return slot == -1 ? 0 : item_styles_[slot];
+}
+
+const IfcGeom::SurfaceStyle* IfcGeom::StyleTable::surface_style(int surface_style_id) const {
+	std::map<int, SurfaceStyle>::const_iterator it = surface_styles_.find(surface_style_id);
+	return it == surface_styles_.end() ? 0 : &it->second;
+}
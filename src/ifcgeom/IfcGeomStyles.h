@@ -0,0 +1,77 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+
+#ifndef IFCGEOMSTYLES_H
+#define IFCGEOMSTYLES_H
+
+#include <map>
+#include <vector>
+
+#include "../ifcparse/IfcParse.h"
+#include "../ifcparse/IfcBaseClass.h"
+
+#include "IfcGeomRenderStyles.h"
+#include "ifc_geom_api.h"
+
+namespace IfcGeom {
+
+	class Kernel;
+
+	/// The surface styles of all styled representation items in a file, resolved
+	/// in a single pass over the IfcStyledItem instances. Items that are not styled
+	/// themselves, but of which a first operand is, as for boolean clipping results,
+	/// are assigned the style of that operand, see Kernel::find_item_carrying_style().
+	/// Every IfcSurfaceStyle is represented by a single SurfaceStyle, so that kernels
+	/// sharing the table refer to the same style instances. The table is read-only
+	/// after build().
+	class IFC_GEOM_API StyleTable {
+	private:
+		// Index in item_styles_ by instance name, -1 for items without a style
+		std::vector<int> slots_;
+		// Null for items that are styled without surface shading
+		std::vector<const SurfaceStyle*> item_styles_;
+		// By instance name of the IfcSurfaceStyle
+		std::map<int, SurfaceStyle> surface_styles_;
+
+		// Returns false if the item is already assigned a style
+		bool assign_(const IfcUtil::IfcBaseClass* item, const SurfaceStyle* style);
+		int slot_(const IfcUtil::IfcBaseClass* item) const;
+
+		StyleTable(const StyleTable&); // N/I
+		StyleTable& operator=(const StyleTable&); // N/I
+	public:
+		StyleTable() {}
+
+		/// Resolves the styles of the items in the file using the kernel
+		void build(Kernel& kernel, IfcParse::IfcFile* file);
+
+		/// Equivalent of Kernel::get_style() for representation items
+		const SurfaceStyle* style(const IfcSchema::IfcRepresentationItem* item) const;
+
+		/// Returns the style created for the IfcSurfaceStyle, null if the surface
+		/// style is not used by any styled item
+		const SurfaceStyle* surface_style(int surface_style_id) const;
+
+		size_t size() const { return item_styles_.size(); }
+	};
+
+}
+
+#endif
@@ -17,14 +17,106 @@
 *                                                                              *
 ********************************************************************************/
 
+#include <BRepBuilderAPI_Copy.hxx>
+#include <TopLoc_Location.hxx>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <cstring>
+#include <vector>
+
 #include "IfcGeom.h"
 #include "IfcGeomShapeType.h"
 
 using namespace IfcSchema;
 using namespace IfcUtil;
 
+namespace {
+
+	typedef bool (IfcGeom::Kernel::*shapes_converter)(const IfcBaseClass*, IfcGeom::IfcRepresentationShapeItems&);
+	typedef bool (IfcGeom::Kernel::*shape_converter)(const IfcBaseClass*, TopoDS_Shape&);
+	typedef bool (IfcGeom::Kernel::*wire_converter)(const IfcBaseClass*, TopoDS_Wire&);
+	typedef bool (IfcGeom::Kernel::*curve_converter)(const IfcBaseClass*, Handle(Geom_Curve)&);
+
+	/// The shape type and conversion functions of every type in the schema,
+	/// indexed by IfcSchema::Type::Enum. Subtypes are resolved to the function
+	/// of the supertype that is registered first in IfcRegister.h, so that
+	/// dispatching an instance does not involve any calls to is(). See
+	/// examples/IfcDispatchBenchmark.cpp for a comparison with is() calls.
+	class DispatchTable {
+	public:
+		struct entry {
+			IfcGeom::ShapeType shape_type;
+			shapes_converter shapes;
+			shape_converter shape;
+			shape_converter face;
+			wire_converter wire;
+			curve_converter curve;
+			entry() : shape_type(IfcGeom::ST_OTHER), shapes(0), shape(0), face(0), wire(0), curve(0) {}
+		};
+	private:
+		std::vector<entry> entries_;
+		entry undefined_;
+
+		static bool is_subtype_of(IfcSchema::Type::Enum t, IfcSchema::Type::Enum supertype) {
+			boost::optional<IfcSchema::Type::Enum> s = t;
+			while (s) {
+				if (*s == supertype) {
+					return true;
+				}
+				s = IfcSchema::Type::Parent(*s);
+			}
+			return false;
+		}
+
+		template <typename F>
+		void add(IfcSchema::Type::Enum t, IfcGeom::ShapeType st, F entry::*slot, F f) {
+			for (size_t i = 0; i < entries_.size(); ++i) {
+				if (!is_subtype_of(static_cast<IfcSchema::Type::Enum>(i), t)) {
+					continue;
+				}
+				entry& e = entries_[i];
+				if (e.shape_type == IfcGeom::ST_OTHER) {
+					e.shape_type = st;
+				}
+				if (!(e.*slot)) {
+					e.*slot = f;
+				}
+			}
+		}
+	public:
+		DispatchTable()
+			: entries_(IfcSchema::Type::UNDEFINED)
+		{
+#include "IfcRegisterDispatch.h"
+		}
+
+		const entry& operator[](IfcSchema::Type::Enum t) const {
+			const size_t i = static_cast<size_t>(t);
+			return i < entries_.size() ? entries_[i] : undefined_;
+		}
+	};
+
+	// Built during static initialization, before any kernel can be used
+	const DispatchTable dispatch_table;
+
+	void log_failure(const std::exception& e, const IfcBaseClass* l) {
+		Logger::Message(Logger::LOG_ERROR, std::string(e.what()) + "\nFailed to convert:", l->entity);
+	}
+
+	void log_failure(const Standard_Failure& f, const IfcBaseClass* l) {
+		if (f.GetMessageString() && strlen(f.GetMessageString())) {
+			Logger::Message(Logger::LOG_ERROR, std::string("Error in: ") + f.GetMessageString() + "\nFailed to convert:", l->entity);
+		} else {
+			Logger::Message(Logger::LOG_ERROR, "Failed to convert:", l->entity);
+		}
+	}
+
+}
+
 bool IfcGeom::Kernel::convert_shapes(const IfcBaseClass* l, IfcRepresentationShapeItems& r) {
-	if (shape_type(l) != ST_SHAPELIST) {
+	const DispatchTable::entry& e = dispatch_table[l->type()];
+	if (e.shape_type != ST_SHAPELIST) {
 		TopoDS_Shape shp;
 		if (convert_shape(l, shp)) {
 			r.push_back(IfcGeom::IfcRepresentationShapeItem(shp, get_style(l->as<IfcSchema::IfcRepresentationItem>())));
@@ -33,14 +125,18 @@ bool IfcGeom::Kernel::convert_shapes(const IfcBaseClass* l, IfcRepresentationSha
 		return false;
 	}
 
-#include "IfcRegisterConvertShapes.h"
-	Logger::Message(Logger::LOG_ERROR,"No operation defined for:",l->entity);
+	try {
+		return (this->*e.shapes)(l, r);
+	} catch (const std::exception& ex) {
+		log_failure(ex, l);
+	} catch (const Standard_Failure& f) {
+		log_failure(f, l);
+	}
 	return false;
 }
 
 IfcGeom::ShapeType IfcGeom::Kernel::shape_type(const IfcBaseClass* l) {
-#include "IfcRegisterShapeType.h"
-	return ST_OTHER;
+	return dispatch_table[l->type()].shape_type;
 }
 
 bool IfcGeom::Kernel::convert_shape(const IfcBaseClass* l, TopoDS_Shape& r) {
@@ -50,20 +146,64 @@ bool IfcGeom::Kernel::convert_shape(const IfcBaseClass* l, TopoDS_Shape& r) {
 	bool ignored = false;
 
 #ifndef NO_CACHE
+	// Shapes in a concurrently used cache are copied, as they can be used by other threads
+	IfcGeom::SharedCacheEntry<TopoDS_Shape> shared_cache_entry(shared_cache ? &shared_cache->Shape : 0, id, *this);
+	if ( shared_cache_entry.find(r) ) {
+		if ( shared_cache->concurrent() ) {
+			r = BRepBuilderAPI_Copy(r);
+		}
+		return true;
+	}
 	std::map<int,TopoDS_Shape>::const_iterator it = cache.Shape.find(id);
-	if ( it != cache.Shape.end() ) { r = it->second; return true; }
+	if ( !shared_cache && it != cache.Shape.end() ) { r = it->second; return true; }
 #endif
 	const bool include_curves = getValue(GV_DIMENSIONALITY) != +1;
 	const bool include_solids_and_surfaces = getValue(GV_DIMENSIONALITY) != -1;
 
 	IfcGeom::ShapeType st = shape_type(l);
 	ignored = (!include_solids_and_surfaces && (st == ST_SHAPE || st == ST_FACE)) || (!include_curves && (st == ST_WIRE || st == ST_CURVE));
-	if (st == ST_SHAPELIST) {
+
+	bool deduplicated = false;
+#ifndef NO_CACHE
+	// Items that are equal to an item that has been converted before reuse
+	// its shape, moved to their own placement
+	gp_Trsf placement;
+	const IfcParse::ContentHash::value_type geometry_key = (shared_cache && st == ST_SHAPE && include_solids_and_surfaces)
+		? deduplication_key(l, placement)
+		: 0;
+	IfcGeom::SharedCacheEntry<IfcGeom::DeduplicatedShape, boost::uint64_t> deduplication_entry(
+		geometry_key ? &shared_cache->Geometry : 0, geometry_key, *this);
+	IfcGeom::DeduplicatedShape deduplicated_shape;
+	if (deduplication_entry.find(deduplicated_shape)) {
+		r = shared_cache->concurrent() ? BRepBuilderAPI_Copy(deduplicated_shape.shape).Shape() : deduplicated_shape.shape;
+		r.Move(TopLoc_Location(placement * deduplicated_shape.placement.Inverted()));
+		shared_cache->deduplicated(deduplicated_shape.seconds);
+		deduplicated = true;
+	}
+	const boost::posix_time::ptime conversion_start = boost::posix_time::microsec_clock::universal_time();
+#endif
+
+	if (deduplicated) {
+		processed = success = true;
+	} else if (st == ST_SHAPELIST) {
 		processed = true;
 		IfcRepresentationShapeItems items;
 		success = convert_shapes(l, items) && flatten_shape_list(items, r, false);
 	} else if (st == ST_SHAPE && include_solids_and_surfaces) {
-#include "IfcRegisterConvertShape.h"
+		processed = true;
+		try {
+			success = (this->*dispatch_table[l->type()].shape)(l, r);
+		} catch (const std::exception& e) {
+			log_failure(e, l);
+			return false;
+		} catch (const Standard_Failure& f) {
+			log_failure(f, l);
+			return false;
+		}
+		if (!success) {
+			Logger::Message(Logger::LOG_ERROR, "Failed to convert:", l->entity);
+			return false;
+		}
 	} else if (st == ST_FACE && include_solids_and_surfaces) {
 		processed = true;
 		success = convert_face(l, r);
@@ -85,10 +225,27 @@ bool IfcGeom::Kernel::convert_shape(const IfcBaseClass* l, TopoDS_Shape& r) {
 	}
 
 	if ( processed && success ) { 
-		const double precision = getValue(GV_PRECISION);
-		apply_tolerance(r, precision);
+		if ( !deduplicated ) {
+			const double precision = getValue(GV_PRECISION);
+			apply_tolerance(r, precision);
+		}
 #ifndef NO_CACHE
-		cache.Shape[id] = r;
+		// Shapes converted beyond the time budget may be incomplete and are
+		// not cached, reserved entries are abandoned
+		const bool cacheable = !time_budget_exceeded();
+		if ( shared_cache && cacheable ) {
+			if ( shared_cache_entry.reserved() ) {
+				shared_cache_entry.set(shared_cache->concurrent() ? BRepBuilderAPI_Copy(r).Shape() : r);
+			}
+			if ( deduplication_entry.reserved() ) {
+				deduplicated_shape.shape = shared_cache->concurrent() ? BRepBuilderAPI_Copy(r).Shape() : r;
+				deduplicated_shape.placement = placement;
+				deduplicated_shape.seconds = (boost::posix_time::microsec_clock::universal_time() - conversion_start).total_microseconds() / 1.e6;
+				deduplication_entry.set(deduplicated_shape);
+			}
+		} else if ( cacheable ) {
+			cache.Shape[id] = r;
+		}
 #endif
 	} else if (!ignored) {
 		const char* const msg = processed
@@ -100,7 +257,10 @@ bool IfcGeom::Kernel::convert_shape(const IfcBaseClass* l, TopoDS_Shape& r) {
 }
 
 bool IfcGeom::Kernel::convert_wire(const IfcBaseClass* l, TopoDS_Wire& r) {
-#include "IfcRegisterConvertWire.h"
+	const wire_converter f = dispatch_table[l->type()].wire;
+	if (f) {
+		return (this->*f)(l, r);
+	}
 	Handle(Geom_Curve) curve;
 	if (IfcGeom::Kernel::convert_curve(l, curve)) {
 		return IfcGeom::Kernel::convert_curve_to_wire(curve, r);
@@ -110,13 +270,19 @@ bool IfcGeom::Kernel::convert_wire(const IfcBaseClass* l, TopoDS_Wire& r) {
 }
 
 bool IfcGeom::Kernel::convert_face(const IfcBaseClass* l, TopoDS_Shape& r) {
-#include "IfcRegisterConvertFace.h"
+	const shape_converter f = dispatch_table[l->type()].face;
+	if (f) {
+		return (this->*f)(l, r);
+	}
 	Logger::Message(Logger::LOG_ERROR,"No operation defined for:",l->entity);
 	return false;
 }
 
 bool IfcGeom::Kernel::convert_curve(const IfcBaseClass* l, Handle(Geom_Curve)& r) {
-#include "IfcRegisterConvertCurve.h"
+	const curve_converter f = dispatch_table[l->type()].curve;
+	if (f) {
+		return (this->*f)(l, r);
+	}
 	Logger::Message(Logger::LOG_ERROR,"No operation defined for:",l->entity);
 	return false;
 }
\ No newline at end of file
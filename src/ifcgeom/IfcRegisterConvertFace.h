@@ -1,6 +0,0 @@
-﻿#include "IfcRegisterUndef.h"
-#define FACE(T) \
-	if ( l->is(T::Class()) ) return convert((T*)l,r);
-#include "IfcRegisterDef.h"
-
-#include "IfcRegister.h"
\ No newline at end of file
@@ -0,0 +1,6 @@
+﻿#include "IfcRegisterUndef.h"
+#define CLASS(T,V) \
+	SharedCacheMap<V> T;
+#include "IfcRegisterDef.h"
+
+#include "IfcRegister.h"
\ No newline at end of file
@@ -0,0 +1,19 @@
+﻿#include "IfcRegisterUndef.h"
+#define SHAPES(T) \
+	add(IfcSchema::Type::T, ST_SHAPELIST, \
+		&entry::shapes, &IfcGeom::Kernel::convert_as<IfcSchema::T, IfcGeom::IfcRepresentationShapeItems>);
+#define SHAPE(T) \
+	add(IfcSchema::Type::T, ST_SHAPE, \
+		&entry::shape, &IfcGeom::Kernel::convert_as<IfcSchema::T, TopoDS_Shape>);
+#define FACE(T) \
+	add(IfcSchema::Type::T, ST_FACE, \
+		&entry::face, &IfcGeom::Kernel::convert_as<IfcSchema::T, TopoDS_Shape>);
+#define WIRE(T) \
+	add(IfcSchema::Type::T, ST_WIRE, \
+		&entry::wire, &IfcGeom::Kernel::convert_as<IfcSchema::T, TopoDS_Wire>);
+#define CURVE(T) \
+	add(IfcSchema::Type::T, ST_CURVE, \
+		&entry::curve, &IfcGeom::Kernel::convert_as<IfcSchema::T, Handle(Geom_Curve) >);
+#include "IfcRegisterDef.h"
+
+#include "IfcRegister.h"
\ No newline at end of file
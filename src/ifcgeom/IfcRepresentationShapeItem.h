@@ -20,18 +20,49 @@
 #ifndef IFCSHAPELIST_H
 #define IFCSHAPELIST_H
 
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
 #include <gp_GTrsf.hxx>
+#include <gp_XYZ.hxx>
 #include <TopoDS_Shape.hxx>
 
 #include "../ifcgeom/IfcGeomRenderStyles.h"
 
 namespace IfcGeom {	
+	/// The indexed polygons of a tessellated representation item, such as an
+	/// IfcTriangulatedFaceSet, in the units of the kernel. When only triangulated
+	/// output is requested, items carry their mesh instead of a shape, which is
+	/// copied into the triangulation as is.
+	struct TessellatedMesh {
+		typedef std::vector<int> Loop;
+		/// The outer boundary followed by the inner boundaries
+		typedef std::vector<Loop> Face;
+
+		std::vector<gp_XYZ> points;
+		/// Either empty or a normal for every point
+		std::vector<gp_XYZ> normals;
+		/// Zero-based indices into points
+		std::vector<Face> faces;
+		/// Zero-based indices into points, three per triangle, grouped by face
+		std::vector<int> triangles;
+		/// The offset into triangles of the triangles of every face, followed
+		/// by the size of triangles. Empty if the faces are not triangulated.
+		std::vector<int> face_offsets;
+
+		bool is_triangulated() const { return !faces.empty() && face_offsets.size() == faces.size() + 1; }
+	};
+
 	class IFC_GEOM_API IfcRepresentationShapeItem {
 	private:
 		gp_GTrsf placement;
 		TopoDS_Shape shape;
+		boost::shared_ptr<const TessellatedMesh> mesh;
 		const SurfaceStyle* style;
 	public:
+		IfcRepresentationShapeItem(const boost::shared_ptr<const TessellatedMesh>& mesh, const SurfaceStyle* style)
+			: mesh(mesh), style(style) {}
 		IfcRepresentationShapeItem(const gp_GTrsf& placement, const TopoDS_Shape& shape, const SurfaceStyle* style)
 			: placement(placement), shape(shape), style(style) {}
 		IfcRepresentationShapeItem(const gp_GTrsf& placement, const TopoDS_Shape& shape)
@@ -43,6 +74,9 @@ namespace IfcGeom {
 		void append(const gp_GTrsf& trsf) { placement.Multiply(trsf); }
 		void prepend(const gp_GTrsf& trsf) { placement.PreMultiply(trsf); }
 		const TopoDS_Shape& Shape() const { return shape; }
+		/// Items with a mesh do not have a shape, see Kernel::set_mesh_passthrough()
+		bool hasMesh() const { return mesh.get() != 0; }
+		const TessellatedMesh& Mesh() const { return *mesh; }
 		const gp_GTrsf& Placement() const { return placement; }
 		bool hasStyle() const { return style != 0; }
 		const SurfaceStyle& Style() const { return *style; }
@@ -171,16 +171,21 @@ public:
 
 class IfcModel : public Command {
 private:
-	std::string str;
+	int32_t length_;
 protected:
+	// Only the length of the model is read here. The contents are read
+	// by the iterator directly from the stream, which allows the file to
+	// be scanned while it is being received.
 	void read_content(std::istream& s) {
-		str = sread<std::string>(s);
-	}
-	void write_content(std::ostream& s) {
-		swrite(s, str);
+		length_ = sread<int32_t>(s);
 	}
+	void write_content(std::ostream& /*s*/) {}
 public:
-	const std::string& string() { return str; }
+	int32_t length() const { return length_; }
+	void read_padding(std::istream& s) {
+		int32_t len = length_;
+		while (len++ % 4) s.get();
+	}
 	IfcModel() : Command(IFC_MODEL) {};
 };
 
@@ -485,14 +490,13 @@ int main () {
 		switch (msg_type) {
 		case IFC_MODEL: {
 			IfcModel m; m.read(std::cin);
-			std::string::size_type len = m.string().size();
-			char* data = new char[len];
-			memcpy(data, m.string().c_str(), len);
 
 			IfcGeom::IteratorSettings settings;
             settings.set(IfcGeom::IteratorSettings::USE_WORLD_COORDS, false);
             settings.set(IfcGeom::IteratorSettings::WELD_VERTICES, false);
             settings.set(IfcGeom::IteratorSettings::CONVERT_BACK_UNITS, true);
+            // Quantities are computed from the shapes of the elements
+            settings.set(IfcGeom::IteratorSettings::NO_MESH_PASSTHROUGH, true);
             // settings.set(IfcGeom::IteratorSettings::INCLUDE_CURVES, true);
 
 			std::vector< std::pair<uint32_t, uint32_t> >::const_iterator it = setting_pairs.begin();
@@ -502,7 +506,14 @@ int main () {
 
 			settings.set_deflection_tolerance(deflection);
 
-			iterator = new IfcGeom::Iterator<float>(settings, data, (int)len);
+			iterator = new IfcGeom::Iterator<float>(settings, std::cin, m.length());
+			m.read_padding(std::cin);
+			// The model is read directly from the input, when it is cut
+			// short there is no next message to synchronize on.
+			if (!std::cin) {
+				exit_code = 1;
+				break;
+			}
 			has_more = iterator->initialize();
 
 			More(has_more).write(std::cout);
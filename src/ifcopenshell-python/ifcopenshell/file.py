@@ -119,6 +119,22 @@ class file(object):
     def remove(self, inst):
         return self.wrapped_data.remove(inst.wrapped_data)
 
+    def remove_entities(self, insts):
+        """
+        Removes multiple entity instances at once, which is considerably
+        faster than calling remove() for every instance individually.
+        """
+        return self.wrapped_data.remove_entities([inst.wrapped_data for inst in insts])
+
+    def write_subset(self, insts, fn):
+        """
+        Writes the entity instances to a new file. Instances that have not
+        been modified are copied verbatim from the original file. Referenced
+        instances are not included automatically, use traverse() to obtain
+        them.
+        """
+        return self.wrapped_data.write_subset([inst.wrapped_data for inst in insts], fn)
+
     def __iter__(self):
         return iter(self[id] for id in self.wrapped_data.entity_names())
 
@@ -80,8 +80,10 @@ for ty in (ifcopenshell_wrapper.iterator_single_precision, ifcopenshell_wrapper.
 
 # Make sure people are able to use python's platform agnostic paths
 class iterator(_iterator):
-    def __init__(self, settings, file_or_filename):
+    def __init__(self, settings, file_or_filename, num_threads=None):
         self.settings = settings
+        if num_threads is not None:
+            settings.set_num_threads(num_threads)
         if isinstance(file_or_filename, file):
             file_or_filename = file_or_filename.wrapped_data
         else:
@@ -169,8 +171,8 @@ def create_shape(settings, inst, repr=None):
         ))
 
 
-def iterate(settings, filename):
-    it = iterator(settings, filename)
+def iterate(settings, filename, num_threads=None):
+    it = iterator(settings, filename, num_threads)
     if it.initialize():
         while True:
             yield it.get()
@@ -0,0 +1,259 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+#include <algorithm>
+
+#include "../ifcparse/IfcEntityBatch.h"
+#include "../ifcparse/IfcException.h"
+
+#ifdef USE_IFC4
+#include "../ifcparse/Ifc4-latebound.h"
+#else
+#include "../ifcparse/Ifc2x3-latebound.h"
+#endif
+
+using namespace IfcParse;
+
+namespace {
+	// Collects the entity instances directly referenced by the attributes of data
+	void forward_references(const IfcEntityInstanceData* data, std::vector<IfcUtil::IfcBaseClass*>& references) {
+		references.clear();
+		const std::vector<Argument*>& attributes = data->attributes();
+		for (std::vector<Argument*>::const_iterator it = attributes.begin(); it != attributes.end(); ++it) {
+			Argument* attr = *it;
+			const IfcUtil::ArgumentType attr_type = attr->type();
+			if (attr_type == IfcUtil::Argument_ENTITY_INSTANCE) {
+				IfcUtil::IfcBaseClass* inst = *attr;
+				references.push_back(inst);
+			} else if (attr_type == IfcUtil::Argument_AGGREGATE_OF_ENTITY_INSTANCE) {
+				IfcEntityList::ptr instances = *attr;
+				references.insert(references.end(), instances->begin(), instances->end());
+			} else if (attr_type == IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_ENTITY_INSTANCE) {
+				IfcEntityListList::ptr instances = *attr;
+				for (IfcEntityListList::outer_it jt = instances->begin(); jt != instances->end(); ++jt) {
+					references.insert(references.end(), jt->begin(), jt->end());
+				}
+			}
+		}
+	}
+}
+
+IfcEntityBatch::IfcEntityBatch(IfcFile& file, unsigned int block_size)
+	: file_(file)
+	, block_size_(block_size > 0 ? block_size : 1)
+	, next_id_(0)
+	, ids_left_(0)
+{}
+
+IfcEntityBatch::~IfcEntityBatch() {
+	for (std::vector<IfcUtil::IfcBaseClass*>::const_iterator it = instances_.begin(); it != instances_.end(); ++it) {
+		delete (*it)->entity;
+		delete *it;
+	}
+}
+
+unsigned int IfcEntityBatch::fresh_id() {
+	if (ids_left_ == 0) {
+		next_id_ = file_.FreshIds(block_size_);
+		ids_left_ = block_size_;
+	}
+	--ids_left_;
+	return next_id_++;
+}
+
+void IfcEntityBatch::release_ids() {
+	// Return the remainder of the last reserved block to the file, in case
+	// no other names have been handed out in the meantime.
+	if (ids_left_ && file_.MaxId == next_id_ + ids_left_ - 1) {
+		file_.MaxId -= ids_left_;
+		ids_left_ = 0;
+	}
+}
+
+IfcWrite::IfcWriteArgument* IfcEntityBatch::argument(IfcUtil::IfcBaseClass* instance, unsigned int i) {
+	if (instance->entity->file) {
+		throw IfcException("Instance is already part of a file");
+	}
+	std::vector<Argument*>& attributes = instance->entity->attributes();
+	if (i >= attributes.size()) {
+		throw IfcAttributeOutOfRangeException("Argument index out of range");
+	}
+	IfcWrite::IfcWriteArgument* arg = dynamic_cast<IfcWrite::IfcWriteArgument*>(attributes[i]);
+	if (!arg) {
+		throw IfcException("Attribute is not writable");
+	}
+	return arg;
+}
+
+IfcUtil::IfcBaseClass* IfcEntityBatch::create(IfcSchema::Type::Enum type) {
+	IfcEntityInstanceData* data = new IfcEntityInstanceData(type);
+	const int count = IfcSchema::Type::GetAttributeCount(type);
+	std::vector<Argument*>& attributes = data->attributes();
+	attributes.reserve(count);
+	for (int i = 0; i < count; ++i) {
+		IfcWrite::IfcWriteArgument* attr = new IfcWrite::IfcWriteArgument();
+		attr->set(boost::blank());
+		attributes.push_back(attr);
+	}
+	IfcUtil::IfcBaseClass* instance = IfcSchema::SchemaEntity(data);
+	instances_.push_back(instance);
+	return instance;
+}
+
+void IfcEntityBatch::add(IfcUtil::IfcBaseClass* instance) {
+	if (instance->entity->file) {
+		throw IfcException("Instance is already part of a file");
+	}
+	instances_.push_back(instance);
+}
+
+IfcEntityList::ptr IfcEntityBatch::commit() {
+	std::vector<IfcUtil::IfcBaseClass*> pending;
+	pending.swap(instances_);
+	const size_t batched = pending.size();
+
+	// The instances in the batch are pointed to the file upfront, so that
+	// references among them are not mistaken for instances to be added.
+	for (std::vector<IfcUtil::IfcBaseClass*>::const_iterator it = pending.begin(); it != pending.end(); ++it) {
+		(*it)->entity->file = &file_;
+	}
+
+	std::vector<IfcUtil::IfcBaseClass*> references;
+
+	// First pass: referenced instances that are not part of a file yet are
+	// appended to the list of instances. The file is left untouched until
+	// this pass succeeds, on failure the instances are detached again and
+	// handed back to the batch.
+	try {
+		for (size_t i = 0; i < pending.size(); ++i) {
+			forward_references(pending[i]->entity, references);
+			for (std::vector<IfcUtil::IfcBaseClass*>::const_iterator it = references.begin(); it != references.end(); ++it) {
+				IfcEntityInstanceData* ref = (*it)->entity;
+				if (ref->file == 0) {
+					ref->file = &file_;
+					pending.push_back(*it);
+				} else if (ref->file != &file_) {
+					throw IfcException("Instance from a different file referenced in batch");
+				}
+			}
+		}
+	} catch (...) {
+		for (std::vector<IfcUtil::IfcBaseClass*>::const_iterator it = pending.begin(); it != pending.end(); ++it) {
+			(*it)->entity->file = 0;
+		}
+		pending.resize(batched);
+		instances_.swap(pending);
+		throw;
+	}
+
+	// Entity instance names are only assigned once the instances are known
+	// to be valid, so that a failed commit does not consume any names.
+	for (std::vector<IfcUtil::IfcBaseClass*>::const_iterator it = pending.begin(); it != pending.end(); ++it) {
+		IfcEntityInstanceData* data = (*it)->entity;
+		if (!IfcSchema::Type::IsSimple(data->type()) && data->id() == 0) {
+			data->set_id(fresh_id());
+		}
+	}
+
+	release_ids();
+
+	// Second pass: the mappings of the file are updated. The lists by type
+	// are looked up only once for every type encountered in the batch.
+	std::vector< std::vector<IfcEntityList*> > type_lists(IfcSchema::Type::UNDEFINED);
+
+	IfcEntityList::ptr committed(new IfcEntityList);
+	committed->reserve((unsigned int) pending.size());
+	file_.byid.reserve(file_.byid.size() + pending.size());
+
+	for (std::vector<IfcUtil::IfcBaseClass*>::const_iterator it = pending.begin(); it != pending.end(); ++it) {
+		IfcUtil::IfcBaseClass* instance = *it;
+		IfcEntityInstanceData* data = instance->entity;
+		const IfcSchema::Type::Enum type = data->type();
+
+		std::vector<IfcEntityList*>& lists = type_lists[type];
+		if (lists.empty()) {
+			IfcEntityList::ptr& excl = file_.bytype_excl[type];
+			if (!excl) {
+				excl.reset(new IfcEntityList);
+			}
+			lists.push_back(excl.get());
+			IfcSchema::Type::Enum ty = type;
+			for (;;) {
+				IfcEntityList::ptr& incl = file_.bytype[ty];
+				if (!incl) {
+					incl.reset(new IfcEntityList);
+				}
+				lists.push_back(incl.get());
+				boost::optional<IfcSchema::Type::Enum> pt = IfcSchema::Type::Parent(ty);
+				if (pt) {
+					ty = *pt;
+				} else {
+					break;
+				}
+			}
+		}
+		for (std::vector<IfcEntityList*>::const_iterator jt = lists.begin(); jt != lists.end(); ++jt) {
+			(*jt)->push(instance);
+		}
+
+		if (instance->is(IfcSchema::Type::IfcRoot)) {
+			IfcSchema::IfcRoot* ifc_root = (IfcSchema::IfcRoot*) instance;
+			try {
+				const std::string guid = ifc_root->GlobalId();
+				if (file_.byguid.find(guid) != file_.byguid.end()) {
+					std::stringstream ss;
+					ss << "Overwriting entity with guid " << guid;
+					Logger::Message(Logger::LOG_WARNING, ss.str());
+				}
+				file_.byguid[guid] = ifc_root;
+			} catch (const IfcException& ex) {
+				Logger::Message(Logger::LOG_ERROR, ex.what());
+			}
+		}
+
+		committed->push(instance);
+
+		const unsigned int id = data->id();
+		if (id == 0) {
+			continue;
+		}
+
+		if (file_.byid.find(id) != file_.byid.end()) {
+			std::stringstream ss;
+			ss << "Overwriting entity with id " << id;
+			Logger::Message(Logger::LOG_WARNING, ss.str());
+		}
+		file_.byid[id] = instance;
+
+		// Inverses are registered once for every distinct instance referenced
+		forward_references(data, references);
+		std::sort(references.begin(), references.end());
+		references.erase(std::unique(references.begin(), references.end()), references.end());
+		for (std::vector<IfcUtil::IfcBaseClass*>::const_iterator jt = references.begin(); jt != references.end(); ++jt) {
+			const unsigned int ref_id = (*jt)->entity->id();
+			if (ref_id != 0) {
+				file_.byref[ref_id].push_back(id);
+			}
+		}
+	}
+
+	file_.mark_entity_as_modified(0);
+
+	return committed;
+}
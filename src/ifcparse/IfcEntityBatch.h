@@ -0,0 +1,105 @@
+/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+/********************************************************************************
+ *                                                                              *
+ * This class provides a way to create large numbers of entity instances in an  *
+ * IfcFile. Attribute values are moved into place rather than copied, entity    *
+ * instance names are reserved from the file in blocks and the mappings of the  *
+ * file (by name, type, guid and reference) are updated in a single pass.       *
+ *                                                                              *
+ ********************************************************************************/
+
+#ifndef IFCENTITYBATCH_H
+#define IFCENTITYBATCH_H
+
+#include <vector>
+
+#include "ifc_parse_api.h"
+
+#include "../ifcparse/IfcFile.h"
+#include "../ifcparse/IfcWrite.h"
+
+namespace IfcParse {
+
+/// Instances created by or added to a batch are not part of the file until
+/// commit() is called. Until then, no entity instance names are assigned and
+/// no inverse relations are registered. Instances in a batch can reference
+/// instances that are already part of the file or that are part of the same
+/// batch. Instances referenced by batch instances that are not part of any
+/// file are added as well upon commit().
+class IFC_PARSE_API IfcEntityBatch {
+private:
+	IfcEntityBatch(const IfcEntityBatch&); // N/I
+	IfcEntityBatch& operator=(const IfcEntityBatch&); // N/I
+
+	IfcFile& file_;
+	unsigned int block_size_;
+	unsigned int next_id_;
+	unsigned int ids_left_;
+	std::vector<IfcUtil::IfcBaseClass*> instances_;
+
+	unsigned int fresh_id();
+	void release_ids();
+	IfcWrite::IfcWriteArgument* argument(IfcUtil::IfcBaseClass* instance, unsigned int i);
+
+public:
+	IfcEntityBatch(IfcFile& file, unsigned int block_size = 4096);
+
+	/// Deletes the instances that have not been committed
+	~IfcEntityBatch();
+
+	/// Creates an instance of the specified type with all attributes set to null
+	IfcUtil::IfcBaseClass* create(IfcSchema::Type::Enum type);
+
+	template <class T>
+	T* create() {
+		return (T*) create(T::Class());
+	}
+
+	/// Adds an instance that is not part of a file yet, for example created
+	/// by means of the generated constructors.
+	void add(IfcUtil::IfcBaseClass* instance);
+
+	/// Sets attribute i of an instance created by this batch. NB: For
+	/// strings and aggregates prefer move() to prevent a copy.
+	template <typename T>
+	void set(IfcUtil::IfcBaseClass* instance, unsigned int i, const T& t) {
+		argument(instance, i)->set(t);
+	}
+
+	/// Moves the value into attribute i of an instance created by this
+	/// batch, t is left empty.
+	template <typename T>
+	void move(IfcUtil::IfcBaseClass* instance, unsigned int i, T& t) {
+		argument(instance, i)->move(t);
+	}
+
+	unsigned int size() const { return (unsigned int) instances_.size(); }
+
+	/// Adds the instances to the file, including any instances not part of
+	/// a file that are referenced by them. Returns the instances added. If
+	/// an exception is thrown the file is unchanged, including the names it
+	/// hands out, and the instances remain in the batch.
+	IfcEntityList::ptr commit();
+};
+
+}
+
+#endif
@@ -22,6 +22,7 @@
 
 #include "../ifcparse/ArgumentType.h"
 
+#include <boost/atomic.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <vector>
@@ -44,17 +45,21 @@ protected:
 	// To reduce memory footprint, these two could potentially be combined,
 	// e.g. initialized_ <-> offset_in_file_ == 0, but it would imply that
 	// instances cannot be located at the beginning of the file. Officially
-	// there should be a header anyways.
-	mutable bool initialized_;
+	// there should be a header anyways. Atomic, because instances are read
+	// lazily from multiple threads: the flag is checked without holding the
+	// read lock of the file and only set once the attributes are complete.
+	mutable boost::atomic<bool> initialized_;
+	// Whether attributes have been set since the instance was read from file
+	bool modified_;
 	unsigned offset_in_file_;
 
 public:
 	IfcEntityInstanceData(IfcSchema::Type::Enum type, IfcParse::IfcFile* file_, unsigned id = 0, unsigned offset_in_file = 0)
-		: file(file_), id_(id), type_(type), initialized_(false), offset_in_file_(offset_in_file)
+		: file(file_), id_(id), type_(type), initialized_(false), modified_(false), offset_in_file_(offset_in_file)
 	{}
 
 	IfcEntityInstanceData(IfcSchema::Type::Enum type)
-		: file(0), id_(0), type_(type), initialized_(true)
+		: file(0), id_(0), type_(type), initialized_(true), modified_(false), offset_in_file_(0)
 	{}
 
 	/*
@@ -83,7 +88,7 @@ public:
 	void setArgument(unsigned int i, Argument* a, IfcUtil::ArgumentType attr_type = IfcUtil::Argument_UNKNOWN);
 
 	unsigned int getArgumentCount() const {
-		if (!initialized_) {
+		if (!initialized_.load(boost::memory_order_acquire)) {
 			load();
 		}
 		return (unsigned int)attributes_.size();
@@ -97,6 +102,7 @@ public:
 
 	unsigned int id() const { return id_; }
 	unsigned int offset_in_file() const { return offset_in_file_; }
+	bool modified() const { return modified_; }
 
 	// NB: const ommitted for lazy loading
 	std::vector<Argument*>& attributes() const { return attributes_; }
@@ -23,6 +23,7 @@
 #include <map>
 #include <set>
 #include <boost/unordered_map.hpp>
+#include <boost/thread/recursive_mutex.hpp>
 
 #include "ifc_parse_api.h"
 
@@ -31,6 +32,8 @@
 
 namespace IfcParse {
 
+class IfcEntityBatch;
+
 /// This class provides several static convenience functions and variables
 /// and provide access to the entities in an IFC file
 class IFC_PARSE_API IfcFile {
@@ -70,6 +73,8 @@ public:
 	};
 
 private:
+	friend class IfcEntityBatch;
+
 	typedef std::map<IfcUtil::IfcBaseClass*, IfcUtil::IfcBaseClass*> entity_entity_map_t;
 
 	bool parsing_complete_;
@@ -88,6 +93,25 @@ private:
 
 	void setDefaultHeaderValues();
 
+	// State of the instance scanner, retained between calls to Feed(): the
+	// position in the stream, the last three tokens and the name of the
+	// instance being scanned.
+	unsigned int scan_offset_;
+	Token scan_tokens_[3];
+	unsigned int scan_id_;
+	bool scan_started_;
+	int scan_progress_;
+	bool header_read_;
+
+	// Serializes access to the lexer, whose stream cursor is shared by all
+	// instances that are lazily parsed, and to the caches populated on read.
+	mutable boost::recursive_mutex read_mutex_;
+
+	/// Reads the header and verifies the schema identifier
+	bool readHeader();
+	/// Scans entity instance records until the end of the available data
+	void scan();
+
 public:
 	IfcParse::IfcSpfLexer* tokens;
 	IfcParse::IfcSpfStream* stream;
@@ -148,6 +172,11 @@ public:
 	/// in the first function argument.
 	IfcEntityList::ptr traverse(IfcUtil::IfcBaseClass* instance, int max_level=-1);
 
+	/// Returns the mutex that is held while entity instances are read from
+	/// the file. Reading the file from multiple threads is safe, modifying
+	/// it concurrently is not.
+	boost::recursive_mutex& read_mutex() const { return read_mutex_; }
+
 	/// Marks entity as modified so that potential cache for it is invalidated.
 	/// @todo Currently the whole cache is invalidated. Implement more fine-grained invalidation.
 	void mark_entity_as_modified(int id);
@@ -161,15 +190,47 @@ public:
 	bool Init(void* data, int len);
 	bool Init(IfcParse::IfcSpfStream* f);
 
+	/// Appends data to the file contents and scans the entity instance records
+	/// completed by it, so that a file can be scanned while it is being
+	/// received. Scanning is finalized when the END-ISO-10303-21; terminator
+	/// arrives or when Finish() is called. Returns false if the file cannot
+	/// be parsed, e.g. because of a mismatching schema identifier.
+	bool Feed(const void* data, unsigned int length);
+	/// Scans the data remaining after the last complete record and finalizes
+	/// a file that is read using Feed().
+	bool Finish();
+	/// Returns whether all instances of the file have been scanned
+	bool parsing_complete() const { return parsing_complete_; }
+
 	IfcEntityList::ptr getInverse(int instance_id, IfcSchema::Type::Enum type, int attribute_index);
 
 	unsigned int FreshId() { return ++MaxId; }
 
+	/// The highest entity instance name in use
+	unsigned int getMaxId() const { return MaxId; }
+
+	/// Reserves a contiguous block of n entity instance names and
+	/// returns the first one.
+	unsigned int FreshIds(unsigned int n) { const unsigned int first = MaxId + 1; MaxId += n; return first; }
+
 	IfcUtil::IfcBaseClass* addEntity(IfcUtil::IfcBaseClass* entity);
 	void addEntities(IfcEntityList::ptr es);
 
 	void removeEntity(IfcUtil::IfcBaseClass* entity);
 
+	/// Removes the instances from the file. Unlike repeated calls to
+	/// removeEntity() every instance referencing the instances to be
+	/// removed is rewritten only once and the lists by type are compacted
+	/// in a single sweep.
+	void removeEntities(IfcEntityList::ptr entities);
+
+	/// Writes the instances, which are expected to be closed under forward
+	/// references, for example as returned by IfcParse::Traversal, along with
+	/// the header of this file to os. Instances that have been read from file
+	/// and not modified are copied verbatim from the file contents, others
+	/// are serialized.
+	void write_subset(IfcEntityList::ptr instances, std::ostream& os) const;
+
 	const IfcSpfHeader& header() const { return _header; }
 	IfcSpfHeader& header() { return _header; }
 
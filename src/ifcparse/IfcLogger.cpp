@@ -26,6 +26,8 @@
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/version.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 
 #include <iostream>
 #include <algorithm>
@@ -62,10 +64,19 @@ namespace {
 		}
 		boost::property_tree::write_json(os, pt, false);
 	}
+
+	// Messages can be logged from multiple threads, e.g. by the geometry
+	// iterator, hence the product is tracked per thread and output is
+	// serialized.
+	boost::thread_specific_ptr< boost::optional<IfcSchema::IfcProduct*> > current_product;
+	boost::mutex log_mutex;
 }
 
 void Logger::SetProduct(boost::optional<IfcSchema::IfcProduct*> product) {
-	current_product = product;
+	if (!current_product.get()) {
+		current_product.reset(new boost::optional<IfcSchema::IfcProduct*>);
+	}
+	*current_product = product;
 }
 
 void Logger::SetOutput(std::ostream* l1, std::ostream* l2) { 
@@ -78,11 +89,19 @@ void Logger::SetOutput(std::ostream* l1, std::ostream* l2) {
 
 void Logger::Message(Logger::Severity type, const std::string& message, IfcEntityInstanceData* entity) {
 	if (log2 && type >= verbosity) {
+		const boost::optional<IfcSchema::IfcProduct*> product = current_product.get()
+			? *current_product
+			: boost::optional<IfcSchema::IfcProduct*>();
+		// The message is formatted before acquiring the lock, as formatting
+		// reads entity instances from file, which takes the lock of the file.
+		std::stringstream ss;
 		if (format == FMT_PLAIN) {
-			plain_text_message(*log2, current_product, type, message, entity);
+			plain_text_message(ss, product, type, message, entity);
 		} else if (format == FMT_JSON) {
-			json_message(*log2, current_product, type, message, entity);
+			json_message(ss, product, type, message, entity);
 		}
+		boost::mutex::scoped_lock lock(log_mutex);
+		(*log2) << ss.str();
 	}
 }
 
@@ -92,6 +111,7 @@ void Logger::Message(Logger::Severity type, const std::exception& exception, Ifc
 
 void Logger::Status(const std::string& message, bool new_line) {
 	if (log1) {
+		boost::mutex::scoped_lock lock(log_mutex);
 		(*log1) << message;
 		if ( new_line ) (*log1) << std::endl;
 		else (*log1) << std::flush;
@@ -105,6 +125,7 @@ void Logger::ProgressBar(int progress) {
 }
 
 std::string Logger::GetLog() {
+	boost::mutex::scoped_lock lock(log_mutex);
 	return log_stream.str();
 }
 
@@ -118,5 +139,4 @@ std::ostream* Logger::log1 = 0;
 std::ostream* Logger::log2 = 0;
 std::stringstream Logger::log_stream;
 Logger::Severity Logger::verbosity = Logger::LOG_NOTICE;
-Logger::Format Logger::format = Logger::FMT_PLAIN;
-boost::optional<IfcSchema::IfcProduct*> Logger::current_product;
\ No newline at end of file
+Logger::Format Logger::format = Logger::FMT_PLAIN;
\ No newline at end of file
@@ -47,8 +47,9 @@ private:
 	static std::stringstream log_stream;
 	static Severity verbosity;
 	static Format format;
-	static boost::optional<IfcSchema::IfcProduct*> current_product;
 public:
+	/// Sets the product being processed by the calling thread, which is
+	/// included in subsequent messages logged from that thread
 	static void SetProduct(boost::optional<IfcSchema::IfcProduct*> product);
 	/// Determines to what stream respectively progress and errors are logged
 	static void SetOutput(std::ostream* l1, std::ostream* l2);
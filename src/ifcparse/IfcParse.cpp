@@ -22,8 +22,8 @@
 #include <string>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctime>
-#include <boost/circular_buffer.hpp>
 
 #ifdef _MSC_VER
 #include <Windows.h>
@@ -31,6 +31,7 @@
 
 #include <boost/algorithm/string.hpp>
 #include <boost/math/special_functions/fpclassify.hpp>
+#include <boost/thread/tss.hpp>
 
 #include "../ifcparse/IfcCharacterDecoder.h"
 #include "../ifcparse/IfcParse.h"
@@ -118,6 +119,12 @@ IfcSpfStream::IfcSpfStream(const std::string& fn)
 #endif
 	: stream(0)
 	, buffer(0)
+	, fed(0)
+	, capacity(0)
+	, in_string(false)
+	, in_comment(false)
+	, terminated(false)
+	, previous(0)
 	, valid(false)
 	, eof(false)
 {
@@ -185,6 +192,12 @@ IfcSpfStream::IfcSpfStream(const std::string& fn)
 IfcSpfStream::IfcSpfStream(std::istream& f, int l)
 	: stream(0)
 	, buffer(0)
+	, fed(0)
+	, capacity(0)
+	, in_string(false)
+	, in_comment(false)
+	, terminated(false)
+	, previous(0)
 {
 	eof = false;
 	size = l;
@@ -199,6 +212,12 @@ IfcSpfStream::IfcSpfStream(std::istream& f, int l)
 IfcSpfStream::IfcSpfStream(void* data, int l)
 	: stream(0)
 	, buffer(0)
+	, fed(0)
+	, capacity(0)
+	, in_string(false)
+	, in_comment(false)
+	, terminated(false)
+	, previous(0)
 {
 	eof = false;
 	size = l;
@@ -208,6 +227,85 @@ IfcSpfStream::IfcSpfStream(void* data, int l)
 	len = l;
 }
 
+IfcSpfStream::IfcSpfStream()
+	: stream(0)
+	, buffer(0)
+	, ptr(0)
+	, len(0)
+	, fed(0)
+	, capacity(0)
+	, in_string(false)
+	, in_comment(false)
+	, terminated(false)
+	, previous(0)
+	, valid(true)
+	, eof(true)
+	, size(0)
+{}
+
+//
+// Appends data and advances the readable length to the end of the last
+// complete record
+//
+void IfcSpfStream::Feed(const void* data, unsigned int length) {
+	if (fed + length > capacity) {
+		capacity = (std::max)(fed + length, capacity * 2);
+		char* buffer_rw = new char[capacity];
+		if (fed) {
+			memcpy(buffer_rw, buffer, fed);
+		}
+		delete[] buffer;
+		buffer = buffer_rw;
+	}
+	char* buffer_rw = const_cast<char*>(buffer);
+	memcpy(buffer_rw + fed, data, length);
+
+	static const char terminator[] = "END-ISO-10303-21";
+	static const unsigned int terminator_length = sizeof(terminator) - 1;
+
+	const unsigned int begin = fed;
+	fed += length;
+	size = fed;
+
+	for (unsigned int i = begin; i < fed; ++i) {
+		char c = buffer[i];
+		if (in_comment) {
+			if (previous == '*' && c == '/') {
+				in_comment = false;
+				c = 0;
+			}
+		} else if (in_string) {
+			if (c == '\'') {
+				in_string = false;
+			}
+		} else if (c == '\'') {
+			in_string = true;
+		} else if (previous == '/' && c == '*') {
+			in_comment = true;
+			c = 0;
+		} else if (c == ';') {
+			len = i + 1;
+			unsigned int j = i;
+			while (j > 0 && (buffer[j - 1] == ' ' || buffer[j - 1] == '\r' || buffer[j - 1] == '\n' || buffer[j - 1] == '\t')) --j;
+			if (j >= terminator_length && memcmp(buffer + j - terminator_length, terminator, terminator_length) == 0) {
+				terminated = true;
+			}
+		}
+		previous = c;
+	}
+
+	if (ptr < len) {
+		eof = false;
+	}
+}
+
+void IfcSpfStream::Finish() {
+	len = fed;
+	if (ptr < len) {
+		eof = false;
+	}
+}
+
 IfcSpfStream::~IfcSpfStream()
 {
 	Close();
@@ -228,8 +326,8 @@ void IfcSpfStream::Close() {
 //
 void IfcSpfStream::Seek(unsigned int o) {
 	ptr = o;
-	if (ptr >= len) throw IfcException("Reading outside of file limits");
-	eof = false;
+	if (ptr > len) throw IfcException("Reading outside of file limits");
+	eof = ptr == len;
 }
 
 //
@@ -352,7 +450,7 @@ Token IfcSpfLexer::Next() {
 // Omits whitespace and comments
 //
 void IfcSpfLexer::TokenString(unsigned int offset, std::string &buffer) {
-	const bool was_eof = stream->eof;
+	boost::recursive_mutex::scoped_lock lock(file->read_mutex());
 	unsigned int old_offset = stream->Tell();
 	stream->Seek(offset);
 	buffer.clear();
@@ -367,8 +465,9 @@ void IfcSpfLexer::TokenString(unsigned int offset, std::string &buffer) {
 		}
 		else buffer.push_back(c);
 	}
-	if ( was_eof ) stream->eof = true;
-	else stream->Seek(old_offset);
+	// Also at the end of the data, the cursor needs to be restored, as
+	// scanning continues from there when more data is fed to the stream.
+	stream->Seek(old_offset);
 }
 
 //Note: according to STEP standard, there may be newlines in tokens
@@ -537,11 +636,20 @@ double TokenFunc::asFloat(const Token& t) {
 	}
 }
 
+namespace {
+	// The string returned by reference from asStringRef() outlives the lock
+	// on the lexer, hence a buffer is allocated for every reading thread.
+	boost::thread_specific_ptr<std::string> token_string_buffer;
+}
+
 const std::string &TokenFunc::asStringRef(const Token& t) {
     if (t.type == Token_NONE) {
         throw IfcParse::IfcException("Null token encountered, premature end of file?");
     }
-	std::string &str = t.lexer->GetTempString();
+	if (!token_string_buffer.get()) {
+		token_string_buffer.reset(new std::string);
+	}
+	std::string &str = *token_string_buffer;
 	t.lexer->TokenString(t.startPos, str);
 	if ((isString(t) || isEnumeration(t) || isBinary(t)) && !str.empty()) {
 		//remove start+end characters in-place
@@ -869,6 +977,7 @@ IfcEntityInstanceData* IfcParse::read(unsigned int i, IfcFile* f, boost::optiona
 }
 
 void IfcParse::IfcFile::load(const IfcEntityInstanceData& data) {
+	boost::recursive_mutex::scoped_lock lock(read_mutex_);
 	if (tokens->stream->Tell() != data.offset_in_file()) {
 		tokens->stream->Seek(data.offset_in_file());
 		Token datatype = tokens->Next();
@@ -909,7 +1018,7 @@ void IfcParse::IfcFile::unregister_inverse(unsigned id_from, IfcUtil::IfcBaseCla
 // Note that this initializes the entity if it is not initialized
 //
 std::string IfcEntityInstanceData::toString(bool upper) const {
-	if (!initialized_) {
+	if (!initialized_.load(boost::memory_order_acquire)) {
 		load();
 	}
 
@@ -963,6 +1072,11 @@ IfcEntityList::ptr IfcEntityInstanceData::getInverse(IfcSchema::Type::Enum type,
 IfcFile::IfcFile()
 	: parsing_complete_(false)
 	, MaxId(0)
+	, scan_offset_(0)
+	, scan_id_(0)
+	, scan_started_(false)
+	, scan_progress_(0)
+	, header_read_(false)
 	, tokens(0)
 	, stream(0)
 {
@@ -970,14 +1084,21 @@ IfcFile::IfcFile()
 }
 
 void IfcEntityInstanceData::load() const {
+	boost::recursive_mutex::scoped_lock lock(file->read_mutex());
+	// Another thread might have parsed the instance while waiting for the lock
+	if (initialized_.load(boost::memory_order_relaxed)) {
+		return;
+	}
 	file->load(*this);
-	initialized_ = true;
+	initialized_.store(true, boost::memory_order_release);
 }
 
 IfcEntityInstanceData::IfcEntityInstanceData(const IfcEntityInstanceData& e) {
 	file = 0;
 	type_ = e.type_;
 	id_ = 0;
+	modified_ = false;
+	offset_in_file_ = 0;
 
 	// In order not to have the instance read from file
 	initialized_ = true;
@@ -990,7 +1111,7 @@ IfcEntityInstanceData::IfcEntityInstanceData(const IfcEntityInstanceData& e) {
 
 
 Argument* IfcEntityInstanceData::getArgument(unsigned int i) const {
-	if (!initialized_) {
+	if (!initialized_.load(boost::memory_order_acquire)) {
 		load();
 	}
 	if (i < attributes_.size()) {
@@ -1092,7 +1213,7 @@ public:
 };
 
 void IfcEntityInstanceData::setArgument(unsigned int i, Argument* a, IfcUtil::ArgumentType attr_type) {
-	if (!initialized_) {
+	if (!initialized_.load(boost::memory_order_acquire)) {
 		load();
 	}
 
@@ -1223,6 +1344,8 @@ void IfcEntityInstanceData::setArgument(unsigned int i, Argument* a, IfcUtil::Ar
 		// We have asserted above that the size is at least i
 		attributes_.push_back(copy);
 	}
+
+	modified_ = true;
 }
 
 //
@@ -1240,7 +1363,26 @@ bool IfcFile::Init(const std::string& fn) {
 #endif
 
 bool IfcFile::Init(std::istream& f, int len) {
-	return IfcFile::Init(new IfcSpfStream(f,len));
+	// The stream is read in chunks that are scanned as they arrive, so that
+	// reading from e.g. a pipe overlaps with scanning.
+	// When the contents fail to parse, the remaining len bytes are still
+	// consumed, so that the stream is positioned after the file contents.
+	// A short read means the stream ended or failed before len bytes were
+	// read, in which case there is nothing left to consume and the stream
+	// is left in a failed state for the caller to detect.
+	std::vector<char> chunk((std::min)(len, 1 << 16));
+	bool ok = true;
+	while (len > 0) {
+		const int n = (std::min)(len, (int) chunk.size());
+		f.read(&chunk[0], n);
+		if (f.gcount() != n) {
+			Logger::Message(Logger::LOG_ERROR, "Unexpected end of stream");
+			return false;
+		}
+		ok = ok && Feed(&chunk[0], n);
+		len -= n;
+	}
+	return ok && Finish();
 }
 
 bool IfcFile::Init(void* data, int len) {
@@ -1258,6 +1400,83 @@ bool IfcFile::Init(IfcParse::IfcSpfStream* s) {
 	}
 
 	tokens = new IfcSpfLexer(stream, this);
+	if (!readHeader()) {
+		return false;
+	}
+
+	scan();
+
+	Logger::Status("\rDone scanning file   ");
+
+	parsing_complete_ = true;
+
+	return true;
+}
+
+bool IfcFile::Feed(const void* data, unsigned int length) {
+	if (parsing_complete_) {
+		return true;
+	}
+
+	if (!stream) {
+		init_locale();
+		stream = new IfcSpfStream();
+		tokens = new IfcSpfLexer(stream, this);
+	} else if (!stream->valid) {
+		return false;
+	}
+
+	stream->Feed(data, length);
+
+	if (!header_read_) {
+		// The header can only be read when it has been received completely
+		static const char endsec[] = "ENDSEC";
+		const char* begin = stream->Data(0);
+		const char* end = begin + stream->Length();
+		if (std::search(begin, end, endsec, endsec + sizeof(endsec) - 1) == end) {
+			return true;
+		}
+		if (!readHeader()) {
+			stream->valid = false;
+			return false;
+		}
+	}
+
+	scan();
+
+	if (stream->Terminated()) {
+		return Finish();
+	}
+
+	return true;
+}
+
+bool IfcFile::Finish() {
+	if (parsing_complete_) {
+		return true;
+	}
+
+	if (!stream || !stream->valid) {
+		return false;
+	}
+
+	stream->Finish();
+
+	if (!header_read_ && !readHeader()) {
+		stream->valid = false;
+		return false;
+	}
+
+	scan();
+
+	Logger::Status("\rDone scanning file   ");
+
+	parsing_complete_ = true;
+
+	return true;
+}
+
+bool IfcFile::readHeader() {
 	_header.file(this);
 	_header.tryRead();
 
@@ -1275,37 +1494,59 @@ bool IfcFile::Init(IfcParse::IfcSpfStream* s) {
 		return false;
 	}
 
-	boost::circular_buffer<Token> token_stream(3, Token());
+	header_read_ = true;
+	scan_offset_ = stream->Tell();
+	Logger::Status("Scanning file...");
 
-	IfcEntityInstanceData* data;
-	IfcUtil::IfcBaseClass* instance = 0;
+	return true;
+}
+
+void IfcFile::scan() {
+	// The tokens are consumed until the end of the data that is available,
+	// a subsequent call resumes with the state stored in the scan_ members.
+	// Instances may have been read in between, which moves the cursor.
+	if (stream->Tell() != scan_offset_) {
+		stream->Seek(scan_offset_);
+	}
 
-	unsigned current_id = 0;
-	int progress = 0;
-	Logger::Status("Scanning file...");
-	
 	while (!stream->eof) {
-		if (token_stream[0].type == IfcParse::Token_IDENTIFIER &&
-			token_stream[1].type == IfcParse::Token_OPERATOR &&
-			token_stream[1].value_char == '=' &&
-			token_stream[2].type == IfcParse::Token_KEYWORD)
+		Token next_token;
+		try {
+			next_token = tokens->Next();
+		} catch (const IfcException& e) {
+			Logger::Message(Logger::LOG_ERROR, std::string(e.what()) + ". Parsing terminated");
+		} catch (...) {
+			Logger::Message(Logger::LOG_ERROR, "Parsing terminated");
+		}
+
+		if (next_token.type == Token_NONE) break;
+
+		scan_tokens_[0] = scan_tokens_[1];
+		scan_tokens_[1] = scan_tokens_[2];
+		scan_tokens_[2] = next_token;
+
+		if (scan_tokens_[0].type == IfcParse::Token_IDENTIFIER &&
+			scan_tokens_[1].type == IfcParse::Token_OPERATOR &&
+			scan_tokens_[1].value_char == '=' &&
+			scan_tokens_[2].type == IfcParse::Token_KEYWORD)
 		{
-			current_id = (unsigned) TokenFunc::asIdentifier(token_stream[0]);
+			scan_id_ = (unsigned) TokenFunc::asIdentifier(scan_tokens_[0]);
 			IfcSchema::Type::Enum entity_type;
 			try {
-				entity_type = IfcSchema::Type::FromString(TokenFunc::asStringRef(token_stream[2]));
+				entity_type = IfcSchema::Type::FromString(TokenFunc::asStringRef(scan_tokens_[2]));
 			} catch (const IfcException& ex) {
 				Logger::Message(Logger::LOG_ERROR, ex.what());
-				goto advance;
+				continue;
 			}		
 				
-			data = new IfcEntityInstanceData(entity_type, this, current_id, token_stream[2].startPos);
-			instance = IfcSchema::SchemaEntity(data);
+			IfcEntityInstanceData* data = new IfcEntityInstanceData(entity_type, this, scan_id_, scan_tokens_[2].startPos);
+			IfcUtil::IfcBaseClass* instance = IfcSchema::SchemaEntity(data);
+			scan_started_ = true;
 
             /// @todo Printing to stdout in a library class feels weird. Maybe move the progress prints to the client code?
 			// Update the status after every 1000 instances parsed
-			if (!((++progress) % 1000)) {
-				std::stringstream ss; ss << "\r#" << current_id;
+			if (!((++scan_progress_) % 1000)) {
+				std::stringstream ss; ss << "\r#" << scan_id_;
 				Logger::Status(ss.str(), false);
 			}
 
@@ -1350,80 +1591,324 @@ bool IfcFile::Init(IfcParse::IfcSpfStream* s) {
 				}
 			}
 
-			if (byid.find(current_id) != byid.end()) {
+			if (byid.find(scan_id_) != byid.end()) {
 				std::stringstream ss;
-				ss << "Overwriting instance with name #" << current_id;
+				ss << "Overwriting instance with name #" << scan_id_;
 				Logger::Message(Logger::LOG_WARNING,ss.str());
 			}
-			byid[current_id] = instance;
+			byid[scan_id_] = instance;
 			
-			MaxId = (std::max)(MaxId, current_id);
-		} else if (token_stream[0].type == IfcParse::Token_IDENTIFIER && instance) {
-			register_inverse(current_id, token_stream[0]);
+			MaxId = (std::max)(MaxId, scan_id_);
+		} else if (scan_tokens_[0].type == IfcParse::Token_IDENTIFIER && scan_started_) {
+			register_inverse(scan_id_, scan_tokens_[0]);
 		}
+	}
 
-	advance:
-		Token next_token;
-		try {
-			next_token = tokens->Next();
-		} catch (const IfcException& e) {
-			Logger::Message(Logger::LOG_ERROR, std::string(e.what()) + ". Parsing terminated");
-		} catch (...) {
-			Logger::Message(Logger::LOG_ERROR, "Parsing terminated");
+	scan_offset_ = stream->Tell();
+}
+
+class collect_visitor {
+private:
+	std::vector<IfcUtil::IfcBaseClass*>& instances_;
+
+public:
+	collect_visitor(std::vector<IfcUtil::IfcBaseClass*>& instances)
+		: instances_(instances)
+	{}
+
+	void operator()(IfcUtil::IfcBaseClass* inst) {
+		instances_.push_back(inst);
+	}
+};
+
+namespace {
+	enum traversal_behaviour { TRAVERSAL_UNKNOWN, TRAVERSAL_DESCEND, TRAVERSAL_STOP, TRAVERSAL_SKIP };
+
+	// Resets the bits set in the visited bitmap of a Traversal when it goes
+	// out of scope, also when reading an instance throws halfway. Only the
+	// bits of the instances returned are reset, so that the bitmap can be
+	// reused without clearing it entirely.
+	class reset_visited {
+	private:
+		boost::dynamic_bitset<>& visited_;
+		const IfcEntityList::ptr& instances_;
+		IfcParse::IfcFile* const& file_;
+		const bool& used_;
+	public:
+		reset_visited(boost::dynamic_bitset<>& visited, const IfcEntityList::ptr& instances, IfcParse::IfcFile* const& file, const bool& used)
+			: visited_(visited)
+			, instances_(instances)
+			, file_(file)
+			, used_(used)
+		{}
+
+		~reset_visited() {
+			if (!used_) return;
+			for (IfcEntityList::it it = instances_->begin(); it != instances_->end(); ++it) {
+				const unsigned id = (*it)->entity->id();
+				if (id != 0 && file_ && (*it)->entity->file == file_ && id < visited_.size()) {
+					visited_.reset(id);
+				}
+			}
 		}
+	};
+}
 
-		if (next_token.type == Token_NONE) break;
+IfcParse::Traversal::Traversal(int max_level)
+	: max_level_(max_level)
+	, file_(0)
+{}
 
-		token_stream.push_back(next_token);
+IfcParse::Traversal& IfcParse::Traversal::skip(IfcSchema::Type::Enum t) {
+	skip_.insert(t);
+	behaviour_.assign((size_t) IfcSchema::Type::UNDEFINED + 1, (unsigned char) TRAVERSAL_UNKNOWN);
+	return *this;
+}
+
+IfcParse::Traversal& IfcParse::Traversal::stop_at(IfcSchema::Type::Enum t) {
+	stop_.insert(t);
+	behaviour_.assign((size_t) IfcSchema::Type::UNDEFINED + 1, (unsigned char) TRAVERSAL_UNKNOWN);
+	return *this;
+}
+
+unsigned char IfcParse::Traversal::behaviour(IfcSchema::Type::Enum t) {
+	if (behaviour_.empty()) {
+		return TRAVERSAL_DESCEND;
+	}
+	unsigned char& b = behaviour_[t];
+	if (b == TRAVERSAL_UNKNOWN) {
+		b = TRAVERSAL_DESCEND;
+		boost::optional<IfcSchema::Type::Enum> ty = t;
+		while (ty) {
+			if (skip_.find(*ty) != skip_.end()) {
+				b = TRAVERSAL_SKIP;
+				break;
+			} else if (stop_.find(*ty) != stop_.end()) {
+				// Keep looking, a skipped supertype takes precedence
+				b = TRAVERSAL_STOP;
+			}
+			ty = IfcSchema::Type::Parent(*ty);
+		}
 	}
+	return b;
+}
 
-	Logger::Status("\rDone scanning file   ");
+IfcEntityList::ptr IfcParse::Traversal::operator()(IfcUtil::IfcBaseClass* instance) {
+	return traverse_(&instance, &instance + 1);
+}
 
-	parsing_complete_ = true;
+IfcEntityList::ptr IfcParse::Traversal::operator()(IfcEntityList::ptr instances) {
+	if (instances->size() == 0) {
+		return IfcEntityList::ptr(new IfcEntityList);
+	}
+	IfcUtil::IfcBaseClass* const* begin = &*instances->begin();
+	return traverse_(begin, begin + instances->size());
+}
 
-	return true;
+IfcEntityList::ptr IfcParse::Traversal::traverse_(IfcUtil::IfcBaseClass* const* begin, IfcUtil::IfcBaseClass* const* end) {
+	IfcEntityList::ptr return_value(new IfcEntityList);
+
+	// Small traversals, such as the ones used to update inverses, find
+	// visited instances among the instances returned so far. Beyond that,
+	// instances part of the file of the first root are marked as visited by
+	// name and others (simple type instances or instances not added to a
+	// file) are kept in a set.
+	static const unsigned int linear_search_threshold = 64;
+	bool use_bitmap = false;
+	std::set<IfcUtil::IfcBaseClass*> visited_other;
+
+	IfcFile* file = 0;
+	for (IfcUtil::IfcBaseClass* const* it = begin; it != end; ++it) {
+		if ((file = (*it)->entity->file) != 0) break;
+	}
+	if (file != file_) {
+		file_ = file;
+		visited_.clear();
+	}
+
+	reset_visited guard(visited_, return_value, file, use_bitmap);
+
+	std::vector< std::pair<IfcUtil::IfcBaseClass*, int> > stack;
+	std::vector<IfcUtil::IfcBaseClass*> children;
+	stack.reserve(32);
+	children.reserve(16);
+
+	for (IfcUtil::IfcBaseClass* const* it = begin; it != end; ++it) {
+		stack.push_back(std::make_pair(*it, 0));
+
+		while (!stack.empty()) {
+			IfcUtil::IfcBaseClass* instance = stack.back().first;
+			const int level = stack.back().second;
+			stack.pop_back();
+
+			const unsigned char b = level == 0 ? (unsigned char) TRAVERSAL_DESCEND : behaviour(instance->type());
+			if (b == TRAVERSAL_SKIP) continue;
+
+			if (use_bitmap) {
+				const unsigned id = instance->entity->id();
+				if (id != 0 && file && instance->entity->file == file) {
+					if (id >= visited_.size()) {
+						visited_.resize(std::max((size_t) id + 1, (size_t) file->getMaxId() + 1));
+					}
+					if (visited_.test(id)) continue;
+					visited_.set(id);
+				} else if (!visited_other.insert(instance).second) {
+					continue;
+				}
+			} else {
+				if (return_value->contains(instance)) continue;
+				if (return_value->size() == linear_search_threshold) {
+					use_bitmap = true;
+					if (file && visited_.size() < (size_t) file->getMaxId() + 1) {
+						visited_.resize((size_t) file->getMaxId() + 1);
+					}
+					stack.push_back(std::make_pair(instance, level));
+					for (IfcEntityList::it jt = return_value->begin(); jt != return_value->end(); ++jt) {
+						const unsigned id = (*jt)->entity->id();
+						if (id != 0 && file && (*jt)->entity->file == file && id < visited_.size()) {
+							visited_.set(id);
+						} else {
+							visited_other.insert(*jt);
+						}
+					}
+					continue;
+				}
+			}
+
+			return_value->push(instance);
+
+			if (b == TRAVERSAL_STOP) continue;
+			if (level >= max_level_ && max_level_ > 0) continue;
+
+			// Children are pushed in reverse so that they are visited in order
+			children.clear();
+			collect_visitor visit(children);
+			apply_individual_instance_visitor(instance->entity).apply(visit);
+			for (std::vector<IfcUtil::IfcBaseClass*>::reverse_iterator jt = children.rbegin(); jt != children.rend(); ++jt) {
+				stack.push_back(std::make_pair(*jt, level + 1));
+			}
+		}
+	}
+
+	return return_value;
 }
 
-class traversal_visitor {
-private:
-	std::set<IfcUtil::IfcBaseClass*>& visited_;
-	IfcEntityList::ptr& list_;
-	int level_;
-	int max_level_;
+IfcEntityList::ptr IfcParse::traverse(IfcUtil::IfcBaseClass* instance, int max_level) {
+	return Traversal(max_level)(instance);
+}
 
-public:
-	traversal_visitor(std::set<IfcUtil::IfcBaseClass*>& visited, IfcEntityList::ptr& list, int level, int max_level)
-		: visited_(visited)
-		, list_(list)
-		, level_(level)
-		, max_level_(max_level)
-	{}
+namespace {
+	// Values reserved in ContentHash::hashes_ for instances that are not
+	// visited yet and that are being visited respectively
+	const IfcParse::ContentHash::value_type HASH_NOT_VISITED = 0;
+	const IfcParse::ContentHash::value_type HASH_IN_PROGRESS = 1;
+}
 
-	void operator()(IfcUtil::IfcBaseClass* inst);
-};
+IfcParse::ContentHash::ContentHash()
+	: file_(0)
+{}
 
-void traverse_(IfcUtil::IfcBaseClass* instance, std::set<IfcUtil::IfcBaseClass*>& visited, IfcEntityList::ptr list, int level, int max_level) {
-	if (visited.find(instance) != visited.end()) {
-		return;
+void IfcParse::ContentHash::clear() {
+	file_ = 0;
+	hashes_.clear();
+}
+
+// 64-bit FNV-1a
+IfcParse::ContentHash::value_type IfcParse::ContentHash::hash(const std::string& s) {
+	value_type h = 14695981039346656037ULL;
+	for (std::string::const_iterator it = s.begin(); it != s.end(); ++it) {
+		h ^= (unsigned char) *it;
+		h *= 1099511628211ULL;
 	}
-	visited.insert(instance);
-	list->push(instance);
+	return h;
+}
 
-	if (level >= max_level && max_level > 0) return;
+void IfcParse::ContentHash::combine(value_type& seed, value_type v) {
+	seed ^= v + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
 
-	traversal_visitor visit(visited, list, level + 1, max_level);
-	apply_individual_instance_visitor(instance->entity).apply(visit);
+void IfcParse::ContentHash::hash_argument_(value_type& seed, Argument* argument) {
+	const IfcUtil::ArgumentType argument_type = argument->type();
+	combine(seed, (value_type) argument_type);
+	if (argument_type == IfcUtil::Argument_ENTITY_INSTANCE) {
+		IfcUtil::IfcBaseClass* instance = *argument;
+		combine(seed, hash_(instance));
+	} else if (argument_type == IfcUtil::Argument_AGGREGATE_OF_ENTITY_INSTANCE) {
+		IfcEntityList::ptr instances = *argument;
+		combine(seed, (value_type) instances->size());
+		for (IfcEntityList::it it = instances->begin(); it != instances->end(); ++it) {
+			combine(seed, hash_(*it));
+		}
+	} else if (argument_type == IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_ENTITY_INSTANCE) {
+		IfcEntityListList::ptr instances = *argument;
+		combine(seed, (value_type) instances->size());
+		for (IfcEntityListList::outer_it it = instances->begin(); it != instances->end(); ++it) {
+			combine(seed, (value_type) it->size());
+			for (IfcEntityListList::inner_it jt = it->begin(); jt != it->end(); ++jt) {
+				combine(seed, hash_(*jt));
+			}
+		}
+	} else {
+		// Values that do not contain references are hashed by their
+		// serialization. Note that this is also the case for aggregates
+		// of which the type could not be determined.
+		combine(seed, hash(argument->toString()));
+	}
 }
 
-void traversal_visitor::operator()(IfcUtil::IfcBaseClass* inst) {
-	traverse_(inst, visited_, list_, level_, max_level_);
+IfcParse::ContentHash::value_type IfcParse::ContentHash::hash_(IfcUtil::IfcBaseClass* instance, int excluded_argument) {
+	IfcEntityInstanceData* data = instance->entity;
+	const unsigned id = data->id();
+
+	// Instances of simple types and instances not added to a file have no
+	// name, their hashes are not retained. Neither are partial hashes.
+	const bool named = id != 0 && data->file != 0 && excluded_argument == -1;
+	if (named) {
+		if (data->file != file_) {
+			file_ = data->file;
+			hashes_.clear();
+		}
+		if (id >= hashes_.size()) {
+			hashes_.resize(std::max((size_t) id + 1, (size_t) file_->getMaxId() + 1), HASH_NOT_VISITED);
+		}
+		if (hashes_[id] == HASH_IN_PROGRESS) {
+			// A cyclic reference, which is not valid in IFC-SPF. The type
+			// is used to break the cycle.
+			return hash(IfcSchema::Type::ToString(data->type()));
+		} else if (hashes_[id] != HASH_NOT_VISITED) {
+			return hashes_[id];
+		}
+		hashes_[id] = HASH_IN_PROGRESS;
+	}
+
+	value_type seed = hash(IfcSchema::Type::ToString(data->type()));
+	const unsigned int count = data->getArgumentCount();
+	for (unsigned int i = 0; i < count; ++i) {
+		if ((int) i == excluded_argument) {
+			combine(seed, 0);
+		} else {
+			hash_argument_(seed, data->getArgument(i));
+		}
+	}
+
+	if (seed == HASH_NOT_VISITED || seed == HASH_IN_PROGRESS) {
+		seed += 2;
+	}
+
+	if (named) {
+		// Indexed again, as nested calls may have resized the vector
+		hashes_[id] = seed;
+	}
+
+	return seed;
 }
 
-IfcEntityList::ptr IfcParse::traverse(IfcUtil::IfcBaseClass* instance, int max_level) {
-	std::set<IfcUtil::IfcBaseClass*> visited;
-	IfcEntityList::ptr return_value(new IfcEntityList);
-	traverse_(instance, visited, return_value, 0, max_level);
-	return return_value;
+IfcParse::ContentHash::value_type IfcParse::ContentHash::operator()(IfcUtil::IfcBaseClass* instance) {
+	return hash_(instance);
+}
+
+IfcParse::ContentHash::value_type IfcParse::ContentHash::operator()(IfcUtil::IfcBaseClass* instance, unsigned int excluded_argument) {
+	return hash_(instance, (int) excluded_argument);
 }
 
 /// @note: for backwards compatibility
@@ -1784,6 +2269,181 @@ void IfcFile::removeEntity(IfcUtil::IfcBaseClass* entity) {
 	delete entity;
 }
 
+namespace {
+	class name_contained_in {
+	private:
+		const std::set<unsigned>& names_;
+	public:
+		name_contained_in(const std::set<unsigned>& names)
+			: names_(names) {}
+		bool operator()(unsigned name) const {
+			return names_.find(name) != names_.end();
+		}
+	};
+}
+
+void IfcFile::removeEntities(IfcEntityList::ptr entities) {
+	std::set<IfcUtil::IfcBaseClass*> removed;
+	std::set<unsigned> removed_ids;
+
+	for (IfcEntityList::it it = entities->begin(); it != entities->end(); ++it) {
+		IfcUtil::IfcBaseClass* entity = *it;
+		const unsigned id = entity->entity->id();
+		entity_by_id_t::const_iterator jt = byid.find(id);
+		if (jt == byid.end() || jt->second != entity) {
+			throw IfcParse::IfcException("Instance not part of this file");
+		}
+		removed.insert(entity);
+		removed_ids.insert(id);
+	}
+
+	// The instances that reference any of the instances being removed, but
+	// that are not removed themselves, are collected first, so that every
+	// one of them is rewritten only once.
+	std::set<unsigned> referrers;
+	for (std::set<unsigned>::const_iterator it = removed_ids.begin(); it != removed_ids.end(); ++it) {
+		entities_by_ref_t::const_iterator jt = byref.find(*it);
+		if (jt == byref.end()) continue;
+		for (std::vector<unsigned>::const_iterator kt = jt->second.begin(); kt != jt->second.end(); ++kt) {
+			if (removed_ids.find(*kt) == removed_ids.end()) {
+				referrers.insert(*kt);
+			}
+		}
+	}
+
+	// As with removeEntity(), dangling references are set to null or removed
+	// from the aggregates they are part of. Inversely related instances are
+	// not removed themselves.
+	for (std::set<unsigned>::const_iterator it = referrers.begin(); it != referrers.end(); ++it) {
+		IfcUtil::IfcBaseEntity* related_instance = (IfcUtil::IfcBaseEntity*) entityById(*it);
+		for (unsigned i = 0; i < related_instance->getArgumentCount(); ++i) {
+			Argument* attr = related_instance->getArgument(i);
+			if (attr->isNull()) continue;
+
+			IfcUtil::ArgumentType attr_type = related_instance->getArgumentType(i);
+			switch(attr_type) {
+			case IfcUtil::Argument_ENTITY_INSTANCE: {
+				IfcUtil::IfcBaseClass* instance_attribute = *attr;
+				if (removed.find(instance_attribute) != removed.end()) {
+					IfcWrite::IfcWriteArgument* copy = new IfcWrite::IfcWriteArgument();
+					copy->set(boost::blank());
+					related_instance->entity->setArgument(i, copy);
+				} }
+				break;
+			case IfcUtil::Argument_AGGREGATE_OF_ENTITY_INSTANCE: {
+				IfcEntityList::ptr instance_list = *attr;
+				IfcEntityList::ptr new_list(new IfcEntityList);
+				new_list->reserve(instance_list->size());
+				for (IfcEntityList::it jt = instance_list->begin(); jt != instance_list->end(); ++jt) {
+					if (removed.find(*jt) == removed.end()) {
+						new_list->push(*jt);
+					}
+				}
+				if (new_list->size() != instance_list->size()) {
+					IfcWrite::IfcWriteArgument* copy = new IfcWrite::IfcWriteArgument();
+					copy->set(new_list);
+					related_instance->entity->setArgument(i, copy);
+				} }
+				break;
+			case IfcUtil::Argument_AGGREGATE_OF_AGGREGATE_OF_ENTITY_INSTANCE: {
+				IfcEntityListList::ptr instance_list_list = *attr;
+				IfcEntityListList::ptr new_list(new IfcEntityListList);
+				bool modified = false;
+				for (IfcEntityListList::outer_it jt = instance_list_list->begin(); jt != instance_list_list->end(); ++jt) {
+					std::vector<IfcUtil::IfcBaseClass*> instances;
+					instances.reserve(jt->size());
+					for (IfcEntityListList::inner_it kt = jt->begin(); kt != jt->end(); ++kt) {
+						if (removed.find(*kt) == removed.end()) {
+							instances.push_back(*kt);
+						}
+					}
+					modified = modified || instances.size() != jt->size();
+					new_list->push(instances);
+				}
+				if (modified) {
+					IfcWrite::IfcWriteArgument* copy = new IfcWrite::IfcWriteArgument();
+					copy->set(new_list);
+					related_instance->entity->setArgument(i, copy);
+				} }
+				break;
+			default: break;
+			}
+		}
+	}
+
+	// The instances referenced by the instances being removed no longer have
+	// them as inverses. Every list of inverses is compacted only once.
+	std::set<unsigned> referenced;
+	for (std::set<IfcUtil::IfcBaseClass*>::const_iterator it = removed.begin(); it != removed.end(); ++it) {
+		IfcEntityList::ptr entity_attributes = traverse(*it, 1);
+		for (IfcEntityList::it jt = entity_attributes->begin(); jt != entity_attributes->end(); ++jt) {
+			// Do not update inverses for simple types (which have id()==0 in IfcOpenShell).
+			const unsigned int name = (*jt)->entity->id();
+			if (name != 0 && removed_ids.find(name) == removed_ids.end()) {
+				referenced.insert(name);
+			}
+		}
+	}
+	for (std::set<unsigned>::const_iterator it = referenced.begin(); it != referenced.end(); ++it) {
+		entities_by_ref_t::iterator byref_it = byref.find(*it);
+		if (byref_it != byref.end()) {
+			std::vector<unsigned>& ids = byref_it->second;
+			ids.erase(std::remove_if(ids.begin(), ids.end(), name_contained_in(removed_ids)), ids.end());
+		}
+	}
+
+	std::set<IfcSchema::Type::Enum> types;
+	for (std::set<IfcUtil::IfcBaseClass*>::const_iterator it = removed.begin(); it != removed.end(); ++it) {
+		IfcUtil::IfcBaseClass* entity = *it;
+		const unsigned id = entity->entity->id();
+
+		if (entity->is(IfcSchema::Type::IfcRoot)) {
+			const std::string global_id = ((IfcSchema::IfcRoot*) entity)->GlobalId();
+			entity_by_guid_t::iterator jt = byguid.find(global_id);
+			if (jt != byguid.end() && jt->second == entity) {
+				byguid.erase(jt);
+			}
+		}
+
+		byref.erase(id);
+		byid.erase(id);
+		types.insert(entity->type());
+	}
+
+	// The lists by type are compacted in a single sweep for every type
+	// and supertype of the instances being removed.
+	std::set<IfcSchema::Type::Enum> supertypes;
+	for (std::set<IfcSchema::Type::Enum>::const_iterator it = types.begin(); it != types.end(); ++it) {
+		entities_by_type_t::iterator jt = bytype_excl.find(*it);
+		if (jt != bytype_excl.end()) {
+			jt->second->remove(removed);
+			if (jt->second->size() == 0) {
+				bytype_excl.erase(jt);
+			}
+		}
+		boost::optional<IfcSchema::Type::Enum> ty = *it;
+		while (ty && supertypes.insert(*ty).second) {
+			ty = IfcSchema::Type::Parent(*ty);
+		}
+	}
+	for (std::set<IfcSchema::Type::Enum>::const_iterator it = supertypes.begin(); it != supertypes.end(); ++it) {
+		entities_by_type_t::iterator jt = bytype.find(*it);
+		if (jt != bytype.end()) {
+			jt->second->remove(removed);
+			if (jt->second->size() == 0) {
+				bytype.erase(jt);
+			}
+		}
+	}
+
+	mark_entity_as_modified(0);
+
+	for (std::set<IfcUtil::IfcBaseClass*>::const_iterator it = removed.begin(); it != removed.end(); ++it) {
+		delete (*it)->entity;
+		delete *it;
+	}
+}
+
 IfcEntityList::ptr IfcFile::entitiesByType(IfcSchema::Type::Enum t) {
 	entities_by_type_t::const_iterator it = bytype.find(t);
 	return (it == bytype.end()) ? IfcEntityList::ptr() : it->second;
@@ -1799,6 +2459,7 @@ IfcEntityList::ptr IfcFile::entitiesByType(const std::string& t) {
 }
 
 IfcEntityList::ptr IfcFile::entitiesByReference(int t) {
+	boost::recursive_mutex::scoped_lock lock(read_mutex_);
 	entities_by_ref_t::const_iterator it = byref.find(t);
 	IfcEntityList::ptr ret;
 	if (it != byref.end()) {
@@ -1900,6 +2561,66 @@ std::ostream& operator<< (std::ostream& os, const IfcParse::IfcFile& f) {
 	return os;
 }
 
+namespace {
+	// Returns the offset of the semicolon that terminates the entity instance
+	// record in data starting at offset. String literals and comments, which
+	// may contain semicolons, are skipped. Escaped quotes in strings ('') are
+	// handled by entering and leaving the literal twice.
+	unsigned int find_record_end(const char* data, unsigned int offset, unsigned int len) {
+		bool in_string = false;
+		for (unsigned int i = offset; i < len; ++i) {
+			const char c = data[i];
+			if (in_string) {
+				if (c == '\'') in_string = false;
+			} else if (c == '\'') {
+				in_string = true;
+			} else if (c == '/' && i + 1 < len && data[i + 1] == '*') {
+				for (i += 2; i + 1 < len && !(data[i] == '*' && data[i + 1] == '/'); ++i) {}
+				++i;
+			} else if (c == ';') {
+				return i;
+			}
+		}
+		throw IfcException("Unterminated entity instance record");
+	}
+}
+
+void IfcFile::write_subset(IfcEntityList::ptr instances, std::ostream& os) const {
+	typedef std::vector<std::pair<unsigned int, IfcUtil::IfcBaseClass*> > vector_t;
+	vector_t sorted;
+	sorted.reserve(instances->size());
+	for (IfcEntityList::it it = instances->begin(); it != instances->end(); ++it) {
+		IfcUtil::IfcBaseClass* e = *it;
+		if (IfcSchema::Type::IsSimple(e->type())) continue;
+		if (e->entity->file != this) {
+			throw IfcException("Instance not part of this file");
+		}
+		sorted.push_back(std::make_pair(e->entity->id(), e));
+	}
+	std::sort(sorted.begin(), sorted.end(), id_instance_pair_sorter());
+	sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+	header().write(os);
+
+	for (vector_t::const_iterator it = sorted.begin(); it != sorted.end(); ++it) {
+		const IfcEntityInstanceData* data = it->second->entity;
+		const unsigned int offset = data->offset_in_file();
+		// Instances that have been read from file and have not been modified
+		// are copied from the file contents, without parsing or re-encoding.
+		if (stream && offset != 0 && !data->modified()) {
+			const unsigned int end = find_record_end(stream->Data(0), offset, stream->Length());
+			os << "#" << it->first << "=";
+			os.write(stream->Data(offset), end - offset);
+			os << ";\n";
+		} else {
+			os << data->toString(true) << ";\n";
+		}
+	}
+
+	os << "ENDSEC;" << std::endl;
+	os << "END-ISO-10303-21;" << std::endl;
+}
+
 std::string IfcFile::createTimestamp() const {
 	char buf[255];
 	
@@ -36,9 +36,11 @@
 #include <fstream>
 #include <cstring>
 #include <map>
+#include <set>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/dynamic_bitset.hpp>
+#include <boost/cstdint.hpp>
 
 #include "ifc_parse_api.h"
 
@@ -258,6 +260,77 @@ namespace IfcParse {
 	
 	IFC_PARSE_API IfcEntityInstanceData* read(unsigned int i, IfcFile* t, boost::optional<unsigned> offset = boost::none);
 
+	/// Computes the closure of the instances referenced by one or more root
+	/// instances in depth-first order. Once more than a handful of instances
+	/// are visited, instances are marked as visited in a bitmap indexed by
+	/// their entity instance name, which is retained for subsequent calls.
+	/// Instances of types passed to skip() are neither returned nor descended
+	/// into, instances of types passed to stop_at() are returned, but not
+	/// descended into. Subtypes are included. Root instances are always
+	/// returned.
+	class IFC_PARSE_API Traversal {
+	private:
+		int max_level_;
+		std::set<IfcSchema::Type::Enum> skip_;
+		std::set<IfcSchema::Type::Enum> stop_;
+		// Traversal behaviour by type, evaluated lazily when types to skip or
+		// stop at are specified, see Traversal::behaviour()
+		std::vector<unsigned char> behaviour_;
+
+		IfcFile* file_;
+		boost::dynamic_bitset<> visited_;
+
+		unsigned char behaviour(IfcSchema::Type::Enum t);
+		IfcEntityList::ptr traverse_(IfcUtil::IfcBaseClass* const* begin, IfcUtil::IfcBaseClass* const* end);
+	public:
+		/// A max_level of zero or less means the traversal is unbounded
+		explicit Traversal(int max_level = -1);
+
+		Traversal& skip(IfcSchema::Type::Enum t);
+		Traversal& stop_at(IfcSchema::Type::Enum t);
+
+		IfcEntityList::ptr operator()(IfcUtil::IfcBaseClass* instance);
+
+		/// Returns the union of the closures of the instances. Instances
+		/// shared between them are visited only once.
+		IfcEntityList::ptr operator()(IfcEntityList::ptr instances);
+	};
+
+
+	/// Computes a hash over the attribute values of an instance and, in place
+	/// of the entity instance names, over the hashes of the instances it
+	/// references. Equal definitions therefore obtain equal hashes, also when
+	/// they occur in different files. A fixed hash function is used, so that
+	/// the values can be persisted. The hashes of visited instances are kept
+	/// for subsequent calls; use clear() after instances are modified.
+	class IFC_PARSE_API ContentHash {
+	public:
+		typedef boost::uint64_t value_type;
+	private:
+		IfcFile* file_;
+		// Indexed by entity instance name, zero for instances not yet visited
+		std::vector<value_type> hashes_;
+
+		value_type hash_(IfcUtil::IfcBaseClass* instance, int excluded_argument = -1);
+		void hash_argument_(value_type& seed, Argument* argument);
+	public:
+		ContentHash();
+
+		value_type operator()(IfcUtil::IfcBaseClass* instance);
+		/// Returns the hash of the instance with the attribute at the specified
+		/// index omitted, for example to compare geometry regardless of its
+		/// placement. These hashes are not retained.
+		value_type operator()(IfcUtil::IfcBaseClass* instance, unsigned int excluded_argument);
+
+		void clear();
+
+		static value_type hash(const std::string& s);
+		static void combine(value_type& seed, value_type v);
+	};
+
+	/// Equivalent to Traversal(max_level)(instance). Callers that traverse many
+	/// instances of a large file should reuse a Traversal instead, so that its
+	/// visited bitmap is not allocated for every call.
 	IFC_PARSE_API IfcEntityList::ptr traverse(IfcUtil::IfcBaseClass* instance, int max_level = -1);
 }
 
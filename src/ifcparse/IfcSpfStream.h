@@ -49,10 +49,21 @@ namespace IfcParse {
 		const char* buffer;
 		unsigned int ptr;
 		unsigned int len;
+		// State for streams that are fed incrementally: the number of bytes
+		// received and allocated, and the lexical context at the end of the
+		// received data, so that string literals and comments can span chunks.
+		unsigned int fed;
+		unsigned int capacity;
+		bool in_string;
+		bool in_comment;
+		bool terminated;
+		char previous;
 	public:
 		bool valid;
 		bool eof;
 		unsigned int size;
+		/// Creates an empty stream to which data is appended using Feed()
+		IfcSpfStream();
 #ifdef USE_MMAP
 		IfcSpfStream(const std::string& fn, bool mmap=false);
 #else
@@ -72,6 +83,18 @@ namespace IfcParse {
 		void Seek(unsigned int offset);
 		/// Returns the cursor position
 		unsigned int Tell();
+		/// Returns a pointer to the contents of the file at specified offset
+		const char* Data(unsigned int offset) const { return buffer + offset; }
+		/// Returns the number of bytes available
+		unsigned int Length() const { return len; }
+		/// Appends data to the stream. Only the data up to and including the
+		/// last semicolon outside of string literals and comments, i.e. the
+		/// last complete entity instance record, is made available for reading.
+		void Feed(const void* data, unsigned int length);
+		/// Makes all data that has been fed available for reading
+		void Finish();
+		/// Returns whether the END-ISO-10303-21; terminator has been fed
+		bool Terminated() const { return terminated; }
 	};
 }
 
@@ -64,6 +64,23 @@ void IfcEntityList::remove(IfcUtil::IfcBaseClass* instance) {
 	}
 }
 
+namespace {
+	class contained_in {
+	private:
+		const std::set<IfcUtil::IfcBaseClass*>& instances_;
+	public:
+		contained_in(const std::set<IfcUtil::IfcBaseClass*>& instances)
+			: instances_(instances) {}
+		bool operator()(IfcUtil::IfcBaseClass* instance) const {
+			return instances_.find(instance) != instances_.end();
+		}
+	};
+}
+
+void IfcEntityList::remove(const std::set<IfcUtil::IfcBaseClass*>& instances) {
+	ls.erase(std::remove_if(ls.begin(), ls.end(), contained_in(instances)), ls.end());
+}
+
 IfcEntityList::ptr IfcEntityList::filtered(const std::set<IfcSchema::Type::Enum>& entities) {
 	IfcEntityList::ptr return_value(new IfcEntityList);
 	for (it it = begin(); it != end(); ++it) {
@@ -298,4 +298,14 @@ void IfcWriteArgument::set(IfcUtil::IfcBaseClass*const& v) {
 	} else {
 		container = boost::blank();
 	}
-}
\ No newline at end of file
+}
+
+void IfcWriteArgument::move(IfcEntityList::ptr& v) {
+	set(v);
+	v.reset();
+}
+
+void IfcWriteArgument::move(IfcEntityListList::ptr& v) {
+	set(v);
+	v.reset();
+}
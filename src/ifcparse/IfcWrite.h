@@ -139,7 +139,22 @@ namespace IfcWrite {
 
 		// Overload to detect null values
 		void set(IfcUtil::IfcBaseClass*const & v);
-		
+
+		// Moves the value into the argument by swapping it with a default
+		// constructed value, t is left empty. This avoids copying large
+		// aggregates, e.g. coordinate lists, when generating models in bulk.
+		template <typename T>
+		typename boost::disable_if<boost::is_base_of<IfcUtil::IfcBaseClass, typename boost::remove_pointer<T>::type>, void>::type
+		move(T& t) {
+			container = T();
+			using std::swap;
+			swap(boost::get<T>(container), t);
+		}
+
+		// Moves the aggregate of instances into the argument, v is reset
+		void move(IfcEntityList::ptr& v);
+		void move(IfcEntityListList::ptr& v);
+
 		operator int() const;
 		operator bool() const;
 		operator double() const;
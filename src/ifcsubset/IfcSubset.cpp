@@ -0,0 +1,265 @@
+﻿/********************************************************************************
+ *                                                                              *
+ * This file is part of IfcOpenShell.                                           *
+ *                                                                              *
+ * IfcOpenShell is free software: you can redistribute it and/or modify         *
+ * it under the terms of the Lesser GNU General Public License as published by  *
+ * the Free Software Foundation, either version 3.0 of the License, or          *
+ * (at your option) any later version.                                          *
+ *                                                                              *
+ * IfcOpenShell is distributed in the hope that it will be useful,              *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+ * Lesser GNU General Public License for more details.                          *
+ *                                                                              *
+ * You should have received a copy of the Lesser GNU General Public License     *
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.         *
+ *                                                                              *
+ ********************************************************************************/
+
+/********************************************************************************
+ *                                                                              *
+ * Extracts a subset of an IFC file, for example a single building storey and  *
+ * everything it depends on, into a new IFC file. Entity instance records are   *
+ * copied verbatim from the input file, so that they do not need to be parsed   *
+ * and re-encoded.                                                              *
+ *                                                                              *
+ ********************************************************************************/
+
+#include "../ifcparse/IfcFile.h"
+
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <time.h>
+
+#if USE_VLD
+#include <vld.h>
+#endif
+
+namespace po = boost::program_options;
+
+void print_version()
+{
+	std::cout << "IfcOpenShell " << IfcSchema::Identifier << " IfcSubset " << IFCOPENSHELL_VERSION << "\n";
+}
+
+void print_usage(bool suggest_help = true)
+{
+	std::cout << "Usage: IfcSubset [options] <input.ifc> <output.ifc>\n"
+		<< "\n"
+		<< "Writes the entity instances selected by GlobalId or by type, along with all\n"
+		<< "instances they reference, to a new IFC file.\n";
+	if (suggest_help) {
+		std::cout << "\nRun 'IfcSubset --help' for more information.";
+	}
+	std::cout << std::endl;
+}
+
+/// Adds the relationships by which product is decomposed into other products
+/// (spatial containment, aggregation, openings and their fillings) and the
+/// related products to instances, recursively.
+void add_decomposition(IfcSchema::IfcObjectDefinition* product, IfcEntityList::ptr instances)
+{
+	IfcEntityList::ptr related(new IfcEntityList);
+
+#ifdef USE_IFC4
+	if (product->is(IfcSchema::Type::IfcSpatialElement)) {
+		IfcSchema::IfcRelContainedInSpatialStructure::list::ptr rels = ((IfcSchema::IfcSpatialElement*) product)->ContainsElements();
+#else
+	if (product->is(IfcSchema::Type::IfcSpatialStructureElement)) {
+		IfcSchema::IfcRelContainedInSpatialStructure::list::ptr rels = ((IfcSchema::IfcSpatialStructureElement*) product)->ContainsElements();
+#endif
+		for (IfcSchema::IfcRelContainedInSpatialStructure::list::it it = rels->begin(); it != rels->end(); ++it) {
+			instances->push(*it);
+			related->push((*it)->RelatedElements()->generalize());
+		}
+	}
+
+#ifdef USE_IFC4
+	IfcSchema::IfcRelAggregates::list::ptr decomposition = product->IsDecomposedBy();
+	for (IfcSchema::IfcRelAggregates::list::it it = decomposition->begin(); it != decomposition->end(); ++it) {
+#else
+	IfcSchema::IfcRelDecomposes::list::ptr decomposition = product->IsDecomposedBy();
+	for (IfcSchema::IfcRelDecomposes::list::it it = decomposition->begin(); it != decomposition->end(); ++it) {
+#endif
+		instances->push(*it);
+		related->push((*it)->RelatedObjects()->generalize());
+	}
+
+	if (product->is(IfcSchema::Type::IfcElement)) {
+		IfcSchema::IfcRelVoidsElement::list::ptr openings = ((IfcSchema::IfcElement*) product)->HasOpenings();
+		for (IfcSchema::IfcRelVoidsElement::list::it it = openings->begin(); it != openings->end(); ++it) {
+			instances->push(*it);
+			related->push((*it)->RelatedOpeningElement());
+		}
+	}
+
+	if (product->is(IfcSchema::Type::IfcOpeningElement)) {
+		IfcSchema::IfcRelFillsElement::list::ptr fillings = ((IfcSchema::IfcOpeningElement*) product)->HasFillings();
+		for (IfcSchema::IfcRelFillsElement::list::it it = fillings->begin(); it != fillings->end(); ++it) {
+			instances->push(*it);
+			related->push((*it)->RelatedBuildingElement());
+		}
+	}
+
+	for (IfcEntityList::it it = related->begin(); it != related->end(); ++it) {
+		instances->push(*it);
+		add_decomposition((IfcSchema::IfcObjectDefinition*) *it, instances);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> guids, entities;
+
+	po::options_description generic_options("Command line options");
+	generic_options.add_options()
+		("help,h", "display usage information")
+		("version", "display version information")
+		("quiet,q", "less status and progress output")
+		("yes,y", "answer 'yes' automatically to possible confirmation queries (e.g. overwriting an existing output file)");
+
+	po::options_description fileio_options;
+	fileio_options.add_options()
+#ifdef USE_MMAP
+		("mmap", "use memory-mapped file for input")
+#endif
+		("input-file", po::value<std::string>(), "input IFC file")
+		("output-file", po::value<std::string>(), "output IFC file");
+
+	po::options_description subset_options("Subset options");
+	subset_options.add_options()
+		("guids", po::value< std::vector<std::string> >(&guids)->multitoken(),
+			"Specifies the GlobalIds of the instances to be included.")
+		("entities", po::value< std::vector<std::string> >(&entities)->multitoken(),
+			"Specifies the types of which all instances are to be included, for example "
+			"IfcBuildingStorey. Subtypes are included as well. The entity names are handled "
+			"case-insensitively.")
+		("decomposition",
+			"Specifies whether to include the elements contained in, aggregated by, or "
+			"voiding the selected instances as well, recursively, along with the "
+			"relationships that relate them.");
+
+	po::options_description cmdline_options;
+	cmdline_options.add(generic_options).add(fileio_options).add(subset_options);
+
+	po::positional_options_description positional_options;
+	positional_options.add("input-file", 1);
+	positional_options.add("output-file", 1);
+
+	po::variables_map vmap;
+	try {
+		po::store(po::command_line_parser(argc, argv).
+			options(cmdline_options).positional(positional_options).run(), vmap);
+	} catch (const std::exception& e) {
+		std::cerr << "[Error] " << e.what() << "\n\n";
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	po::notify(vmap);
+
+	const bool quiet = vmap.count("quiet") != 0;
+	const bool decomposition = vmap.count("decomposition") != 0;
+#ifdef USE_MMAP
+	const bool mmap = vmap.count("mmap") != 0;
+#endif
+
+	if (!quiet || vmap.count("version")) {
+		print_version();
+	}
+
+	if (vmap.count("version")) {
+		return EXIT_SUCCESS;
+	} else if (vmap.count("help")) {
+		print_usage(false);
+		std::cout << "\n" << generic_options.add(subset_options) << std::endl;
+		return EXIT_SUCCESS;
+	} else if (!vmap.count("input-file") || !vmap.count("output-file")) {
+		std::cerr << "[Error] Input and output file need to be specified" << std::endl;
+		print_usage();
+		return EXIT_FAILURE;
+	} else if (guids.empty() && entities.empty()) {
+		std::cerr << "[Error] No instances selected, use --guids or --entities" << std::endl;
+		print_usage();
+		return EXIT_FAILURE;
+	}
+
+	const std::string input_filename = vmap["input-file"].as<std::string>();
+	const std::string output_filename = vmap["output-file"].as<std::string>();
+
+	if (std::ifstream(output_filename.c_str()).good() && !vmap.count("yes")) {
+		std::string answer;
+		std::cout << "A file '" << output_filename << "' already exists. Overwrite the existing file?" << std::endl;
+		std::cin >> answer;
+		if (!boost::iequals(answer, "yes") && !boost::iequals(answer, "y")) {
+			return EXIT_SUCCESS;
+		}
+	}
+
+	Logger::SetOutput(quiet ? 0 : &std::cout, &std::cerr);
+
+	time_t start, end;
+	time(&start);
+
+	IfcParse::IfcFile ifc_file;
+#ifdef USE_MMAP
+	if (!ifc_file.Init(input_filename, mmap)) {
+#else
+	if (!ifc_file.Init(input_filename)) {
+#endif
+		std::cerr << "[Error] Unable to parse input file '" << input_filename << "'" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	IfcEntityList::ptr roots(new IfcEntityList);
+	try {
+		for (std::vector<std::string>::const_iterator it = guids.begin(); it != guids.end(); ++it) {
+			roots->push(ifc_file.entityByGuid(*it));
+		}
+		for (std::vector<std::string>::const_iterator it = entities.begin(); it != entities.end(); ++it) {
+			IfcEntityList::ptr of_type = ifc_file.entitiesByType(*it);
+			if (of_type) {
+				roots->push(of_type);
+			}
+		}
+	} catch (const std::exception& e) {
+		std::cerr << "[Error] " << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (decomposition) {
+		IfcEntityList::ptr products(new IfcEntityList);
+		for (IfcEntityList::it it = roots->begin(); it != roots->end(); ++it) {
+			if ((*it)->is(IfcSchema::Type::IfcObjectDefinition)) {
+				add_decomposition((IfcSchema::IfcObjectDefinition*) *it, products);
+			}
+		}
+		roots->push(products);
+	}
+
+	IfcEntityList::ptr instances = IfcParse::Traversal()(roots);
+
+	std::ofstream output(output_filename.c_str(), std::ios_base::binary);
+	if (!output.good()) {
+		std::cerr << "[Error] Unable to open output file '" << output_filename << "'" << std::endl;
+		return EXIT_FAILURE;
+	}
+	ifc_file.write_subset(instances, output);
+	output.close();
+
+	time(&end);
+
+	if (!quiet) {
+		std::cout << "Written " << instances->size() << " instances to '" << output_filename << "' in "
+			<< (int) difftime(end, start) << " seconds" << std::endl;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -36,6 +36,7 @@ private:
 %ignore IfcParse::FileName::FileName;
 %ignore IfcParse::FileSchema::FileSchema;
 %ignore IfcParse::IfcFile::tokens;
+%ignore IfcParse::IfcFile::write_subset;
 
 %ignore IfcParse::IfcSpfHeader::IfcSpfHeader(IfcSpfLexer*);
 %ignore IfcParse::IfcSpfHeader::lexer;
@@ -59,6 +60,7 @@ private:
 %rename("file") IfcFile;
 %rename("add") addEntity;
 %rename("remove") removeEntity;
+%rename("remove_entities") removeEntities;
 
 %extend IfcParse::IfcFile {
 	IfcUtil::IfcBaseClass* by_guid(const std::string& guid) {
@@ -73,6 +75,11 @@ private:
 		f << (*$self);
 	}
 
+	void write_subset(IfcEntityList::ptr instances, const std::string& fn) {
+		std::ofstream f(fn.c_str(), std::ios_base::binary);
+		$self->write_subset(instances, f);
+	}
+
 	std::vector<unsigned> entity_names() const {
 		std::vector<unsigned> keys;
 		keys.reserve(std::distance($self->begin(), $self->end()));